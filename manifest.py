@@ -151,7 +151,7 @@ DIST_FILES = [
              includefile=['README','.*\.xpm$','.*\.png$','.*\.gif$']
              ) + \
     listTree('pyformex/lib',
-             includefile=['.*\.c$','.*\.py$','.*\.pyx$']
+             includefile=['.*\.c$','.*\.h$','.*\.py$','.*\.pyx$','.*\.json$']
              ) + \
     listTree('pyformex/bin',
              excludefile=['.*~$'],
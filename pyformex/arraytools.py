@@ -5136,13 +5136,15 @@ def nodalSum(val, elems, nnod=-1):
         As a convenience, if nval=1, the last dimension may be absent.
         Also, if the values at all the nodes of an element are
         the same, an array with shape (nelems, 1, nval) may be provided.
-    elems: int array (nelems,nplex)
-        The node indices of the elements.
+    elems: int array (nelems,nplex) | :class:`NodalIndex`
+        The node indices of the elements. If many sums have to be
+        computed on the same elems, it is faster to pass a
+        :class:`NodalIndex` created from elems.
     nnod: int, optional
         If provided, the length of the output arrays will be set to
         this value. It should be higher than the highest node number
         appering in elems. The default will set it automatically to
-        ``elems.max() + 1``.
+        ``elems.max() + 1``. Not used if elems is a :class:`NodalIndex`.
 
     Returns
     -------
@@ -5158,7 +5160,7 @@ def nodalSum(val, elems, nnod=-1):
     Examples
     --------
     >>> elems = np.array([[0,1,4], [1,2,4], [2,3,4], [3,0,4]])
-    >>> val = np. array([[1.], [2.], [3.], [4.]])
+    >>> val = np.array([[1.], [2.], [3.], [4.]])
     >>> sum, cnt = nodalSum(val, elems)
     >>> print(sum)
     [[ 5.]
@@ -5170,28 +5172,9 @@ def nodalSum(val, elems, nnod=-1):
     [2 2 2 2 4]
 
     """
-    try:
-        from pyformex.lib.misc import nodalsum
-    except ImportError:
-        # Could not import nodalsum form pyformex.lib
-        # So we define a replacement here
-        def nodalsum(val, elems, nnod):
-            """Python emulation of nodalsum from pyformex.lib.misc_c."""
-            if nnod < 0:
-                nnod = elems.max() + 1
-
-            # create return arrays
-            nval = val.shape[2]
-            sum = np.zeros((nnod, nval), dtype=np.float32)
-            cnt = np.zeros((nnod,), dtype=np.int32)
-
-            for i, elem in enumerate(elems):
-                for j, node in enumerate(elem):
-                    sum[node] += val[i, j].reshape(nval)
-                    cnt[node] += 1
-
-            return sum, cnt
-
+    if isinstance(elems, NodalIndex):
+        return elems.sum(val), elems.count()
+    from pyformex.lib import misc
     if val.ndim != 3:
         val = val.reshape(val.shape+(1,))
     if val.shape[1] == 1:
@@ -5199,9 +5182,12 @@ def nodalSum(val, elems, nnod=-1):
     if elems.shape != val.shape[:2]:
         raise RuntimeError(f"shapes of elems ({elems.shape}) and val"
                            f"({val.shape[:2]}) do not match")
-    val = val.astype(Float)
-    elems = elems.astype(Int)
-    return nodalsum(val, elems, nnod)
+    # float64 and int64 data are used as they are by the library
+    if val.dtype not in (np.float32, np.float64):
+        val = val.astype(Float)
+    if elems.dtype not in (np.int32, np.int64):
+        elems = elems.astype(Int)
+    return misc.nodalsum(val, elems, nnod)
 
 
 def nodalAvg(val, elems, nnod=-1):
@@ -5211,13 +5197,14 @@ def nodalAvg(val, elems, nnod=-1):
     ----------
     val: float array (nelems,nplex,nval)
         Array with ``nval`` values at ``nplex`` nodes of ``nelems`` elements.
-    elems: int array (nelems,nplex)
-        The node indices of the elements.
+    elems: int array (nelems,nplex) | :class:`NodalIndex`
+        The node indices of the elements, or a :class:`NodalIndex`
+        created from them.
     nnod: int, optional
         If provided, the length of the output arrays will be set to
         this value. It should be higher than the highest node number
         appering in elems. The default will set it automatically to
-        ``elems.max() + 1``.
+        ``elems.max() + 1``. Not used if elems is a :class:`NodalIndex`.
 
     Returns
     -------
@@ -5228,10 +5215,139 @@ def nodalAvg(val, elems, nnod=-1):
     --------
     nodalSum: compute the nodal sum of values defined on element nodes
     """
+    if isinstance(elems, NodalIndex):
+        return elems.avg(val)
     sum, cnt = nodalSum(val, elems, nnod)
     return sum/cnt[:, np.newaxis]
 
 
+class NodalIndex():
+    """An inverse index from nodes to element nodes.
+
+    A NodalIndex stores for each node the element nodes where it
+    appears, in a compressed (CSR) format. It is created once from
+    an elems array and can then be used to quickly compute many nodal
+    reductions (sum, average, maximum, minimum) of values defined
+    on the element nodes, like the results of a finite element analysis.
+    Because every node is reduced independently, the compiled library
+    computes large reductions in parallel.
+
+    Parameters
+    ----------
+    elems: int array (nelems,nplex)
+        The node indices of the elements. Negative values are ignored.
+    nnod: int, optional
+        The number of nodes. It should be higher than the highest node
+        number appering in elems. The default will set it automatically
+        to ``elems.max() + 1``.
+
+    Attributes
+    ----------
+    shape: tuple of ints
+        The shape (nelems,nplex) of the elems array.
+    offsets: int array (nnod+1)
+        The entries in index for node n are
+        ``index[offsets[n]:offsets[n+1]]``.
+    index: int array
+        The flat positions in elems where each node appears.
+
+    See Also
+    --------
+    nodalSum: compute the nodal sum of values defined on element nodes
+    nodalAvg: compute the nodal average of values defined on element nodes
+
+    Examples
+    --------
+    >>> elems = np.array([[0,1,4], [1,2,4], [2,3,4], [3,0,4]])
+    >>> val = np.array([[1.], [2.], [3.], [4.]])
+    >>> ind = NodalIndex(elems)
+    >>> ind.nnod
+    5
+    >>> print(ind.count())
+    [2 2 2 2 4]
+    >>> print(ind.sum(val).ravel())
+    [ 5.  3.  5.  7. 10.]
+    >>> print(ind.avg(val).ravel())
+    [2.5 1.5 2.5 3.5 2.5]
+    >>> print(ind.max(val).ravel())
+    [4. 2. 3. 4. 4.]
+    >>> print(ind.min(val).ravel())
+    [1. 1. 2. 3. 1.]
+    >>> print(nodalSum(val, ind)[0].ravel())
+    [ 5.  3.  5.  7. 10.]
+    """
+    _ops = {'sum': 0, 'avg': 1, 'max': 2, 'min': 3}
+
+    def __init__(self, elems, nnod=-1):
+        from pyformex.lib import misc
+        elems = np.asarray(elems)
+        if elems.ndim != 2:
+            raise InvalidShape("elems should be a 2-dim array")
+        self.shape = elems.shape
+        if elems.dtype not in (np.int32, np.int64):
+            elems = elems.astype(Int)
+        self.offsets, self.index = misc.nodalindex(elems, nnod)
+
+    @property
+    def nnod(self):
+        """The number of nodes in the index"""
+        return self.offsets.shape[0] - 1
+
+    def count(self):
+        """Return the number of element nodes connected to each node"""
+        return np.diff(self.offsets)
+
+    def reduce(self, val, op='sum'):
+        """Reduce values defined on element nodes to the nodes.
+
+        Parameters
+        ----------
+        val: float array (nelems,nplex,nval)
+            Array with ``nval`` values at ``nplex`` nodes of ``nelems``
+            elements. The same shape conveniences as in :func:`nodalSum`
+            apply.
+        op: 'sum' | 'avg' | 'max' | 'min'
+            The reduction operation to perform over all the values at
+            the same node.
+
+        Returns
+        -------
+        float array (nnod, nval)
+            The reduced values at the nodes. Nodes that do not appear in
+            elems get a value 0 for 'sum' and NaN for the others.
+        """
+        from pyformex.lib import misc
+        val = np.asarray(val)
+        if val.ndim != 3:
+            val = val.reshape(val.shape+(1,))
+        if val.shape[1] == 1:
+            val = multiplex(val, self.shape[1], 1)
+        if self.shape != val.shape[:2]:
+            raise RuntimeError(f"shapes of elems ({self.shape}) and val"
+                               f"({val.shape[:2]}) do not match")
+        if val.dtype not in (np.float32, np.float64):
+            val = val.astype(Float)
+        if op not in self._ops:
+            raise ValueError(f"Invalid op: {op}")
+        return misc.nodalreduce(val, self.offsets, self.index, self._ops[op])
+
+    def sum(self, val):
+        """Compute the nodal sum of values. See :meth:`reduce`."""
+        return self.reduce(val, 'sum')
+
+    def avg(self, val):
+        """Compute the nodal average of values. See :meth:`reduce`."""
+        return self.reduce(val, 'avg')
+
+    def max(self, val):
+        """Compute the nodal maximum of values. See :meth:`reduce`."""
+        return self.reduce(val, 'max')
+
+    def min(self, val):
+        """Compute the nodal minimum of values. See :meth:`reduce`."""
+        return self.reduce(val, 'min')
+
+
 def fmtData1d(data, npl=8, sep=', ', linesep='\n', fmt=str):
     """Format data in lines with maximum npl items.
 
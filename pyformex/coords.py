@@ -574,8 +574,12 @@ class Coords(np.ndarray):
          [3. 3. 0.]]
         """
         if self.size > 0:
+            from pyformex.lib import misc
             x = self.points()
-            bb = np.row_stack([x.min(axis=0), x.max(axis=0)])
+            if misc._accelerated:
+                bb = misc.bbox(x)
+            else:
+                bb = np.row_stack([x.min(axis=0), x.max(axis=0)])
         else:
             o = origin()
             bb = [o, o]
@@ -1165,8 +1169,12 @@ class Coords(np.ndarray):
         [0.   1.41 1.41 0.71]
 
         """
+        from pyformex.lib import misc
         p = at.checkArray(p, size=3, kind='f', allow='i').reshape(3)
         n = at.checkArray(n, size=3, kind='f', allow='i').reshape(3)
+        if misc._accelerated:
+            return misc.distanceFromLine(self.points(), p, n).reshape(
+                self.pshape())
         n = at.normalize(n)
         xp = self-p
         xpt = at.dotpr(xp, n)
@@ -1203,8 +1211,12 @@ class Coords(np.ndarray):
         [ 0.  2.  1. -1.]
 
         """
+        from pyformex.lib import misc
         p = at.checkArray(p, size=3, kind='f', allow='i').reshape(3)
         n = at.checkArray(n, size=3, kind='f', allow='i').reshape(3)
+        if misc._accelerated:
+            return misc.distanceFromPlane(self.points(), p, n).reshape(
+                self.pshape())
         n = at.normalize(n)
         d = np.inner(self, n) - np.inner(p, n)
         return np.asarray(d)
@@ -1567,10 +1579,21 @@ class Coords(np.ndarray):
         [4. 2. 2.]
         >>> print(X.scale(2,center=[1.,0.5,0.]))
         [1.   1.5  2. ]
+        >>> print(X.scale(2,dir=(1,2),center=[0.,0.5,0.]))
+        [1.   1.5  2. ]
 
         """
         if center is not None:
             center = np.asarray(center)
+            if np.size(scale) in (1, 3) and center.size == 3:
+                # do it in a single affine transformation
+                s = np.ones(3)
+                if dir is None:
+                    s[:] = scale
+                else:
+                    s[list(np.atleast_1d(dir))] = scale
+                return self._affine(np.diag(s), center.reshape(3)*(1.-s),
+                                    self.dtype)
             return self.trl(-center).scale(scale, dir).translate(center)
 
         if inplace:
@@ -1808,6 +1831,9 @@ class Coords(np.ndarray):
         mat = at.checkArray(mat, shape=(3, 3), kind='f')
         if around is not None:
             around = np.asarray(around)
+            if around.size == 3:
+                a = around.reshape(3)
+                return self.affine(mat, a - np.dot(a, mat))
             out = self.translate(-around)
         else:
             out = self
@@ -1940,12 +1966,33 @@ class Coords(np.ndarray):
          [17.   0.   2.]]
 
         """
+        mat = np.asarray(mat)
+        if mat.shape == (3, 3) and (vec is None or np.size(vec) == 3):
+            if vec is None:
+                vec = np.zeros(3)
+            return self._affine(mat, np.reshape(vec, 3),
+                                np.result_type(self.dtype, mat.dtype))
         out = np.dot(self, mat)
         if vec is not None:
             out += vec
         return out
 
 
+    def _affine(self, mat, vec, dtype):
+        """Perform an affine transformation mat (3,3), vec (3,).
+
+        Returns a Coords with the given float dtype, holding
+        ``self * mat + vec``. If the compiled library is available,
+        this is done in a single pass over the points.
+        """
+        from pyformex.lib import misc
+        if not misc._accelerated or dtype not in (np.float32, np.float64):
+            return (np.dot(self, mat) + vec).astype(dtype, copy=False)
+        out = np.empty(self.shape, dtype=dtype)
+        misc.transform(self.reshape(-1, 3), mat, vec, out.reshape(-1, 3))
+        return out.view(Coords)
+
+
     def toCS(self, cs):
         """Transform the coordinates to another CoordSys.
 
@@ -3229,8 +3276,13 @@ class Coords(np.ndarray):
         Coords([[-0.5, 0.5, 2. ],
                 [-0.5, 0.5, 5. ]])
         """
-        x = self.reshape(-1, 3).copy()
         P = Coords(P).reshape(-1, 3)
+        if not at.isInt(n) and np.size(n) == 3 and P.shape[0] == 1:
+            # projection on a single plane is an affine transformation
+            n = at.normalize(np.asarray(n, dtype=np.float64).reshape(3))
+            mat = np.identity(3) - np.outer(n, n)
+            return self._affine(mat, np.dot(P[0], n) * n, self.dtype)
+        x = self.reshape(-1, 3).copy()
         if at.isInt(n):
             x[:, n] = P[:, n]
         else:
@@ -3751,7 +3803,8 @@ class Coords(np.ndarray):
         return ox, dx, nx
 
 
-    def fuse(self, ppb=1, shift=0.5, rtol=1.e-5, atol=1.e-8, repeat=True):
+    def fuse(self, ppb=1, shift=0.5, rtol=1.e-5, atol=1.e-8, repeat=True,
+             method='box'):
         """Find (almost) coinciding points and return a compressed set.
 
         This method finds the points that are very close to each other
@@ -3767,16 +3820,28 @@ class Coords(np.ndarray):
         ppb: int, optional
             Average number of points per box. The box sizes and number
             of boxes will be determined to approximate this number.
+            Only used with ``method='box'``.
         shift: float (0.0 .. 1.0), optional
             Relative shift value for the box grid. Applying a shift of 0.5
             will make the lowest coordinate values fall at the center
-            of the outer boxes.
+            of the outer boxes. Only used with ``method='box'``.
         rtol: float, optional
             Relative tolerance used when considering two points for fusing.
         atol: float, optional
             Absolute tolerance used when considering two points for fusing.
         repeat: bool, optional
             If True, repeat the procedure with a second shift value.
+            Only used with ``method='box'``.
+        method: 'box' | 'hash'
+            The fuse algorithm to use. The default 'box' method sorts the
+            points into boxes. The 'hash' method does a single pass over
+            the points using a spatial hash grid, and finds all close
+            points. Both methods find the same unique points, but number
+            them in a different order. See Notes. The 'box' method remains
+            the default because existing models and results depend on its
+            numbering of the unique points. Callers that do not depend on
+            the numbering, like the rendering of Formex actors, use the
+            faster 'hash' method.
 
         Returns
         -------
@@ -3798,7 +3863,15 @@ class Coords(np.ndarray):
 
         Notes
         -----
-        The procedure works by first dividing the 3D space in a number of
+        With the 'hash' method, the points are stored in a
+        uniform grid with a cell size not smaller than the tolerance.
+        Each point is then compared only with the unique points already
+        found in its own and the 26 neighbouring cells. This finds all
+        close points in a single pass, with a computing time proportional
+        to the number of points. The unique points are numbered in the
+        order of their first occurrence.
+
+        The default 'box' method works by first dividing the 3D space in a number of
         equally sized boxes, with a average population of `ppb` points. The
         arguments `pbb` and `shift` are passed to :meth:`boxes` for this
         purpose.
@@ -3811,8 +3884,8 @@ class Coords(np.ndarray):
         Points considered very close are replaced by a single one, and an index
         is kept from the original points to the new list of points.
 
-        Running the procedure once does not guarantee finding all close nodes:
-        two close nodes might be in adjacent boxes. The performance hit for
+        With the box method, running the procedure once does not guarantee
+        finding all close nodes: two close nodes might be in adjacent boxes. The performance hit for
         testing adjacent boxes is rather high, and the probability of separating
         two close nodes with the computed box limits is very small.
         Therefore, the most sensible way is to run the procedure twice, with
@@ -3837,6 +3910,9 @@ class Coords(np.ndarray):
         [0 0 1]
         >>> np.allclose(X,x[e],atol=0.01)
         True
+        >>> x,e = X.fuse(atol=0.01, method='hash')
+        >>> print(e)
+        [0 0 1]
 
         """
         from pyformex.lib import misc
@@ -3844,11 +3920,19 @@ class Coords(np.ndarray):
             # allow empty coords sets
             return Coords(), np.array([], dtype=at.Int).reshape(self.pshape())
 
+        if method == 'hash':
+            x = self.points()
+            tol = np.float32(max(rtol*self.maxsize(), atol))
+            sel, flag, x = misc.hashfuse(x, tol, 1)
+            return Coords(x), sel.reshape(self.pshape())
+
         if repeat:
             # Apply twice with different shift value
-            coords, index = self.fuse(ppb, shift, rtol, atol, repeat=False)
+            coords, index = self.fuse(ppb, shift, rtol, atol, repeat=False,
+                                      method='box')
             newshift = shift + (0.25 if shift <= 0.5 else -0.25)
-            coords, index2 = coords.fuse(ppb, newshift, rtol, atol, repeat=False)
+            coords, index2 = coords.fuse(ppb, newshift, rtol, atol,
+                                         repeat=False, method='box')
             index = index2[index]
             return coords, index
 
@@ -3875,11 +3959,8 @@ class Coords(np.ndarray):
         # rearrange the data according to the sort order
         val = val[srt]
         x = x[srt]
-        # make sure we use np.int32 (for the fast C fuse function)
-        # Using np.int32 limits this procedure to 10**9 points, which is more
-        # than enough for all practical purposes
-        x = x.astype(np.float32)
-        val = val.astype(np.int32)
+        # The C fuse function reads float32/float64 coordinates and
+        # int32/int64 box numbers as they are
         tol = np.float32(max(rtol*self.maxsize(), atol))
         nnod = val.shape[0]
         flag = np.ones((nnod,), dtype=np.int32)   # 1 = new, 0 = existing node
@@ -54,7 +54,7 @@ def getData():
             _I('scale', [1., 1., 1.], itemptype='point'),
             _I('trl', [0., 0., 0.], itemptype='point'),
         ]),
-        _I('method', choices=['gts', 'vtk']),
+        _I('method', choices=['lib', 'gts', 'vtk']),
         _I('multi', True, text='Allow parallel processing'),
         _I('atol', 0.001),
     ], enablers = [
@@ -31,10 +31,10 @@ This example illustrates how to create isocontours through pixel data.
 
 _level = 'expert'
 _topics = ['image', 'curve']
-_techniques = ['isoline', ]
+_techniques = ['isoline', 'isolines']
 
 from pyformex.gui.draw import *
-from pyformex.plugins.isosurface import isoline
+from pyformex.plugins.isosurface import isolines
 
 def run():
     global filename  # because we set it before updating globals
@@ -90,8 +90,7 @@ def run():
     #print(levels)
     pf.canvas.settings.colormap = pf.refcfg.canvas.colormap[:npalette]
     transparent()
-    for col, level in enumerate(levels):
-        seg = isoline(data, level, nproc=-1)
+    for col, seg in enumerate(isolines(data, levels)):
         C = Formex(seg)
         draw(C, color=col, linewidth=3)
 
@@ -37,8 +37,9 @@
 #include "dxfparser.h"
 
 #include <stdio.h>
+#include <string.h>
 
-const char* _version_ = "dxfparser 0.2";
+const char* _version_ = "dxfparser 0.3";
 const char* _copyright_ = "Copyright (C) 2011 Benedict Verhegghe";
 const char* ArcFmt = "Arc(%f,%f,%f,%f,%f,%f)\n";
 const char* CircleFmt = "Circle(%f,%f,%f,%f)\n";
@@ -46,32 +47,93 @@ const char* LineFmt = "Line(%f,%f,%f,%f,%f,%f)\n";
 const char* PolylineFmt = "Polyline(%d)\n";
 const char* VertexFmt = "Vertex(%f,%f,%f)\n";
 
+// Binary output: the magic string, followed by the int64 counts
+// nlines, narcs, npolylines, nvertices and the arrays:
+//   float64 lines (nlines,2,3), int64 lineid (nlines),
+//   float64 arcs (narcs,6), int64 arcid (narcs),
+//   int64 polyofs (npolylines+1), float64 vertices (nvertices,3),
+//   int64 polyid (npolylines)
+// in native byte order. The ids are the sequence numbers of the
+// entities in the DXF file.
+const char BinaryMagic[16] = "DXFPARSER-BIN1\n";
+
 void MyDxfFilter::addArc(const DL_ArcData& d) {
-  printf(ArcFmt,d.cx,d.cy,d.cz,d.radius,d.angle1,d.angle2);
+  if (binary) {
+    double a[6] = {d.cx,d.cy,d.cz,d.radius,d.angle1,d.angle2};
+    arcs.insert(arcs.end(),a,a+6);
+    arcid.push_back(count++);
+  } else
+    printf(ArcFmt,d.cx,d.cy,d.cz,d.radius,d.angle1,d.angle2);
 }
 
 void MyDxfFilter::addCircle(const DL_CircleData& d) {
-  printf(CircleFmt,d.cx,d.cy,d.cz,d.radius);
+  if (binary) {
+    double a[6] = {d.cx,d.cy,d.cz,d.radius,0.,360.};
+    arcs.insert(arcs.end(),a,a+6);
+    arcid.push_back(count++);
+  } else
+    printf(CircleFmt,d.cx,d.cy,d.cz,d.radius);
 }
 
 void MyDxfFilter::addLine(const DL_LineData& d) {
-  printf(LineFmt,d.x1,d.y1,d.z1,d.x2,d.y2,d.z2);
+  if (binary) {
+    double a[6] = {d.x1,d.y1,d.z1,d.x2,d.y2,d.z2};
+    lines.insert(lines.end(),a,a+6);
+    lineid.push_back(count++);
+  } else
+    printf(LineFmt,d.x1,d.y1,d.z1,d.x2,d.y2,d.z2);
 }
 
 void MyDxfFilter::addPolyline(const DL_PolylineData& d){
-  printf(PolylineFmt,d.number);
+  if (binary) {
+    if (polyofs.empty()) polyofs.push_back(0);
+    polyofs.push_back(polyofs.back());
+    polyid.push_back(count++);
+  } else
+    printf(PolylineFmt,d.number);
 }
 
 void MyDxfFilter::addVertex(const DL_VertexData& d){
-  printf(VertexFmt,d.x,d.y,d.z);
+  if (binary) {
+    // Vertices belong to the last started polyline
+    if (polyofs.empty()) return;
+    double a[3] = {d.x,d.y,d.z};
+    vertices.insert(vertices.end(),a,a+3);
+    polyofs.back()++;
+  } else
+    printf(VertexFmt,d.x,d.y,d.z);
+}
+
+template <class T>
+static void writeArray(FILE* fil, const std::vector<T>& a) {
+  if (!a.empty()) fwrite(a.data(),sizeof(T),a.size(),fil);
+}
+
+void MyDxfFilter::writeBinary(FILE* fil) const {
+  long long npoly = polyid.size();
+  long long counts[4] = {(long long)lineid.size(), (long long)arcid.size(),
+			 npoly, (long long)vertices.size()/3};
+  long long zero = 0;
+  fwrite(BinaryMagic,1,16,fil);
+  fwrite(counts,sizeof(long long),4,fil);
+  writeArray(fil,lines);
+  writeArray(fil,lineid);
+  writeArray(fil,arcs);
+  writeArray(fil,arcid);
+  if (npoly > 0)
+    writeArray(fil,polyofs);
+  else
+    fwrite(&zero,sizeof(long long),1,fil);
+  writeArray(fil,vertices);
+  writeArray(fil,polyid);
 }
 
 
 
 int main(int argc, char* argv[])
 {
-  MyDxfFilter f;
-  DL_Dxf dxf;
+  bool binary = false;
+  int nfiles = 0;
   for(int i = 1; i < argc; i++) {
     if (argv[i][0] == '-') {
       // Process switch
@@ -83,15 +145,28 @@ int main(int argc, char* argv[])
 	printf("%s\n",_copyright_);
 	return 0;
       }
+      if (!strcmp(argv[i],"-b") || !strcmp(argv[i],"--binary")) {
+	binary = true;
+	continue;
+      }
       printf("Unknown switch '%s'\n",argv[i]);
       return 1;
     }
-    printf("# Converted from %s by %s\n",argv[i],_version_);
+  }
+  MyDxfFilter f(binary);
+  DL_Dxf dxf;
+  for(int i = 1; i < argc; i++) {
+    if (argv[i][0] == '-') continue;
+    if (!binary)
+      printf("# Converted from %s by %s\n",argv[i],_version_);
     if (!dxf.in(argv[i], &f)) {
-      printf(" !! file could not be opened.\n");
+      fprintf(binary ? stderr : stdout," !! file could not be opened.\n");
       return 1;
     }
+    nfiles++;
   }
+  if (binary && nfiles > 0)
+    f.writeBinary(stdout);
   return 0;
 }
 
@@ -39,16 +39,33 @@
 
 #include <dl_creationadapter.h>
 #include <dl_dxf.h>
+#include <stdio.h>
+#include <vector>
 
 
 class MyDxfFilter : public DL_CreationAdapter {
 
+public:
+  MyDxfFilter(bool binary=false) : binary(binary), count(0) {}
+  void writeBinary(FILE* fil) const;
+
   virtual void addArc(const DL_ArcData& d);
   virtual void addCircle(const DL_CircleData& d);
   virtual void addLine(const DL_LineData& d);
   virtual void addPolyline(const DL_PolylineData& d);
   virtual void addVertex(const DL_VertexData& d);
 
+private:
+  // In binary mode, the entities are collected in per-type arrays,
+  // together with their sequence number in the DXF file.
+  bool binary;
+  long long count;
+  std::vector<double> lines;         // (nlines,2,3) end points
+  std::vector<double> arcs;          // (narcs,6) cx,cy,cz,radius,angle1,angle2
+  std::vector<double> vertices;      // (nvertices,3) polyline vertices
+  std::vector<long long> polyofs;    // (npolylines+1) offsets into vertices
+  std::vector<long long> lineid, arcid, polyid;
+
 };
 
 #endif // DXFPARSER_H
@@ -132,6 +132,231 @@ gboolean gts_point_is_inside_surface (GtsPoint * p,
   return is_open ? (nc % 2 == 0) : (nc % 2 != 0);
 }
 
+/*
+ * Batched inside test.
+ *
+ * The test above builds a GtsPoint, a list of the stabbed bounding
+ * boxes and uses exact orientation predicates for every point. With
+ * large numbers of points it is much faster to store the triangles in
+ * a flat bounding volume hierarchy (BVH) and test all points against
+ * it in parallel. The nodes are in depth first order, the left child
+ * directly following its parent. As all rays are shot in the positive
+ * x-direction, a node only needs its bounds in y and z and its maximal
+ * x. The triangle coordinates are stored per component in the order
+ * of the leaves, so that the triangles of a leaf are tested in a
+ * single vectorized loop.
+ *
+ * The ray hits a triangle if the point is inside the projection of the
+ * triangle on the yz plane, as decided by the signs of the three edge
+ * functions. Exactly the same expression is used for an edge in both
+ * triangles, so the values are exactly opposite. Zero values get the
+ * sign they would have after moving the point over (eps,eps^2) in the
+ * yz plane, so that a ray through an edge or vertex hits exactly one
+ * of the triangles sharing it.
+ */
+
+/* Floating point contraction (FMA) would break the exact opposite
+ * values of the edge functions */
+#if defined(__GNUC__) && !defined(__clang__)
+#  define NO_FP_CONTRACT __attribute__((optimize("fp-contract=off")))
+#else
+#  define NO_FP_CONTRACT
+#endif
+
+#define BVH_LEAFSIZE 8    /* maximal number of triangles in a leaf */
+#define BVH_MAXSPLIT 48   /* depth after which nodes are halved */
+#define BVH_STACKSIZE 128 /* traversal stack: BVH_MAXSPLIT + 64 */
+
+typedef struct {
+  gdouble lo[2], hi[2];   /* bounds in y and z */
+  gdouble xmax;           /* maximal x */
+  glong first;            /* leaf: first triangle; inner: right child */
+  glong count;            /* leaf: number of triangles; inner: 0 */
+} BvhNode;
+
+typedef struct {
+  BvhNode * nodes;
+  glong nnodes;
+  gdouble * t;            /* 9 arrays of ntri coordinates */
+  glong ntri, ntri_alloc;
+  gdouble * tb;           /* build only: lo[2], hi[2], xmax, center[2] */
+  glong * ind;            /* build only: triangle numbers in leaf order */
+} Bvh;
+
+/* component c of vertex v of the triangles */
+#define TRI(b,v,c) ((b)->t + (3*(v)+(c))*(b)->ntri_alloc)
+
+static void add_triangle (GtsTriangle * t, Bvh * b)
+{
+  GtsVertex * v[3];
+  gint i;
+
+  gts_triangle_vertices (t, &v[0], &v[1], &v[2]);
+  for (i = 0; i < 3; i++) {
+    TRI (b, i, 0)[b->ntri] = GTS_POINT (v[i])->x;
+    TRI (b, i, 1)[b->ntri] = GTS_POINT (v[i])->y;
+    TRI (b, i, 2)[b->ntri] = GTS_POINT (v[i])->z;
+  }
+  b->ntri++;
+}
+
+static glong bvh_build (Bvh * b, glong i0, glong i1, gint depth)
+{
+  glong i, m, node = b->nnodes++;
+  BvhNode * nd = b->nodes + node;
+  gdouble cmin[2] = {G_MAXDOUBLE, G_MAXDOUBLE};
+  gdouble cmax[2] = {-G_MAXDOUBLE, -G_MAXDOUBLE};
+  gdouble mid;
+  gint k;
+
+  for (k = 0; k < 2; k++) {
+    nd->lo[k] = G_MAXDOUBLE;
+    nd->hi[k] = -G_MAXDOUBLE;
+  }
+  nd->xmax = -G_MAXDOUBLE;
+  for (i = i0; i < i1; i++) {
+    gdouble * tb = b->tb + 7*b->ind[i];
+    for (k = 0; k < 2; k++) {
+      nd->lo[k] = MIN (nd->lo[k], tb[k]);
+      nd->hi[k] = MAX (nd->hi[k], tb[2+k]);
+      cmin[k] = MIN (cmin[k], tb[5+k]);
+      cmax[k] = MAX (cmax[k], tb[5+k]);
+    }
+    nd->xmax = MAX (nd->xmax, tb[4]);
+  }
+  if (i1 - i0 <= BVH_LEAFSIZE) {
+    nd->first = i0;
+    nd->count = i1 - i0;
+    return node;
+  }
+  /* split at the middle of the centers in the largest direction */
+  k = cmax[1] - cmin[1] > cmax[0] - cmin[0];
+  mid = (cmin[k] + cmax[k])/2.;
+  m = i0;
+  for (i = i0; i < i1; i++)
+    if (b->tb[7*b->ind[i]+5+k] < mid) {
+      glong tmp = b->ind[i];
+      b->ind[i] = b->ind[m];
+      b->ind[m++] = tmp;
+    }
+  if (m == i0 || m == i1 || depth >= BVH_MAXSPLIT)
+    m = (i0 + i1)/2;
+  bvh_build (b, i0, m, depth + 1);
+  i = bvh_build (b, m, i1, depth + 1);
+  b->nodes[node].first = i;
+  b->nodes[node].count = 0;
+  return node;
+}
+
+/* Build the BVH of the faces of surface s */
+static void bvh_new (Bvh * b, GtsSurface * s)
+{
+  glong i, n = gts_surface_face_number (s);
+  gint c, v;
+
+  b->ntri = 0;
+  b->ntri_alloc = n;
+  b->nnodes = 0;
+  b->nodes = g_new (BvhNode, 2*n + 1);
+  b->t = g_new (gdouble, 9*n);
+  b->tb = g_new (gdouble, 7*n);
+  b->ind = g_new (glong, n);
+  gts_surface_foreach_face (s, (GtsFunc) add_triangle, b);
+
+  for (i = 0; i < n; i++) {
+    gdouble * tb = b->tb + 7*i;
+    for (c = 0; c < 2; c++) {
+      gdouble p = TRI (b, 0, c+1)[i], q = TRI (b, 1, c+1)[i], r = TRI (b, 2, c+1)[i];
+      tb[c] = MIN (p, MIN (q, r));
+      tb[2+c] = MAX (p, MAX (q, r));
+      tb[5+c] = (p + q + r)/3.;
+    }
+    tb[4] = MAX (TRI (b, 0, 0)[i], MAX (TRI (b, 1, 0)[i], TRI (b, 2, 0)[i]));
+    b->ind[i] = i;
+  }
+  if (n > 0)
+    bvh_build (b, 0, n, 0);
+
+  /* reorder the triangle coordinates to the leaf order */
+  for (v = 0; v < 9; v++) {
+    gdouble * t = b->t + v*n;
+    for (i = 0; i < n; i++)
+      b->tb[i] = t[b->ind[i]];
+    memcpy (t, b->tb, n*sizeof (gdouble));
+  }
+  g_free (b->tb);
+  g_free (b->ind);
+}
+
+static void bvh_destroy (Bvh * b)
+{
+  g_free (b->nodes);
+  g_free (b->t);
+}
+
+/* the sign of an edge function e of an edge with direction (dy,dz),
+ * with zero values replaced by their perturbed sign */
+#define EDGE_SIGN(e,dy,dz) ((e) != 0. ? (e) : (dz) != 0. ? -(dz) : (dy))
+
+/* count the hits of the ray from p with the n triangles from k0 */
+static NO_FP_CONTRACT gint leaf_hits (const Bvh * b, glong k0, glong n,
+				      const gdouble * p)
+{
+  const gdouble * ax = TRI (b,0,0) + k0, * ay = TRI (b,0,1) + k0, * az = TRI (b,0,2) + k0;
+  const gdouble * bx = TRI (b,1,0) + k0, * by = TRI (b,1,1) + k0, * bz = TRI (b,1,2) + k0;
+  const gdouble * cx = TRI (b,2,0) + k0, * cy = TRI (b,2,1) + k0, * cz = TRI (b,2,2) + k0;
+  glong k;
+  gint hits = 0;
+
+#pragma omp simd reduction(+:hits)
+  for (k = 0; k < n; k++) {
+    gdouble ay1 = ay[k] - p[1], az1 = az[k] - p[2];
+    gdouble by1 = by[k] - p[1], bz1 = bz[k] - p[2];
+    gdouble cy1 = cy[k] - p[1], cz1 = cz[k] - p[2];
+    /* edge functions of the edges opposite to a, b, c */
+    gdouble ea = by1*cz1 - bz1*cy1;
+    gdouble eb = cy1*az1 - cz1*ay1;
+    gdouble ec = ay1*bz1 - az1*by1;
+    gdouble sa = EDGE_SIGN (ea, cy[k] - by[k], cz[k] - bz[k]);
+    gdouble sb = EDGE_SIGN (eb, ay[k] - cy[k], az[k] - cz[k]);
+    gdouble sc = EDGE_SIGN (ec, by[k] - ay[k], bz[k] - az[k]);
+    /* the intersection is beyond p if num has the sign of the area */
+    gdouble num = ea*(ax[k] - p[0]) + eb*(bx[k] - p[0]) + ec*(cx[k] - p[0]);
+    gint pos = sa > 0. && sb > 0. && sc > 0. && num > 0.;
+    gint neg = sa < 0. && sb < 0. && sc < 0. && num < 0.;
+    hits += pos | neg;
+  }
+  return hits;
+}
+
+/* count the hits of the ray from p in the positive x-direction */
+static gint bvh_hits (const Bvh * b, const gdouble * p)
+{
+  glong stack[BVH_STACKSIZE];
+  glong node = 0;
+  gint sp = 0, hits = 0;
+
+  if (b->nnodes == 0)
+    return 0;
+  for (;;) {
+    const BvhNode * nd = b->nodes + node;
+    if (p[1] >= nd->lo[0] && p[1] <= nd->hi[0] &&
+	p[2] >= nd->lo[1] && p[2] <= nd->hi[1] && p[0] < nd->xmax) {
+      if (nd->count)
+	hits += leaf_hits (b, nd->first, nd->count, p);
+      else {
+	stack[sp++] = nd->first;
+	node++;
+	continue;
+      }
+    }
+    if (sp == 0)
+      break;
+    node = stack[--sp];
+  }
+  return hits;
+}
+
 /* inside - check if points are inside a surface */
 int main (int argc, char * argv[])
 {
@@ -140,11 +365,14 @@ int main (int argc, char * argv[])
   GtsPoint P;
   FILE * fptr, * bbptr;
   GtsFile * fp;
-  int c = 0, cnt = 0;
+  GArray * points;
+  gchar * inside;
+  int c = 0;
+  glong cnt, npts;
   double x,y,z;
-  gboolean verbose = FALSE;
+  gboolean verbose = FALSE, use_gts = FALSE;
   gchar * file1, * file2;
-  gboolean is_open1, is_inside;
+  gboolean is_open1;
 
   if (!setlocale (LC_ALL, "POSIX"))
     g_warning ("cannot set locale to POSIX");
@@ -154,17 +382,22 @@ int main (int argc, char * argv[])
 #ifdef HAVE_GETOPT_LONG
     static struct option long_options[] = {
       {"help", no_argument, NULL, 'h'},
-      {"verbose", no_argument, NULL, 'v'}
+      {"verbose", no_argument, NULL, 'v'},
+      {"gts", no_argument, NULL, 'g'},
+      {NULL, 0, NULL, 0}
     };
     int option_index = 0;
-    switch ((c = getopt_long (argc, argv, "shv",
+    switch ((c = getopt_long (argc, argv, "shvg",
 			      long_options, &option_index))) {
 #else /* not HAVE_GETOPT_LONG */
-    switch ((c = getopt (argc, argv, "shv"))) {
+    switch ((c = getopt (argc, argv, "shvg"))) {
 #endif /* not HAVE_GETOPT_LONG */
     case 'v': /* verbose */
       verbose = TRUE;
       break;
+    case 'g': /* gts */
+      use_gts = TRUE;
+      break;
     case 'h': /* help */
       fprintf (stderr,
 	"Usage: gtsinside [OPTION] FILE1 FILE2\n"
@@ -173,6 +406,8 @@ int main (int argc, char * argv[])
 	"contains the three coordinates of a point, separated with blanks.\n"
 	"\n"
 	"  -v      --verbose  print statistics about the surface\n"
+	"  -g      --gts      use the (slower) GTS bounding box tree and\n"
+	"                     predicates, and write the tree to bbtree.oogl\n"
 	"  -h      --help     display this help and exit\n"
 	"\n"
 	"Reports bugs to %s\n",
@@ -236,38 +471,17 @@ int main (int argc, char * argv[])
     return 1;
   }
 
-  /* build bounding box tree for the surface */
-  tree1 = gts_bb_tree_surface (s1);
   is_open1 = gts_surface_volume (s1) < 0. ? TRUE : FALSE;
 #ifdef DEBUG
   fprintf(stderr,"is_open1: %d\n",is_open1);
 #endif
 
-  /* write the bboxtree */
-  if ((bbptr = fopen ("bbtree.oogl", "w")) == NULL) {
-    fprintf (stderr, "gtsinside: can not open bbtree file \n");
-    return 1;
-  }
-  gts_bb_tree_draw(tree1, 3, bbptr);
-  fclose(bbptr);
-
-  /* scan file 2 for points and determine if they are inside surface */
+  /* read the points from file 2 */
+  points = g_array_new (FALSE, FALSE, sizeof (gdouble));
   while ( fscanf(fptr, "%lg %lg %lg", &x, &y, &z) == 3 ) {
-    P.x = x; P.y = y; P.z = z;
-    is_inside = gts_point_is_inside_surface(&P,tree1,is_open1);
-#ifdef DEBUG
-    fprintf(stderr,"Point %d is_inside: %d\n",cnt, is_inside);
-#endif
-    if (is_inside) {
-	printf("%d\n",cnt);
-#ifdef DEBUG
-	fprintf(stderr,"YES inside!\n");
-#endif
-    }
-#ifdef DEBUG
-    fprintf(stderr,"Point %d: %lf, %lf, %lf: %d\n",cnt,P.x,P.y,P.z,is_inside);
-#endif
-    cnt++;
+    g_array_append_val (points, x);
+    g_array_append_val (points, y);
+    g_array_append_val (points, z);
   }
   if ( !feof(fptr) ) {
     fprintf (stderr, "gtsinside: error while reading points from file `%s'\n",
@@ -275,12 +489,58 @@ int main (int argc, char * argv[])
     return 1;
   }
   fclose (fptr);
+  npts = points->len / 3;
+  inside = g_new (gchar, npts);
+
+  if (use_gts) {
+    /* build bounding box tree for the surface */
+    tree1 = gts_bb_tree_surface (s1);
+
+    /* write the bboxtree */
+    if ((bbptr = fopen ("bbtree.oogl", "w")) == NULL) {
+      fprintf (stderr, "gtsinside: can not open bbtree file \n");
+      return 1;
+    }
+    gts_bb_tree_draw(tree1, 3, bbptr);
+    fclose(bbptr);
+
+    /* determine if the points are inside surface */
+    for (cnt = 0; cnt < npts; cnt++) {
+      gdouble * p = &g_array_index (points, gdouble, 3*cnt);
+      P.x = p[0]; P.y = p[1]; P.z = p[2];
+      inside[cnt] = gts_point_is_inside_surface(&P,tree1,is_open1);
+#ifdef DEBUG
+      fprintf(stderr,"Point %ld: %lf, %lf, %lf: %d\n",cnt,P.x,P.y,P.z,inside[cnt]);
+#endif
+    }
+
+    /* destroy bounding box tree (including bounding boxes) */
+    gts_bb_tree_destroy (tree1, TRUE);
+  }
+  else {
+    Bvh b;
+
+    bvh_new (&b, s1);
+    if (verbose)
+      fprintf (stderr, "BVH with %ld nodes for %ld triangles\n",
+	       b.nnodes, b.ntri);
+#pragma omp parallel for schedule(dynamic,256)
+    for (cnt = 0; cnt < npts; cnt++) {
+      gint nc = bvh_hits (&b, &g_array_index (points, gdouble, 3*cnt));
+      inside[cnt] = is_open1 ? (nc % 2 == 0) : (nc % 2 != 0);
+    }
+    bvh_destroy (&b);
+  }
+
+  for (cnt = 0; cnt < npts; cnt++)
+    if (inside[cnt])
+      printf("%ld\n",cnt);
+
+  g_free (inside);
+  g_array_free (points, TRUE);
 
   /* destroy surface */
   gts_object_destroy (GTS_OBJECT (s1));
 
-  /* destroy bounding box tree (including bounding boxes) */
-  gts_bb_tree_destroy (tree1, TRUE);
-
   return 0;
 }
@@ -35,13 +35,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <errno.h>
 #include <assert.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 
 char* copyright = "postabq 0.2 (C) 2008,2014 Benedict Verhegghe";
 
-FILE * fil;
-
 /* Blocks and records
   A block consists of :
   - lead : 4 byte word with value 4096  (RECSIZE in bytes)
@@ -54,18 +60,33 @@ FILE * fil;
   - DATA (NW-2) : the data
 
   !!! Records may span the block boundary !!!
-  Reading from file is done block by block. If we want to process records as
-  a whole, we need to buffer at least 2 blocks.
+  The file is memory mapped and processed in two passes. The first pass
+  scans the file and builds an index of the records. The second pass
+  copies each record in turn to the data buffer and processes it.
+  In the text output mode, the second pass processes groups of records
+  in parallel, each thread collecting its output in a buffer. The buffers
+  are written out in the order of the records.
 */
 
 #define RECSIZE 512
 #define BUFSIZE 2*RECSIZE
+#define BLKSIZE (8*RECSIZE+2*sizeof(int32_t))
+#define CHUNKSIZE 4096  /* Number of records processed by a thread at once */
 
 int64_t recnr = 0;
-int64_t blknr = 0;
 int64_t err = 0;
 
-int32_t lead,tail;
+const char *map;  /* The memory mapped file */
+int64_t nwords;   /* Number of data words in the file */
+
+/* An entry in the record index */
+typedef struct {
+  int64_t w;      /* Position of the record in the data (in words) */
+  int64_t nw;     /* Length of the record (in words) */
+  int64_t key;    /* Type of the record */
+  int explicit;   /* Value of explicit at the start of the record */
+} Record;
+
 union {
   double d[BUFSIZE];
   int64_t i[BUFSIZE];
@@ -73,6 +94,7 @@ union {
 } data;
 
 int64_t nw,key;
+int64_t filpos; /* Position of the current record in the file */
 
 int64_t
   j,    /* Pointer to current data */
@@ -86,6 +108,51 @@ int explicit = 0;  /* assume standard unless specified/detected */
 int verbose = 0;
 int fake = 0;
 
+/* A growing string buffer */
+typedef struct {
+  char *s;
+  size_t n, cap;
+} StrBuf;
+
+void sb_printf(StrBuf *b, const char *fmt, ...) {
+  va_list ap;
+  if (b->s == NULL) {
+    b->cap = 1024;
+    b->s = malloc(b->cap);
+  }
+  for (;;) {
+    size_t room = b->cap - b->n;
+    va_start(ap, fmt);
+    int m = vsnprintf(b->s + b->n, room, fmt, ap);
+    va_end(ap);
+    if (m >= 0 && (size_t)m < room) {
+      b->n += m;
+      return;
+    }
+    b->cap = 2*b->cap + (m > 0 ? m : 0) + 256;
+    b->s = realloc(b->s, b->cap);
+  }
+}
+
+/* Append a string as a JSON string */
+void sb_json(StrBuf *b, const char *s) {
+  sb_printf(b, "\"");
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') sb_printf(b, "\\%c", *s);
+    else if ((unsigned char)*s < 32) sb_printf(b, "\\u%04x", *s);
+    else sb_printf(b, "%c", *s);
+  }
+  sb_printf(b, "\"");
+}
+
+/* The output buffer of the text mode */
+StrBuf obuf;
+
+#define out(...) sb_printf(&obuf, __VA_ARGS__)
+
+/* Each thread processes its records in its own copy of these */
+#pragma omp threadprivate(data, nw, key, filpos, j, jend, jmax, s, explicit, recnr, obuf)
+
 /* Copy character data into the string buffer */
 /*
   Copies character data from the current data buffer to the string buffer s.
@@ -98,10 +165,10 @@ int fake = 0;
 char* stripn(int64_t k,int64_t n,int strip) {
   s[0] = '\0';
   int64_t m = 8*n;
-  if (m > STRINGBUFSIZE) m = STRINGBUFSIZE;
+  if (m > STRINGBUFSIZE-1) m = STRINGBUFSIZE-1;
   memmove(s,data.c + (8*k),m);
-  while (s[--m] == ' ') {}
-  s[++m] = '\0';
+  while (m > 0 && s[m-1] == ' ') m--;
+  s[m] = '\0';
   char* p = s;
   if (strip) {
     while (*p==' ') p++;
@@ -122,78 +189,78 @@ char* str(int64_t k) {
 }
 
 void do_element() {
-  printf("D.Element(%d,",(int)data.i[j++]);
-  printf("'%s',[",str(j++));
-  while (j < jend) printf("%d,",(int)data.i[j++]);
-  printf("])\n");
+  out("D.Element(%d,",(int)data.i[j++]);
+  out("'%s',[",str(j++));
+  while (j < jend) out("%d,",(int)data.i[j++]);
+  out("])\n");
 }
 
 void do_node() {
-  printf("D.Node(%d,[",(int)data.i[j++]);
+  out("D.Node(%d,[",(int)data.i[j++]);
   int64_t j3 = j+3;
   if (j3 > jend) j3 = jend;
-  while (j < j3) printf("%e,",data.d[j++]);
+  while (j < j3) out("%e,",data.d[j++]);
   if (j < jend) {
-    printf("],normal=[");
-    while (j < jend) printf("%e,",data.d[j++]);
+    out("],normal=[");
+    while (j < jend) out("%e,",data.d[j++]);
   }
-  printf("])\n");
+  out("])\n");
 }
 
 void do_dofs() {
-  printf("D.Dofs([");
-  while (j < jend) printf("%d,",(int)data.i[j++]);
-  printf("])\n");
+  out("D.Dofs([");
+  while (j < jend) out("%d,",(int)data.i[j++]);
+  out("])\n");
 }
 
 void do_outreq() {
   int64_t * ip = data.i + j++;
   int flag = ip[0];
-  printf("D.OutputRequest(flag=%d,set='%s'",flag,str(j++));
-  if (flag==0) printf(",eltyp='%s',",str(j++));
-  printf(")\n");
+  out("D.OutputRequest(flag=%d,set='%s'",flag,str(j++));
+  if (flag==0) out(",eltyp='%s',",str(j++));
+  out(")\n");
 }
 
 void do_abqver() {
-  printf("D.Abqver('%s')\n",str(j++));
+  out("D.Abqver('%s')\n",str(j++));
   /* BEWARE ! Do not call str() multiple times in the same printf instruction */
-  printf("D.Date('%s',",strn(j,2)); j += 2;
-  printf("'%s')\n",str(j++));
-  printf("D.Size(nelems=%d,nnodes=%d,length=%f)\n",(int)data.i[j],(int)data.i[j+1],data.d[j+2]);
+  out("D.Date('%s',",strn(j,2)); j += 2;
+  out("'%s')\n",str(j++));
+  out("D.Size(nelems=%d,nnodes=%d,length=%f)\n",(int)data.i[j],(int)data.i[j+1],data.d[j+2]);
 }
 
 void do_heading() {
-  printf("D.Heading('%s')\n",strn(j,jend-j));
+  out("D.Heading('%s')\n",strn(j,jend-j));
 }
 
 void do_nodeset() {
-  printf("D.Nodeset('%s',[",stripn(j++,1,1));
-  while (j<jend) printf("%d,",(int)data.i[j++]);
-  printf("])\n");
+  out("D.Nodeset('%s',[",stripn(j++,1,1));
+  while (j<jend) out("%d,",(int)data.i[j++]);
+  out("])\n");
 }
 
 void add_nodeset() {
-  printf("D.NodesetAdd([");
-  while (j<jend) printf("%d,",(int)data.i[j++]);
-  printf("])\n");
+  out("D.NodesetAdd([");
+  while (j<jend) out("%d,",(int)data.i[j++]);
+  out("])\n");
 }
 
 void do_elemset() {
-  printf("D.Elemset('%s',[",stripn(j++,1,1));
-  while (j<jend) printf("%d,",(int)data.i[j++]);
-  printf("])\n");
+  out("D.Elemset('%s',[",stripn(j++,1,1));
+  while (j<jend) out("%d,",(int)data.i[j++]);
+  out("])\n");
 }
 
 void add_elemset() {
-  printf("D.ElemsetAdd([");
-  while (j<jend) printf("%d,",(int)data.i[j++]);
-  printf("])\n");
+  out("D.ElemsetAdd([");
+  while (j<jend) out("%d,",(int)data.i[j++]);
+  out("])\n");
 }
 
 void do_label() {
-  printf("D.Label(tag='%d',value='",(int)data.i[j++]);
-  printf("%s",strn(j,jend-j));
-  printf("')\n");
+  out("D.Label(tag='%d',value='",(int)data.i[j++]);
+  out("%s",strn(j,jend-j));
+  out("')\n");
 }
 
 void do_increment() {
@@ -201,26 +268,26 @@ void do_increment() {
   double * dp = data.d + j;
   int64_t type = ip[4];
   explicit = (type==17 || type == 74);
-  printf("D.Increment(");
-  printf("step=%ld,",ip[5]);
-  printf("inc=%ld,",ip[6]);
-  printf("tottime=%e,",dp[0]);
-  printf("steptime=%e,",dp[1]);
-  printf("timeinc=%e,",dp[10]);
-  printf("type=%ld,",type);
-  printf("heading='%s',",stripn(j+11,10,1));
+  out("D.Increment(");
+  out("step=%ld,",ip[5]);
+  out("inc=%ld,",ip[6]);
+  out("tottime=%e,",dp[0]);
+  out("steptime=%e,",dp[1]);
+  out("timeinc=%e,",dp[10]);
+  out("type=%ld,",type);
+  out("heading='%s',",stripn(j+11,10,1));
   if (!explicit) {
-    printf("maxcreep=%e,",dp[2]);
-    printf("solamp=%e,",dp[3]);
-    printf("linpert=%ld,",ip[7]);
-    printf("loadfactor=%e,",dp[8]);
-    printf("frequency=%e,",dp[9]);
+    out("maxcreep=%e,",dp[2]);
+    out("solamp=%e,",dp[3]);
+    out("linpert=%ld,",ip[7]);
+    out("loadfactor=%e,",dp[8]);
+    out("frequency=%e,",dp[9]);
   }
-  printf(")\n");
+  out(")\n");
 }
 
 void end_increment() {
-  printf("D.EndIncrement()\n");
+  out("D.EndIncrement()\n");
 }
 
 char* output_location[] = { "gp", "ec", "en", "rb", "na", "el" };
@@ -228,71 +295,481 @@ char* output_location[] = { "gp", "ec", "en", "rb", "na", "el" };
 void do_elemheader() {
   int64_t * ip = data.i + j;
   int loc = ip[3];
-  printf("D.ElemHeader(loc='%s',",output_location[loc]);
-  printf("i=%d,",(int)ip[0]);
+  out("D.ElemHeader(loc='%s',",output_location[loc]);
+  out("i=%d,",(int)ip[0]);
   if (loc==0)
-    printf("gp=%d,",(int)ip[1]);
+    out("gp=%d,",(int)ip[1]);
   else if (loc==2)
-    printf("np=%d,",(int)ip[1]);
+    out("np=%d,",(int)ip[1]);
   else if (ip[1]!=0)
-    printf("ip=%d,",(int)ip[1]);
+    out("ip=%d,",(int)ip[1]);
   if (ip[2]!=0)
-    printf("sp=%d,",(int)ip[2]);
+    out("sp=%d,",(int)ip[2]);
   if (loc==3)
-    printf("rb='%s',",stripn(j+4,1,1));
-  printf("ndi=%d,",(int)ip[5]);
-  printf("nshr=%d,",(int)ip[6]);
-  printf("nsfc=%d,",(int)ip[8]);
+    out("rb='%s',",stripn(j+4,1,1));
+  out("ndi=%d,",(int)ip[5]);
+  out("nshr=%d,",(int)ip[6]);
+  out("nsfc=%d,",(int)ip[8]);
   if (explicit)
-      printf("ndir=%d,",(int)ip[7]);
-  printf(")\n");
+      out("ndir=%d,",(int)ip[7]);
+  out(")\n");
 }
 
 void do_elemout(char* text) {
-  printf("D.ElemOutput('%s',[",text);
-  while (j < jend) printf("%e,",data.d[j++]);
-  printf("])\n");
+  out("D.ElemOutput('%s',[",text);
+  while (j < jend) out("%e,",data.d[j++]);
+  out("])\n");
 }
 
 void do_nodeout(char* text) {
-  printf("D.NodeOutput('%s',%d,[",text,(int)data.i[j++]);
-  while (j < jend) printf("%e,",data.d[j++]);
-  printf("])\n");
+  out("D.NodeOutput('%s',%d,[",text,(int)data.i[j++]);
+  while (j < jend) out("%e,",data.d[j++]);
+  out("])\n");
 }
 
 void do_total_energies() {
   double * dp = data.d + j;
-  printf("D.TotalEnergies(");
-  printf("ALLKE=%f,",dp[0]);
-  printf("ALLSE=%f,",dp[1]);
-  printf("ALLWK=%f,",dp[2]);
-  printf("ALLPD=%f,",dp[3]);
-  printf("ALLCD=%f,",dp[4]);
-  printf("ALLVD=%f,",dp[5]);
-  printf("ALLAE=%f,",dp[7]);
-  printf("ALLIE=%f,",dp[10]);
-  printf("ETOTAL=%f,",dp[11]);
-  printf("ALLFD=%f,",dp[12]);
-  printf("ALLDMD=%f,",dp[16]);
+  out("D.TotalEnergies(");
+  out("ALLKE=%f,",dp[0]);
+  out("ALLSE=%f,",dp[1]);
+  out("ALLWK=%f,",dp[2]);
+  out("ALLPD=%f,",dp[3]);
+  out("ALLCD=%f,",dp[4]);
+  out("ALLVD=%f,",dp[5]);
+  out("ALLAE=%f,",dp[7]);
+  out("ALLIE=%f,",dp[10]);
+  out("ETOTAL=%f,",dp[11]);
+  out("ALLFD=%f,",dp[12]);
+  out("ALLDMD=%f,",dp[16]);
   if (explicit) {
-    printf("ALLDC=%f,",dp[8]);
-    printf("ALLIHE=%f,",dp[16]);
-    printf("ALLHF=%f,",dp[17]);
+    out("ALLDC=%f,",dp[8]);
+    out("ALLIHE=%f,",dp[16]);
+    out("ALLHF=%f,",dp[17]);
   } else {
-    printf("ALLKL=%f,",dp[6]);
-    printf("ALLQB=%f,",dp[8]);
-    printf("ALLEE=%f,",dp[9]);
-    printf("ALLJD=%f,",dp[13]);
-    printf("ALLSD=%f,",dp[14]);
+    out("ALLKL=%f,",dp[6]);
+    out("ALLQB=%f,",dp[8]);
+    out("ALLEE=%f,",dp[9]);
+    out("ALLJD=%f,",dp[13]);
+    out("ALLSD=%f,",dp[14]);
+  }
+  out(")\n");
+}
+
+/********************** Binary output ***********************************/
+/*
+  With the -b option, the results are written in binary form into a
+  directory BASE.fepost, where BASE is the input file name without the
+  .fil suffix. The directory contains:
+
+  - info.json: the model info and an index of the increments,
+  - nodes.npy: float32 (nnodes,3) nodal coordinates,
+  - nodid.npy: int32 (nnodes,) node numbers,
+  - elems_TYPE.npy: int32 (nelems,nplex) connectivity of the elements
+    of type TYPE, as indices in the nodes array,
+  - nset_NAME.npy, eset_NAME.npy: int32 node and element numbers
+    of the node and element sets,
+  - results.bin: float32 nodal results. Each result of an increment
+    is a contiguous (nnodes,ncols) block. The byte offset and ncols of
+    each block are stored in the increment index in info.json.
+
+  The .npy files can be loaded (or memory mapped) by numpy. The
+  results are collected in memory for one increment at a time.
+*/
+
+int binary = 0;
+char outdir[FILENAME_MAX-2*STRINGBUFSIZE];
+
+/* A growing array of int32 values */
+typedef struct {
+  char name[STRINGBUFSIZE];
+  int64_t nplex;
+  int32_t *v;
+  int64_t n, cap;
+} IntArray;
+
+void ia_append(IntArray *a, int32_t v) {
+  if (a->n == a->cap) {
+    a->cap = 2*a->cap + 1024;
+    a->v = realloc(a->v, a->cap*sizeof(int32_t));
+  }
+  a->v[a->n++] = v;
+}
+
+/* Find (or create) the array with given name in a list of arrays */
+IntArray *ia_find(IntArray **list, int *n, const char *name) {
+  for (int i=0; i<*n; i++)
+    if (strcmp((*list)[i].name, name) == 0) return *list+i;
+  *list = realloc(*list, (*n+1)*sizeof(IntArray));
+  IntArray *a = *list + (*n)++;
+  memset(a, 0, sizeof(IntArray));
+  strncpy(a->name, name, STRINGBUFSIZE-1);
+  return a;
+}
+
+/* A nodal result of the current increment */
+typedef struct {
+  char key[8];
+  int64_t ncols;
+  float *v;
+} Field;
+
+#define MAXFIELDS 32
+#define MAXDOFS 30
+
+struct {
+  StrBuf info, labels, incs;
+  IntArray nodid;            /* node numbers */
+  float *nodes;              /* node coordinates */
+  int64_t nnodes, nodcap;
+  int64_t *row;              /* row in nodes for each node number */
+  int64_t maxid;
+  IntArray *elems, *nsets, *esets, *curset;
+  int nelems, nnsets, nesets;
+  int64_t dofs[MAXDOFS], ndofs, displ[6], ndispl, udim;
+  int modeldone, incopen, nwarn;
+  int64_t hdrloc, hdri, hdrndi;
+  Field fields[MAXFIELDS];
+  int nfields;
+  FILE *res;
+  int64_t resoffset;
+} B;
+
+/* Print a word of character data as a stripped JSON string */
+void sb_jstr(StrBuf *b, int64_t k, int64_t n) {
+  sb_json(b, stripn(k,n,1));
+}
+
+/* Replace characters that are unsafe in file names */
+char *safe_name(const char *name) {
+  static char buf[STRINGBUFSIZE];
+  int i;
+  for (i=0; name[i] && i<STRINGBUFSIZE-1; i++)
+    buf[i] = (isalnum((unsigned char)name[i]) || name[i]=='-') ? name[i] : '_';
+  buf[i] = '\0';
+  return buf;
+}
+
+/* Write an array as a .npy file in the output directory */
+int write_npy(const char *name, const char *type, int64_t n0, int64_t n1,
+	      const void *data, size_t itemsize) {
+  char path[FILENAME_MAX], hdr[256];
+  int one = 1;
+  char endian = *(char *)&one ? '<' : '>';
+  snprintf(path, FILENAME_MAX, "%s/%s.npy", outdir, name);
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) {
+    fprintf(stderr,"ERROR: can not write '%s'\n",path);
+    return 1;
   }
-  printf(")\n");
+  int h;
+  if (n1 > 0)
+    h = snprintf(hdr, sizeof(hdr), "{'descr': '%c%s', 'fortran_order': False, 'shape': (%ld, %ld), }", endian, type, n0, n1);
+  else
+    h = snprintf(hdr, sizeof(hdr), "{'descr': '%c%s', 'fortran_order': False, 'shape': (%ld,), }", endian, type, n0);
+  /* pad the header with blanks and a newline to a multiple of 64 bytes */
+  while ((10+h+1) % 64) hdr[h++] = ' ';
+  hdr[h++] = '\n';
+  unsigned char pre[10] = { 0x93, 'N','U','M','P','Y', 1, 0, h & 0xff, h >> 8 };
+  size_t count = n0 * (n1 > 0 ? n1 : 1);
+  int res = fwrite(pre, 10, 1, f) != 1 || fwrite(hdr, h, 1, f) != 1 ||
+    (count > 0 && fwrite(data, itemsize, count, f) != count);
+  fclose(f);
+  if (res) fprintf(stderr,"ERROR while writing '%s'\n",path);
+  return res;
+}
+
+/* Write the model data, once all of them have been read */
+void bin_model() {
+  int i;
+  int64_t k;
+  if (B.modeldone) return;
+  B.modeldone = 1;
+  /* node number to row */
+  B.maxid = 0;
+  for (k=0; k<B.nnodes; k++)
+    if (B.nodid.v[k] > B.maxid) B.maxid = B.nodid.v[k];
+  B.row = malloc((B.maxid+1)*sizeof(int64_t));
+  for (k=0; k<=B.maxid; k++) B.row[k] = -1;
+  for (k=0; k<B.nnodes; k++) B.row[B.nodid.v[k]] = k;
+  err |= write_npy("nodes", "f4", B.nnodes, 3, B.nodes, sizeof(float));
+  err |= write_npy("nodid", "i4", B.nnodes, 0, B.nodid.v, sizeof(int32_t));
+  sb_printf(&B.info, ",\n\"nnodes\": %ld", B.nnodes);
+  sb_printf(&B.info, ",\n\"elems\": {");
+  for (i=0; i<B.nelems; i++) {
+    IntArray *a = B.elems+i;
+    char name[STRINGBUFSIZE+8];
+    /* node numbers to indices */
+    for (k=0; k<a->n; k++) {
+      int32_t id = a->v[k];
+      a->v[k] = (id >= 0 && id <= B.maxid) ? B.row[id] : -1;
+    }
+    snprintf(name, sizeof(name), "elems_%s", safe_name(a->name));
+    err |= write_npy(name, "i4", a->n/a->nplex, a->nplex, a->v, sizeof(int32_t));
+    sb_printf(&B.info, "%s", i ? ", " : "");
+    sb_json(&B.info, a->name);
+    sb_printf(&B.info, ": \"%s.npy\"", name);
+  }
+  sb_printf(&B.info, "}");
+  for (int s=0; s<2; s++) {
+    IntArray *sets = s ? B.esets : B.nsets;
+    int nsets = s ? B.nesets : B.nnsets;
+    sb_printf(&B.info, ",\n\"%s\": {", s ? "esets" : "nsets");
+    for (i=0; i<nsets; i++) {
+      IntArray *a = sets+i;
+      char name[STRINGBUFSIZE+8];
+      snprintf(name, sizeof(name), "%s_%s", s ? "eset" : "nset", safe_name(a->name));
+      err |= write_npy(name, "i4", a->n, 0, a->v, sizeof(int32_t));
+      sb_printf(&B.info, "%s", i ? ", " : "");
+      sb_json(&B.info, a->name);
+      sb_printf(&B.info, ": \"%s.npy\"", name);
+    }
+    sb_printf(&B.info, "}");
+  }
+}
+
+/* Write the results of the current increment */
+void bin_flush() {
+  if (!B.incopen) return;
+  B.incopen = 0;
+  sb_printf(&B.incs, ", \"fields\": {");
+  for (int i=0; i<B.nfields; i++) {
+    Field *f = B.fields+i;
+    size_t count = B.nnodes * f->ncols;
+    if (count > 0 && fwrite(f->v, sizeof(float), count, B.res) != count) {
+      fprintf(stderr,"ERROR while writing the results\n");
+      err = 1;
+    }
+    sb_printf(&B.incs, "%s\"%s\": [%ld, %ld]", i ? ", " : "", f->key, B.resoffset, f->ncols);
+    B.resoffset += count * sizeof(float);
+    free(f->v);
+  }
+  B.nfields = 0;
+  sb_printf(&B.incs, "}}");
+}
+
+/* Get the result array for key, creating it if needed */
+Field *bin_field(const char *key, int64_t ncols) {
+  for (int i=0; i<B.nfields; i++)
+    if (strcmp(B.fields[i].key, key) == 0) return B.fields+i;
+  if (B.nfields == MAXFIELDS) return NULL;
+  Field *f = B.fields + B.nfields++;
+  strncpy(f->key, key, 7);
+  f->key[7] = '\0';
+  f->ncols = ncols;
+  f->v = calloc(B.nnodes*ncols, sizeof(float));
+  return f;
+}
+
+/* Store the nodal values from data.d[j:jend] for node id */
+void bin_store(const char *key, int64_t id) {
+  int64_t n = jend - j, k, col;
+  int64_t ncols = strcmp(key,"U") == 0 ? B.udim :
+    strcmp(key,"S") == 0 ? 6 : strcmp(key,"COORD") == 0 ? 3 : n;
+  if (!B.incopen) return;
+  if (id < 0 || id > B.maxid || B.row[id] < 0) {
+    if (B.nwarn++ < 10) fprintf(stderr,"WARNING: results for unknown node %ld\n",id);
+    return;
+  }
+  Field *f = bin_field(key, ncols);
+  if (f == NULL) return;
+  float *v = f->v + B.row[id]*f->ncols;
+  for (k=0; k<n; k++) {
+    if (strcmp(key,"U") == 0)
+      col = k < B.ndispl ? B.displ[k]-1 : k;
+    else if (strcmp(key,"S") == 0)
+      col = k < B.hdrndi ? k : k+3-B.hdrndi;
+    else
+      col = k;
+    if (col >= 0 && col < f->ncols) v[col] = data.d[j+k];
+  }
+}
+
+void bin_element() {
+  int64_t n = jend-j-2;
+  IntArray *a = ia_find(&B.elems, &B.nelems, stripn(j+1,1,1));
+  if (a->nplex == 0) a->nplex = n;
+  if (a->nplex != n) {
+    fprintf(stderr,"ERROR: elements of type %s with different plexitude\n",a->name);
+    err = 1;
+    return;
+  }
+  for (int64_t k=j+2; k<jend; k++) ia_append(a, data.i[k]);
+}
+
+void bin_node() {
+  if (B.nnodes == B.nodcap) {
+    B.nodcap = 2*B.nodcap + 1024;
+    B.nodes = realloc(B.nodes, 3*B.nodcap*sizeof(float));
+  }
+  ia_append(&B.nodid, data.i[j]);
+  float *x = B.nodes + 3*B.nnodes++;
+  for (int k=0; k<3; k++)
+    x[k] = j+1+k < jend ? data.d[j+1+k] : 0.;
+}
+
+void bin_dofs() {
+  B.ndofs = B.ndispl = 0;
+  sb_printf(&B.info, ",\n\"dofs\": [");
+  for (int64_t k=j; k<jend && B.ndofs<MAXDOFS; k++) {
+    B.dofs[B.ndofs] = (int)data.i[k];
+    sb_printf(&B.info, "%s%ld", B.ndofs ? ", " : "", B.dofs[B.ndofs]);
+    if (B.ndofs < 6 && B.dofs[B.ndofs] > 0) B.displ[B.ndispl++] = B.dofs[B.ndofs];
+    B.ndofs++;
+  }
+  sb_printf(&B.info, "]");
+  B.udim = 3;
+  for (int k=0; k<B.ndispl; k++)
+    if (B.displ[k] > 3) B.udim = 6;
+}
+
+void bin_abqver() {
+  sb_printf(&B.info, ",\n\"abqver\": ");
+  sb_jstr(&B.info, j, 1);
+  sb_printf(&B.info, ",\n\"abqdate\": ");
+  sb_jstr(&B.info, j+1, 2);
+  sb_printf(&B.info, ",\n\"abqtime\": ");
+  sb_jstr(&B.info, j+3, 1);
+  sb_printf(&B.info, ",\n\"nelems\": %d,\n\"length\": %.17g", (int)data.i[j+4], data.d[j+6]);
+}
+
+void bin_heading() {
+  sb_printf(&B.info, ",\n\"heading\": ");
+  sb_jstr(&B.info, j, jend-j);
+}
+
+void bin_set(IntArray **list, int *n, int add) {
+  if (!add)
+    B.curset = ia_find(list, n, stripn(j++,1,1));
+  if (B.curset == NULL) return;
+  while (j<jend) ia_append(B.curset, data.i[j++]);
+}
+
+void bin_label() {
+  sb_printf(&B.labels, "%s\"%d\": ", B.labels.n ? ", " : "", (int)data.i[j]);
+  sb_jstr(&B.labels, j+1, jend-j-1);
 }
 
+void bin_increment() {
+  int64_t * ip = data.i + j;
+  double * dp = data.d + j;
+  bin_model();
+  bin_flush();
+  explicit = (ip[4]==17 || ip[4] == 74);
+  sb_printf(&B.incs, "%s\n{\"step\": %ld, \"inc\": %ld, \"type\": %ld, ", B.incs.n ? "," : "", ip[5], ip[6], ip[4]);
+  sb_printf(&B.incs, "\"tottime\": %.17g, \"steptime\": %.17g, \"timeinc\": %.17g, ", dp[0], dp[1], dp[10]);
+  sb_printf(&B.incs, "\"heading\": ");
+  sb_jstr(&B.incs, j+11, 10);
+  sb_printf(&B.incs, ", \"filpos\": %ld", filpos);
+  B.incopen = 1;
+}
+
+void bin_elemheader() {
+  int64_t * ip = data.i + j;
+  B.hdri = (int)ip[0];
+  B.hdrloc = (int)ip[3];
+  B.hdrndi = (int)ip[5];
+}
+
+void bin_elemout(char *text) {
+  /* only nodal averaged element results are stored */
+  if (B.hdrloc == 4) bin_store(text, B.hdri);
+}
+
+void bin_nodeout(char *text) {
+  int64_t id = (int)data.i[j++];
+  bin_store(text, id);
+}
+
+/* Process the data of a record in binary mode */
+int process_binary() {
+  switch(key) {
+  case 1900: bin_element(); break;
+  case 1901: bin_node(); break;
+  case 1902: bin_dofs();  break;
+  case 1921: bin_abqver(); break;
+  case 1922: bin_heading(); break;
+  case 1931: bin_set(&B.nsets, &B.nnsets, 0); break;
+  case 1932: bin_set(&B.nsets, &B.nnsets, 1); break;
+  case 1933: bin_set(&B.esets, &B.nesets, 0); break;
+  case 1934: bin_set(&B.esets, &B.nesets, 1); break;
+  case 1940: bin_label(); break;
+  case 2000: bin_increment(); break;
+  case 2001: bin_model(); bin_flush(); break;
+
+  case 1:   bin_elemheader(); break;
+  case 11:  bin_elemout("S"); break;
+  case 12:  bin_elemout("SINV"); break;
+  case 13:  bin_elemout("SF"); break;
+  case 101: bin_nodeout("U"); break;
+  case 102: bin_nodeout("V"); break;
+  case 103: bin_nodeout("A"); break;
+  case 104: bin_nodeout("RF"); break;
+  case 105: bin_nodeout("EPOT"); break;
+  case 106: bin_nodeout("CF"); break;
+  case 107: bin_nodeout("COORD"); break;
+  case 108: bin_nodeout("POR"); break;
+  case 109: bin_nodeout("RVF"); break;
+  case 110: bin_nodeout("RVT"); break;
+  }
+  return err;
+}
+
+/* Start the binary output for file fn */
+int bin_open(const char *fn) {
+  char path[FILENAME_MAX];
+  size_t n = strlen(fn);
+  if (n > 4 && strcmp(fn+n-4, ".fil") == 0) n -= 4;
+  snprintf(outdir, sizeof(outdir), "%.*s.fepost", (int)n, fn);
+  if (mkdir(outdir, 0777) && errno != EEXIST) {
+    fprintf(stderr,"ERROR: can not create directory '%s'\n",outdir);
+    return 1;
+  }
+  snprintf(path, FILENAME_MAX, "%s/results.bin", outdir);
+  memset(&B, 0, sizeof(B));
+  B.udim = 3;
+  B.res = fopen(path, "wb");
+  if (B.res == NULL) {
+    fprintf(stderr,"ERROR: can not write '%s'\n",path);
+    return 1;
+  }
+  sb_printf(&B.info, "{\n\"creator\": \"%s\"", copyright);
+  fprintf(stderr,"Writing binary results to '%s'\n",outdir);
+  return 0;
+}
+
+/* Finish the binary output */
+int bin_close() {
+  char path[FILENAME_MAX];
+  int i;
+  bin_model();
+  bin_flush();
+  fclose(B.res);
+  snprintf(path, FILENAME_MAX, "%s/info.json", outdir);
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    fprintf(stderr,"ERROR: can not write '%s'\n",path);
+    return 1;
+  }
+  fprintf(f, "%s,\n\"labels\": {%s},\n\"increments\": [%s\n]\n}\n",
+	  B.info.s, B.labels.n ? B.labels.s : "", B.incs.n ? B.incs.s : "");
+  fclose(f);
+  /* Cleanup */
+  free(B.info.s); free(B.labels.s); free(B.incs.s);
+  free(B.nodid.v); free(B.nodes); free(B.row);
+  for (i=0; i<B.nelems; i++) free(B.elems[i].v);
+  for (i=0; i<B.nnsets; i++) free(B.nsets[i].v);
+  for (i=0; i<B.nesets; i++) free(B.esets[i].v);
+  free(B.elems); free(B.nsets); free(B.esets);
+  return err;
+}
+
+
 /* Process the data of a record */
 int process_data() {
   /* nw and key have been set, j points to data*/
   if (verbose) fprintf(stderr,"Record %ld Offset %ld Length %ld Type %ld End %ld max %ld\n",recnr,j,nw,key,jend,jmax);
   if (fake) return 0;
+  if (binary) return process_binary();
   switch(key) {
   case 1900: do_element(); break;
   case 1901: do_node(); break;
@@ -324,85 +801,161 @@ int process_data() {
   case 110: do_nodeout("RVT"); break;
 
   case 1999: do_total_energies(); break;
-  default: printf("D.Unknown(%ld)\n",key);
+  default: out("D.Unknown(%ld)\n",key);
   }
   return err;
 }
 
 
-/* read the next block from file */
-int read_block() {
-  if (j < jmax) {
-    /* Move the remaining data to the start of the buffer */
-    int64_t nm = jmax-j;
-    if (verbose) fprintf(stderr,"Moving %ld words to start of buffer\n",nm);
-    memmove(data.d,data.d+j,8*nm);
-    j = 0;
-    jmax = j+nm;
-  } else {
-    j = 0;
-    jmax = 0;
-  }
-  blknr++;
-  if (verbose)
-    fprintf(stderr,"Reading block at filepos %ld, %d\n",ftell(fil),feof(fil));
-  if ( (fread(&lead,sizeof(lead),1,fil) != 1 && !feof(fil)) ||
-       (!feof(fil) && fread(data.d+jmax,RECSIZE*8,1,fil) != 1) ||
-       (!feof(fil) && fread(&tail,sizeof(tail),1,fil) != 1) ) {
-    fprintf(stderr,"ERROR while reading block nr %ld at filepos %ld\n",blknr,ftell(fil));
-    return 1;
+/* Return the position in the file of data word w */
+int64_t word_offset(int64_t w) {
+  return (w/RECSIZE)*BLKSIZE + sizeof(int32_t) + (w%RECSIZE)*8;
+}
+
+/* Return data word w as an integer */
+int64_t get_word(int64_t w) {
+  int64_t v;
+  memcpy(&v, map+word_offset(w), 8);
+  return v;
+}
+
+/* Copy n words starting at data word w to the data buffer */
+void copy_words(int64_t w, int64_t n) {
+  int64_t k = 0;
+  while (k < n) {
+    /* words left in this block */
+    int64_t m = RECSIZE - (w+k)%RECSIZE;
+    if (m > n-k) m = n-k;
+    memcpy(data.d+k, map+word_offset(w+k), 8*m);
+    k += m;
   }
-  if (feof(fil)) return 1;
-  jmax += RECSIZE;
-  if (verbose) {
-    fprintf(stderr,"** Block %ld size %d lead %d tail %d\n",blknr,8*RECSIZE,lead,tail);
-    fprintf(stderr,"** Buffer Start %ld End %ld size %ld\n",j,jmax,jmax-j);
+}
+
+/* Scan the file and build the record index */
+/*
+  Returns the index and sets nrec to the number of records,
+  or returns NULL and sets nrec to -1 on error.
+*/
+Record *scan_records(int64_t *nrec) {
+  Record *rec = NULL;
+  int64_t n = 0, cap = 0, w = 0;
+  int expl = explicit;
+  while (w < nwords) {
+    int64_t nw = get_word(w);
+    if (nw <= 0) {
+      /* this must be block padding */
+      if (verbose) fprintf(stderr,"Skipping rest of block(padding)\n");
+      w = (w/RECSIZE+1)*RECSIZE;
+      continue;
+    }
+    if (w+nw > nwords) {
+      if (verbose) fprintf(stderr,"Record exceeds the end of file\n");
+      break;
+    }
+    if (nw < 2 || nw > BUFSIZE) {
+      fprintf(stderr,"ERROR: invalid length %ld of record %ld\n",nw,n+1);
+      free(rec);
+      *nrec = -1;
+      return NULL;
+    }
+    if (n == cap) {
+      cap = 2*cap + 1024;
+      rec = realloc(rec, cap*sizeof(Record));
+    }
+    Record *r = rec + n++;
+    r->w = w;
+    r->nw = nw;
+    r->key = get_word(w+1);
+    r->explicit = expl;
+    if (r->key == 2000 && nw > 6) {
+      int64_t type = get_word(w+6);
+      expl = (type==17 || type == 74);
+    }
+    w += nw;
   }
-  return 0;
+  *nrec = n;
+  return rec;
+}
+
+/* Process record number r from the index */
+int process_record(Record *rec, int64_t r) {
+  nw = rec[r].nw;
+  key = rec[r].key;
+  explicit = rec[r].explicit;
+  filpos = word_offset(rec[r].w);
+  recnr = r+1;
+  copy_words(rec[r].w, nw);
+  j = 2;
+  jend = jmax = nw;
+  return process_data();
 }
 
 /* Process a single file */
 int process_file(const char* fn) {
+  struct stat st;
+  int64_t r, nrec, fail = 0;
   fprintf(stderr,"Processing file '%s'\n",fn);
-  fil = fopen(fn,"r");
-  if (fil == NULL) return 1;
-
-  printf("#!/usr/bin/env pyformex\n");
-  printf("# Created by %s\n",copyright);
-  printf("from plugins.fe_post import FeResult\n");
-  printf("D = FeResult()\n");
-  j = jmax = 0; /* start with empty buffer */
-  while (!feof(fil)) {
-    if (read_block()) break;
-    while (j < jmax) { /* we have data : process them */
-      nw = data.i[j];
-      if (nw <= 0) {
-	/* this must be block padding */
-	if (verbose) fprintf(stderr,"Skipping rest of block(padding)\n)");
-	j = jmax;
-	break;
-      }
-      if (j+nw > jmax) {
-	/* record spans block boundary */
-	if (verbose) fprintf(stderr,"Record exceeds block boundary\n");
-	break;
-      }
-      jend = j+nw;
-      if (jend > jmax) {
-	fprintf(stderr,"ERROR: record seems to span more than 2 blocks\n");
-	return 1;
+  int fd = open(fn,O_RDONLY);
+  if (fd < 0) return 1;
+  if (fstat(fd,&st)) {
+    close(fd);
+    return 1;
+  }
+  /* we only use complete blocks */
+  nwords = st.st_size / BLKSIZE * RECSIZE;
+  map = NULL;
+  if (nwords > 0) {
+    map = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    if (map == MAP_FAILED) {
+      fprintf(stderr,"ERROR: can not map file '%s'\n",fn);
+      close(fd);
+      return 1;
+    }
+    madvise((void *)map,st.st_size,MADV_SEQUENTIAL);
+  }
+  close(fd);
+  Record *rec = scan_records(&nrec);
+  if (verbose) fprintf(stderr,"Found %ld records\n",nrec);
+  if (nrec < 0) fail = 1;
+
+  else if (binary) {
+    fail = bin_open(fn);
+    for (r=0; r<nrec && !fail; r++)
+      fail = process_record(rec,r);
+    if (!fail) fail = bin_close();
+
+  } else {
+    printf("#!/usr/bin/env pyformex\n");
+    printf("# Created by %s\n",copyright);
+    printf("from plugins.fe_post import FeResult\n");
+    printf("D = FeResult()\n");
+    int64_t c, nchunks = (nrec+CHUNKSIZE-1) / CHUNKSIZE;
+    /* the chunks are processed in parallel, but written in order */
+#pragma omp parallel for ordered schedule(static,1) if(nchunks > 1 && !verbose)
+    for (c=0; c<nchunks; c++) {
+      int64_t r, r1 = (c+1)*CHUNKSIZE;
+      if (r1 > nrec) r1 = nrec;
+      for (r=c*CHUNKSIZE; r<r1; r++)
+	if (process_record(rec,r)) {
+#pragma omp atomic write
+	  fail = 1;
+	  break;
+	}
+#pragma omp ordered
+      {
+	fwrite(obuf.s,1,obuf.n,stdout);
+	obuf.n = 0;
       }
-      key = data.i[j+1];
-      recnr++;
-      j += 2;
-      if (process_data()) return 1;
-      j = jend; /* in case the process_data did not process everything */
+    }
+    if (!fail) {
+      printf("D.Export()\n");
+      printf("# End\n");
     }
   }
-  printf("D.Export()\n");
-  printf("# End\n");
-  fclose(fil);
-  return 0;
+
+  free(rec);
+  if (map) munmap((void *)map,st.st_size);
+  return fail;
 }
 
 void print_copyright() {
@@ -418,6 +971,8 @@ Options:\n\
   -v : Be verbose (mostly for debugging)\n\
   -e : Force EXPLICIT from the start (default is to autodetect)\n\
   -n : Dry run: run through the file but do not produce conversion\n\
+  -b : Write the results in binary form into a directory BASE.fepost,\n\
+       where BASE is the input file name without the .fil suffix\n\
   -h : Print this help text\n\
   -V : Print version and exit\n\
 \n");
@@ -438,6 +993,7 @@ int main(int argc, char *argv[]) {
     case 'v': verbose=1; break;
     case 'e': explicit=1; break;
     case 'n': fake=1; break;
+    case 'b': binary=1; break;
     case 'h': print_usage();
     case 'V': return 0;
     default: fprintf(stderr,"Invalid option '%c'; use '-h' for help\n",c);
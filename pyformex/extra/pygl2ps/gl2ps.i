@@ -31,7 +31,11 @@
 */
 %module gl2ps
 %{
+#include <unistd.h>
 #include "gl2ps.h"
+
+/* The stream opened for the page by gl2psBeginPage */
+static FILE *_gl2ps_stream = NULL;
 %}
 
 
@@ -41,10 +45,60 @@ typedef float   GLfloat;
 typedef GLfloat GL2PSrgba[4];
 
 
+/* The output stream is a C stream on a duplicate of the file descriptor
+   of the passed Python file object. It should be closed with
+   gl2psCloseStream after gl2psEndPage. */
 %typemap(in) FILE* {
-  $1 = (FILE *) PyFile_AsFile($input);
-  printf("BV: Received a file\n");
+  int fd = PyObject_AsFileDescriptor($input);
+  if (fd < 0) SWIG_fail;
+  if (_gl2ps_stream) fclose(_gl2ps_stream);
+  _gl2ps_stream = fdopen(dup(fd), "wb");
+  if (_gl2ps_stream == NULL) {
+    PyErr_SetFromErrno(PyExc_OSError);
+    SWIG_fail;
+  }
+  $1 = _gl2ps_stream;
+}
+
+/* A viewport is passed as a sequence of 4 ints (x,y,w,h), or None */
+%typemap(in) GLint viewport[4] (GLint temp[4]) {
+  if ($input == Py_None)
+    $1 = NULL;
+  else {
+    int i;
+    if (!PySequence_Check($input) || PySequence_Length($input) != 4) {
+      PyErr_SetString(PyExc_ValueError,
+		      "viewport should be a sequence of 4 ints");
+      SWIG_fail;
+    }
+    for (i = 0; i < 4; i++) {
+      PyObject *o = PySequence_GetItem($input, i);
+      temp[i] = o ? (GLint) PyLong_AsLong(o) : 0;
+      Py_XDECREF(o);
+    }
+    if (PyErr_Occurred()) SWIG_fail;
+    $1 = temp;
+  }
+}
+
+%inline %{
+/* Flush the page output written so far, e.g. after gl2psEndViewport */
+int gl2psFlushStream(void)
+{
+  return _gl2ps_stream ? fflush(_gl2ps_stream) : 0;
+}
+
+/* Close the page output stream. Call this after gl2psEndPage. */
+int gl2psCloseStream(void)
+{
+  int res = 0;
+  if (_gl2ps_stream) {
+    res = fclose(_gl2ps_stream);
+    _gl2ps_stream = NULL;
+  }
+  return res;
 }
+%}
 
 
 /* Version number */
@@ -166,6 +166,14 @@ def gl2psEndViewport():
   return _gl2ps.gl2psEndViewport()
 gl2psEndViewport = _gl2ps.gl2psEndViewport
 
+def gl2psFlushStream():
+  return _gl2ps.gl2psFlushStream()
+gl2psFlushStream = _gl2ps.gl2psFlushStream
+
+def gl2psCloseStream():
+  return _gl2ps.gl2psCloseStream()
+gl2psCloseStream = _gl2ps.gl2psCloseStream
+
 def gl2psText(*args):
   return _gl2ps.gl2psText(*args)
 gl2psText = _gl2ps.gl2psText
@@ -2956,8 +2956,30 @@ static swig_module_info swig_module = {swig_types, 8, 0, 0, 0, 0};
 #define SWIG_as_voidptrptr(a) ((void)SWIG_as_voidptr(*a),(void**)(a)) 
 
 
+#include <unistd.h>
 #include "gl2ps.h"
 
+/* The stream opened for the page by gl2psBeginPage */
+static FILE *_gl2ps_stream = NULL;
+
+
+/* Flush the page output written so far, e.g. after gl2psEndViewport */
+int gl2psFlushStream(void)
+{
+  return _gl2ps_stream ? fflush(_gl2ps_stream) : 0;
+}
+
+/* Close the page output stream. Call this after gl2psEndPage. */
+int gl2psCloseStream(void)
+{
+  int res = 0;
+  if (_gl2ps_stream) {
+    res = fclose(_gl2ps_stream);
+    _gl2ps_stream = NULL;
+  }
+  return res;
+}
+
 
   #define SWIG_From_long   PyInt_FromLong 
 
@@ -3294,8 +3316,7 @@ SWIGINTERN PyObject *_wrap_gl2psBeginPage(PyObject *SWIGUNUSEDPARM(self), PyObje
   int res2 ;
   char *buf2 = 0 ;
   int alloc2 = 0 ;
-  void *argp3 = 0 ;
-  int res3 = 0 ;
+  GLint temp3[4] ;
   int val4 ;
   int ecode4 = 0 ;
   int val5 ;
@@ -3347,11 +3368,25 @@ SWIGINTERN PyObject *_wrap_gl2psBeginPage(PyObject *SWIGUNUSEDPARM(self), PyObje
     SWIG_exception_fail(SWIG_ArgError(res2), "in method '" "gl2psBeginPage" "', argument " "2"" of type '" "char const *""'");
   }
   arg2 = (char *)(buf2);
-  res3 = SWIG_ConvertPtr(obj2, &argp3,SWIGTYPE_p_int, 0 |  0 );
-  if (!SWIG_IsOK(res3)) {
-    SWIG_exception_fail(SWIG_ArgError(res3), "in method '" "gl2psBeginPage" "', argument " "3"" of type '" "GLint [4]""'"); 
-  } 
-  arg3 = (GLint *)(argp3);
+  {
+    if (obj2 == Py_None)
+      arg3 = NULL;
+    else {
+      int i;
+      if (!PySequence_Check(obj2) || PySequence_Length(obj2) != 4) {
+        PyErr_SetString(PyExc_ValueError,
+          "viewport should be a sequence of 4 ints");
+        SWIG_fail;
+      }
+      for (i = 0; i < 4; i++) {
+        PyObject *o = PySequence_GetItem(obj2, i);
+        temp3[i] = o ? (GLint) PyLong_AsLong(o) : 0;
+        Py_XDECREF(o);
+      }
+      if (PyErr_Occurred()) SWIG_fail;
+      arg3 = temp3;
+    }
+  }
   ecode4 = SWIG_AsVal_int(obj3, &val4);
   if (!SWIG_IsOK(ecode4)) {
     SWIG_exception_fail(SWIG_ArgError(ecode4), "in method '" "gl2psBeginPage" "', argument " "4"" of type '" "GLint""'");
@@ -3403,8 +3438,15 @@ SWIGINTERN PyObject *_wrap_gl2psBeginPage(PyObject *SWIGUNUSEDPARM(self), PyObje
   } 
   arg13 = (GLint)(val13);
   {
-    arg14 = (FILE *) PyFile_AsFile(obj13);
-    printf("BV: Received a file\n");
+    int fd = PyObject_AsFileDescriptor(obj13);
+    if (fd < 0) SWIG_fail;
+    if (_gl2ps_stream) fclose(_gl2ps_stream);
+    _gl2ps_stream = fdopen(dup(fd), "wb");
+    if (_gl2ps_stream == NULL) {
+      PyErr_SetFromErrno(PyExc_OSError);
+      SWIG_fail;
+    }
+    arg14 = _gl2ps_stream;
   }
   res15 = SWIG_AsCharPtrAndSize(obj14, &buf15, NULL, &alloc15);
   if (!SWIG_IsOK(res15)) {
@@ -3485,17 +3527,30 @@ fail:
 SWIGINTERN PyObject *_wrap_gl2psBeginViewport(PyObject *SWIGUNUSEDPARM(self), PyObject *args) {
   PyObject *resultobj = 0;
   GLint *arg1 ;
-  void *argp1 = 0 ;
-  int res1 = 0 ;
+  GLint temp1[4] ;
   PyObject * obj0 = 0 ;
   GLint result;
   
   if (!PyArg_ParseTuple(args,(char *)"O:gl2psBeginViewport",&obj0)) SWIG_fail;
-  res1 = SWIG_ConvertPtr(obj0, &argp1,SWIGTYPE_p_int, 0 |  0 );
-  if (!SWIG_IsOK(res1)) {
-    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "gl2psBeginViewport" "', argument " "1"" of type '" "GLint [4]""'"); 
-  } 
-  arg1 = (GLint *)(argp1);
+  {
+    if (obj0 == Py_None)
+      arg1 = NULL;
+    else {
+      int i;
+      if (!PySequence_Check(obj0) || PySequence_Length(obj0) != 4) {
+        PyErr_SetString(PyExc_ValueError,
+          "viewport should be a sequence of 4 ints");
+        SWIG_fail;
+      }
+      for (i = 0; i < 4; i++) {
+        PyObject *o = PySequence_GetItem(obj0, i);
+        temp1[i] = o ? (GLint) PyLong_AsLong(o) : 0;
+        Py_XDECREF(o);
+      }
+      if (PyErr_Occurred()) SWIG_fail;
+      arg1 = temp1;
+    }
+  }
   result = (GLint)gl2psBeginViewport(arg1);
   resultobj = SWIG_From_int((int)(result));
   return resultobj;
@@ -3517,6 +3572,32 @@ fail:
 }
 
 
+SWIGINTERN PyObject *_wrap_gl2psFlushStream(PyObject *SWIGUNUSEDPARM(self), PyObject *args) {
+  PyObject *resultobj = 0;
+  int result;
+  
+  if (!PyArg_ParseTuple(args,(char *)":gl2psFlushStream")) SWIG_fail;
+  result = (int)gl2psFlushStream();
+  resultobj = SWIG_From_int((int)(result));
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_gl2psCloseStream(PyObject *SWIGUNUSEDPARM(self), PyObject *args) {
+  PyObject *resultobj = 0;
+  int result;
+  
+  if (!PyArg_ParseTuple(args,(char *)":gl2psCloseStream")) SWIG_fail;
+  result = (int)gl2psCloseStream();
+  resultobj = SWIG_From_int((int)(result));
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
 SWIGINTERN PyObject *_wrap_gl2psText(PyObject *SWIGUNUSEDPARM(self), PyObject *args) {
   PyObject *resultobj = 0;
   char *arg1 = (char *) 0 ;
@@ -3898,6 +3979,8 @@ static PyMethodDef SwigMethods[] = {
 	 { (char *)"gl2psGetOptions", _wrap_gl2psGetOptions, METH_VARARGS, NULL},
 	 { (char *)"gl2psBeginViewport", _wrap_gl2psBeginViewport, METH_VARARGS, NULL},
 	 { (char *)"gl2psEndViewport", _wrap_gl2psEndViewport, METH_VARARGS, NULL},
+	 { (char *)"gl2psFlushStream", _wrap_gl2psFlushStream, METH_VARARGS, NULL},
+	 { (char *)"gl2psCloseStream", _wrap_gl2psCloseStream, METH_VARARGS, NULL},
 	 { (char *)"gl2psText", _wrap_gl2psText, METH_VARARGS, NULL},
 	 { (char *)"gl2psTextOpt", _wrap_gl2psTextOpt, METH_VARARGS, NULL},
 	 { (char *)"gl2psSpecial", _wrap_gl2psSpecial, METH_VARARGS, NULL},
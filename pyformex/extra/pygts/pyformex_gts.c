@@ -0,0 +1,749 @@
+/* */
+//
+//  SPDX-FileCopyrightText: © 2007-2023 Benedict Verhegghe <bverheg@gmail.com>
+//  SPDX-License-Identifier: GPL-3.0-or-later
+//
+//  This file is part of pyFormex 3.3  (Sun Mar 26 20:16:15 CEST 2023)
+//  pyFormex is a tool for generating, manipulating and transforming 3D
+//  geometrical models by sequences of mathematical operations.
+//  Home page: https://pyformex.org
+//  Project page: https://savannah.nongnu.org/projects/pyformex/
+//  Development: https://gitlab.com/bverheg/pyformex
+//  Distributed under the GNU General Public License version 3 or later.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+#include <Python.h>
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+#include <math.h>
+#include "gts.h"
+
+#define PYARRAY_DATA(p) PyArray_DATA((PyArrayObject *)p)
+#define PYARRAY_DIMS(p) PyArray_DIMS((PyArrayObject *)p)
+
+#ifndef PI
+#define PI 3.14159265359
+#endif
+
+
+/****************** LIBRARY VERSION AND DOCSTRING *******************/
+
+static char *__version__ = "3.4.dev0";
+static char *__doc__ = "\
+In-process GTS surface operations.\n\
+\n\
+This module gives pyFormex direct access to the coarsen, refine,\n\
+smooth and boolean operations of the GTS library. Unlike the\n\
+gtscoarsen, gtsrefine, gtssmooth and gtsset programs, it works directly\n\
+on the coordinate and triangle arrays of a TriSurface: there are no\n\
+temporary .gts files and no subprocesses involved.\n\
+These functions are not intended for the end user. They are called\n\
+internally by the TriSurface methods if this module is installed.\n\
+";
+
+
+/****** INTERNAL FUNCTIONS (not callable from Python) ********/
+
+/*
+   GTS keeps global state (lazily created object classes, static
+   counters in some of the algorithms) and is not thread safe.
+   The Python functions release the GIL while the surface is converted
+   and processed, so that other Python threads can continue, but only
+   one GTS operation runs at any time.
+*/
+G_LOCK_DEFINE_STATIC(gts);
+
+
+/* Return the edge between v1 and v2, creating it if it does not exist */
+static GtsEdge * surface_edge(GtsSurface *s, GtsVertex *v1, GtsVertex *v2)
+{
+  GtsSegment *seg = gts_vertices_are_connected(v1,v2);
+  if (seg != NULL && GTS_IS_EDGE(seg))
+    return GTS_EDGE(seg);
+  return gts_edge_new(s->edge_class,v1,v2);
+}
+
+
+/*
+   Create a GtsSurface from a vertex and a triangle array.
+
+   x: (nnod,3) float64 vertex coordinates
+   elems: (nelems,3) int32 vertex numbers
+
+   The faces are created with edges (a,b), (b,c), (c,a), so that
+   gts_triangle_vertices() returns them with the orientation they had
+   in elems.
+
+   Returns the surface, or NULL if elems contains invalid or repeated
+   vertex numbers.
+*/
+static GtsSurface * surface_from_arrays(double *x, npy_intp nnod,
+					int *elems, npy_intp nelems)
+{
+  GtsSurface *s;
+  GtsVertex **v;
+  npy_intp i;
+  int a, b, c;
+
+  for (i=0; i<3*nelems; i++)
+    if (elems[i] < 0 || elems[i] >= nnod) return NULL;
+  for (i=0; i<nelems; i++) {
+    a = elems[3*i]; b = elems[3*i+1]; c = elems[3*i+2];
+    if (a == b || b == c || c == a) return NULL;
+  }
+
+  s = gts_surface_new(gts_surface_class(), gts_face_class(),
+		      gts_edge_class(), gts_vertex_class());
+  v = g_new(GtsVertex *, nnod);
+  for (i=0; i<nnod; i++)
+    v[i] = gts_vertex_new(s->vertex_class, x[3*i], x[3*i+1], x[3*i+2]);
+  for (i=0; i<nelems; i++) {
+    a = elems[3*i]; b = elems[3*i+1]; c = elems[3*i+2];
+    gts_surface_add_face(s, gts_face_new(s->face_class,
+					 surface_edge(s,v[a],v[b]),
+					 surface_edge(s,v[b],v[c]),
+					 surface_edge(s,v[c],v[a])));
+  }
+  /* Vertices that are not used by any face are not part of the surface */
+  for (i=0; i<nnod; i++)
+    if (v[i]->segments == NULL) gts_object_destroy(GTS_OBJECT(v[i]));
+  g_free(v);
+  return s;
+}
+
+
+typedef struct {
+  double *x;
+  int *elems;
+  guint n;
+} SurfaceArrays;
+
+static void number_vertex(GtsVertex *v, SurfaceArrays *d)
+{
+  GtsPoint *p = GTS_POINT(v);
+  GTS_OBJECT(v)->reserved = GUINT_TO_POINTER(d->n);
+  d->x[3*d->n] = p->x;
+  d->x[3*d->n+1] = p->y;
+  d->x[3*d->n+2] = p->z;
+  d->n++;
+}
+
+static void number_face(GtsTriangle *t, SurfaceArrays *d)
+{
+  GtsVertex *v1, *v2, *v3;
+  gts_triangle_vertices(t,&v1,&v2,&v3);
+  d->elems[3*d->n] = GPOINTER_TO_UINT(GTS_OBJECT(v1)->reserved);
+  d->elems[3*d->n+1] = GPOINTER_TO_UINT(GTS_OBJECT(v2)->reserved);
+  d->elems[3*d->n+2] = GPOINTER_TO_UINT(GTS_OBJECT(v3)->reserved);
+  d->n++;
+}
+
+/* Fill the (nvertices,3) and (nfaces,3) arrays x and elems from s */
+static void surface_to_arrays(GtsSurface *s, double *x, int *elems)
+{
+  SurfaceArrays d = { x, elems, 0 };
+  gts_surface_foreach_vertex(s, (GtsFunc) number_vertex, &d);
+  d.n = 0;
+  gts_surface_foreach_face(s, (GtsFunc) number_face, &d);
+  gts_surface_foreach_vertex(s, (GtsFunc) gts_object_reset_reserved, NULL);
+}
+
+
+/*
+   Convert the Python arguments x and elems to contiguous arrays, and
+   create a GtsSurface from them (with the GIL released).
+
+   Returns the surface, or NULL with an exception set.
+*/
+static GtsSurface * surface_from_args(PyObject *arg1, PyObject *arg2)
+{
+  PyObject *arr1=NULL, *arr2=NULL;
+  GtsSurface *s = NULL;
+  npy_intp *dims1, *dims2;
+
+  arr1 = PyArray_FROM_OTF(arg1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  if (arr1 == NULL) goto fail;
+  arr2 = PyArray_FROM_OTF(arg2, NPY_INT, NPY_ARRAY_IN_ARRAY);
+  if (arr2 == NULL) goto fail;
+  dims1 = PYARRAY_DIMS(arr1);
+  dims2 = PYARRAY_DIMS(arr2);
+  if (PyArray_NDIM((PyArrayObject *)arr1) != 2 || dims1[1] != 3) {
+    PyErr_SetString(PyExc_ValueError, "x should have shape (nnod,3)");
+    goto fail;
+  }
+  if (PyArray_NDIM((PyArrayObject *)arr2) != 2 || dims2[1] != 3) {
+    PyErr_SetString(PyExc_ValueError, "elems should have shape (nelems,3)");
+    goto fail;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  G_LOCK(gts);
+  s = surface_from_arrays((double *)PYARRAY_DATA(arr1), dims1[0],
+			  (int *)PYARRAY_DATA(arr2), dims2[0]);
+  G_UNLOCK(gts);
+  Py_END_ALLOW_THREADS
+
+  if (s == NULL)
+    PyErr_SetString(PyExc_ValueError,
+		    "elems contains invalid or degenerate triangles");
+ fail:
+  Py_XDECREF(arr1);
+  Py_XDECREF(arr2);
+  return s;
+}
+
+
+/*
+   Convert a GtsSurface to a tuple (x,elems) of numpy arrays and destroy it.
+
+   Returns the tuple, or NULL with an exception set.
+*/
+static PyObject * surface_to_tuple(GtsSurface *s)
+{
+  PyObject *ret1=NULL, *ret2=NULL;
+  npy_intp dims[2], nfaces;
+
+  Py_BEGIN_ALLOW_THREADS
+  G_LOCK(gts);
+  dims[0] = gts_surface_vertex_number(s);
+  nfaces = gts_surface_face_number(s);
+  G_UNLOCK(gts);
+  Py_END_ALLOW_THREADS
+
+  dims[1] = 3;
+  ret1 = PyArray_SimpleNew(2,dims,NPY_DOUBLE);
+  if (ret1 == NULL) goto fail;
+  dims[0] = nfaces;
+  ret2 = PyArray_SimpleNew(2,dims,NPY_INT);
+  if (ret2 == NULL) goto fail;
+
+  Py_BEGIN_ALLOW_THREADS
+  G_LOCK(gts);
+  surface_to_arrays(s,(double *)PYARRAY_DATA(ret1),(int *)PYARRAY_DATA(ret2));
+  gts_object_destroy(GTS_OBJECT(s));
+  G_UNLOCK(gts);
+  Py_END_ALLOW_THREADS
+
+  return Py_BuildValue("(NN)", ret1, ret2);
+ fail:
+  Py_BEGIN_ALLOW_THREADS
+  G_LOCK(gts);
+  gts_object_destroy(GTS_OBJECT(s));
+  G_UNLOCK(gts);
+  Py_END_ALLOW_THREADS
+  Py_XDECREF(ret1);
+  Py_XDECREF(ret2);
+  return NULL;
+}
+
+
+/* Cost functions and stop criteria, as in gtscoarsen/gtsrefine */
+
+static gdouble cost_angle(GtsEdge *e)
+{
+  if (e->triangles && e->triangles->next)
+    return fabs(gts_triangles_angle(e->triangles->data,
+				    e->triangles->next->data));
+  return G_MAXDOUBLE;
+}
+
+static gboolean refine_stop_number(gdouble cost, guint number, guint *max)
+{
+  return number > *max;
+}
+
+static gboolean refine_stop_cost(gdouble cost, guint number, gdouble *min)
+{
+  return cost < *min;
+}
+
+
+/* Laplacian smoothing, as in gtssmooth */
+
+typedef struct {
+  GtsSurface *s;
+  gdouble lambda;
+  gdouble maxcosine2;
+  guint nfold;
+} SmoothData;
+
+static void smooth_vertex(GtsVertex *v, SmoothData *d)
+{
+  if (!gts_vertex_is_boundary(v,d->s)) {
+    GSList *vertices = gts_vertex_neighbors(v,NULL,d->s);
+    GSList *i;
+    GtsVector U0 = { 0., 0., 0.};
+    guint n = 0;
+
+    for (i=vertices; i; i=i->next) {
+      GtsPoint *p = i->data;
+      U0[0] += p->x;
+      U0[1] += p->y;
+      U0[2] += p->z;
+      n++;
+    }
+    g_slist_free(vertices);
+
+    if (n > 0) {
+      GTS_POINT(v)->x += d->lambda*(U0[0]/n - GTS_POINT(v)->x);
+      GTS_POINT(v)->y += d->lambda*(U0[1]/n - GTS_POINT(v)->y);
+      GTS_POINT(v)->z += d->lambda*(U0[2]/n - GTS_POINT(v)->z);
+    }
+  }
+}
+
+static void smooth_fold(GtsVertex *v, SmoothData *d)
+{
+  GSList *i;
+  for (i=v->segments; i; i=i->next) {
+    if (GTS_IS_EDGE(i->data)) {
+      GtsEdge *e = i->data;
+      if (gts_triangles_are_folded(e->triangles,
+				   GTS_SEGMENT(e)->v1, GTS_SEGMENT(e)->v2,
+				   d->maxcosine2)) {
+	d->nfold++;
+	smooth_vertex(v,d);
+	return;
+      }
+    }
+  }
+}
+
+
+/********************************************************/
+/****** EXPORTED FUNCTIONS (callable from Python ********/
+
+static char coarsen_doc[] = "\
+Coarsen a triangulated surface.\n\
+\n\
+Parameters\n\
+----------\n\
+x: float array (nnod,3)\n\
+    The vertex coordinates.\n\
+elems: int array (nelems,3)\n\
+    The vertex numbers of the triangles.\n\
+min_edges: int\n\
+    Stop the coarsening if the number of edges was to fall below it.\n\
+max_cost: float, optional\n\
+    If specified, stop the coarsening if the cost of collapsing an\n\
+    edge is larger than this value. This overrides min_edges.\n\
+cost: str\n\
+    The edge collapse cost function: 'optimized' (volume optimized\n\
+    cost), 'length' (squared edge length) or 'angle' (angle between\n\
+    the two triangles at the edge).\n\
+mid_vertex: bool\n\
+    If True, the collapsed edge is replaced by its midpoint instead\n\
+    of a volume optimized point.\n\
+max_fold: float\n\
+    Maximum fold angle in degrees.\n\
+volume_weight, boundary_weight, shape_weight: float\n\
+    The weights for the volume optimized cost and vertex.\n\
+\n\
+Returns\n\
+-------\n\
+x: float array (nnod',3)\n\
+    The vertex coordinates of the coarsened surface.\n\
+elems: int array (nelems',3)\n\
+    The triangles of the coarsened surface.\n\
+";
+
+static PyObject * coarsen(PyObject *dummy, PyObject *args, PyObject *kargs)
+{
+  static char *kwlist[] = {"x", "elems", "min_edges", "max_cost", "cost",
+			   "mid_vertex", "max_fold", "volume_weight",
+			   "boundary_weight", "shape_weight", NULL};
+  PyObject *arg1=NULL, *arg2=NULL, *arg4=Py_None;
+  GtsSurface *s;
+  GtsVolumeOptimizedParams params = { 0.5, 0.5, 0. };
+  GtsKeyFunc cost_func = NULL;
+  GtsCoarsenFunc coarsen_func = NULL;
+  GtsStopFunc stop_func;
+  gpointer cost_data = NULL, coarsen_data = NULL, stop_data;
+  unsigned int number = 0;
+  double cmax = 0., fold = 1.;
+  const char *cost = "optimized";
+  int mid = 0;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kargs, "OO|IOspdddd", kwlist,
+				   &arg1, &arg2, &number, &arg4, &cost,
+				   &mid, &fold, &params.volume_weight,
+				   &params.boundary_weight,
+				   &params.shape_weight))
+    return NULL;
+  if (arg4 != Py_None) {
+    cmax = PyFloat_AsDouble(arg4);
+    if (cmax == -1. && PyErr_Occurred()) return NULL;
+  }
+
+  if (strcmp(cost,"optimized") == 0) {
+    cost_func = (GtsKeyFunc) gts_volume_optimized_cost;
+    cost_data = &params;
+  } else if (strcmp(cost,"angle") == 0)
+    cost_func = (GtsKeyFunc) cost_angle;
+  else if (strcmp(cost,"length") != 0) {
+    PyErr_SetString(PyExc_ValueError,
+		    "cost should be 'optimized', 'length' or 'angle'");
+    return NULL;
+  }
+  if (!mid) {
+    coarsen_func = (GtsCoarsenFunc) gts_volume_optimized_vertex;
+    coarsen_data = &params;
+  }
+  if (arg4 != Py_None) {
+    stop_func = (GtsStopFunc) gts_coarsen_stop_cost;
+    stop_data = &cmax;
+  } else {
+    stop_func = (GtsStopFunc) gts_coarsen_stop_number;
+    stop_data = &number;
+  }
+  fold *= PI/180.;
+
+  s = surface_from_args(arg1,arg2);
+  if (s == NULL) return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+  G_LOCK(gts);
+  gts_surface_coarsen(s, cost_func, cost_data, coarsen_func, coarsen_data,
+		      stop_func, stop_data, fold);
+  G_UNLOCK(gts);
+  Py_END_ALLOW_THREADS
+
+  return surface_to_tuple(s);
+}
+
+
+static char refine_doc[] = "\
+Refine a triangulated surface.\n\
+\n\
+The longest edges are split first.\n\
+\n\
+Parameters\n\
+----------\n\
+x: float array (nnod,3)\n\
+    The vertex coordinates.\n\
+elems: int array (nelems,3)\n\
+    The vertex numbers of the triangles.\n\
+max_edges: int\n\
+    Stop the refining if the number of edges exceeds this value.\n\
+min_cost: float, optional\n\
+    If specified, stop the refining if the cost of refining an edge\n\
+    is smaller than this value. This overrides max_edges.\n\
+\n\
+Returns\n\
+-------\n\
+x: float array (nnod',3)\n\
+    The vertex coordinates of the refined surface.\n\
+elems: int array (nelems',3)\n\
+    The triangles of the refined surface.\n\
+";
+
+static PyObject * refine(PyObject *dummy, PyObject *args, PyObject *kargs)
+{
+  static char *kwlist[] = {"x", "elems", "max_edges", "min_cost", NULL};
+  PyObject *arg1=NULL, *arg2=NULL, *arg4=Py_None;
+  GtsSurface *s;
+  GtsStopFunc stop_func;
+  gpointer stop_data;
+  unsigned int number = 0;
+  double cmin = 0.;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kargs, "OO|IO", kwlist,
+				   &arg1, &arg2, &number, &arg4))
+    return NULL;
+  if (arg4 != Py_None) {
+    cmin = PyFloat_AsDouble(arg4);
+    if (cmin == -1. && PyErr_Occurred()) return NULL;
+    stop_func = (GtsStopFunc) refine_stop_cost;
+    stop_data = &cmin;
+  } else {
+    stop_func = (GtsStopFunc) refine_stop_number;
+    stop_data = &number;
+  }
+
+  s = surface_from_args(arg1,arg2);
+  if (s == NULL) return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+  G_LOCK(gts);
+  gts_surface_refine(s, NULL, NULL, NULL, NULL, stop_func, stop_data);
+  G_UNLOCK(gts);
+  Py_END_ALLOW_THREADS
+
+  return surface_to_tuple(s);
+}
+
+
+static char smooth_doc[] = "\
+Smooth a triangulated surface with a Laplacian filter.\n\
+\n\
+Boundary vertices are not moved.\n\
+\n\
+Parameters\n\
+----------\n\
+x: float array (nnod,3)\n\
+    The vertex coordinates.\n\
+elems: int array (nelems,3)\n\
+    The vertex numbers of the triangles.\n\
+niter: int\n\
+    Number of iterations.\n\
+lamb: float\n\
+    Laplacian filter parameter.\n\
+fold: float, optional\n\
+    If specified, only the vertices on edges with a fold angle larger\n\
+    than this value (in degrees) are smoothed. The iterations stop\n\
+    early when there are no such vertices left.\n\
+\n\
+Returns\n\
+-------\n\
+x: float array (nnod',3)\n\
+    The vertex coordinates of the smoothed surface.\n\
+elems: int array (nelems',3)\n\
+    The triangles of the smoothed surface.\n\
+";
+
+static PyObject * smooth(PyObject *dummy, PyObject *args, PyObject *kargs)
+{
+  static char *kwlist[] = {"x", "elems", "niter", "lamb", "fold", NULL};
+  PyObject *arg1=NULL, *arg2=NULL, *arg5=Py_None;
+  GtsSurface *s;
+  SmoothData d = { NULL, 0.5, 0., 1 };
+  unsigned int n, niter = 1;
+  double fold;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kargs, "OO|IdO", kwlist,
+				   &arg1, &arg2, &niter, &d.lambda, &arg5))
+    return NULL;
+  if (arg5 != Py_None) {
+    fold = PyFloat_AsDouble(arg5);
+    if (fold == -1. && PyErr_Occurred()) return NULL;
+    d.maxcosine2 = cos(fold*PI/180.);
+    d.maxcosine2 *= d.maxcosine2;
+  }
+
+  s = surface_from_args(arg1,arg2);
+  if (s == NULL) return NULL;
+  d.s = s;
+
+  Py_BEGIN_ALLOW_THREADS
+  G_LOCK(gts);
+  for (n=1; n<=niter && (arg5 == Py_None || d.nfold > 0); n++) {
+    if (arg5 != Py_None) {
+      d.nfold = 0;
+      gts_surface_foreach_vertex(s, (GtsFunc) smooth_fold, &d);
+    }
+    else
+      gts_surface_foreach_vertex(s, (GtsFunc) smooth_vertex, &d);
+  }
+  G_UNLOCK(gts);
+  Py_END_ALLOW_THREADS
+
+  return surface_to_tuple(s);
+}
+
+
+static char boolean_doc[] = "\
+Perform a boolean operation on two closed triangulated surfaces.\n\
+\n\
+The operations are set operations on the volumes enclosed by the\n\
+surfaces, as with the gtsset program.\n\
+\n\
+Parameters\n\
+----------\n\
+x1: float array (nnod1,3)\n\
+    The vertex coordinates of the first surface.\n\
+elems1: int array (nelems1,3)\n\
+    The vertex numbers of the triangles of the first surface.\n\
+x2: float array (nnod2,3)\n\
+    The vertex coordinates of the second surface.\n\
+elems2: int array (nelems2,3)\n\
+    The vertex numbers of the triangles of the second surface.\n\
+op: str\n\
+    The operation: union('+'), difference('-') or intersection('*'),\n\
+    or 'a' to return the four parts of the surfaces cut by each other.\n\
+check: bool\n\
+    If True, check that the surfaces are not self-intersecting.\n\
+\n\
+Returns\n\
+-------\n\
+x: float array (nnod,3)\n\
+    The vertex coordinates of the resulting surface.\n\
+elems: int array (nelems,3)\n\
+    The triangles of the resulting surface.\n\
+\n\
+If op is 'a', a tuple of four such (x,elems) tuples is returned,\n\
+holding the part of surface 1 inside surface 2, the part of surface 1\n\
+outside surface 2, the part of surface 2 inside surface 1 and the\n\
+part of surface 2 outside surface 1.\n\
+\n\
+Raises a ValueError if a surface is not orientable or (with check)\n\
+self-intersecting, or if the intersection curve is not closed.\n\
+";
+
+static PyObject * boolean(PyObject *dummy, PyObject *args, PyObject *kargs)
+{
+  static char *kwlist[] = {"x1", "elems1", "x2", "elems2", "op", "check",
+			   NULL};
+  /* the parts of 'a', in the order of the result */
+  static GtsBooleanOperation parts[4] = {
+    GTS_1_IN_2, GTS_1_OUT_2, GTS_2_IN_1, GTS_2_OUT_1 };
+  PyObject *arg1=NULL, *arg2=NULL, *arg3=NULL, *arg4=NULL;
+  PyObject *ret[4] = { NULL, NULL, NULL, NULL };
+  GtsSurface *s1, *s2, *res[4] = { NULL, NULL, NULL, NULL };
+  GtsSurfaceInter *si = NULL;
+  GNode *tree1, *tree2;
+  const char *op, *err = NULL;
+  gboolean closed;
+  int i, nres = 1, check = 0;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kargs, "OOOOs|p", kwlist,
+				   &arg1, &arg2, &arg3, &arg4, &op, &check))
+    return NULL;
+  if (strcmp(op,"a") == 0)
+    nres = 4;
+  else if (strcmp(op,"+") != 0 && strcmp(op,"-") != 0 &&
+	   strcmp(op,"*") != 0) {
+    PyErr_SetString(PyExc_ValueError, "op should be '+', '-', '*' or 'a'");
+    return NULL;
+  }
+
+  s1 = surface_from_args(arg1,arg2);
+  if (s1 == NULL) return NULL;
+  s2 = surface_from_args(arg3,arg4);
+  if (s2 == NULL) {
+    Py_BEGIN_ALLOW_THREADS
+    G_LOCK(gts);
+    gts_object_destroy(GTS_OBJECT(s1));
+    G_UNLOCK(gts);
+    Py_END_ALLOW_THREADS
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  G_LOCK(gts);
+  if (!gts_surface_is_orientable(s1) || !gts_surface_is_orientable(s2))
+    err = "the surfaces should be orientable manifolds";
+  else if (check) {
+    GtsSurface *self1 = gts_surface_is_self_intersecting(s1);
+    GtsSurface *self2 = gts_surface_is_self_intersecting(s2);
+    if (self1 || self2)
+      err = "the surfaces should not be self-intersecting";
+    if (self1) gts_object_destroy(GTS_OBJECT(self1));
+    if (self2) gts_object_destroy(GTS_OBJECT(self2));
+  }
+  if (err == NULL) {
+    tree1 = gts_bb_tree_surface(s1);
+    tree2 = gts_bb_tree_surface(s2);
+    si = gts_surface_inter_new(gts_surface_inter_class(), s1, s2,
+			       tree1, tree2,
+			       gts_surface_volume(s1) < 0.,
+			       gts_surface_volume(s2) < 0.);
+    if (!gts_surface_inter_check(si,&closed) || !closed)
+      err = "the intersection of the surfaces is not a closed curve";
+    else {
+      for (i=0; i<nres; i++)
+	res[i] = gts_surface_new(gts_surface_class(), gts_face_class(),
+				 gts_edge_class(), gts_vertex_class());
+      if (nres == 4)
+	for (i=0; i<4; i++)
+	  gts_surface_inter_boolean(si, res[i], parts[i]);
+      else if (*op == '+') {
+	gts_surface_inter_boolean(si, res[0], GTS_1_OUT_2);
+	gts_surface_inter_boolean(si, res[0], GTS_2_OUT_1);
+      } else if (*op == '*') {
+	gts_surface_inter_boolean(si, res[0], GTS_1_IN_2);
+	gts_surface_inter_boolean(si, res[0], GTS_2_IN_1);
+      } else {
+	/* the part of surface 2 inside 1 is added reversed */
+	GtsSurface *s = gts_surface_new(gts_surface_class(), gts_face_class(),
+					gts_edge_class(), gts_vertex_class());
+	gts_surface_inter_boolean(si, res[0], GTS_1_OUT_2);
+	gts_surface_inter_boolean(si, s, GTS_2_IN_1);
+	gts_surface_foreach_face(s, (GtsFunc) gts_triangle_revert, NULL);
+	gts_surface_merge(res[0], s);
+	gts_object_destroy(GTS_OBJECT(s));
+      }
+    }
+    gts_object_destroy(GTS_OBJECT(si));
+    gts_bb_tree_destroy(tree1, TRUE);
+    gts_bb_tree_destroy(tree2, TRUE);
+  }
+  /* the faces of the results are kept */
+  gts_object_destroy(GTS_OBJECT(s1));
+  gts_object_destroy(GTS_OBJECT(s2));
+  G_UNLOCK(gts);
+  Py_END_ALLOW_THREADS
+
+  if (err) {
+    PyErr_SetString(PyExc_ValueError, err);
+    return NULL;
+  }
+  for (i=0; i<nres; i++) {
+    /* this destroys res[i], also on failure */
+    ret[i] = surface_to_tuple(res[i]);
+    if (ret[i] == NULL) {
+      /* destroy the results that were not converted yet */
+      Py_BEGIN_ALLOW_THREADS
+      G_LOCK(gts);
+      for (i++; i<nres; i++)
+	gts_object_destroy(GTS_OBJECT(res[i]));
+      G_UNLOCK(gts);
+      Py_END_ALLOW_THREADS
+      for (i=0; i<4; i++)
+	Py_XDECREF(ret[i]);
+      return NULL;
+    }
+  }
+  if (nres == 1)
+    return ret[0];
+  return Py_BuildValue("(NNNN)", ret[0], ret[1], ret[2], ret[3]);
+}
+
+
+/********************************************************/
+/* The methods defined in this module */
+static PyMethodDef extension_methods[] = {
+  {"coarsen", (PyCFunction) coarsen, METH_VARARGS|METH_KEYWORDS, coarsen_doc},
+  {"refine", (PyCFunction) refine, METH_VARARGS|METH_KEYWORDS, refine_doc},
+  {"smooth", (PyCFunction) smooth, METH_VARARGS|METH_KEYWORDS, smooth_doc},
+  {"boolean", (PyCFunction) boolean, METH_VARARGS|METH_KEYWORDS, boolean_doc},
+  {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static struct PyModuleDef moduledef = {
+  PyModuleDef_HEAD_INIT,
+  "pyformex_gts",   // module name
+  NULL,      // module doc
+  -1,        //sizeof(struct module_state),
+  extension_methods,
+  NULL,
+  NULL,
+  NULL,
+  NULL
+};
+
+PyMODINIT_FUNC PyInit_pyformex_gts(void)
+{
+  PyObject* m;
+  m = PyModule_Create(&moduledef);
+  if (m == NULL)
+    return NULL;
+  PyModule_AddStringConstant(m,"__version__",__version__);
+  PyModule_AddStringConstant(m,"__doc__",__doc__);
+  import_array(); /* Get access to numpy array API */
+  return m;
+}
+
+/* End */
@@ -0,0 +1,74 @@
+#
+##
+##  SPDX-FileCopyrightText: © 2007-2023 Benedict Verhegghe <bverheg@gmail.com>
+##  SPDX-License-Identifier: GPL-3.0-or-later
+##
+##  This file is part of pyFormex 3.3  (Sun Mar 26 20:16:15 CEST 2023)
+##  pyFormex is a tool for generating, manipulating and transforming 3D
+##  geometrical models by sequences of mathematical operations.
+##  Home page: https://pyformex.org
+##  Project page: https://savannah.nongnu.org/projects/pyformex/
+##  Development: https://gitlab.com/bverheg/pyformex
+##  Distributed under the GNU General Public License version 3 or later.
+##
+##  This program is free software: you can redistribute it and/or modify
+##  it under the terms of the GNU General Public License as published by
+##  the Free Software Foundation, either version 3 of the License, or
+##  (at your option) any later version.
+##
+##  This program is distributed in the hope that it will be useful,
+##  but WITHOUT ANY WARRANTY; without even the implied warranty of
+##  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+##  GNU General Public License for more details.
+##
+##  You should have received a copy of the GNU General Public License
+##  along with this program.  If not, see http://www.gnu.org/licenses/.
+##
+"""Build the pyformex_gts extension module
+
+Use as::
+
+  python3 setup.py build
+  (sudo) python3 setup.py install
+
+Requires the GTS and glib development files and pkg-config.
+"""
+import subprocess
+import numpy as np
+from setuptools import setup, Extension
+
+
+def pkgconfig(option, *packages):
+    """Return the pkg-config flags for packages as a list of str"""
+    out = subprocess.run(['pkg-config', option, *packages], check=True,
+                         capture_output=True, text=True).stdout
+    return out.split()
+
+
+def strip(flags, prefix):
+    """Return the flags starting with prefix, with the prefix removed"""
+    return [f[len(prefix):] for f in flags if f.startswith(prefix)]
+
+
+cflags = pkgconfig('--cflags', 'glib-2.0', 'gts')
+libs = pkgconfig('--libs', 'glib-2.0', 'gts')
+
+setup(name="pyformex_gts",
+      version="3.4.dev0",
+      description="In-process GTS surface operations for pyFormex",
+      author="Benedict Verhegghe",
+      author_email="benedict.verhegghe@ugent.be",
+      url="http://pyformex.org",
+      long_description="""
+Python extension giving pyFormex direct access to the coarsen, refine,
+smooth and boolean operations of the GTS library, working on numpy arrays.
+See http://gts.sourceforge.net/
+""",
+      license="GNU GPL (General Public License)",
+      ext_modules=[Extension("pyformex_gts",
+                             ["pyformex_gts.c"],
+                             include_dirs=[np.get_include()] +
+                             strip(cflags, '-I'),
+                             library_dirs=strip(libs, '-L'),
+                             libraries=strip(libs, '-l'),
+                             )])
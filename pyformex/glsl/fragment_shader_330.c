@@ -30,7 +30,7 @@
 precision mediump float;
 #endif
 
-flat in vec4 pfragColor;
+flat in uint pfragId;
 in vec4 fragColor;
 in vec3 nNormal;        // normalized transformed normal
 in vec2 texCoord;
@@ -43,11 +43,12 @@ uniform vec3 objectColor;  // front and back color (1) or front color (2)
 
 uniform sampler2D tex;
 
-out vec4 fragmentColor;    // output fragment color
+layout(location = 0) out vec4 fragmentColor;  // output fragment color
+layout(location = 1) out uint fragmentId;     // output item id when picking
 
 void main(void) {
   if (picking) {
-      fragmentColor = pfragColor;
+    fragmentId = pfragId;
   } else if (useTexture > 0) {
     vec4 texColor = texture2D(tex,texCoord);
     if (texmode == 0) {
@@ -0,0 +1,126 @@
+//
+//
+//  This file is part of pyFormex
+//  pyFormex is a tool for generating, manipulating and transforming 3D
+//  geometrical models by sequences of mathematical operations.
+//  Home page: http://pyformex.org
+//  Project page:  http://savannah.nongnu.org/projects/pyformex/
+//  Copyright 2004-2012 (C) Benedict Verhegghe (benedict.verhegghe@ugent.be)
+//  Distributed under the GNU General Public License version 3 or later.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+
+// Tessellation control shader for Bezier patches
+//
+// The tessellation levels are set from the projected length of the
+// boundary rows of the control net, so that a tessellated edge spans
+// about tesspixels pixels on the screen. Patches whose control net
+// lies entirely outside the view frustum are culled.
+
+#version 400
+
+// DEGREE_U, DEGREE_V and PATCH_VERTICES are normally defined by shader.py
+#ifndef DEGREE_U
+#define DEGREE_U 3
+#define DEGREE_V 3
+#define PATCH_VERTICES 16
+#endif
+#define NU (DEGREE_U+1)
+#define NV (DEGREE_V+1)
+#define MAX_LEVEL 64.
+
+layout(vertices = PATCH_VERTICES) out;
+
+uniform mat4 modelview;
+uniform mat4 projection;
+uniform vec2 viewport;      // viewport size in pixels
+uniform float tesspixels;   // target length of a tessellated edge in pixels
+
+in vec4 ctrlCoords[];
+out vec4 patchCoords[];
+
+// Clip coordinates of control point k
+vec4 clip(int k)
+{
+  return projection * modelview * vec4(ctrlCoords[k].xyz / ctrlCoords[k].w, 1.);
+}
+
+// Screen position in pixels of control point k
+vec2 screen(int k)
+{
+  vec4 x = clip(k);
+  return 0.5 * viewport * x.xy / max(x.w, 1.e-6);
+}
+
+// Tessellation level for the row of n control points k0+i*stride
+float edgeLevel(int k0, int stride, int n)
+{
+  float len = 0.;
+  vec2 a = screen(k0);
+  for (int i=1; i<n; ++i) {
+    vec2 b = screen(k0+i*stride);
+    len += distance(a,b);
+    a = b;
+  }
+  return clamp(len / tesspixels, 1., MAX_LEVEL);
+}
+
+// Check whether the control net is completely outside one of the
+// side planes of the frustum. By the convex hull property, the
+// patch is then invisible as well.
+bool culled()
+{
+  bool left = true, right = true, bottom = true, top = true;
+  for (int k=0; k<PATCH_VERTICES; ++k) {
+    vec4 x = clip(k);
+    left = left && x.x < -x.w;
+    right = right && x.x > x.w;
+    bottom = bottom && x.y < -x.w;
+    top = top && x.y > x.w;
+  }
+  return left || right || bottom || top;
+}
+
+void main()
+{
+  patchCoords[gl_InvocationID] = ctrlCoords[gl_InvocationID];
+
+  if (gl_InvocationID == 0) {
+    if (culled()) {
+      gl_TessLevelOuter[0] = 0.;
+      gl_TessLevelOuter[1] = 0.;
+      gl_TessLevelOuter[2] = 0.;
+      gl_TessLevelOuter[3] = 0.;
+      gl_TessLevelInner[0] = 0.;
+      gl_TessLevelInner[1] = 0.;
+    } else {
+      // In the quads domain, the outer levels are those of the
+      // edges u=0, v=0, u=1, v=1 (in that order)
+      float e0 = edgeLevel(0, NU, NV);
+      float e1 = edgeLevel(0, 1, NU);
+      float e2 = edgeLevel(NU-1, NU, NV);
+      float e3 = edgeLevel(NU*(NV-1), 1, NU);
+      gl_TessLevelOuter[0] = e0;
+      gl_TessLevelOuter[1] = e1;
+      gl_TessLevelOuter[2] = e2;
+      gl_TessLevelOuter[3] = e3;
+      gl_TessLevelInner[0] = max(e1, e3);
+      gl_TessLevelInner[1] = max(e0, e2);
+    }
+  }
+}
+
+// End
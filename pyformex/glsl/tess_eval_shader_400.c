@@ -0,0 +1,218 @@
+//
+//
+//  This file is part of pyFormex
+//  pyFormex is a tool for generating, manipulating and transforming 3D
+//  geometrical models by sequences of mathematical operations.
+//  Home page: http://pyformex.org
+//  Project page:  http://savannah.nongnu.org/projects/pyformex/
+//  Copyright 2004-2012 (C) Benedict Verhegghe (benedict.verhegghe@ugent.be)
+//  Distributed under the GNU General Public License version 3 or later.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+
+// Tessellation evaluation shader for Bezier patches
+//
+// Evaluates the rational Bezier patch and its normal at the tessellation
+// coordinates and applies the same coloring and lighting as the vertex
+// shader, so that it can be combined with fragment_shader_330.
+
+#version 400
+
+// DEGREE_U, DEGREE_V are normally defined by shader.py
+#ifndef DEGREE_U
+#define DEGREE_U 3
+#define DEGREE_V 3
+#endif
+#define NU (DEGREE_U+1)
+#define NV (DEGREE_V+1)
+#define MAX_ORDER (NU > NV ? NU : NV)
+
+#define MAX_LIGHTS 4
+
+layout(quads, fractional_odd_spacing, ccw) in;
+
+in vec4 patchCoords[];
+
+uniform mat4 modelview;
+uniform mat4 projection;
+uniform mat3 normalstransform;
+uniform bool highlight;
+uniform bool picking;
+uniform bool alphablend;     // Switch transparency on/off
+uniform vec3 highlightColor; // Color used for highlighting
+
+uniform int drawface;        // Which side of the face to draw (0,1,2)
+uniform int useObjectColor;  // 0 = no, 1 = single color, 2 = twosided color
+uniform vec3 objectColor;    // front and back color (1) or front color (2)
+uniform vec3 objectBkColor;  // back color (2)
+uniform float alpha;       // Material opacity
+uniform float bkalpha;     // Material backside opacity
+
+uniform float ambient;     // Material ambient value
+uniform float diffuse;     // Material diffuse value
+uniform float specular;    // Material Intensity of reflection
+uniform float shininess;   // Material surface shininess
+
+uniform bool lighting;          // Are the lights on?
+uniform int nlights;            // Number of lights?  <= MAX_LIGHTS
+uniform vec3 ambicolor;                // Total ambient color
+uniform vec3 diffcolor[MAX_LIGHTS];    // Colors of diffuse light
+uniform vec3 speccolor[MAX_LIGHTS];    // Colors of reflected light
+uniform vec3 lightdir[MAX_LIGHTS];     // Light directions
+
+flat out uint pfragId;          // Element id when picking
+out vec4 fragColor;     // Final fragment color, including opacity
+out vec3 nNormal;       // normalized transformed normal
+out vec2 texCoord;      // Pass texture coordinate
+
+// Compute the Bernstein polynomials B of degree p at t, and their
+// derivatives dB. See The NURBS Book, A1.3. Requires p > 0.
+void bernstein(int p, float t, out float B[MAX_ORDER], out float dB[MAX_ORDER])
+{
+  float s = 1. - t;
+  float fp = float(p);
+  B[0] = 1.;
+  for (int j=1; j<MAX_ORDER; ++j) {
+    B[j] = 0.;
+  }
+  // degree p-1 polynomials
+  for (int j=1; j<p; ++j) {
+    float saved = 0.;
+    for (int r=0; r<j; ++r) {
+      float temp = B[r];
+      B[r] = saved + s*temp;
+      saved = t*temp;
+    }
+    B[j] = saved;
+  }
+  // derivatives of the degree p polynomials
+  dB[0] = -fp*B[0];
+  for (int i=1; i<p; ++i) {
+    dB[i] = fp*(B[i-1] - B[i]);
+  }
+  dB[p] = fp*B[p-1];
+  // degree p polynomials
+  float saved = 0.;
+  for (int r=0; r<p; ++r) {
+    float temp = B[r];
+    B[r] = saved + s*temp;
+    saved = t*temp;
+  }
+  B[p] = saved;
+}
+
+// Evaluate the point X and the (unnormalized) normal N of the patch at uv
+void evalPatch(vec2 uv, out vec3 X, out vec3 N)
+{
+  float Bu[MAX_ORDER], dBu[MAX_ORDER], Bv[MAX_ORDER], dBv[MAX_ORDER];
+  bernstein(DEGREE_U, uv.x, Bu, dBu);
+  bernstein(DEGREE_V, uv.y, Bv, dBv);
+
+  // homogeneous point and partial derivatives
+  vec4 S = vec4(0.), Su = vec4(0.), Sv = vec4(0.);
+  for (int j=0; j<NV; ++j) {
+    for (int i=0; i<NU; ++i) {
+      vec4 P = patchCoords[j*NU+i];
+      S += Bu[i]*Bv[j] * P;
+      Su += dBu[i]*Bv[j] * P;
+      Sv += Bu[i]*dBv[j] * P;
+    }
+  }
+  X = S.xyz / S.w;
+  vec3 Xu = (Su.xyz - X*Su.w) / S.w;
+  vec3 Xv = (Sv.xyz - X*Sv.w) / S.w;
+  N = cross(Xu, Xv);
+}
+
+void main()
+{
+  vec3 X, normal;
+  evalPatch(gl_TessCoord.xy, X, normal);
+  if (dot(normal, normal) < 1.e-30) {
+    // degenerate edge (e.g. a pole): take the normal slightly inside
+    vec3 Y;
+    evalPatch(mix(gl_TessCoord.xy, vec2(0.5), 1.e-3), Y, normal);
+  }
+
+  vec3 fragmentColor;
+  float fragmentAlpha;
+  // Set color
+  if (picking) {
+    pfragId = 0u;
+  } else {
+    if (highlight) {
+      fragmentColor = highlightColor;
+    } else if (useObjectColor == 2 && drawface == -1) {
+      fragmentColor = objectBkColor;
+    } else {
+      // Patches have no vertex colors
+      fragmentColor = objectColor;
+    }
+
+    // Add in lighting
+    if (highlight) {
+      fragColor = vec4(fragmentColor,1.);
+    } else {
+
+      if (lighting) {
+
+	nNormal = normalize(normalstransform * normal);
+
+        if (drawface == -1) {
+	  nNormal = -nNormal;
+	}
+
+	vec3 fcolor = fragmentColor;
+
+	// ambient
+	fragmentColor = fcolor * ambicolor * ambient;
+
+	// add diffuse and specular for each light
+	for (int i=0; i<MAX_LIGHTS; ++i) {
+	  if (i < nlights) {
+	    vec3 nlight = normalize(lightdir[i]);
+	    vec3 eyeDirection = normalize(vec3(0.,0.,1.));
+	    vec3 reflectionDirection = reflect(-nlight, nNormal);
+	    float nspecular = specular*pow(max(dot(reflectionDirection,eyeDirection), 0.0), shininess);
+	    float ndiffuse = diffuse * max(dot(nNormal,nlight),0.0);
+	    fragmentColor += (fcolor + diffcolor[i])/2. * ndiffuse;
+	    fragmentColor += (fcolor + speccolor[i])/2. * nspecular;
+	  }
+	}
+      } //lighting
+
+      // Add in opacity
+      if (alphablend) {
+	if (drawface == -1) {
+	  fragmentAlpha = bkalpha;
+	} else {
+	  fragmentAlpha = alpha;
+	}
+      }	else {
+	// No alpha blending: set to opaque
+      	fragmentAlpha = 1.;
+      }
+      fragColor = vec4(fragmentColor,fragmentAlpha);
+    }
+  }
+
+  // the patch parameters serve as texture coordinates
+  texCoord = gl_TessCoord.xy;
+
+  gl_Position = projection * modelview * vec4(X,1.0);
+}
+
+// End
@@ -0,0 +1,43 @@
+//
+//
+//  This file is part of pyFormex
+//  pyFormex is a tool for generating, manipulating and transforming 3D
+//  geometrical models by sequences of mathematical operations.
+//  Home page: http://pyformex.org
+//  Project page:  http://savannah.nongnu.org/projects/pyformex/
+//  Copyright 2004-2012 (C) Benedict Verhegghe (benedict.verhegghe@ugent.be)
+//  Distributed under the GNU General Public License version 3 or later.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+
+// Vertex shader for tessellated Bezier patches
+//
+// The vertices are the homogeneous control points (w*x,w*y,w*z,w) of
+// the Bezier patches. They are passed unchanged to the tessellation
+// control shader.
+
+#version 400
+
+in vec4 vertexCoords;
+
+out vec4 ctrlCoords;
+
+void main()
+{
+  ctrlCoords = vertexCoords;
+}
+
+// End
@@ -36,11 +36,14 @@ precision mediump float;
 #define MAX_LIGHTS 4
 
 in vec3 vertexCoords;
-in vec3 vertexNormal;
+in vec3 vertexNormal;       // xy only if normalformat == 2
 in vec4 vertexColor;
 in vec3 vertexOffset;       // offset for rendertype -1
 in vec2 vertexTexturePos;
-in vec4 pickColor;
+in int pickId;              // element id, if pickDivisor < 0
+in mat4 instanceTransform;  // per-instance transform (divisor 1),
+                            // rigid or uniformly scaled: it also
+                            // transforms the normals
 
 uniform bool pyformex;              // Is the shader being used in pyFormex
 uniform mat4 modelview;
@@ -50,6 +53,8 @@ uniform mat3 normalstransform;
 uniform float pointsize;
 uniform bool highlight;
 uniform bool picking;
+uniform int pickBase;        // id of the first pickable item
+uniform int pickDivisor;     // vertices per item; 0: constant; <0: pickId
 uniform bool alphablend;     // Switch transparency on/off
 uniform int rendertype;
 uniform vec3 offset3;        // offset for rendertype 1
@@ -63,6 +68,8 @@ uniform bool rgbamode;       // vertexColor has 4 components
 uniform float alpha;       // Material opacity
 uniform float bkalpha;     // Material backside opacity
 uniform int useTexture;    // 0: no texture, 1: single texture
+uniform int normalformat;  // 0: float, 1: int2101010, 2: octahedral
+uniform bool instancing;   // Use instanceTransform
 
 uniform float ambient;     // Material ambient value
 uniform float diffuse;     // Material diffuse value
@@ -76,18 +83,35 @@ uniform vec3 diffcolor[MAX_LIGHTS];    // Colors of diffuse light
 uniform vec3 speccolor[MAX_LIGHTS];    // Colors of reflected light
 uniform vec3 lightdir[MAX_LIGHTS];     // Light directions
 
-flat out vec4 pfragColor;       // Final fragment color when picking
+flat out uint pfragId;          // Item id when picking
 out vec4 fragColor;     // Final fragment color, including opacity
 out vec3 nNormal;       // normalized transformed normal
 out vec2 texCoord;      // Pass texture coordinate
 
+// Decode an octahedral encoded normal
+vec3 octDecode(vec2 e)
+{
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return normalize(n);
+}
+
 void main()
 {
   vec3 fragmentColor;
   float fragmentAlpha;
   // Set color
   if (picking) {
-      pfragColor = vec4(pickColor);
+    // Derive the item id from the vertex index
+    if (pickDivisor > 0) {
+      pfragId = uint(pickBase + gl_VertexID / pickDivisor);
+    } else if (pickDivisor < 0) {
+      pfragId = uint(pickBase + pickId);
+    } else {
+      pfragId = uint(pickBase);
+    }
   } else {
     if (highlight) {
       // Highlight color, currently hardwired yellow
@@ -110,7 +134,14 @@ void main()
 
       if (lighting) {
 
-	vec3 fTransformedVertexNormal = normalstransform * vertexNormal;
+	vec3 normal = vertexNormal;
+	if (normalformat == 2) {
+	  normal = octDecode(vertexNormal.xy);
+	}
+	if (instancing) {
+	  normal = mat3(instanceTransform) * normal;
+	}
+	vec3 fTransformedVertexNormal = normalstransform * normal;
 
 	nNormal = normalize(fTransformedVertexNormal);
 
@@ -169,6 +200,9 @@ void main()
 
   // Transforming the vertex coordinates
   vec4 position = vec4(vertexCoords,1.0);
+  if (instancing) {
+    position = instanceTransform * position;
+  }
 
   gl_Position = projection * modelview * position;
   if (rendertype == 1) {
@@ -2041,7 +2041,7 @@ def drawMarks(X, M, *, colors=None, prefix='', ontop=True, fuse=False,
     if fuse:
         # TODO: if multiple colors are used, we should also pick the
         # corrrect colors.
-        X, ind = X.fuse()
+        X, ind = X.fuse(method='hash')
         ind = Varray(ind.reshape(-1,1)).inverse()
         M = [','.join([str(M[i]) for i in row]) for row in ind]
     #print(colors, kargs)
@@ -393,9 +393,203 @@ def save_qt(filename, format, quality=-1, canvas=None, size=None,
 # if we have gl2ps, or when building docs
 if gl2ps or pf.sphinx :
 
+    # Maximum number of feedback buffer floats used by a single
+    # primitive: a triangle clipped by the 6 frustum planes has up to
+    # 9 vertices, each with 3 coordinates and 4 color components.
+    _gl2ps_prim_size = 2 + 9 * 7
+
+    _gl2ps_sort = {
+        'none': 'GL2PS_NO_SORT',
+        'simple': 'GL2PS_SIMPLE_SORT',
+        'bsp': 'GL2PS_BSP_SORT',
+    }
+
+
+    def _gl2ps_cullable(actor):
+        """Check that an actor can be exported in parts.
+
+        Only plain 3D actors drawn as points, lines or triangles can be
+        culled and split over chunks. Other actors, including instanced
+        ones, are exported whole.
+        """
+        from pyformex.opengl.gl import GL
+        if actor.trl or actor.rot or actor.trl0 or actor.children:
+            return False
+        for d in actor.drawable:
+            if (d.rendertype != 0 or d.counts is not None or d.vbo is None
+                or d.xbo is not None
+                or d.glmode not in (GL.GL_POINTS, GL.GL_LINES,
+                                    GL.GL_TRIANGLES)):
+                return False
+        return True
+
+
+    def _gl2ps_primitives(canvas, drawable, cull, minsize):
+        """Cull the primitives of a drawable for chunked gl2ps export.
+
+        Parameters
+        ----------
+        canvas: :class:`~opengl.canvas.Canvas`
+            The canvas being exported.
+        drawable: :class:`~opengl.drawable.Drawable`
+            A drawable accepted by :func:`_gl2ps_cullable`.
+        cull: tuple of str
+            The culling to apply: any of 'back', 'offscreen', 'subpixel'.
+        minsize: float
+            The size in pixels below which a primitive is sub-pixel.
+
+        Returns
+        -------
+        prims: int array (nprims,nplex)
+            The vertex numbers of the primitives that are kept.
+        depth: float array (nprims,)
+            The depth of the primitives in normalized device coordinates.
+        """
+        import numpy as np
+        from pyformex.opengl.gl import GL
+        nplex = {GL.GL_POINTS: 1, GL.GL_LINES: 2,
+                 GL.GL_TRIANGLES: 3}[drawable.glmode]
+        x = np.asarray(drawable.vbo.data, dtype=float).reshape(-1, 3)
+        if drawable.indices is not None:
+            prims = np.asarray(drawable.indices).reshape(-1, nplex)
+        else:
+            prims = np.arange(len(x)).reshape(-1, nplex)
+        # clip coordinates
+        m = np.dot(np.asarray(canvas.camera.modelview),
+                   np.asarray(canvas.camera.projection))
+        h = np.dot(np.column_stack([x, np.ones(len(x))]), m)[prims]
+        w = h[..., 3]
+        if 'offscreen' in cull:
+            # outside if all vertices are beyond the same frustum plane
+            out = np.zeros(len(prims), dtype=bool)
+            for j in range(3):
+                out |= (h[..., j] > w).all(axis=1)
+                out |= (h[..., j] < -w).all(axis=1)
+            prims, h, w = prims[~out], h[~out], w[~out]
+        front = (w > 0.).all(axis=1)
+        wp = np.where(w > 0., w, 1.)
+        depth = (h[..., 2] / wp).mean(axis=1)
+        xy = (h[..., :2] / wp[..., np.newaxis] + 1.) * 0.5 * \
+            np.asarray(canvas.camera.viewport[2:], dtype=float)
+        keep = np.ones(len(prims), dtype=bool)
+        if nplex == 3:
+            d1 = xy[:, 1] - xy[:, 0]
+            d2 = xy[:, 2] - xy[:, 0]
+            area = d1[:, 0] * d2[:, 1] - d1[:, 1] * d2[:, 0]
+            if 'back' in cull or drawable.cullface == 'back':
+                keep &= ~front | (area >= 0.)
+            if drawable.cullface == 'front':
+                keep &= ~front | (area <= 0.)
+        if 'subpixel' in cull and nplex > 1:
+            # keep only one sub-pixel primitive per pixel
+            small = front & (np.ptp(xy, axis=1) < minsize).all(axis=1)
+            if small.any():
+                ismall = np.where(small & keep)[0]
+                pix = np.floor(xy[ismall].mean(axis=1) / minsize)
+                _, first = np.unique(pix, axis=0, return_index=True)
+                keep[small] = False
+                keep[ismall[first]] = True
+        return prims[keep], depth[keep]
+
+
+    def _gl2ps_render_part(renderer, actor, drawable, prims):
+        """Render a subset of the primitives of a drawable"""
+        import numpy as np
+        from OpenGL.arrays.vbo import VBO
+        from pyformex.opengl.gl import GL
+        ibo = drawable.ibo
+        drawable.ibo = VBO(prims.astype(np.int32).ravel(),
+                           target=GL.GL_ELEMENT_ARRAY_BUFFER)
+        try:
+            GL.glDepthFunc(GL.GL_LESS)
+            renderer.setDefaults()
+            renderer.shader.loadUniforms(actor)
+            drawable.render(renderer)
+        finally:
+            drawable.ibo.delete()
+            drawable.ibo = ibo
+
+
+    def _gl2ps_render_chunked(canvas, chunksize, cull, minsize, stream):
+        """Render the canvas scene in bounded chunks to gl2ps.
+
+        Every chunk is rendered in its own gl2ps viewport, so that gl2ps
+        sorts and writes it at the end of the chunk, and the feedback
+        buffer and the primitive list never hold more than one chunk.
+        The 3D primitives are distributed over the chunks from back to
+        front, so that the painter ordering between chunks is preserved,
+        and those of the ontop actors come last. The actors that can not
+        be split are rendered whole with the normal 3D rendering, before
+        the chunks.
+
+        Returns the number of viewports that overflowed the feedback buffer.
+        """
+        import numpy as np
+        from pyformex.opengl.gl import GL
+        from pyformex.opengl.renderer import front, back
+        renderer = canvas.renderer
+        scene = canvas.scene
+        vp = [int(i) for i in canvas.camera.viewport]
+        noverflow = 0
+
+        def viewport(func, *args):
+            nonlocal noverflow
+            gl2ps.gl2psBeginViewport(vp)
+            func(*args)
+            if gl2ps.gl2psEndViewport() == gl2ps.GL2PS_OVERFLOW:
+                noverflow += 1
+            if stream:
+                gl2ps.gl2psFlushStream()
+
+        # Split the actors in parts
+        actors = [a for a in scene.actors + scene.annot3d
+                  if a.visible is not False]
+        whole = [a for a in actors if not _gl2ps_cullable(a)]
+        parts, prims, depth, ontop = [], [], [], []
+        for a in actors:
+            if a in whole:
+                continue
+            for d in a.drawable:
+                p, z = _gl2ps_primitives(canvas, d, cull, minsize)
+                parts.append((a, d))
+                prims.append(p)
+                depth.append(z)
+                ontop.append(np.full(len(z), bool(a.ontop)))
+        partid = np.concatenate(
+            [np.full(len(z), i) for i, z in enumerate(depth)] + [[]]
+        ).astype(int)
+        primid = np.concatenate(
+            [np.arange(len(z)) for z in depth] + [[]]).astype(int)
+        # far primitives first, the ontop actors after all others
+        order = np.lexsort((-np.concatenate(depth + [[]]),
+                            np.concatenate(ontop + [[]]).astype(bool)))
+
+        def render_chunk(sel):
+            renderer.loadMatrices()
+            GL.glEnable(GL.GL_DEPTH_TEST)
+            for i in np.unique(partid[sel]):
+                a, d = parts[i]
+                _gl2ps_render_part(renderer, a, d,
+                                   prims[i][primid[sel[partid[sel] == i]]])
+
+        renderer.shader.bind()
+        try:
+            viewport(renderer.renderBG, back(scene.backgrounds))
+            viewport(renderer.render2D, back(scene.decorations + scene.annot2d))
+            if whole:
+                viewport(renderer.render3D, whole)
+            for start in range(0, len(order), chunksize):
+                viewport(render_chunk, order[start:start+chunksize])
+            viewport(renderer.render2D, front(scene.annot2d + scene.decorations))
+            viewport(renderer.renderBG, front(scene.backgrounds))
+        finally:
+            renderer.shader.unbind()
+        return noverflow
+
+
     def save_gl2ps(filename, format=None, canvas=None, title='', producer='',
-               # viewport=None
-    ):
+                   *, chunksize=None, cull=('offscreen', 'subpixel'),
+                   minsize=1.0, sort='bsp', stream=True):
         """ Export the OpenGL rendering to PostScript/PDF/TeX format.
 
         Exporting OpenGL renderings to PostScript is based on the PS2GL
@@ -428,6 +622,32 @@ if gl2ps or pf.sphinx :
         producer: str, optional
             A producer string to be written in the image file. Default
             is a pyFormex identification.
+        chunksize: int, optional
+            If specified, the scene is exported in bounded memory: the
+            3D primitives are culled and fed to gl2ps in chunks of at most
+            this number of primitives, ordered back to front. Each chunk is
+            sorted and written on its own, with a feedback buffer sized
+            for one chunk. This is the mode to use for large models.
+            The default exports the whole scene at once, growing the
+            feedback buffer until everything fits.
+        cull: tuple of str
+            Only used with `chunksize`: the primitives to remove before
+            they reach the feedback buffer. Contains any of:
+
+            - 'offscreen': primitives completely outside the view,
+            - 'subpixel': of all the lines and triangles smaller than
+              `minsize` pixels, only one per `minsize` square is kept,
+            - 'back': back facing triangles. Only use this for closed
+              surfaces. Drawables that cull their back or front faces
+              in the rendering are always culled in the same way.
+        minsize: float
+            The size in pixels of a sub-pixel primitive.
+        sort: 'bsp' | 'simple' | 'none'
+            The sorting algorithm used by gl2ps. With `chunksize`, this
+            sorts the primitives within a chunk.
+        stream: bool
+            Only used with `chunksize`: if True (default), the output is
+            flushed to the file after each chunk.
 
         See Also
         --------
@@ -438,6 +658,8 @@ if gl2ps or pf.sphinx :
         from pyformex.opengl.gl import GL
 
         pf.debug(f"save_window_gl2ps", pf.DEBUG.IMAGE)
+        if canvas is None:
+            canvas = pf.canvas
         # make sure we have the current content displayed (on top)
         canvas.makeCurrent()
         canvas.raise_()
@@ -447,36 +669,47 @@ if gl2ps or pf.sphinx :
         filename = Path(filename)
         if format is None:
             format = filename.lsuffix.strip('.')
-        if format in imageFormats('gl2ps', 'w'):
-            pf.debug("Image format can be saved by gl2ps", pf.DEBUG.IMAGE)
-            filetype = _gl2ps_types[filetype]
+        if format not in imageFormats('gl2ps', 'w'):
+            raise ValueError(f"Image format {format} can not be saved by gl2ps")
+        pf.debug("Image format can be saved by gl2ps", pf.DEBUG.IMAGE)
+        filetype = _gl2ps_types[format]
+        sort = getattr(gl2ps, _gl2ps_sort[sort])
 
         fp = open(filename, "wb")
         if not title:
-            title = filename
+            title = str(filename)
         if not producer:
-            producer = pf.fullVersion()
-        # if not viewport:
-        #     viewport = GL.glGetIntegerv(GL.GL_VIEWPORT)
-        bufsize = 0
-        state = gl2ps.GL2PS_OVERFLOW
+            producer = _producer
         opts = ( gl2ps.GL2PS_SILENT |
                  gl2ps.GL2PS_SIMPLE_LINE_OFFSET |
                  gl2ps.GL2PS_USE_CURRENT_VIEWPORT
                  )
         ##| gl2ps.GL2PS_NO_BLENDING | gl2ps.GL2PS_OCCLUSION_CULL | gl2ps.GL2PS_BEST_ROOT
-        ##color = GL[[0.,0.,0.,0.]]
-        #print(f"VIEWPORT {viewport}")
-        #print(fp)
         viewport=None
-        while state == gl2ps.GL2PS_OVERFLOW:
-            bufsize += 1024*1024
-            gl2ps.gl2psBeginPage(title, _producer, viewport, filetype,
-                                 gl2ps.GL2PS_BSP_SORT, opts, GL.GL_RGBA,
+        if chunksize:
+            bufsize = chunksize * _gl2ps_prim_size + 1024*1024
+            gl2ps.gl2psBeginPage(title, producer, viewport, filetype,
+                                 sort, opts, GL.GL_RGBA,
                                  0, None, 0, 0, 0, bufsize, fp, '')
-            canvas.display()
+            noverflow = _gl2ps_render_chunked(canvas, chunksize, cull,
+                                              minsize, stream)
             canvas.glFinish()
             state = gl2ps.gl2psEndPage()
+            if noverflow:
+                pf.warning(f"{noverflow} parts of the scene did not fit in"
+                           f" the gl2ps buffer and have been lost")
+        else:
+            bufsize = 0
+            state = gl2ps.GL2PS_OVERFLOW
+            while state == gl2ps.GL2PS_OVERFLOW:
+                bufsize += 1024*1024
+                gl2ps.gl2psBeginPage(title, producer, viewport, filetype,
+                                     sort, opts, GL.GL_RGBA,
+                                     0, None, 0, 0, 0, bufsize, fp, '')
+                canvas.display()
+                canvas.glFinish()
+                state = gl2ps.gl2psEndPage()
+        gl2ps.gl2psCloseStream()
         fp.close()
         return 0
 
@@ -850,8 +1083,8 @@ def saveImage(filename=None,
                         break
 
 
-        elif tool == 'ps2gl':
-            sta = save_ps(pf.canvas, filename, filetype=format)
+        elif tool == 'gl2ps':
+            sta = save_gl2ps(filename, format, canvas=pf.canvas)
 
         if sta == 0 and extent != 'allvps':
             print(f"Image file {filename} written")
@@ -41,6 +41,7 @@ from pyformex.mesh import Mesh
 
 from pyformex.opengl import canvas
 from pyformex.opengl.gl import GL
+from pyformex.opengl.pickbuffer import PickBuffer, idPicking
 
 from pyformex import arraytools as at
 from pyformex.gui import QtCore, QtGui, QtOpenGL, QtWidgets
@@ -392,6 +393,10 @@ class QtCanvas(QtOpenGL.QGLWidget, canvas.Canvas):
         --------
         rgb: returns the canvas rendering as a numpy ndarray
         """
+        if picking and idPicking():
+            # The 330 shader renders the pick ids into the pick buffer
+            raise ValueError(
+                "With the 330 shader, use pickIds() instead of picking")
         self.makeCurrent()
         w, h = self.getSize()
         if resize:
@@ -442,7 +447,8 @@ class QtCanvas(QtOpenGL.QGLWidget, canvas.Canvas):
         remove_alpha: bool
             If True (default), the alpha channel is removed from the image.
         picking: bool
-            This argument is for internal use only.
+            This argument is for internal use only. It can not be used
+            with the 330 shader: see :meth:`pickIds`.
 
         Returns
         -------
@@ -482,11 +488,76 @@ class QtCanvas(QtOpenGL.QGLWidget, canvas.Canvas):
         return K
 
 
+    @staticmethod
+    def pickRegion(rect):
+        """Return the pixel region (x, y, w, h) picked by a rectangle"""
+        x0, y0, x1, y1 = rect
+        if (x0, y0) == (x1, y1):
+            return (x0, y0, 1, 1)
+        # Same pixels as with color picking: exclude the border
+        x1, y1 = max(x1, x0+2), max(y1, y0+2)
+        return (x0+1, y0+1, x1-x0-1, y1-y0-1)
+
+
+    def startPickIds(self, rect, obj_type='element'):
+        """Start the ID-buffer rendering and readback of a rectangle
+
+        This only queues the GL commands and returns at once. The ids
+        are collected by a later :meth:`pickIds` with the same arguments.
+        The interactive :meth:`pick` calls this when the rubber band
+        rectangle is released.
+
+        Parameters: see :meth:`pickIds`.
+        """
+        self.makeCurrent()
+        if self.pickbuffer is None:
+            self.pickbuffer = PickBuffer()
+        self.pickbuffer.start(self, obj_type, self.pickRegion(rect))
+
+
+    def pickIds(self, rect, obj_type='element'):
+        """Return the unique pick ids inside a rectangle
+
+        This uses ID-buffer picking on the GPU: only the rectangle
+        is rendered and read back. If the readback was started by
+        :meth:`startPickIds`, the events are processed until the
+        GPU is done, otherwise the readback is started now.
+
+        Parameters
+        ----------
+        rect: tuple of int
+            The rectangle (x0, y0, x1, y1), with y upwards. If x0==x1 and
+            y0==y1, the single pixel under the mouse is picked.
+        obj_type: str
+            The type of items to pick.
+
+        Returns
+        -------
+        uint32 array
+            The sorted unique ids of the items rendered inside rect.
+        """
+        region = self.pickRegion(rect)
+        if (self.pickbuffer is None or
+            self.pickbuffer.pending != (obj_type, region)):
+            self.startPickIds(rect, obj_type)
+        else:
+            # Keep the GUI alive, but do not start a new pick
+            while not self.pickbuffer.done():
+                QtCore.QThread.msleep(1)
+                pf.app.processEvents(
+                    QtCore.QEventLoop.ExcludeUserInputEvents)
+        self.makeCurrent()
+        return self.pickbuffer.result()
+
+
     def insideRect(self, rect=None, obj_type='element'):
         """Find collection of elements inside a rectangle"""
         if rect is None:
             rect = self.getRectangle()
         x0, y0, x1, y1 = rect
+        if idPicking():
+            return self.split_pickids(
+                self.pickIds(rect, obj_type), obj_type=obj_type)
         h = self.height()
         qim = self.image(picking=obj_type)
         if pf.debugon(pf.DEBUG.PICK):
@@ -660,6 +731,10 @@ class QtCanvas(QtOpenGL.QGLWidget, canvas.Canvas):
             x1 = min(max(self.statex, x), self.width())
             y1 = min(max(self.statey, y), self.height())
             self.rectangle = x0, y0, x1, y1
+            if (self.pick_mode is not None and self.pick_tool == 'pix'
+                and idPicking()):
+                # Start the GPU readback: pick() collects the ids
+                self.startPickIds(self.rectangle, self.pick_mode)
             self.interaction_busy = False
 
     def mouse_line(self, x, y, action):
@@ -30,8 +30,12 @@ This tries to load the compiled libraries, and replaces those that failed
 to load with the (slower) Python versions, if possible.
 """
 
+import os
+import sys
+
 import pyformex as pf
-__all__ = ['misc', 'nurbs', 'accelerated']
+__all__ = ['misc', 'nurbs', 'accelerated', 'setThreads', 'enableStats',
+           'stats', 'resetStats', 'printStats']
 
 misc = nurbs = None
 accelerated = []
@@ -78,6 +82,173 @@ if nurbs is None:
     pf.debug("Using the (slower) Python nurbs functions", pf.DEBUG.LIB)
     from pyformex.lib import nurbs_e as nurbs
 
+
+# Threading
+#
+# All compiled modules run their parallel loops on the one OpenMP thread
+# pool of the process, which is started on first use. The long running
+# functions release the GIL, so other Python threads keep running.
+
+nthreads = 0   # the requested number of threads (0 = OpenMP default)
+
+
+def defaultThreads():
+    """Return the configured number of threads for the compiled libraries
+
+    This is the value of the environment variable PYFORMEX_NTHREADS if
+    it is set, else the 'lib/nthreads' setting, else 0 (meaning: use
+    the OpenMP default).
+    """
+    n = os.environ.get('PYFORMEX_NTHREADS')
+    if n is None:
+        try:
+            n = pf.cfg['lib/nthreads']
+        except Exception:
+            n = None
+    try:
+        return max(int(n), 0)
+    except (TypeError, ValueError):
+        return 0
+
+
+def threadedModules():
+    """Return the loaded compiled modules with thread control"""
+    mods = accelerated + [sys.modules.get('pyformex.lib.clust_c')]
+    return [m for m in mods if hasattr(m, 'set_num_threads')]
+
+
+def setThreads(n=None, module=None):
+    """Set the number of threads used by the compiled libraries
+
+    Parameters
+    ----------
+    n: int, optional
+        The number of threads to use in the parallel loops. A value 0
+        uses the OpenMP default: the OMP_NUM_THREADS environment variable
+        or the number of processors. If not provided, the value from
+        :func:`defaultThreads` is used, or the previously set value if
+        `module` is specified.
+    module: module, optional
+        Only apply the setting to this module. This is used for
+        compiled modules that are loaded later, like clust_c.
+
+    Returns
+    -------
+    int
+        The requested number of threads.
+    """
+    global nthreads
+    if n is None:
+        n = nthreads if module else defaultThreads()
+    nthreads = max(int(n), 0)
+    mods = [module] if module else threadedModules()
+    for m in mods:
+        m.set_num_threads(nthreads)
+    return nthreads
+
+
+setThreads()
+
+
+# Statistics
+#
+# The compiled modules can record per function statistics: the number
+# of calls, the wall time, the bytes copied while converting the input
+# arrays, the scratch memory allocated and some algorithm counters.
+# They are off by default and cost nothing then.
+
+statsEnabled = False   # whether the statistics are enabled
+
+
+def statsModules():
+    """Return the loaded compiled modules that record statistics"""
+    return [m for m in threadedModules() if hasattr(m, 'stats')]
+
+
+def enableStats(on=True, module=None):
+    """Enable or disable the statistics of the compiled libraries
+
+    While enabled, the functions of the compiled modules are replaced
+    with instrumented versions. Only calls through the module attribute
+    (like ``misc.isosurface(...)``) are counted: a reference to a
+    function obtained before enabling the statistics keeps calling the
+    original function.
+
+    Parameters
+    ----------
+    on: bool
+        If True, enable the statistics, else disable them. The recorded
+        values are kept when disabling.
+    module: module, optional
+        Only apply the setting to this module. This is used for
+        compiled modules that are loaded later, like clust_c.
+
+    Returns
+    -------
+    bool
+        True if the statistics were enabled before the call.
+    """
+    global statsEnabled
+    prev = statsEnabled
+    if module is None:
+        statsEnabled = bool(on)
+        mods = statsModules()
+    else:
+        mods = [module]
+    for m in mods:
+        m.enable_stats(on)
+    return prev
+
+
+def stats():
+    """Return the statistics of the compiled libraries
+
+    Returns
+    -------
+    dict
+        A dict with keys 'module.function' for all functions that were
+        called while the statistics were enabled. The values are dicts
+        with the counters:
+
+        - calls: the number of calls,
+        - time: the cumulative wall time in seconds,
+        - copied: the number of bytes copied while converting the input
+          arguments to arrays of the required type and layout,
+        - scratch: the largest amount of scratch memory (in bytes)
+          in use during a single call,
+        - iters: the number of algorithm iterations (like those of the
+          energy minimization in clust.cluster),
+        - items: the number of output items (like the triangles of
+          misc.isosurface or the segments of misc.isoline).
+    """
+    res = {}
+    for m in statsModules():
+        name = m.__name__.split('.')[-1]
+        for f, d in m.stats().items():
+            res[f"{name}.{f}"] = d
+    return res
+
+
+def resetStats():
+    """Reset the statistics of the compiled libraries to zero"""
+    for m in statsModules():
+        m.reset_stats()
+
+
+def printStats(out=sys.stdout):
+    """Print a table with the statistics of the compiled libraries
+
+    The functions are sorted on decreasing time.
+    """
+    S = stats()
+    out.write(f"{'function':<40} {'calls':>8} {'time(s)':>10} "
+              f"{'copied':>10} {'scratch':>10} {'iters':>8} {'items':>10}\n")
+    for f, d in sorted(S.items(), key=lambda x: -x[1]['time']):
+        out.write(f"{f:<40} {d['calls']:>8} {d['time']:>10.4f} "
+                  f"{d['copied']:>10.0f} {d['scratch']:>10.0f} "
+                  f"{d['iters']:>8.0f} {d['items']:>10.0f}\n")
+
+
 pf.debug("Accelerated: %s" % accelerated, pf.DEBUG.LIB|pf.DEBUG.INFO)
 pf.debug(misc, pf.DEBUG.LIB)
 pf.debug(nurbs, pf.DEBUG.LIB)
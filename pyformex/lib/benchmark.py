@@ -0,0 +1,750 @@
+#
+##
+##  SPDX-FileCopyrightText: © 2007-2023 Benedict Verhegghe <bverheg@gmail.com>
+##  SPDX-License-Identifier: GPL-3.0-or-later
+##
+##  This file is part of pyFormex 3.3  (Sun Mar 26 20:16:15 CEST 2023)
+##  pyFormex is a tool for generating, manipulating and transforming 3D
+##  geometrical models by sequences of mathematical operations.
+##  Home page: https://pyformex.org
+##  Project page: https://savannah.nongnu.org/projects/pyformex/
+##  Development: https://gitlab.com/bverheg/pyformex
+##  Distributed under the GNU General Public License version 3 or later.
+##
+##  This program is free software: you can redistribute it and/or modify
+##  it under the terms of the GNU General Public License as published by
+##  the Free Software Foundation, either version 3 of the License, or
+##  (at your option) any later version.
+##
+##  This program is distributed in the hope that it will be useful,
+##  but WITHOUT ANY WARRANTY; without even the implied warranty of
+##  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+##  GNU General Public License for more details.
+##
+##  You should have received a copy of the GNU General Public License
+##  along with this program.  If not, see http://www.gnu.org/licenses/.
+##
+#
+"""Benchmarks for the compiled libraries in :mod:`pyformex.lib`.
+
+This times the functions of the compiled modules misc_c, nurbs_c and
+clust_c over a sweep of problem sizes, and reports the run time, the
+throughput (elements per second), the peak memory allocated by numpy
+during the call, and the growth of the process resident set size (which
+also includes the work space allocated in C). Where an emulation exists in misc_e or nurbs_e, it is
+timed as well (up to a smaller maximum size, since the emulations are
+slow), and its results are checked against those of the compiled version.
+
+The results can be saved in a JSON file and compared against a previously
+saved baseline. Timings more than a threshold slower than the baseline
+are reported as regressions.
+
+Usage::
+
+  python3 -m pyformex.lib.benchmark [OPTIONS] [PATTERN ...]
+
+Only the functions matching one of the PATTERNs (shell style, e.g.
+'misc.iso*') are run. Use --help to see the options. The GNUmakefile
+has targets 'benchbaseline' (save a new baseline in
+pyformex/lib/benchmark.json) and 'bench' (compare with that baseline).
+The baseline should be saved on the reference machine, with the
+libraries built from the release being compared against.
+The checked-in baseline pyformex/lib/benchmark.json is still missing:
+it holds no reference numbers yet. Until they are saved, the comparison
+with it prints an error saying so and fails.
+
+With --stats, the statistics of the compiled modules (see
+:func:`pyformex.lib.stats`) are recorded during the run and printed
+at the end: they show where the wall time goes, and how many bytes
+were copied converting the input arrays.
+"""
+import sys
+import os
+import time
+import json
+import fnmatch
+import argparse
+import platform
+import importlib
+import resource
+import tracemalloc
+
+import numpy as np
+
+#: The default sizes of the sweep
+SIZES = (10, 1000, 100000, 10000000)
+
+#: The default baseline file
+BASELINE = os.path.join(os.path.dirname(__file__), 'benchmark.json')
+
+_libs = {}
+
+
+def _lib(name):
+    """Load a library module, or return None if it is not available"""
+    if name not in _libs:
+        try:
+            _libs[name] = importlib.import_module('pyformex.lib.' + name)
+        except ImportError:
+            _libs[name] = None
+    return _libs[name]
+
+
+class Case():
+    """A benchmark case for a single library function.
+
+    Parameters
+    ----------
+    lib: str
+        The library: 'misc', 'nurbs' or 'clust'. The compiled function
+        is taken from lib + '_c', the emulation from lib + '_e'.
+    func: str
+        The name of the function.
+    setup: callable
+        A function setup(n, rng) returning a tuple with the arguments
+        for a problem of (about) size n.
+    emulated: bool
+        Whether the function is emulated with the same signature.
+    sizes: tuple of int
+        The sizes for which to run the function. Default is the sweep.
+    cmax: int
+        The maximum size for the compiled function.
+    emax: int
+        The maximum size for the emulation.
+    copy: tuple of int
+        Indices of arguments that are changed by the function. These
+        are copied (outside the timing) before each call.
+    output: callable
+        A function output(args, ret) returning the results to compare.
+        The default compares the return values.
+    """
+    def __init__(self, lib, func, setup, emulated=True, sizes=None,
+                 cmax=10**7, emax=10**4, copy=(), output=None):
+        self.lib = lib
+        self.func = func
+        self.setup = setup
+        self.emulated = emulated
+        self.sizes = sizes
+        self.cmax = cmax
+        self.emax = emax
+        self.copy = copy
+        self.output = output
+
+    @property
+    def name(self):
+        return f"{self.lib}.{self.func}"
+
+    def function(self, suffix):
+        mod = _lib(self.lib + suffix)
+        return getattr(mod, self.func, None) if mod else None
+
+    def args(self, args):
+        """Return the arguments for a call"""
+        return tuple(a.copy() if i in self.copy else a
+                     for i, a in enumerate(args))
+
+    def results(self, args, ret):
+        if self.output:
+            ret = self.output(args, ret)
+        return ret if isinstance(ret, tuple) else (ret,)
+
+
+CASES = []
+
+
+def case(lib, **kargs):
+    """Decorator registering a setup function as a benchmark Case.
+
+    The function name is the name of the setup function.
+    """
+    def decorator(setup):
+        CASES.append(Case(lib, setup.__name__, setup, **kargs))
+        return setup
+    return decorator
+
+
+def _reset_rss_peak():
+    """Reset the peak resident set size of the process (Linux only)"""
+    try:
+        with open('/proc/self/clear_refs', 'w') as f:
+            f.write('5')
+    except OSError:
+        pass
+
+
+def _rss():
+    """Return the current and peak resident set size of the process in bytes
+
+    The values are read from /proc/self/status. Where this is not
+    available, both are the peak RSS since the start of the process,
+    from resource.getrusage.
+    """
+    try:
+        with open('/proc/self/status') as f:
+            d = dict(line.split(':', 1) for line in f
+                     if line.startswith(('VmRSS:', 'VmHWM:')))
+        return int(d['VmRSS'].split()[0]) * 1024, \
+            int(d['VmHWM'].split()[0]) * 1024
+    except (OSError, KeyError, ValueError):
+        rss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+        if sys.platform != 'darwin':
+            rss *= 1024
+        return rss, rss
+
+
+def measure(func, args, case, mintime):
+    """Time a function call and measure its peak memory.
+
+    Returns a tuple (time, peak, rss, ret) with the best time of repeated
+    calls (until mintime has been spent), the peak memory (bytes)
+    allocated by numpy and Python during a single call, the growth of
+    the peak resident set size during that call, and its return value.
+
+    The numpy allocations are seen by tracemalloc, but the work space
+    that the compiled functions allocate with malloc is not: that only
+    shows in the resident set size. The RSS peak is reset before the
+    call on Linux; elsewhere only a growth beyond the previous peak of
+    the process is seen. The RSS includes the tracemalloc overhead and
+    has page granularity, so it is only meaningful for large sizes.
+    """
+    a = case.args(args)
+    _reset_rss_peak()
+    rss0 = _rss()[0]
+    tracemalloc.start()
+    ret = func(*a)
+    peak = tracemalloc.get_traced_memory()[1]
+    tracemalloc.stop()
+    rss = max(_rss()[1] - rss0, 0)
+    best, total, nrep = np.inf, 0., 0
+    while (total < mintime or nrep < 3) and nrep < 10000:
+        a = case.args(args)
+        t0 = time.perf_counter()
+        func(*a)
+        t = time.perf_counter() - t0
+        best = min(best, t)
+        total += t
+        nrep += 1
+        if total > 10 * mintime:
+            break
+    return best, peak, rss, case.results(args, ret)
+
+
+def _comparable(a):
+    """Turn a result in a float array, or None if it is not numeric"""
+    try:
+        return np.asarray(a, dtype=np.float64)
+    except (TypeError, ValueError):
+        return None
+
+
+def check(res1, res2, rtol=1e-5, atol=1e-5):
+    """Check that two sets of results are the same.
+
+    Only the common leading results are compared: some emulations return
+    additional values.
+    """
+    for r1, r2 in zip(res1, res2):
+        a1, a2 = _comparable(r1), _comparable(r2)
+        if a1 is None or a2 is None:
+            continue
+        if a1.shape != a2.shape:
+            return False
+        if not np.allclose(a1, a2, rtol=rtol, atol=atol, equal_nan=True):
+            return False
+    return True
+
+
+def run(cases, sizes, mintime=0.1, emulate=True, out=sys.stdout):
+    """Run the benchmark cases over the sizes.
+
+    Returns a dict with the results, keyed on 'lib.func:n'.
+    """
+    results = {}
+    rng = np.random.default_rng(12345)
+    out.write(f"{'function':34s}{'n':>10s}{'time':>11s}{'Mel/s':>9s}"
+              f"{'peak MB':>9s}{'rss MB':>9s}{'emu time':>11s}"
+              f"{'speedup':>9s}  check\n")
+    for c in cases:
+        fc, fe = c.function('_c'), c.function('_e')
+        if fc is None:
+            out.write(f"{c.name:34s} skipped: no compiled library\n")
+            continue
+        if not c.emulated:
+            fe = None
+        for n in c.sizes or sizes:
+            if n > c.cmax:
+                continue
+            args = c.setup(n, rng)
+            t, peak, rss, res = measure(fc, args, c, mintime)
+            r = {'time': t, 'peak': peak, 'rss': rss,
+                 'rate': n/t if t > 0 else 0.}
+            line = (f"{c.name:34s}{n:10d}{t:11.3e}{r['rate']*1e-6:9.2f}"
+                    f"{peak/2**20:9.2f}{rss/2**20:9.2f}")
+            if emulate and fe is not None and n <= c.emax:
+                te, _, _, rese = measure(fe, args, c, mintime)
+                r['emu_time'] = te
+                r['check'] = check(res, rese)
+                line += (f"{te:11.3e}{te/t:9.1f}  "
+                         f"{'ok' if r['check'] else 'FAIL'}")
+            out.write(line + '\n')
+            out.flush()
+            results[f"{c.name}:{n}"] = r
+    return results
+
+
+def compare(results, baseline, threshold, out=sys.stdout):
+    """Compare results with a baseline.
+
+    Returns the number of regressions: timings that are more than
+    a factor threshold slower than in the baseline. Results without a
+    baseline value are counted and reported, but are not regressions.
+    If the baseline has no results at all, an error is reported and
+    None is returned.
+    """
+    base = baseline.get('results')
+    if not base:
+        out.write("\nERROR: The baseline has no results: no reference "
+                  "numbers have been saved yet.\nNo regressions can be "
+                  "detected. Save a baseline on the reference machine "
+                  "with 'make benchbaseline'.\n")
+        return None
+    nreg = nmiss = 0
+    out.write(f"\nComparison with baseline of {baseline.get('date', '?')}"
+              f" on {baseline.get('machine', '?')}\n")
+    for key, r in results.items():
+        if key not in base:
+            nmiss += 1
+            continue
+        ratio = r['time'] / base[key]['time']
+        if ratio > threshold:
+            nreg += 1
+            out.write(f"REGRESSION {key:40s} {ratio:6.2f} x slower\n")
+        elif ratio < 1. / threshold:
+            out.write(f"improved   {key:40s} {1/ratio:6.2f} x faster\n")
+    out.write(f"{nreg} regressions\n")
+    if nmiss:
+        out.write(f"{nmiss} results have no baseline: save a new baseline "
+                  f"with 'make benchbaseline'\n")
+    return nreg
+
+
+###########################################################################
+## The benchmark cases
+##
+## Each setup function creates the arguments for a problem of size n.
+## The function name is the name of the library function.
+
+
+def _points(n, rng, dtype=np.float32):
+    return rng.random((n, 3)).astype(dtype)
+
+
+def _grid(n, ndim):
+    """Side of a grid with about n points in ndim dimensions"""
+    return max(int(round(n ** (1./ndim))), 3)
+
+
+def _sphere(n, ndim):
+    """Distance field of a sphere on a grid with about n points"""
+    m = _grid(n, ndim)
+    x = np.indices((m,)*ndim, dtype=np.float32) - 0.5*(m-1)
+    return np.sqrt((x*x).sum(axis=0)).astype(np.float32), 0.3*m
+
+
+def _elems(n, rng, nplex=4):
+    """Random elements with a total of about n element nodes"""
+    nelems = max(n // nplex, 1)
+    nnod = max(nelems, 2)
+    return rng.integers(0, nnod, (nelems, nplex)).astype(np.int32), nnod
+
+
+def _directions(n, rng):
+    """Normalized vectors, forming clusters of close directions"""
+    v = rng.random((max(n // 4, 1), 3)) - 0.5
+    v = np.repeat(v, 4, axis=0)[:n] + 1.e-4 * rng.random((n, 3))
+    return (v / np.sqrt((v*v).sum(axis=-1, keepdims=True))).astype(np.float32)
+
+
+def _fuse_points(n, rng):
+    """Points with duplicates, sorted on a hash code"""
+    m = max(int((n/2) ** (1./3)), 1)
+    x = rng.integers(0, m, (n, 3)).astype(np.float32)
+    val = (x[:, 0] * m + x[:, 1]) * m + x[:, 2]
+    srt = np.argsort(val, kind='stable')
+    return x[srt], val[srt].astype(np.int32)
+
+
+@case('misc', emax=10**4, copy=(2, 3),
+      output=lambda args, ret: (args[2], args[3]))
+def coordsfuse(n, rng):
+    x, val = _fuse_points(n, rng)
+    return (x, val, np.ones(n, dtype=np.int32), np.arange(n, dtype=np.int32),
+            np.float32(1.e-5))
+
+
+@case('misc', emax=10**4)
+def hashfuse(n, rng):
+    x, _ = _fuse_points(n, rng)
+    return x, 1.e-5, 1
+
+
+@case('misc', emax=10**5)
+def nodalsum(n, rng):
+    elems, nnod = _elems(n, rng)
+    val = rng.random(elems.shape + (3,)).astype(np.float32)
+    return val, elems, nnod
+
+
+@case('misc', emax=10**6)
+def nodalindex(n, rng):
+    elems, nnod = _elems(n, rng)
+    return elems, nnod
+
+
+@case('misc', emax=10**5)
+def nodalreduce(n, rng):
+    elems, nnod = _elems(n, rng)
+    val = rng.random(elems.shape + (3,)).astype(np.float32)
+    offsets, index = _lib('misc_e').nodalindex(elems, nnod)
+    return val, offsets, index, 1
+
+
+@case('misc', cmax=10**6, emax=10**3, copy=(0,),
+      output=lambda args, ret: args[0])
+def averageDirection(n, rng):
+    return _directions(n, rng), 0.9
+
+
+@case('misc', cmax=10**6, emax=10**3, copy=(0,),
+      output=lambda args, ret: args[0])
+def averageDirectionIndexed(n, rng):
+    vec = _directions(n, rng)
+    return vec, rng.permutation(n).astype(np.int32), 0.9
+
+
+@case('misc', emax=10**4, copy=(0,), output=lambda args, ret: args[0])
+def averageDirectionGroups(n, rng):
+    vec = _directions(n, rng)
+    offsets = np.append(np.arange(0, n, 8), n).astype(np.int32)
+    return vec, offsets, None, 0.9
+
+
+@case('misc', emax=10**5)
+def minmaxblocks(n, rng):
+    return _sphere(n, 3)[0], 8
+
+
+@case('misc', emax=10**4)
+def isoline(n, rng):
+    return _sphere(n, 2)
+
+
+@case('misc', emax=10**4)
+def isolines(n, rng):
+    data, level = _sphere(n, 2)
+    return data, np.linspace(0.2, 0.8, 4) * 2*level
+
+
+def _sorted_triangles(args, ret):
+    """Triangles sorted in a unique order"""
+    tri = np.asarray(ret).reshape(-1, 9)
+    return tri[np.lexsort(tri.T[::-1])]
+
+
+@case('misc', emax=10**4, output=_sorted_triangles)
+def isosurface(n, rng):
+    data, level = _sphere(n, 3)
+    return data, level, 0
+
+
+@case('misc', emax=10**7)
+def transform(n, rng):
+    mat = rng.random((3, 3))
+    return _points(n, rng), mat, [1., 2., 3.]
+
+
+@case('misc', emax=10**7)
+def bbox(n, rng):
+    return _points(n, rng),
+
+
+@case('misc', emax=10**7)
+def distanceFromPlane(n, rng):
+    return _points(n, rng), [0.5, 0.5, 0.5], [1., 2., 3.]
+
+
+@case('misc', emax=10**7)
+def distanceFromLine(n, rng):
+    return _points(n, rng), [0.5, 0.5, 0.5], [1., 2., 3.]
+
+
+def _sphere_surface(n):
+    """A closed triangulated unit sphere with about n triangles"""
+    m = max(int(np.sqrt(n/2)), 3)
+    u, v = np.meshgrid(np.linspace(0., 2*np.pi, m+1)[:-1],
+                       np.linspace(0., np.pi, m+1)[1:-1])
+    x = np.stack([np.cos(u)*np.sin(v), np.sin(u)*np.sin(v), np.cos(v)], axis=-1)
+    x = np.concatenate([[[0., 0., 1.]], x.reshape(-1, 3), [[0., 0., -1.]]])
+    i = np.arange(m)
+    j = (i+1) % m
+    tri = [np.stack([np.zeros(m, dtype=int), 1+i, 1+j], axis=1)]
+    for r in range(m-2):
+        a, b = 1+r*m, 1+(r+1)*m
+        tri.append(np.stack([a+i, b+i, b+j], axis=1))
+        tri.append(np.stack([a+i, b+j, a+j], axis=1))
+    last = len(x)-1
+    tri.append(np.stack([last-m+j, last-m+i, np.full(m, last)], axis=1))
+    return x.astype(np.float32), np.concatenate(tri).astype(np.int32)
+
+
+@case('misc', emax=10**3)
+def insideSurface(n, rng):
+    x, elems = _sphere_surface(n)
+    return x, elems, 2.4*_points(n, rng)-1.2, 0
+
+
+def _curve(nc, p=3, nd=4):
+    """A clamped B-spline curve with nc control points of degree p"""
+    P = np.random.default_rng(1).random((nc, nd))
+    U = np.concatenate([np.zeros(p), np.linspace(0., 1., nc-p+1), np.ones(p)])
+    return P, U
+
+
+def _surface(n, p=3, nd=4):
+    ns = max(_grid(n, 2) // 4, p+1)
+    P = np.random.default_rng(2).random((ns, ns, nd))
+    U = np.concatenate([np.zeros(p), np.linspace(0., 1., ns-p+1), np.ones(p)])
+    return P, U
+
+
+@case('nurbs', sizes=(1,))
+def binomial(n, rng):
+    return 20, 7
+
+
+@case('nurbs', emulated=False)
+def horner(n, rng):
+    return rng.random((3, 4)), rng.random(n)
+
+
+@case('nurbs', sizes=(1,))
+def bernstein(n, rng):
+    return 2, 5, 0.3
+
+
+@case('nurbs', sizes=(1,))
+def allBernstein(n, rng):
+    return 5, 0.3
+
+
+@case('nurbs', emulated=False, sizes=(1,))
+def basisDerivs(n, rng):
+    P, U = _curve(10)
+    return U, 0.35, 3, 6, 2
+
+
+@case('nurbs', emulated=False)
+def curvePoints(n, rng):
+    P, U = _curve(20)
+    return P, U, rng.random(n)
+
+
+@case('nurbs', emulated=False)
+def curveDerivs(n, rng):
+    P, U = _curve(20)
+    return P, U, rng.random(n), 2
+
+
+@case('nurbs', emulated=False)
+def curvesDerivs(n, rng):
+    P, U = _curve(20)
+    P = np.stack([P] * 100)
+    return P, U, np.sort(rng.random(max(n // 100, 1))), 1
+
+
+@case('nurbs', emulated=False, cmax=10**6)
+def curveDecompose(n, rng):
+    return _curve(max(n, 4))
+
+
+@case('nurbs', emulated=False, cmax=10**6)
+def bezierExtraction(n, rng):
+    P, U = _curve(max(n, 4))
+    return U, 3
+
+
+@case('nurbs', emulated=False, cmax=10**6)
+def curveKnotRefine(n, rng):
+    P, U = _curve(20)
+    return P, U, np.sort(rng.random(n))
+
+
+@case('nurbs', emulated=False, sizes=(1,))
+def curveKnotRemove(n, rng):
+    P, U = _curve(10)
+    Uv, Um = np.unique(U, return_counts=True)
+    return P, Uv, Um.astype(np.int32), 3, 1, 1.
+
+
+@case('nurbs', cmax=10**5, emax=10**3)
+def curveDegreeElevate(n, rng):
+    P, U = _curve(max(n, 4))
+    return P, U, 1
+
+
+@case('nurbs', emulated=False, cmax=10**5)
+def curveDegreeReduce(n, rng):
+    return _curve(max(n, 4))
+
+
+@case('nurbs', cmax=10**4, emax=10**3)
+def curveGlobalInterpolationMatrix(n, rng):
+    return np.linspace(0., 1., max(n, 4)), 3, 0, 0
+
+
+@case('nurbs', emax=10**3)
+def curveGlobalInterpolation(n, rng):
+    nc = max(n, 4)
+    return rng.random((nc, 3)), np.linspace(0., 1., nc), 3
+
+
+@case('nurbs', cmax=10**5, emax=10**3)
+def cubicSplineInterpolation(n, rng):
+    nc = max(n, 4)
+    Q = rng.random((nc, 3))
+    U = np.concatenate([np.zeros(3), np.linspace(0., 1., nc), np.ones(3)])
+    return Q, np.array([1., 0., 0.]), np.array([0., 1., 0.]), U
+
+
+@case('nurbs', emulated=False)
+def surfacePoints(n, rng):
+    P, U = _surface(n)
+    return P, U, U, rng.random((n, 2))
+
+
+@case('nurbs', emulated=False)
+def surfaceGridPoints(n, rng):
+    P, U = _surface(n)
+    m = _grid(n, 2)
+    return P, U, U, np.linspace(0., 1., m), np.linspace(0., 1., m)
+
+
+@case('nurbs', emulated=False, cmax=10**6)
+def surfaceDerivs(n, rng):
+    P, U = _surface(n)
+    return P, U, U, rng.random((n, 2)), 1, 1
+
+
+def _grid_mesh(n):
+    """A triangulated structured grid with about n points.
+
+    Returns the arguments for :func:`clust_c.cluster`, except
+    nclus and maxiter.
+    """
+    m = _grid(n, 2)
+    x = np.indices((m, m)).reshape(2, -1).T
+    cent = np.column_stack([x, np.zeros(m*m)]).astype(np.float32)
+    area = np.ones(m*m, dtype=np.float32)
+    # the 6 neighbors in a grid with diagonals in direction (1,1)
+    shifts = [(1, 0), (1, 1), (0, 1), (-1, 0), (-1, -1), (0, -1)]
+    neigh = np.full((m*m, 6), -1, dtype=np.int32)
+    for k, (i, j) in enumerate(shifts):
+        xi, xj = x[:, 0]+i, x[:, 1]+j
+        ok = (xi >= 0) & (xi < m) & (xj >= 0) & (xj < m)
+        neigh[ok, k] = xi[ok]*m + xj[ok]
+    # put the -1 entries at the end
+    neigh = -np.sort(-neigh, axis=1)
+    nneigh = (neigh >= 0).sum(axis=1).astype(np.int32)
+    edges = np.column_stack([np.repeat(np.arange(m*m), 6), neigh.reshape(-1)])
+    edges = edges[(edges[:, 1] > edges[:, 0])].astype(np.int32)
+    return neigh, nneigh, area, cent, edges
+
+
+@case('clust', emulated=False, cmax=10**6)
+def cluster(n, rng):
+    return _grid_mesh(n) + (max(n // 10, 2), 20)
+
+
+###########################################################################
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        prog='python3 -m pyformex.lib.benchmark',
+        description="Benchmark the pyFormex compiled libraries against "
+        "their emulations.")
+    parser.add_argument('patterns', nargs='*', metavar='PATTERN',
+                        help="only run the functions matching one of the "
+                        "patterns, e.g. 'misc.iso*'")
+    parser.add_argument('--sizes', type=lambda s: [int(float(i)) for i in
+                                                   s.split(',')],
+                        default=SIZES, help="comma separated list of sizes")
+    parser.add_argument('--max', type=float, default=None,
+                        help="skip the sizes above this value")
+    parser.add_argument('--mintime', type=float, default=0.1,
+                        help="minimal time spent per measurement (s)")
+    parser.add_argument('--noemu', action='store_true',
+                        help="do not run the emulations")
+    parser.add_argument('--save', metavar='FILE',
+                        help="save the results as a baseline in FILE")
+    parser.add_argument('--baseline', metavar='FILE', nargs='?',
+                        const=BASELINE,
+                        help="compare with the baseline in FILE "
+                        f"(default {BASELINE})")
+    parser.add_argument('--threshold', type=float, default=1.25,
+                        help="slowdown factor reported as a regression")
+    parser.add_argument('--list', action='store_true',
+                        help="list the benchmark cases")
+    parser.add_argument('--stats', action='store_true',
+                        help="print the statistics of the compiled modules")
+    opts = parser.parse_args(argv)
+
+    cases = [c for c in CASES if not opts.patterns or any(
+        fnmatch.fnmatch(c.name, p) for p in opts.patterns)]
+    if opts.list:
+        for c in cases:
+            print(c.name)
+        return 0
+    sizes = [n for n in opts.sizes if opts.max is None or n <= opts.max]
+    if opts.stats:
+        for c in cases:
+            mod = _lib(c.lib + '_c')
+            if hasattr(mod, 'enable_stats'):
+                mod.enable_stats(True)
+    results = run(cases, sizes, opts.mintime, not opts.noemu)
+    if opts.stats:
+        from pyformex import lib
+        print()
+        lib.printStats()
+
+    nfail = sum(1 for r in results.values() if r.get('check') is False)
+    if nfail:
+        print(f"\n{nfail} checks FAILED")
+    nreg = 0
+    if opts.baseline:
+        if os.path.exists(opts.baseline):
+            with open(opts.baseline) as f:
+                nreg = compare(results, json.load(f), opts.threshold)
+            if nreg is None:
+                # an empty baseline is an error, not a pass
+                nreg = 1
+        else:
+            print(f"\nNo baseline file {opts.baseline}")
+    if opts.save:
+        with open(opts.save, 'w') as f:
+            json.dump({
+                'date': time.strftime('%Y-%m-%d %H:%M:%S'),
+                'machine': f"{platform.node()} {platform.machine()} "
+                f"{os.cpu_count()} cpus",
+                'python': platform.python_version(),
+                'numpy': np.__version__,
+                'results': results,
+            }, f, indent=1)
+        print(f"Results saved in {opts.save}")
+    return 1 if nfail or nreg else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
+
+# End
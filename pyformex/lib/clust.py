@@ -34,8 +34,13 @@ from scipy import sparse
 
 from pyformex import arraytools as at
 from pyformex.trisurface import TriSurface
+from pyformex import lib
 from pyformex.lib import clust_c
 
+lib.setThreads(module=clust_c)
+if lib.statsEnabled:
+    lib.enableStats(module=clust_c)
+
 
 class Clustering():
     """Uniform point clustering based on ACVD.
@@ -63,11 +68,34 @@ class Clustering():
         self._edges = S.edges.astype(at.Int)
         self._opt = _opt
 
-    def cluster(self, nclus, maxiter=100):
-        """Cluster points """
+    def cluster(self, nclus, maxiter=100, init=None):
+        """Cluster points
+
+        Parameters
+        ----------
+        nclus: int
+            The targeted number of clusters.
+        maxiter: int
+            The maximum number of iterations of the energy minimization.
+        init: bool | int :term:`array_like`, optional
+            An initial clustering to start from: an int array with a
+            cluster number for each point, or True to start from the
+            current clusters. The clusters are merged or split if their
+            number differs from `nclus`. If not provided, the clustering
+            starts from scratch.
+
+        Returns
+        -------
+        clusters: int array
+            The cluster number of each point.
+        ndisc: int
+            The number of isolated points.
+        """
+        if init is True:
+            init = self.clusters
         clusters, ndisc = clust_c.cluster(
             self._neigh, self._nneigh, self._area, self._wcent,
-            self._edges,  nclus, maxiter)
+            self._edges,  nclus, maxiter, init)
         if clusters.min() < 0:
             raise ValueError("Cluster optimization failed: {ndisc} isolated clusters")
         clusters = at.renumberClusters(clusters)
@@ -75,6 +103,30 @@ class Clustering():
         self.nclus = clusters.max() + 1
         return clusters, ndisc
 
+    def levels(self, nclus, maxiter=100):
+        """Cluster points at multiple resolutions
+
+        Parameters
+        ----------
+        nclus: list of int
+            The targeted numbers of clusters of the subsequent levels.
+            Each level starts from the clustering of the previous one.
+        maxiter: int
+            The maximum number of iterations per level.
+
+        Returns
+        -------
+        list of int arrays
+            The clusters of each level. The Clustering itself is left
+            with the clusters of the last level.
+        """
+        result = []
+        init = None
+        for n in nclus:
+            init, ndisc = self.cluster(n, maxiter, init)
+            result.append(init)
+        return result
+
     def create_mesh(self, flipnorm=True):
         """ Generates mesh from clusters """
         if flipnorm:
@@ -29,11 +29,15 @@
 #define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
 #include <numpy/arrayobject.h>
 #include <stdio.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "pflib.h"
 
 // cast pointers to avoid warnings
 #define PYARRAY_DATA(p) PyArray_DATA((PyArrayObject *)p)
 #define PYARRAY_DIMS(p) PyArray_DIMS((PyArrayObject *)p)
-#define PYARRAY_FROM_OTF(p,q,r) (PyArrayObject *) PyArray_FROM_OTF(p,q,r)
+#define PYARRAY_FROM_OTF(p,q,r) (PyArrayObject *) pf_from_otf(p,q,r)
 
 #define print PySys_WriteStderr
 
@@ -109,37 +113,41 @@ static void print_clusters(char *s, int *clusters, int npoints)
 }
 #endif
 
-/**************************************************** init_clusters ****/
-/* Initialize clusters */
+/**************************************************** grow_clusters ****/
+/* Grow clusters of about equal area */
 /* args:
-   int clusters (npoints)
+   int clusters (npoints): the points to be assigned should be -1
    int neigh (npoints, maxneigh)
    int nneigh (npoints)
    float area (npoints)
-   int nclus
-   int npoints
+   int subset (nsub): the points to be assigned, or NULL for all points
+   int nsub
+   int first: number of the first cluster
+   int nclus: number of clusters to grow
    int maxneigh
+
+   The clusters are grown greedily over the free neighbors, starting
+   from the first free point. Only points with clusters == -1 are
+   assigned, so the growth stays within the subset if all other points
+   have been assigned before.
 */
-static void init_clusters(int *clusters, int *neigh, int *nneigh,
-			  float *area, int nclus, int npoints, int maxneigh)
+static void grow_clusters(int *clusters, int *neigh, int *nneigh,
+			  float *area, int *subset, int nsub, int first,
+			  int nclus, int maxneigh)
 {
     float tarea, carea;
     int item;
-    int i, j, k, checkitem, c, c_prev;
+    int i, j, k, pt, checkitem, c, c_prev;
     float ctarea;
     int lstind = 0;
     int i_items_new, i_items_old;
 
-    int *items = calloc(npoints*2, sizeof(int));
-
-    /* Initialize clusters */
-    for (i=0; i<npoints; ++i)
-	clusters[i] = -1;
+    int *items = calloc(nsub*2, sizeof(int));
 
     /* Total mesh size */
     float area_remain = 0;
-    for (i=0; i<npoints; ++i)
-        area_remain += area[i];
+    for (j=0; j<nsub; ++j)
+        area_remain += area[subset ? subset[j] : j];
 
     /* Assign clusters */
     ctarea = area_remain/nclus;
@@ -150,17 +158,18 @@ static void init_clusters(int *clusters, int *neigh, int *nneigh,
 
         /* Get starting index (the first free face in list) */
         i_items_new = 0;
-	for (j=lstind; j<npoints; ++j) {
-            if (clusters[j] == -1) {
-                carea += area[j];
-                items[0] = j;
-                clusters[j] = i;
+	for (j=lstind; j<nsub; ++j) {
+	    pt = subset ? subset[j] : j;
+            if (clusters[pt] == -1) {
+                carea += area[pt];
+                items[0] = pt;
+                clusters[pt] = first+i;
                 lstind = j;
                 break;
 	    }
 	}
 
-        if (j == npoints)
+        if (j == nsub)
             break;
 
         /* While there are new items to be added */
@@ -190,7 +199,7 @@ static void init_clusters(int *clusters, int *neigh, int *nneigh,
                         /* if allowable, add to cluster */
                         if (area[item] + carea < tarea) {
                             carea += area[item];
-                            clusters[item] = i;
+                            clusters[item] = first+i;
                             items[c*2+i_items_new] = item;
                             c += 1;
 			}
@@ -204,6 +213,28 @@ static void init_clusters(int *clusters, int *neigh, int *nneigh,
 }
 
 
+/**************************************************** init_clusters ****/
+/* Initialize clusters */
+/* args:
+   int clusters (npoints)
+   int neigh (npoints, maxneigh)
+   int nneigh (npoints)
+   float area (npoints)
+   int nclus
+   int npoints
+   int maxneigh
+*/
+static void init_clusters(int *clusters, int *neigh, int *nneigh,
+			  float *area, int nclus, int npoints, int maxneigh)
+{
+    /* Initialize clusters */
+    for (int i=0; i<npoints; ++i)
+	clusters[i] = -1;
+    grow_clusters(clusters, neigh, nneigh, area, NULL, npoints, 0, nclus,
+		  maxneigh);
+}
+
+
 /**************************************************** grow_null ****/
 /* Grow clusters to include null faces */
 /* args:
@@ -345,6 +376,96 @@ static int disconnected(int *clusters, int *neigh, int *nneigh,
 
 /**************************************************** minimize_energy ****/
 /* Minimize cluster energy */
+/* The energy of a cluster is |sgamma|^2 / srho, where sgamma is the
+   sum of the weighted centroids and srho the sum of the areas of its
+   points. The energy is maximized by moving points across the cluster
+   boundaries, one edge at a time.
+
+   The edges are processed in parallel, in contiguous blocks per thread.
+   As the edges are numbered along the mesh, the threads mostly work on
+   separate groups of clusters. A cluster pair is only updated by the
+   thread holding the locks of both clusters. Edges whose clusters are
+   locked by another thread are skipped and retried in the next
+   iteration. Each move still increases the total energy, so the
+   iterations converge as in the serial case, though the final
+   clustering may depend on the number of threads.
+*/
+
+#define CLUST_PARALLEL_MIN 100000
+
+/* Energy of the cluster with sums sg, rho, after adding (sign=1)
+   or removing (sign=-1) a point with weighted centroid c and area a */
+static inline float cluster_energy(float *sg, float rho, float *c, float a,
+				   float sign)
+{
+    double x = sg[0] + sign*c[0];
+    double y = sg[1] + sign*c[1];
+    double z = sg[2] + sign*c[2];
+    return (x*x + y*y + z*z) / (rho + sign*a);
+}
+
+/* Move point face from cluster clusA to clusB, with the new
+   cluster energies eA and eB */
+static inline void move_point(int face, int clusA, int clusB,
+			      float eA, float eB, int *clusters,
+			      float *area, float *cent, float *sgamma,
+			      float *srho, int *cluscount, float *energy)
+{
+#pragma omp atomic write
+    clusters[face] = clusB;
+    cluscount[clusA] -= 1;
+    cluscount[clusB] += 1;
+    srho[clusB] += area[face];
+    srho[clusA] -= area[face];
+    for (int k=0; k<3; ++k) {
+	sgamma[3*clusB+k] += cent[3*face+k];
+	sgamma[3*clusA+k] -= cent[3*face+k];
+    }
+    energy[clusA] = eA;
+    energy[clusB] = eB;
+}
+
+/* Check the edge (face_a, face_b) between clusters clusA and clusB
+   and move one of the points if that increases the energy.
+   Returns 1 if a point was moved, else 0. */
+static int minimize_edge(int face_a, int face_b, int clusA, int clusB,
+			 int *clusters, float *area, float *sgamma,
+			 float *cent, float *srho, int *cluscount,
+			 float *energy)
+{
+    float eA = 0., eB = 0., eAwB = 0., eBnB = 0., eAnA = 0., eBwA = 0.;
+    float *gA = sgamma+3*clusA, *gB = sgamma+3*clusB;
+    float *cA = cent+3*face_a, *cB = cent+3*face_b;
+    int moveA = cluscount[clusA] > 1;   /* face_a can be removed from A */
+    int moveB = cluscount[clusB] > 1;   /* face_b can be removed from B */
+    float eorig = energy[clusA] + energy[clusB];
+
+    if (moveB) {
+	/* Energy with both items assigned to cluster A */
+	eAwB = cluster_energy(gA, srho[clusA], cB, area[face_b], 1.);
+	eBnB = cluster_energy(gB, srho[clusB], cB, area[face_b], -1.);
+	eA = eAwB + eBnB;
+    }
+    if (moveA) {
+	/* Energy with both items assigned to cluster B */
+	eAnA = cluster_energy(gA, srho[clusA], cA, area[face_a], -1.);
+	eBwA = cluster_energy(gB, srho[clusB], cA, area[face_a], 1.);
+	eB = eAnA + eBwA;
+    }
+    /* select the largest case */
+    if (moveB && eA > eorig && (!moveA || eA > eB)) {
+	move_point(face_b, clusB, clusA, eBnB, eAwB, clusters,
+		   area, cent, sgamma, srho, cluscount, energy);
+	return 1;
+    }
+    if (moveA && eB > eorig && (!moveB || eB > eA)) {
+	move_point(face_a, clusA, clusB, eAnA, eBwA, clusters,
+		   area, cent, sgamma, srho, cluscount, energy);
+	return 1;
+    }
+    return 0;
+}
+
 /* args:
    int edges (nedges, 2)
    int clusters (npoints,)
@@ -357,221 +478,329 @@ static int disconnected(int *clusters, int *neigh, int *nneigh,
    int nedges
    int nclus
    int maxiter
+
+   Returns the number of iterations done.
 */
 
-static void minimize_energy(int *edges, int *clusters, float *area,
+static int minimize_energy(int *edges, int *clusters, float *area,
 			    float *sgamma, float *cent, float *srho,
 			    int *cluscount, float *energy,
 			    int nedges, int nclus, int maxiter)
 {
-    int face_a, face_b, clusA, clusB;
-    float areaface_a, centA0, centA1, centA2;
-    float areaface_b, centB0, centB1, centB2;
-    float eA, eB, eorig, eAwB, eBnB, eAnA, eBwA;
-    int nchange = 1;
+    int nchange = 1, nskip = 0;
     int niter = 0;
     int i;
 
     /* Allocate modified arrays */
     uint8 *mod1 = calloc(nclus, sizeof(uint8));
     uint8 *mod2 = calloc(nclus, sizeof(uint8));
+#ifdef _OPENMP
+    omp_lock_t *lock = malloc(nclus * sizeof(omp_lock_t));
+    for (i=0; i<nclus; ++i)
+	omp_init_lock(lock+i);
+#endif
     /* start all as modified */
     for (i=0; i<nclus; ++i)
 	mod2[i] = 1;
-    while (nchange > 0 && niter < maxiter) {
-	/* print("minimize ITERATION %d\n", niter); */
+    while ((nchange > 0 || nskip > 0) && niter < maxiter) {
 	/* Reset modification arrays */
         for (i=0; i<nclus; ++i) {
             mod1[i] = mod2[i];
             mod2[i] = 0;
 	}
-        nchange = 0;
-	for (i=0; i<nedges; ++i) {
+        nchange = nskip = 0;
+#pragma omp parallel reduction(+:nchange,nskip) num_threads(pf_threads()) \
+    if (nedges >= CLUST_PARALLEL_MIN)
+	{
+	/* A single thread can do without the locks */
+#ifdef _OPENMP
+	int locking = omp_get_num_threads() > 1;
+#else
+	int locking = 0;
+#endif
+#pragma omp for schedule(static)
+	for (int i=0; i<nedges; ++i) {
             /* Get the two clusters sharing an edge */
-            face_a = edges[2*i];
-            face_b = edges[2*i+1];
-            clusA = clusters[face_a];
-            clusB = clusters[face_b];
+	    int face_a = edges[2*i];
+	    int face_b = edges[2*i+1];
+	    int clusA, clusB, moved = 0, skipped = 1;
+#pragma omp atomic read
+	    clusA = clusters[face_a];
+#pragma omp atomic read
+	    clusB = clusters[face_b];
 	    /* If edge shares two different clusters and at least one
 	       has been modified since last iteration */
-            if (clusA != clusB && (mod1[clusA] == 1 || mod1[clusB] == 1)) {
-		/* print("mod %d: %d, %d, %d, %d\n", */
-		/*       i, face_a, face_b, clusA, clusB); */
-                /* Verify that face can be removed from cluster */
-                if (cluscount[clusA] > 1 && cluscount[clusB] > 1) {
-		    /* Can be removed from both A and B */
-                    areaface_a = area[face_a];
-                    centA0 = cent[3*face_a];
-                    centA1 = cent[3*face_a+1];
-                    centA2 = cent[3*face_a+2];
-                    areaface_b = area[face_b];
-                    centB0 = cent[3*face_b];
-                    centB1 = cent[3*face_b+1];
-                    centB2 = cent[3*face_b+2];
-                    /* Current energy */
-                    eorig = energy[clusA] + energy[clusB];
-                    /* Energy with both items assigned to cluster A */
-                    eAwB = (pow(sgamma[3*clusA] + centB0, 2) +
-                            pow(sgamma[3*clusA+1] + centB1, 2) +
-                            pow(sgamma[3*clusA+2] + centB2, 2)) /
-			(srho[clusA] + areaface_b);
-		    eBnB = (pow(sgamma[3*clusB] - centB0, 2) +
-                            pow(sgamma[3*clusB+1] - centB1, 2) +
-                            pow(sgamma[3*clusB+2] - centB2, 2)) /
-			(srho[clusB] - areaface_b);
-                    eA = eAwB + eBnB;
-		    /* Energy with both items assigned to clusterB */
-                    eAnA = (pow(sgamma[3*clusA] - centA0, 2) +
-                            pow(sgamma[3*clusA+1] - centA1, 2) +
-                            pow(sgamma[3*clusA+2] - centA2, 2)) /
-			(srho[clusA] - areaface_a);
-                    eBwA = (pow(sgamma[3*clusB] + centA0, 2) +
-                            pow(sgamma[3*clusB+1] + centA1, 2) +
-                            pow(sgamma[3*clusB+2] + centA2, 2)) /
-			(srho[clusB] + areaface_a);
-                    eB = eAnA + eBwA;
-
-                    /* select the largest case (most negative) */
-                    if (eA > eorig && eA > eB) {
-			/* Show clusters as modified */
-                        mod2[clusA] = 1;
-                        mod2[clusB] = 1;
-                        nchange += 1;
-			/* reassign */
-                        clusters[face_b] = clusA;
-                        cluscount[clusB] -= 1;
-                        cluscount[clusA] += 1;
-			/* Update cluster A mass and centroid */
-                        srho[clusA] += areaface_b;
-                        sgamma[3*clusA] += centB0;
-                        sgamma[3*clusA+1] += centB1;
-                        sgamma[3*clusA+2] += centB2;
-
-                        srho[clusB] -= areaface_b;
-                        sgamma[3*clusB] -= centB0;
-                        sgamma[3*clusB+1] -= centB1;
-                        sgamma[3*clusB+2] -= centB2;
-
-                        /* Update cluster energy */
-                        energy[clusA] = eAwB;
-                        energy[clusB] = eBnB;
-		    }
-		    /* if the energy contribution of both to B is less
-		       than the original and to cluster A */
-                    else if (eB > eorig && eB > eA) {
-			/* Show clusters as modified */
-                        mod2[clusA] = 1;
-                        mod2[clusB] = 1;
-                        nchange += 1;
-			/* reassign */
-                        clusters[face_a] = clusB;
-                        cluscount[clusA] -= 1;
-                        cluscount[clusB] += 1;
-                        /* Add item A to cluster B */
-                        srho[clusB] += areaface_a;
-                        sgamma[3*clusB] += centA0;
-                        sgamma[3*clusB+1] += centA1;
-                        sgamma[3*clusB+2] += centA2;
-			/* Remove item A from cluster A */
-                        srho[clusA] -= areaface_a;
-                        sgamma[3*clusA] -= centA0;
-                        sgamma[3*clusA+1] -= centA1;
-                        sgamma[3*clusA+2] -= centA2;
-                        /* Update cluster energy */
-                        energy[clusA] = eAnA;
-                        energy[clusB] = eBwA;
-		    }
-		}
-		else if (cluscount[clusA] > 1) {
-                    /* Can be removed from A */
-                    areaface_a = area[face_a];
-                    centA0 = cent[3*face_a];
-                    centA1 = cent[3*face_a+1];
-                    centA2 = cent[3*face_a+2];
-		    /* Current energy */
-                    eorig =  energy[clusA] + energy[clusB];
-                    /* Energy with both items assigned to clusterB */
-                    eAnA = (pow(sgamma[3*clusA] - centA0, 2) +
-                            pow(sgamma[3*clusA+1] - centA1, 2) +
-                            pow(sgamma[3*clusA+2] - centA2, 2)) /
-			(srho[clusA] - areaface_a);
-                    eBwA = (pow(sgamma[3*clusB] + centA0, 2) +
-                            pow(sgamma[3*clusB+1] + centA1, 2) +
-                            pow(sgamma[3*clusB+2] + centA2, 2)) /
-			(srho[clusB] + areaface_a);
-                    eB = eAnA + eBwA;
-                    /* Compare energy contributions */
-                    if (eB > eorig) {
-			/* Flag clusters as modified */
-                        mod2[clusA] = 1;
-                        mod2[clusB] = 1;
-                        nchange += 1;
-			/* reassign */
-                        clusters[face_a] = clusB;
-                        cluscount[clusA] -= 1;
-                        cluscount[clusB] += 1;
-			/* Add item A to cluster A */
-                        srho[clusB] += areaface_a;
-                        sgamma[3*clusB] += centA0;
-                        sgamma[3*clusB+1] += centA1;
-                        sgamma[3*clusB+2] += centA2;
-                        /* Remove item A from cluster A */
-                        srho[clusA] -= areaface_a;
-                        sgamma[3*clusA] -= centA0;
-                        sgamma[3*clusA+1] -= centA1;
-                        sgamma[3*clusA+2] -= centA2;
-                        /* Update cluster energy */
-                        energy[clusA] = eAnA;
-                        energy[clusB] = eBwA;
-		    }
-		}
-                else if (cluscount[clusB] > 1) {
-                    /* Can be removed from B */
-		    areaface_b = area[face_b];
-                    centB0 = cent[3*face_b];
-                    centB1 = cent[3*face_b+1];
-                    centB2 = cent[3*face_b+2];
-                    /* Current energy */
-                    eorig =  energy[clusA] + energy[clusB];
-                    /* Energy with both items assigned to cluster A */
-                    eAwB = (pow(sgamma[3*clusA] + centB0, 2) +
-                            pow(sgamma[3*clusA+1] + centB1, 2) +
-                            pow(sgamma[3*clusA+2] + centB2, 2)) /
-			(srho[clusA] + areaface_b);
-                    eBnB = (pow(sgamma[3*clusB] - centB0, 2) +
-                            pow(sgamma[3*clusB+1] - centB1, 2) +
-                            pow(sgamma[3*clusB+2] - centB2, 2)) /
-			(srho[clusB] - areaface_b);
-                    eA = eAwB + eBnB;
-                    /* If moving face B reduces cluster energy */
-                    if (eA > eorig) {
-                        mod2[clusA] = 1;
-                        mod2[clusB] = 1;
-                        nchange+=1;
-			/* reassign */
-                        clusters[face_b] = clusA;
-                        cluscount[clusB] -= 1;
-                        cluscount[clusA] += 1;
-                        /* Update cluster A mass and centroid */
-                        srho[clusA] += areaface_b;
-                        sgamma[3*clusA] += centB0;
-                        sgamma[3*clusA+1] += centB1;
-                        sgamma[3*clusA+2] += centB2;
-                        srho[clusB] -= areaface_b;
-                        sgamma[3*clusB] -= centB0;
-                        sgamma[3*clusB+1] -= centB1;
-                        sgamma[3*clusB+2] -= centB2;
-                        /* Update cluster energy */
-                        energy[clusA] = eAwB;
-                        energy[clusB] = eBnB;
+            if (clusA == clusB || !(mod1[clusA] || mod1[clusB]))
+		continue;
+	    if (!locking) {
+		skipped = 0;
+		moved = minimize_edge(face_a, face_b, clusA, clusB,
+				      clusters, area, sgamma, cent,
+				      srho, cluscount, energy);
+	    }
+#ifdef _OPENMP
+	    /* Lock both clusters, or skip and retry later */
+	    else {
+		int lo = clusA < clusB ? clusA : clusB;
+		int hi = clusA < clusB ? clusB : clusA;
+		if (omp_test_lock(lock+lo)) {
+		    if (omp_test_lock(lock+hi)) {
+			/* The points may have moved before we got the locks */
+			if (clusters[face_a] == clusA &&
+			    clusters[face_b] == clusB) {
+			    skipped = 0;
+			    moved = minimize_edge(face_a, face_b, clusA, clusB,
+						  clusters, area, sgamma, cent,
+						  srho, cluscount, energy);
+			}
+			omp_unset_lock(lock+hi);
 		    }
+		    omp_unset_lock(lock+lo);
 		}
 	    }
+#endif
+	    nchange += moved;
+	    nskip += skipped;
+	    if (moved || skipped) {
+		/* Flag clusters as modified (or to be retried) */
+#pragma omp atomic write
+		mod2[clusA] = 1;
+#pragma omp atomic write
+		mod2[clusB] = 1;
+	    }
+	}
 	}
 	niter += 1;
     }
+#ifdef _OPENMP
+    for (i=0; i<nclus; ++i)
+	omp_destroy_lock(lock+i);
+    free(lock);
+#endif
     free(mod1);
     free(mod2);
+    return niter;
+}
+
+
+/**************************************************** merge_clusters ****/
+/* Merge clusters into a smaller number of clusters */
+/* args:
+   int clusters (npoints): cluster numbers in the range 0..nclus0-1
+   float area (npoints)
+   int edges (nedges, 2)
+   int nclus0: current number of clusters
+   int nclus: new number of clusters (< nclus0)
+   int npoints
+   int nedges
+   int maxiter
+
+   float sgamma (nclus, 3), srho (nclus): the sums of the merged clusters
+
+   The current clusters are clustered themselves, using the same
+   energy as for the points, on the adjacency graph of the clusters.
+   This gives compact merged clusters that only need a few iterations
+   at the point level. The cluster sums of the merged clusters are the
+   sums of those of the cluster graph, so they are passed back in
+   sgamma and srho. Returns 1 if they are valid, or 0 if they have to
+   be recomputed from the points.
+*/
+static int optimize_cluster(int *clusters, int *neigh, int *nneigh,
+			     float *area, float *cent, int *edges,
+			     int npoints, int maxneigh, int nedges,
+			     int nclus, int maxiter, int nclus0,
+			     float *sgamma, float *srho, int *sums,
+			     int *niters);
+
+static int merge_clusters(int *clusters, float *area, float *cent,
+			  int *edges, int nclus0, int nclus, int npoints,
+			  int nedges, int maxiter, float *sgamma, float *srho)
+{
+    int sums;
+    int i, j, k, a, b, maxn, ncedges;
+    float *carea = calloc(nclus0, sizeof(float));
+    float *ccent = calloc(nclus0*3, sizeof(float));
+    int *ptr = calloc(nclus0+1, sizeof(int));
+    int *nadj = calloc(nclus0, sizeof(int));
+    int *mark = malloc(nclus0 * sizeof(int));
+    int *adj, *cneigh, *cedges, *cclus;
+
+    for (i=0; i<npoints; ++i) {
+	j = clusters[i];
+	carea[j] += area[i];
+	ccent[3*j] += cent[3*i];
+	ccent[3*j+1] += cent[3*i+1];
+	ccent[3*j+2] += cent[3*i+2];
+    }
+
+    /* Adjacency of the clusters, in CSR format, with duplicates */
+    for (i=0; i<nedges; ++i) {
+	a = clusters[edges[2*i]];
+	b = clusters[edges[2*i+1]];
+	if (a != b) {
+	    ptr[a+1] += 1;
+	    ptr[b+1] += 1;
+	}
+    }
+    for (j=0; j<nclus0; ++j)
+	ptr[j+1] += ptr[j];
+    adj = malloc(ptr[nclus0] * sizeof(int));
+    for (i=0; i<nedges; ++i) {
+	a = clusters[edges[2*i]];
+	b = clusters[edges[2*i+1]];
+	if (a != b) {
+	    adj[ptr[a]+nadj[a]++] = b;
+	    adj[ptr[b]+nadj[b]++] = a;
+	}
+    }
+    /* Remove the duplicates */
+    maxn = 0;
+    for (j=0; j<nclus0; ++j)
+	mark[j] = -1;
+    for (j=0; j<nclus0; ++j) {
+	int n = 0;
+	for (k=ptr[j]; k<ptr[j]+nadj[j]; ++k)
+	    if (mark[adj[k]] != j) {
+		mark[adj[k]] = j;
+		adj[ptr[j]+n++] = adj[k];
+	    }
+	nadj[j] = n;
+	if (n > maxn)
+	    maxn = n;
+    }
+    /* Neighbors and edges of the cluster graph */
+    cneigh = malloc(nclus0 * (maxn > 0 ? maxn : 1) * sizeof(int));
+    cedges = malloc(ptr[nclus0] * sizeof(int));
+    ncedges = 0;
+    for (j=0; j<nclus0; ++j)
+	for (k=0; k<nadj[j]; ++k) {
+	    b = adj[ptr[j]+k];
+	    cneigh[maxn*j+k] = b;
+	    if (j < b) {
+		cedges[2*ncedges] = j;
+		cedges[2*ncedges+1] = b;
+		ncedges += 1;
+	    }
+	}
+
+    /* Cluster the clusters; unassigned ones are left at -1 */
+    cclus = malloc(nclus0 * sizeof(int));
+    optimize_cluster(cclus, cneigh, nadj, carea, ccent, cedges, nclus0,
+		     maxn, ncedges, nclus, maxiter, 0, sgamma, srho, &sums,
+		     NULL);
+    for (i=0; i<npoints; ++i)
+	clusters[i] = cclus[clusters[i]];
+
+    free(carea);
+    free(ccent);
+    free(ptr);
+    free(nadj);
+    free(mark);
+    free(adj);
+    free(cneigh);
+    free(cedges);
+    free(cclus);
+    return sums;
+}
+
+
+/**************************************************** split_clusters ****/
+/* Split clusters into a larger number of clusters */
+/* args:
+   int clusters (npoints): cluster numbers in the range 0..nclus0-1
+   int neigh (npoints, maxneigh)
+   int nneigh (npoints)
+   float area (npoints)
+   int nclus0: current number of clusters
+   int nclus: new number of clusters (> nclus0)
+   int npoints
+   int maxneigh
+
+   Each cluster is split in a number of parts proportional to its area,
+   by growing clusters of about equal area inside it. Points that are
+   not reached by the growth are left at -1.
+*/
+typedef struct {
+    float frac;
+    int index;
+} Remainder;
+
+/* Sort Remainders in descending order of frac */
+static int cmp_remainder(const void *a, const void *b)
+{
+    float fa = ((const Remainder *)a)->frac, fb = ((const Remainder *)b)->frac;
+    return (fa < fb) - (fa > fb);
+}
+
+static void split_clusters(int *clusters, int *neigh, int *nneigh,
+			   float *area, int nclus0, int nclus, int npoints,
+			   int maxneigh)
+{
+    int i, j, n;
+    double total = 0.;
+    float *carea = calloc(nclus0, sizeof(float));
+    int *parts = malloc(nclus0 * sizeof(int));
+    Remainder *order = malloc(nclus0 * sizeof(Remainder));
+    int *ptr = calloc(nclus0+1, sizeof(int));
+    int *pts = malloc(npoints * sizeof(int));
+    int *pos = calloc(nclus0, sizeof(int));
+
+    for (i=0; i<npoints; ++i)
+	carea[clusters[i]] += area[i];
+    for (j=0; j<nclus0; ++j)
+	total += carea[j];
+
+    /* Number of parts per cluster, by the largest remainder method,
+       with at least one part per cluster */
+    n = 0;
+    for (j=0; j<nclus0; ++j) {
+	double x = carea[j] / total * nclus;
+	parts[j] = (int) x;
+	order[j].frac = x - parts[j];
+	order[j].index = j;
+	if (parts[j] < 1) {
+	    parts[j] = 1;
+	    order[j].frac = -1.;
+	}
+	n += parts[j];
+    }
+    qsort(order, nclus0, sizeof(Remainder), cmp_remainder);
+    for (j=0; n<nclus && j<nclus0; ++j, ++n)
+	parts[order[j].index] += 1;
+    for (j=nclus0-1; n>nclus && j>=0; --j)
+	if (parts[order[j].index] > 1) {
+	    parts[order[j].index] -= 1;
+	    --n;
+	}
+
+    /* Points of each cluster */
+    for (i=0; i<npoints; ++i)
+	ptr[clusters[i]+1] += 1;
+    for (j=0; j<nclus0; ++j)
+	ptr[j+1] += ptr[j];
+    for (i=0; i<npoints; ++i) {
+	j = clusters[i];
+	pts[ptr[j]+pos[j]++] = i;
+    }
+
+    /* Grow the parts inside each cluster */
+    n = 0;
+    for (j=0; j<nclus0; ++j) {
+	int *sub = pts+ptr[j], nsub = ptr[j+1]-ptr[j];
+	for (i=0; i<nsub; ++i)
+	    clusters[sub[i]] = parts[j] > 1 ? -1 : n;
+	if (parts[j] > 1)
+	    grow_clusters(clusters, neigh, nneigh, area, sub, nsub, n,
+			  parts[j], maxneigh);
+	n += parts[j];
+    }
+
+    free(carea);
+    free(parts);
+    free(order);
+    free(ptr);
+    free(pts);
+    free(pos);
 }
 
 
@@ -589,23 +818,45 @@ static void minimize_energy(int *edges, int *clusters, float *area,
    int nedges
    int nclus  : the targeted number of points
    int maxiter
+   int nclus0 : if > 0, clusters contains an initial clustering with
+                nclus0 clusters, which is split or merged to nclus
+                clusters and then further optimized.
+   float *sgamma, *srho: if not NULL, work space (nclus*3 and nclus)
+                for the cluster sums, that holds them on return.
+   int *sums:   if not NULL, returns 1 if sgamma and srho hold the sums
+                of the returned clusters, 0 if the repair of disconnected
+                clusters made them out of date.
+   int *niters: if not NULL, returns the total number of iterations of
+                the energy minimization.
 */
 
 static int optimize_cluster(int *clusters, int *neigh, int *nneigh,
 			     float *area, float *cent, int *edges,
 			     int npoints, int maxneigh, int nedges,
-			     int nclus, int maxiter)
+			     int nclus, int maxiter, int nclus0,
+			     float *sgamma, float *srho, int *sums,
+			     int *niters)
 {
     int iso_try=10;
-    int i, j, ndisc;
+    int i, j, ndisc, nmin, known = 0;
+    int own = sgamma == NULL || srho == NULL;
 
     /* Allocate arrays for cluster centers, masses, and energies */
     int *cluscount = calloc(nclus, sizeof(int));
-    float *sgamma = calloc(nclus*3, sizeof(float));
-    float *srho = calloc(nclus, sizeof(float));
     float *energy = calloc(nclus, sizeof(float));
+    if (own) {
+	sgamma = malloc(nclus*3 * sizeof(float));
+	srho = malloc(nclus * sizeof(float));
+    }
 
-    init_clusters(clusters, neigh, nneigh, area, nclus, npoints, maxneigh);
+    if (nclus0 <= 0)
+	init_clusters(clusters, neigh, nneigh, area, nclus, npoints, maxneigh);
+    else if (nclus < nclus0)
+	known = merge_clusters(clusters, area, cent, edges, nclus0, nclus,
+			       npoints, nedges, maxiter, sgamma, srho);
+    else if (nclus > nclus0)
+	split_clusters(clusters, neigh, nneigh, area, nclus0, nclus, npoints,
+		       maxneigh);
     /* print_clusters("init", clusters, npoints); */
 
     /* Eliminate null clusters by growing existing null clusters */
@@ -623,24 +874,28 @@ static int optimize_cluster(int *clusters, int *neigh, int *nneigh,
 	cluscount[clusters[i]] += 1;
     /* print_clusters("cluscount", cluscount, nclus); */
 
-    /* Compute initial masses of clusters */
-    for (i=0; i<npoints; ++i) {
-	j = clusters[i];
-        srho[j] += area[i];
-        sgamma[3*j] += cent[3*i];
-        sgamma[3*j+1] += cent[3*i+1];
-        sgamma[3*j+2] += cent[3*i+2];
+    /* Compute initial masses of clusters, unless merging gave them */
+    if (!known) {
+	memset(sgamma, 0, nclus*3 * sizeof(float));
+	memset(srho, 0, nclus * sizeof(float));
+	for (i=0; i<npoints; ++i) {
+	    j = clusters[i];
+	    srho[j] += area[i];
+	    sgamma[3*j] += cent[3*i];
+	    sgamma[3*j+1] += cent[3*i+1];
+	    sgamma[3*j+2] += cent[3*i+2];
+	}
+    }
+    for (j=0; j<nclus; ++j) {
+	double x = sgamma[3*j], y = sgamma[3*j+1], z = sgamma[3*j+2];
+        energy[j] = (x*x + y*y + z*z) / srho[j];
     }
-    for (j=0; j<nclus; ++j)
-        energy[j] = (pow(sgamma[3*j], 2) +
-		     pow(sgamma[3*j+1], 2) +
-		     pow(sgamma[3*j+2], 2)) / srho[j];
 
     /* print_clusters("before optimize", clusters,npoints); */
 
     /* Optimize clusters */
-    minimize_energy(edges, clusters, area, sgamma, cent, srho, cluscount,
-                    energy, nedges, nclus, maxiter);
+    nmin = minimize_energy(edges, clusters, area, sgamma, cent, srho,
+			   cluscount, energy, nedges, nclus, maxiter);
     /* print_clusters("after optimize", clusters,npoints); */
 
     /* Identify isolated clusters here */
@@ -655,8 +910,8 @@ static int optimize_cluster(int *clusters, int *neigh, int *nneigh,
 	/* print_clusters("grow_null", clusters, npoints); */
 
 	/* Re-optimize clusters */
-	minimize_energy(edges, clusters, area, sgamma, cent, srho, cluscount,
-                    energy, nedges, nclus, maxiter);
+	nmin += minimize_energy(edges, clusters, area, sgamma, cent, srho,
+				cluscount, energy, nedges, nclus, maxiter);
 	/* print_clusters("reoptimize", clusters, npoints); */
 
 	/* Check again for disconnected clusters */
@@ -682,10 +937,14 @@ static int optimize_cluster(int *clusters, int *neigh, int *nneigh,
     }
 /* ret1: */
     free(cluscount);
-    free(sgamma);
-    free(srho);
     free(energy);
+    if (own) {
+	free(sgamma);
+	free(srho);
+    }
 
+    if (sums) *sums = niter == 0;
+    if (niters) *niters = nmin;
     return ndisc;
     }
 
@@ -704,38 +963,58 @@ nclus: int32\n\
     The targeted number of points\n\
 maxiter: int32\n\
     The maximum number of iterations\n\
+init: int32 array (npoints), optional\n\
+    An initial clustering, e.g. the result of a previous call, with\n\
+    cluster numbers 0..nclus0-1. If nclus < nclus0, the clusters are\n\
+    merged, and if nclus > nclus0 they are split, before resuming the\n\
+    optimization. This is much faster than starting from scratch when\n\
+    the initial clustering is close to the result.\n\
+\n\
+Returns\n\
+-------\n\
+clusters: int32 array (npoints)\n\
+    The cluster number of each point, or -1 for isolated points.\n\
+ndisc: int\n\
+    The number of isolated points.\n\
+\n\
+Notes\n\
+-----\n\
+The GIL is released during the computation. On large meshes the\n\
+energy minimization runs in multiple threads, and the resulting\n\
+clusters may then differ slightly from run to run.\n\
 ";
 
 PyObject * cluster(PyObject *dummy, PyObject *args)
 {
-    PyObject *a1=NULL, *a2=NULL, *a3=NULL, *a4=NULL, *a5=NULL;
+    PyObject *a1=NULL, *a2=NULL, *a3=NULL, *a4=NULL, *a5=NULL, *a6=NULL;
     PyObject *arr1=NULL, *arr2=NULL, *arr3=NULL, *arr4=NULL, *arr5=NULL;
+    PyObject *arr6=NULL;
     int *neigh, *nneigh, *edges, *clusters;
     float *area, *cent;
-    int nclus, maxiter;
-    int ndisc = -1;
+    int nclus, maxiter, nclus0 = 0;
+    int ndisc = -1, niters = 0;
     PyObject *ret1 = NULL;
 
     /* print("============= This is C cluster==============\n"); */
-    if (!PyArg_ParseTuple(args, "OOOOOii", &a1, &a2, &a3, &a4, &a5,
-			  &nclus, &maxiter)) return NULL;
-    arr1 = PyArray_FROM_OTF(a1, NPY_INT, NPY_ARRAY_IN_ARRAY);
+    if (!PyArg_ParseTuple(args, "OOOOOii|O", &a1, &a2, &a3, &a4, &a5,
+			  &nclus, &maxiter, &a6)) return NULL;
+    arr1 = pf_from_otf(a1, NPY_INT, NPY_ARRAY_IN_ARRAY);
     if (arr1 == NULL) return NULL;
-    arr2 = PyArray_FROM_OTF(a2, NPY_INT, NPY_ARRAY_IN_ARRAY);
+    arr2 = pf_from_otf(a2, NPY_INT, NPY_ARRAY_IN_ARRAY);
     if (arr2 == NULL) goto fail;
-    arr3 = PyArray_FROM_OTF(a3, NPY_FLOAT, NPY_ARRAY_IN_ARRAY);
+    arr3 = pf_from_otf(a3, NPY_FLOAT, NPY_ARRAY_IN_ARRAY);
     if (arr3 == NULL) goto fail;
-    arr4 = PyArray_FROM_OTF(a4, NPY_FLOAT, NPY_ARRAY_IN_ARRAY);
+    arr4 = pf_from_otf(a4, NPY_FLOAT, NPY_ARRAY_IN_ARRAY);
     if (arr4 == NULL) goto fail;
-    arr5 = PyArray_FROM_OTF(a5, NPY_INT, NPY_ARRAY_IN_ARRAY);
+    arr5 = pf_from_otf(a5, NPY_INT, NPY_ARRAY_IN_ARRAY);
     if (arr5 == NULL) goto fail;
     /* We suppose the dimensions are correct*/
     int npoints, maxneigh, nedges;
     npy_intp *dims;
-    dims = PYARRAY_DIMS(a1);
+    dims = PYARRAY_DIMS(arr1);
     npoints = dims[0];
     maxneigh = dims[1];
-    dims = PYARRAY_DIMS(a5);
+    dims = PYARRAY_DIMS(arr5);
     nedges = dims[0];
     neigh = (int *)PYARRAY_DATA(arr1);
     nneigh = (int *)PYARRAY_DATA(arr2);
@@ -747,20 +1026,48 @@ PyObject * cluster(PyObject *dummy, PyObject *args)
     npy_intp dim[1];
     dim[0] = npoints;
     ret1 = PyArray_SimpleNew(1,dim, NPY_INT);
+    if (ret1 == NULL) goto fail;
     clusters = (int *)PYARRAY_DATA(ret1);
 
+    /* Copy the initial clustering */
+    if (a6 != NULL && a6 != Py_None) {
+	arr6 = pf_from_otf(a6, NPY_INT, NPY_ARRAY_IN_ARRAY);
+	if (arr6 == NULL) goto fail;
+	if (PyArray_SIZE((PyArrayObject *)arr6) != npoints) {
+	    PyErr_SetString(PyExc_ValueError,
+			    "init should have a value for each point");
+	    goto fail;
+	}
+	int *init = (int *)PYARRAY_DATA(arr6);
+	for (int i=0; i<npoints; ++i) {
+	    if (init[i] < 0) {
+		PyErr_SetString(PyExc_ValueError,
+				"init should not contain negative values");
+		goto fail;
+	    }
+	    clusters[i] = init[i];
+	    if (init[i] >= nclus0)
+		nclus0 = init[i]+1;
+	}
+    }
+
     /* Compute */
+    Py_BEGIN_ALLOW_THREADS
     ndisc = optimize_cluster(clusters, neigh, nneigh,
 			     area, cent, edges,
 			     npoints, maxneigh, nedges,
-			     nclus, maxiter);
+			     nclus, maxiter, nclus0, NULL, NULL, NULL,
+			     &niters);
+    Py_END_ALLOW_THREADS
+    PF_STAT_ITERS(niters);
     /* Clean up and return */
     Py_DECREF(arr1);
     Py_DECREF(arr2);
     Py_DECREF(arr3);
     Py_DECREF(arr4);
     Py_DECREF(arr5);
-    return Py_BuildValue("(Oi)", ret1, ndisc);
+    Py_XDECREF(arr6);
+    return Py_BuildValue("(Ni)", ret1, ndisc);
 
 fail:
     Py_XDECREF(arr1);
@@ -768,6 +1075,8 @@ fail:
     Py_XDECREF(arr3);
     Py_XDECREF(arr4);
     Py_XDECREF(arr5);
+    Py_XDECREF(arr6);
+    Py_XDECREF(ret1);
     return NULL;
 }
 
@@ -776,6 +1085,7 @@ fail:
 /* The public methods defined in this module */
 static PyMethodDef extension_methods[] = {
   {"cluster", cluster, METH_VARARGS, cluster__doc__},
+  PF_THREAD_METHODS
   {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
@@ -802,6 +1112,7 @@ PyObject *PyInit_clust_c(void)
   PyModule_AddStringConstant(m,"__doc__",__doc__);
   PyModule_AddIntConstant(m,"_accelerated",1);
   import_array(); /* Get access to numpy array API */
+  pf_instrument(m, extension_methods);
   return m;
 }
 
@@ -29,11 +29,15 @@
 #define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
 #include <numpy/arrayobject.h>
 #include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "pflib.h"
 
 // cast pointers to avoid warnings
 #define PYARRAY_DATA(p) PyArray_DATA((PyArrayObject *)p)
 #define PYARRAY_DIMS(p) PyArray_DIMS((PyArrayObject *)p)
-#define PYARRAY_FROM_OTF(p,q,r) (PyArrayObject *) PyArray_FROM_OTF(p,q,r)
+#define PYARRAY_FROM_OTF(p,q,r) (PyArrayObject *) pf_from_otf(p,q,r)
 
 
 /****************** LIBRARY VERSION AND DOCSTRING *******************/
@@ -51,6 +55,88 @@ internally by other pyFormex functions to speed up their operation.\n\
 
 /****** INTERNAL FUNCTIONS (not callable from Python) ********/
 
+/* Maximum number of threads that can be used in parallel loops */
+int max_threads(void)
+{
+  return pf_threads();
+}
+
+
+/*
+   Generic array access.
+
+   Some kernels read their input arrays in place, whatever their type
+   (float32 or float64 for floats, int32 or int64 for integers) and
+   strides, so that no converted copies have to be made. They access
+   the data through an ARRAY view, with byte offsets computed from the
+   strides.
+*/
+typedef struct {
+  char *data;           /* address of the first item */
+  int itemsize;         /* size of the items: 4 or 8 */
+  int ndim;             /* number of dimensions */
+  npy_intp *dims;       /* shape of the array */
+  npy_intp *strides;    /* strides of the array, in bytes */
+} ARRAY;
+
+/* Byte offset of item (i,j) or (i,j,k) in an ARRAY */
+#define OFS2(a,i,j) ((i)*(a)->strides[0] + (j)*(a)->strides[1])
+#define OFS3(a,i,j,k) (OFS2(a,i,j) + (k)*(a)->strides[2])
+
+/* Read the float item at byte offset ofs */
+static inline double getf(const ARRAY *a, npy_intp ofs)
+{
+  const char *p = a->data + ofs;
+  return a->itemsize == 8 ? *(const double *)p : *(const float *)p;
+}
+
+/* Read the integer item at byte offset ofs */
+static inline npy_intp geti(const ARRAY *a, npy_intp ofs)
+{
+  const char *p = a->data + ofs;
+  return a->itemsize == 8 ? (npy_intp)*(const npy_int64 *)p : *(const npy_int32 *)p;
+}
+
+/*
+   Get an ARRAY view on a float (kind 'f') or signed integer (kind 'i')
+   array with ndim dimensions. Aligned arrays of 4 or 8 byte items of
+   the requested kind are used as they are, with any strides. Other
+   objects are converted to a float32 or int32 array.
+   Returns a new reference to the array (which should be kept while
+   the view is used), or NULL on failure.
+*/
+static PyObject * array_view(PyObject *obj, char kind, int ndim, ARRAY *a)
+{
+  PyObject *arr;
+  PyArrayObject *p;
+  int ok = 0;
+  arr = PyArray_FROM_OF(obj, NPY_ARRAY_ALIGNED | NPY_ARRAY_NOTSWAPPED);
+  if (arr == NULL) return NULL;
+  p = (PyArrayObject *)arr;
+  if (PyArray_ITEMSIZE(p) == 4 || PyArray_ITEMSIZE(p) == 8)
+    ok = kind == 'f' ? PyArray_ISFLOAT(p) : PyArray_ISSIGNED(p);
+  if (!ok) {
+    Py_DECREF(arr);
+    arr = PyArray_FROM_OTF(obj, kind == 'f' ? NPY_FLOAT : NPY_INT, NPY_ARRAY_IN_ARRAY);
+    if (arr == NULL) return NULL;
+    p = (PyArrayObject *)arr;
+  }
+  if (PyArray_NDIM(p) != ndim) {
+    PyErr_Format(PyExc_ValueError, "expected a %d-dim array, got %d-dim",
+		 ndim, PyArray_NDIM(p));
+    Py_DECREF(arr);
+    return NULL;
+  }
+  if (arr != obj) PF_STAT_COPIED(arr);
+  a->data = PyArray_BYTES(p);
+  a->itemsize = PyArray_ITEMSIZE(p);
+  a->ndim = ndim;
+  a->dims = PyArray_DIMS(p);
+  a->strides = PyArray_STRIDES(p);
+  return arr;
+}
+
+
 /* Dot product of two vectors of length n */
 /* ia and ib are the strides of the elements addressed starting from a, b */
 float dotprod(float *a, int ia, float *b, int ib, int n)
@@ -67,6 +153,17 @@ float dotprod(float *a, int ia, float *b, int ib, int n)
 }
 
 
+/* Check the points array: it should have shape (npts,3) */
+static int check_points(ARRAY *x)
+{
+  if (x->dims[1] != 3) {
+    PyErr_SetString(PyExc_ValueError, "points should have shape (npts,3)");
+    return -1;
+  }
+  return 0;
+}
+
+
 /**************************************************** coordsfuse ****/
 static char coordsfuse_doc[] = "\
 coordsfuse(x, val, flag, sel, tol)\n\
@@ -75,9 +172,9 @@ Fuse points whose coordinates are (almost) the same.\n\
 \n\
 Parameters\n\
 ----------\n\
-x: float32 array (npts, 3)\n\
+x: float array (npts, 3)\n\
     The coordinates of npts points.\n\
-val: int32 array (npts)\n\
+val: int array (npts)\n\
     An integer code for each point, such that points with the same code\n\
     are in the same neighborhood. Any point will only be compared with\n\
     the other points in its neighborhood. The points in x and the values in\n\
@@ -90,6 +187,9 @@ sel: int32 array (npts)\n\
 tol: float\n\
     The absolute tolerance to define equality between coordinates.\n\
 \n\
+The float arrays can be float32 or float64, the int arrays int32 or\n\
+int64. x and val are read in place, with any strides.\n\
+\n\
 Returns\n\
 -------\n\
 None\n\
@@ -106,39 +206,39 @@ static PyObject * coordsfuse(PyObject *dummy, PyObject *args)
 {
   PyObject *arg1=NULL, *arg2=NULL, *arg3=NULL, *arg4=NULL;
   PyObject *arr1=NULL, *arr2=NULL, *arr3=NULL, *arr4=NULL;
-  float *x;
+  ARRAY x, val;
   int *flag;
-  int *val,*sel;
+  int *sel;
   float tol;
   if (!PyArg_ParseTuple(args, "OOOOf", &arg1, &arg2, &arg3, &arg4, &tol)) return NULL;
-  arr1 = PyArray_FROM_OTF(arg1, NPY_FLOAT, NPY_ARRAY_IN_ARRAY);
+  arr1 = array_view(arg1, 'f', 2, &x);
   if (arr1 == NULL) return NULL;
-  arr2 = PyArray_FROM_OTF(arg2, NPY_INT, NPY_ARRAY_IN_ARRAY);
+  if (check_points(&x) < 0) goto fail;
+  arr2 = array_view(arg2, 'i', 1, &val);
   if (arr2 == NULL) goto fail;
-  arr3 = PyArray_FROM_OTF(arg3, NPY_INT, NPY_ARRAY_INOUT_ARRAY);
+  arr3 = pf_from_otf(arg3, NPY_INT, NPY_ARRAY_INOUT_ARRAY);
   if (arr3 == NULL) goto fail;
-  arr4 = PyArray_FROM_OTF(arg4, NPY_INT, NPY_ARRAY_INOUT_ARRAY);
+  arr4 = pf_from_otf(arg4, NPY_INT, NPY_ARRAY_INOUT_ARRAY);
   if (arr4 == NULL) goto fail;
   /* We suppose the dimensions are correct*/
-  npy_intp * dims;
-  dims = PYARRAY_DIMS(arg1);
-  int nnod;
-  nnod = dims[0];
-  x = (float *)PYARRAY_DATA(arr1);
-  val = (int *)PYARRAY_DATA(arr2);
+  npy_intp nnod;
+  nnod = x.dims[0];
   flag = (int *)PYARRAY_DATA(arr3);
   sel = (int *)PYARRAY_DATA(arr4);
-  int i,j,ki,kj,nexti;
+  npy_intp i,j,vi,k;
+  double xi[3];
+  int nexti;
 
   nexti = 1;
+  Py_BEGIN_ALLOW_THREADS
   for (i=1; i<nnod; i++) {
     j = i-1;
-    ki = 3*i;
-    while (j >= 0 && val[i]==val[j]) {
-      kj = 3*j;
-      if ( fabs(x[ki]-x[kj]) < tol &&
-	   fabs(x[ki+1]-x[kj+1]) < tol &&
-	   fabs(x[ki+2]-x[kj+2]) < tol ) {
+    vi = geti(&val,i*val.strides[0]);
+    for (k=0; k<3; k++) xi[k] = getf(&x,OFS2(&x,i,k));
+    while (j >= 0 && vi == geti(&val,j*val.strides[0])) {
+      if ( fabs(xi[0]-getf(&x,OFS2(&x,j,0))) < tol &&
+	   fabs(xi[1]-getf(&x,OFS2(&x,j,1))) < tol &&
+	   fabs(xi[2]-getf(&x,OFS2(&x,j,2))) < tol ) {
 	flag[i] = 0;
 	sel[i] = sel[j];
 	break;
@@ -150,6 +250,7 @@ static PyObject * coordsfuse(PyObject *dummy, PyObject *args)
       ++nexti;
     }
   }
+  Py_END_ALLOW_THREADS
   /* Clean up and return */
   Py_DECREF(arr1);
   Py_DECREF(arr2);
@@ -166,22 +267,234 @@ static PyObject * coordsfuse(PyObject *dummy, PyObject *args)
 }
 
 
+/**************************************************** hashfuse ****/
+/* Fuse points using a uniform spatial hash grid */
+
+/* Maximum number of grid cells along a single axis */
+#define HASHFUSE_MAXCELLS 1048576
+
+/* Hash the integer coordinates of a grid cell into a table of size mask+1 */
+static size_t cell_hash(int i, int j, int k, size_t mask)
+{
+  size_t h;
+  h = ((size_t)i * 73856093u) ^ ((size_t)j * 19349663u) ^ ((size_t)k * 83492791u);
+  return h & mask;
+}
+
+/*
+   Fuse the npts points x (npts,3) that are closer than tol in all
+   coordinates. Each point is compared with the unique points found
+   before it in the 27 grid cells around it. The grid cell size is at
+   least tol, so no close point can be missed.
+   On return, flag[i] is 1 if point i is a new unique point and 0 if it
+   was fused, and sel[i] is the number of the unique point it belongs to.
+   Returns the number of unique points, or -1 if out of memory.
+*/
+int hash_fuse(ARRAY *x, int npts, float tol, int *flag, int *sel)
+{
+  int i,k,n,nuniq,di,dj,dk;
+  int ci[3];
+  double xmin[3], xmax[3], h, p[3], v;
+  int *head, *next;
+  size_t nbuck, b;
+
+  if (npts <= 0) return 0;
+
+  /* find the bounding box */
+  for (k=0; k<3; k++) xmin[k] = xmax[k] = getf(x,OFS2(x,0,k));
+  for (i=1; i<npts; i++)
+    for (k=0; k<3; k++) {
+      v = getf(x,OFS2(x,i,k));
+      if (v < xmin[k]) xmin[k] = v;
+      if (v > xmax[k]) xmax[k] = v;
+    }
+
+  /* cell size: not smaller than tol, and limited number of cells */
+  h = tol;
+  for (k=0; k<3; k++)
+    if ((xmax[k]-xmin[k]) / HASHFUSE_MAXCELLS > h)
+      h = (xmax[k]-xmin[k]) / HASHFUSE_MAXCELLS;
+  if (h <= 0.0) h = 1.0;
+
+  /* hash table with linked lists of the unique points in each bucket */
+  nbuck = 1;
+  while (nbuck < 2*(size_t)npts) nbuck <<= 1;
+  head = (int *) malloc(nbuck*sizeof(int));
+  next = (int *) malloc(npts*sizeof(int));
+  if (head == NULL || next == NULL) {
+    free(head);
+    free(next);
+    return -1;
+  }
+  for (b=0; b<nbuck; b++) head[b] = -1;
+
+  nuniq = 0;
+  for (i=0; i<npts; i++) {
+    for (k=0; k<3; k++) {
+      p[k] = getf(x,OFS2(x,i,k));
+      ci[k] = (int) floor((p[k]-xmin[k]) / h);
+    }
+    /* look for a close unique point in the neighbour cells */
+    for (di=-1; di<=1; di++)
+      for (dj=-1; dj<=1; dj++)
+	for (dk=-1; dk<=1; dk++) {
+	  b = cell_hash(ci[0]+di, ci[1]+dj, ci[2]+dk, nbuck-1);
+	  for (n=head[b]; n>=0; n=next[n]) {
+	    if ( fabs(p[0]-getf(x,OFS2(x,n,0))) < tol &&
+		 fabs(p[1]-getf(x,OFS2(x,n,1))) < tol &&
+		 fabs(p[2]-getf(x,OFS2(x,n,2))) < tol ) goto found;
+	  }
+	}
+    /* this is a new unique point */
+    flag[i] = 1;
+    sel[i] = nuniq++;
+    b = cell_hash(ci[0], ci[1], ci[2], nbuck-1);
+    next[i] = head[b];
+    head[b] = i;
+    continue;
+  found:
+    flag[i] = 0;
+    sel[i] = sel[n];
+  }
+
+  free(head);
+  free(next);
+  return nuniq;
+}
+
+static char hashfuse_doc[] = "\
+hashfuse(x, tol, unique=0)\n\
+\n\n\
+Fuse points whose coordinates are (almost) the same.\n\
+\n\
+This is a single pass alternative for :func:`coordsfuse` that does not\n\
+require the points to be presorted. The points are stored in a uniform\n\
+spatial hash grid, and each point is only compared with the unique\n\
+points in the 27 grid cells around it. The run time is proportional\n\
+to the number of points.\n\
+\n\
+Parameters\n\
+----------\n\
+x: float32 or float64 array (npts, 3)\n\
+    The coordinates of npts points. The array is read in place, with\n\
+    any strides.\n\
+tol: float\n\
+    The absolute tolerance to define equality between coordinates.\n\
+unique: int\n\
+    If nonzero, the coordinates of the unique points are returned as well.\n\
+\n\
+Returns\n\
+-------\n\
+sel: int32 array (npts)\n\
+    For each point the index of the unique point it is fused with.\n\
+    The unique points are numbered in order of their first occurrence.\n\
+flag: int32 array (npts)\n\
+    A value 1 for the points that remain in the fused set, and 0 for\n\
+    those that were fused with a previous point.\n\
+coords: float array (nuniq, 3)\n\
+    Only returned if unique is nonzero: the coordinates of the unique\n\
+    points. This is the same as ``x[flag>0]``, with the same type as x.\n\
+\n\
+See Also\n\
+--------\n\
+:meth:`coords.Coords.fuse`: the user oriented method to fuse points\n\
+";
+
+static PyObject * hashfuse(PyObject *dummy, PyObject *args)
+{
+  PyObject *arg1=NULL;
+  PyObject *arr1=NULL, *ret1=NULL, *ret2=NULL, *ret3=NULL;
+  ARRAY x;
+  char *xu;
+  int *flag, *sel;
+  float tol;
+  int unique=0;
+  if (!PyArg_ParseTuple(args, "Of|i", &arg1, &tol, &unique)) return NULL;
+  arr1 = array_view(arg1, 'f', 2, &x);
+  if (arr1 == NULL) return NULL;
+  if (check_points(&x) < 0) goto fail;
+
+  int npts, nuniq, i, k;
+  npts = x.dims[0];
+
+  /* create return arrays */
+  npy_intp newdim[2];
+  newdim[0] = npts;
+  ret1 = PyArray_SimpleNew(1,newdim, NPY_INT);
+  ret2 = PyArray_SimpleNew(1,newdim, NPY_INT);
+  if (ret1 == NULL || ret2 == NULL) goto fail;
+  sel = (int *)PYARRAY_DATA(ret1);
+  flag = (int *)PYARRAY_DATA(ret2);
+
+  /* compute */
+  Py_BEGIN_ALLOW_THREADS
+  nuniq = hash_fuse(&x,npts,tol,flag,sel);
+  Py_END_ALLOW_THREADS
+  PF_STAT_ITEMS(nuniq);
+  if (nuniq < 0) {
+    PyErr_NoMemory();
+    goto fail;
+  }
+
+  if (unique) {
+    newdim[0] = nuniq;
+    newdim[1] = 3;
+    ret3 = PyArray_SimpleNew(2,newdim, x.itemsize == 8 ? NPY_DOUBLE : NPY_FLOAT);
+    if (ret3 == NULL) goto fail;
+    xu = (char *)PYARRAY_DATA(ret3);
+    for (i=0; i<npts; i++)
+      if (flag[i])
+	for (k=0; k<3; k++) {
+	  memcpy(xu,x.data+OFS2(&x,i,k),x.itemsize);
+	  xu += x.itemsize;
+	}
+  }
+
+  /* Clean up and return */
+  Py_DECREF(arr1);
+  if (unique) return Py_BuildValue("NNN",ret1,ret2,ret3);
+  return Py_BuildValue("NN",ret1,ret2);
+ fail:
+  Py_XDECREF(arr1);
+  Py_XDECREF(ret1);
+  Py_XDECREF(ret2);
+  Py_XDECREF(ret3);
+  return NULL;
+}
+
+
 /**************************************************** nodalsum ****/
 /* Nodal sum of values defined on elements */
 
-void nodal_sum(float *val, int *elems, float *sum, int *cnt, int nelems, int nplex, int nval, int nnod)
+/*
+   Sum the values val (nelems,nplex,nval) at the nodes elems (nelems,nplex).
+   sum (nnod,nval) is a float32 array, or a float64 array if val is.
+   Entries in elems outside the range 0..nnod-1 are skipped.
+*/
+void nodal_sum(ARRAY *val, ARRAY *elems, void *sum, int *cnt, int nnod)
 {
-  int i,k,n;
+  npy_intp i,j,k,n;
+  npy_intp nelems = elems->dims[0], nplex = elems->dims[1], nval = val->dims[2];
+  float *fsum = (float *)sum;
+  double *dsum = (double *)sum;
 
   for (i=0; i<nnod; i++) cnt[i] = 0;
-  for (i=0; i<nnod*nval; i++) sum[i] = 0.0;
+  for (i=0; i<nnod*nval; i++) {
+    if (val->itemsize == 8) dsum[i] = 0.0;
+    else fsum[i] = 0.0;
+  }
 
   /* Loop over the input and sum */
-  for (i=0; i<nelems*nplex; ++i) {
-    n = elems[i];
-    for (k=0; k<nval; ++k) sum[n*nval+k] += val[i*nval+k];
-    cnt[n]++;
-  }
+  for (i=0; i<nelems; ++i)
+    for (j=0; j<nplex; ++j) {
+      n = geti(elems,OFS2(elems,i,j));
+      if (n < 0 || n >= nnod) continue;
+      for (k=0; k<nval; ++k) {
+	if (val->itemsize == 8) dsum[n*nval+k] += getf(val,OFS3(val,i,j,k));
+	else fsum[n*nval+k] += (float)getf(val,OFS3(val,i,j,k));
+      }
+      cnt[n]++;
+    }
 }
 
 static char nodalsum_doc[] = "\
@@ -191,18 +504,20 @@ Compute the nodal sum of values defined on elements.\n\
 \n\
 Parameters\n\
 ----------\n\
-val: float32 array (nelems, nplex, nval)\n\
+val: float32 or float64 array (nelems, nplex, nval)\n\
     The data sets: nval values at nplex nodes of nelems elements.\n\
-elems: int32 array (nelems, nplex)\n\
+elems: int32 or int64 array (nelems, nplex)\n\
     The node indices of the elements.\n\
 nnod: int\n\
     The number of nodes. It should be higher than the highest node\n\
     number used in elems (maxnod). If negative, it will be set to maxnod+1.\n\
 \n\
+The arrays are read in place, with any strides.\n\
+\n\
 Returns\n\
 -------\n\
-sum: float32 array (nnod, nval)\n\
-    The sum of all the values at same node\n\
+sum: float array (nnod, nval)\n\
+    The sum of all the values at same node, with the type of val.\n\
 cnt: int32 array (nnod)\n\
     The number of values that were summed at each node\n\
 \n\
@@ -215,50 +530,341 @@ static PyObject * nodalsum(PyObject *dummy, PyObject *args)
 {
   PyObject *arg1=NULL, *arg2=NULL, *ret1=NULL, *ret2=NULL;
   PyObject *arr1=NULL, *arr2=NULL;
-  float *val,*sum;
-  int *elems,*cnt;
-  int nnod,nelems,nplex,nval,i;
+  ARRAY val, elems;
+  int *cnt;
+  npy_intp nelems,nplex,i,j,n;
+  int nnod;
   if (!PyArg_ParseTuple(args, "OOi", &arg1, &arg2, &nnod)) return NULL;
-  arr1 = PyArray_FROM_OTF(arg1, NPY_FLOAT, NPY_ARRAY_IN_ARRAY);
+  arr1 = array_view(arg1, 'f', 3, &val);
   if (arr1 == NULL) return NULL;
-  arr2 = PyArray_FROM_OTF(arg2, NPY_INT, NPY_ARRAY_IN_ARRAY);
+  arr2 = array_view(arg2, 'i', 2, &elems);
   if (arr2 == NULL) goto fail;
 
-  npy_intp * dim;
-  dim = PYARRAY_DIMS(arg1);
-  nelems = dim[0];
-  nplex = dim[1];
-  nval = dim[2];
-
-  val = (float *)PYARRAY_DATA(arr1);
-  elems = (int *)PYARRAY_DATA(arr2);
+  nelems = elems.dims[0];
+  nplex = elems.dims[1];
+  if (val.dims[0] != nelems || val.dims[1] != nplex) {
+    PyErr_SetString(PyExc_ValueError, "shapes of val and elems do not match");
+    goto fail;
+  }
 
   if (nnod < 0) {
     nnod = 0;
-    for (i=0; i<nelems*nplex; ++i)
-      if (elems[i] > nnod) nnod = elems[i];
+    for (i=0; i<nelems; ++i)
+      for (j=0; j<nplex; ++j) {
+	n = geti(&elems,OFS2(&elems,i,j));
+	if (n > nnod) nnod = n;
+      }
     ++nnod;
   }
 
   /* create return arrays */
   npy_intp newdim[2];
   newdim[0] = nnod;
-  newdim[1] = nval;
-  ret1 = PyArray_SimpleNew(2,newdim, NPY_FLOAT);
+  newdim[1] = val.dims[2];
+  ret1 = PyArray_SimpleNew(2,newdim, val.itemsize == 8 ? NPY_DOUBLE : NPY_FLOAT);
   ret2 = PyArray_SimpleNew(1,newdim, NPY_INT);
-  sum = (float *)PYARRAY_DATA(ret1);
+  if (ret1 == NULL || ret2 == NULL) goto fail;
   cnt = (int *)PYARRAY_DATA(ret2);
 
   /* compute */
-  nodal_sum(val,elems,sum,cnt,nelems,nplex,nval,nnod);
+  void *sum = PYARRAY_DATA(ret1);
+  Py_BEGIN_ALLOW_THREADS
+  nodal_sum(&val,&elems,sum,cnt,nnod);
+  Py_END_ALLOW_THREADS
+
+  /* Clean up and return */
+  Py_DECREF(arr1);
+  Py_DECREF(arr2);
+  return Py_BuildValue("NN",ret1,ret2);
+ fail:
+  Py_XDECREF(arr1);
+  Py_XDECREF(arr2);
+  Py_XDECREF(ret1);
+  Py_XDECREF(ret2);
+  return NULL;
+}
+
+
+/**************************************************** nodalindex ****/
+/* Inverse index from nodes to element nodes, and reductions over it */
+
+/* Minimum number of nodes to run the nodal reductions in parallel */
+#define NODAL_PARALLEL_MIN 10000
+
+/* Reduction operations for nodal_reduce */
+#define NODAL_SUM 0
+#define NODAL_AVG 1
+#define NODAL_MAX 2
+#define NODAL_MIN 3
+
+/*
+   Create a compressed (CSR) inverse index of elems (nelems,nplex) for
+   nnod nodes. The element nodes connected to node n are
+   index[offsets[n]:offsets[n+1]], in ascending order. Each value in
+   index is the flat position i = e*nplex+j of the element node.
+   Entries in elems outside the range 0..nnod-1 are skipped.
+   offsets has length nnod+1, index should be large enough to hold all
+   valid entries of elems. Returns the number of values in index.
+*/
+int nodal_index(ARRAY *elems, int nnod, int *offsets, int *index)
+{
+  npy_intp i,j,n,nplex=elems->dims[1];
+
+  /* count the entries of each node */
+  for (i=0; i<=nnod; i++) offsets[i] = 0;
+  for (i=0; i<elems->dims[0]; i++)
+    for (j=0; j<nplex; j++) {
+      n = geti(elems,OFS2(elems,i,j));
+      if (n >= 0 && n < nnod) offsets[n+1]++;
+    }
+  /* turn the counts into offsets */
+  for (i=0; i<nnod; i++) offsets[i+1] += offsets[i];
+  /* fill the index, using offsets as insertion pointers */
+  for (i=0; i<elems->dims[0]; i++)
+    for (j=0; j<nplex; j++) {
+      n = geti(elems,OFS2(elems,i,j));
+      if (n >= 0 && n < nnod) index[offsets[n]++] = i*nplex+j;
+    }
+  /* restore the offsets */
+  for (i=nnod; i>0; i--) offsets[i] = offsets[i-1];
+  offsets[0] = 0;
+  return offsets[nnod];
+}
+
+/*
+   Reduce the values val (nelems,nplex,nval) over the element nodes
+   connected to each of the nnod nodes in the inverse index
+   (offsets,index). The result is stored in out (nnod,nval), which is
+   a float32 array, or a float64 array if val is. The sums are
+   accumulated in the type of out. Nodes without values get a zero sum,
+   and NaN for the other operations.
+   Each node is computed independently, so the nodes can be divided
+   over multiple threads without any write conflicts.
+*/
+void nodal_reduce(ARRAY *val, int *offsets, int *index, int nnod, int op, void *out)
+{
+  int n;
+  npy_intp nplex = val->dims[1], nval = val->dims[2];
+
+#pragma omp parallel for schedule(static) if (nnod >= NODAL_PARALLEL_MIN) num_threads(pf_threads())
+  for (n=0; n<nnod; n++) {
+    int i,cnt;
+    npy_intp k;
+    double v, o;
+    float of;
+    cnt = offsets[n+1] - offsets[n];
+    for (k=0; k<nval; k++) {
+      if (cnt == 0) o = of = op == NODAL_SUM ? 0.0 : NAN;
+      else {
+	o = getf(val,OFS3(val,index[offsets[n]]/nplex,index[offsets[n]]%nplex,k));
+	of = o;
+	for (i=offsets[n]+1; i<offsets[n+1]; i++) {
+	  v = getf(val,OFS3(val,index[i]/nplex,index[i]%nplex,k));
+	  switch (op) {
+	  case NODAL_MAX:
+	    if (v > o) o = v;
+	    break;
+	  case NODAL_MIN:
+	    if (v < o) o = v;
+	    break;
+	  default:
+	    o += v;
+	    of += (float)v;
+	  }
+	}
+	if (op == NODAL_AVG) {
+	  o /= cnt;
+	  of /= cnt;
+	}
+      }
+      if (val->itemsize == 8) ((double *)out)[n*nval+k] = o;
+      else ((float *)out)[n*nval+k] = op < NODAL_MAX ? of : (float)o;
+    }
+  }
+}
+
+static char nodalindex_doc[] = "\
+nodalindex(elems, nnod)\n\
+\n\n\
+Create an inverse index from nodes to element nodes.\n\
+\n\
+Parameters\n\
+----------\n\
+elems: int32 or int64 array (nelems, nplex)\n\
+    The node indices of the elements. Values outside the range\n\
+    0..nnod-1 (like -1) are ignored. The array is read in place,\n\
+    with any strides.\n\
+nnod: int\n\
+    The number of nodes. It should be higher than the highest node\n\
+    number used in elems (maxnod). If negative, it will be set to maxnod+1.\n\
+\n\
+Returns\n\
+-------\n\
+offsets: int32 array (nnod+1)\n\
+    The start of the entries for each node in index. The entries for\n\
+    node n are index[offsets[n]:offsets[n+1]].\n\
+index: int32 array (nind)\n\
+    For each node, the flat positions e*nplex+j in elems where the node\n\
+    appears, in ascending order.\n\
+\n\
+See Also\n\
+--------\n\
+:class:`arraytools.NodalIndex`: the user oriented class to use this\n\
+";
+
+static PyObject * nodalindex(PyObject *dummy, PyObject *args)
+{
+  PyObject *arg1=NULL, *ret1=NULL, *ret2=NULL;
+  PyObject *arr1=NULL;
+  ARRAY elems;
+  int *offsets, *index;
+  int nnod,nind;
+  npy_intp i,j,n;
+  if (!PyArg_ParseTuple(args, "Oi", &arg1, &nnod)) return NULL;
+  arr1 = array_view(arg1, 'i', 2, &elems);
+  if (arr1 == NULL) return NULL;
+
+  if (nnod < 0) {
+    nnod = 0;
+    for (i=0; i<elems.dims[0]; ++i)
+      for (j=0; j<elems.dims[1]; ++j) {
+	n = geti(&elems,OFS2(&elems,i,j));
+	if (n > nnod) nnod = n;
+      }
+    ++nnod;
+  }
+
+  /* create return arrays */
+  npy_intp newdim[1];
+  newdim[0] = nnod+1;
+  ret1 = PyArray_SimpleNew(1,newdim, NPY_INT);
+  if (ret1 == NULL) goto fail;
+  offsets = (int *)PYARRAY_DATA(ret1);
+  /* count the valid entries */
+  nind = 0;
+  for (i=0; i<elems.dims[0]; ++i)
+    for (j=0; j<elems.dims[1]; ++j) {
+      n = geti(&elems,OFS2(&elems,i,j));
+      if (n >= 0 && n < nnod) nind++;
+    }
+  newdim[0] = nind;
+  ret2 = PyArray_SimpleNew(1,newdim, NPY_INT);
+  if (ret2 == NULL) goto fail;
+  index = (int *)PYARRAY_DATA(ret2);
+
+  /* compute */
+  Py_BEGIN_ALLOW_THREADS
+  nodal_index(&elems,nnod,offsets,index);
+  Py_END_ALLOW_THREADS
+
+  /* Clean up and return */
+  Py_DECREF(arr1);
+  return Py_BuildValue("NN",ret1,ret2);
+ fail:
+  Py_XDECREF(arr1);
+  Py_XDECREF(ret1);
+  return NULL;
+}
+
+static char nodalreduce_doc[] = "\
+nodalreduce(val, offsets, index, op)\n\
+\n\n\
+Reduce values defined on element nodes to the nodes.\n\
+\n\
+The nodes are processed independently from each other, so that\n\
+large sets are divided over multiple threads.\n\
+\n\
+Parameters\n\
+----------\n\
+val: float32 or float64 array (nelems, nplex, nval)\n\
+    The data sets: nval values at nplex nodes of nelems elements.\n\
+    The array is read in place, with any strides.\n\
+offsets: int32 array (nnod+1)\n\
+    The offsets array returned by :func:`nodalindex`: nondecreasing,\n\
+    from 0 or higher up to at most nind.\n\
+index: int32 array (nind)\n\
+    The index array returned by :func:`nodalindex`.\n\
+op: int\n\
+    The reduction to perform: 0 = sum, 1 = average, 2 = maximum,\n\
+    3 = minimum. Other values raise a ValueError.\n\
+\n\
+Returns\n\
+-------\n\
+float array (nnod, nval)\n\
+    The reduced values at each node, with the type of val.\n\
+    Nodes that do not appear in any\n\
+    element get a value 0 for the sum, and NaN for the other operations.\n\
+\n\
+See Also\n\
+--------\n\
+:class:`arraytools.NodalIndex`: the user oriented class to use this\n\
+";
+
+static PyObject * nodalreduce(PyObject *dummy, PyObject *args)
+{
+  PyObject *arg1=NULL, *arg2=NULL, *arg3=NULL, *ret=NULL;
+  PyObject *arr1=NULL, *arr2=NULL, *arr3=NULL;
+  ARRAY val;
+  int *offsets,*index;
+  int nnod,op;
+  npy_intp i,nind;
+  if (!PyArg_ParseTuple(args, "OOOi", &arg1, &arg2, &arg3, &op)) return NULL;
+  if (op < NODAL_SUM || op > NODAL_MIN) {
+    PyErr_SetString(PyExc_ValueError, "op should be 0, 1, 2 or 3");
+    return NULL;
+  }
+  arr1 = array_view(arg1, 'f', 3, &val);
+  if (arr1 == NULL) return NULL;
+  arr2 = pf_from_otf(arg2, NPY_INT, NPY_ARRAY_IN_ARRAY);
+  if (arr2 == NULL) goto fail;
+  arr3 = pf_from_otf(arg3, NPY_INT, NPY_ARRAY_IN_ARRAY);
+  if (arr3 == NULL) goto fail;
+
+  if (PyArray_NDIM((PyArrayObject *)arr2) != 1 || PYARRAY_DIMS(arr2)[0] < 1) {
+    PyErr_SetString(PyExc_ValueError, "offsets should have shape (nnod+1,)");
+    goto fail;
+  }
+  nnod = PYARRAY_DIMS(arr2)[0]-1;
+  offsets = (int *)PYARRAY_DATA(arr2);
+  index = (int *)PYARRAY_DATA(arr3);
+  nind = PyArray_SIZE((PyArrayObject *)arr3);
+  if (offsets[0] < 0 || offsets[nnod] > nind) {
+    PyErr_SetString(PyExc_ValueError, "offsets out of range");
+    goto fail;
+  }
+  for (i=0; i<nnod; i++)
+    if (offsets[i+1] < offsets[i]) {
+      PyErr_SetString(PyExc_ValueError, "offsets should be nondecreasing");
+      goto fail;
+    }
+  for (i=0; i<nind; i++)
+    if (index[i] < 0 || index[i] >= val.dims[0]*val.dims[1]) {
+      PyErr_SetString(PyExc_ValueError, "index out of range");
+      goto fail;
+    }
+
+  /* create return array */
+  npy_intp newdim[2];
+  newdim[0] = nnod;
+  newdim[1] = val.dims[2];
+  ret = PyArray_SimpleNew(2,newdim, val.itemsize == 8 ? NPY_DOUBLE : NPY_FLOAT);
+  if (ret == NULL) goto fail;
+
+  /* compute */
+  void *res = PYARRAY_DATA(ret);
+  Py_BEGIN_ALLOW_THREADS
+  nodal_reduce(&val,offsets,index,nnod,op,res);
+  Py_END_ALLOW_THREADS
 
   /* Clean up and return */
   Py_DECREF(arr1);
   Py_DECREF(arr2);
-  return Py_BuildValue("OO",ret1,ret2);
+  Py_DECREF(arr3);
+  return ret;
  fail:
   Py_XDECREF(arr1);
   Py_XDECREF(arr2);
+  Py_XDECREF(arr3);
   return NULL;
 }
 
@@ -271,106 +877,151 @@ static PyObject * nodalsum(PyObject *dummy, PyObject *args)
 
     The vectors are supposed to be normalized.
     The operations are done in-place. The return value is None.
+
+   The vectors are clustered greedily: the first vector not yet treated
+   collects all following vectors with a projection >= tol on it, and
+   is replaced with their average. Finally all the vectors of a cluster
+   are set to the average.
+
+   Larger groups of vectors are binned on a grid over their first
+   (at most 3) components, with a cell size not smaller than the
+   largest distance between two vectors that are within tolerance.
+   Then only the vectors in the neighbouring cells need to be compared.
+   The result is the same as comparing all pairs.
 */
 
-void average_direction(float *vec, int nvec, int ndim, float tol)
+/* Minimum number of vectors to use binning */
+#define AVGDIR_BINNED_MIN 32
+
+/* Maximum number of grid cells along an axis */
+#define AVGDIR_MAXCELLS 1024
+
+static int compare_int(const void *a, const void *b)
+{
+  int i = *(const int *)a, j = *(const int *)b;
+  return (i > j) - (i < j);
+}
+
+
+/*
+   Average the directions of the nvec vectors vec[ind[i]] (or vec[i]
+   if ind is NULL). Returns 0 on success, -1 if out of memory.
+*/
+int average_direction_group(float *vec, int ndim, int *ind, int nvec, float tol)
 {
-  int i,j,k, cnt, *par;
-  float p;
+  int i,j,k,m,n,cnt,nmem,*par,*mem;
+  int *cell=NULL, *head=NULL, *next=NULL;
+  int nd, nb=0, c[3], d[3];
+  size_t nbuck=0, b;
+  float p, r2, hmax, h=0.0, *v, *w;
 
-  par = (int *) malloc(nvec*sizeof(int));
+#define VEC(i) (vec + (npy_intp)(ind ? ind[i] : (i))*ndim)
 
+  par = (int *) malloc(2*(nvec+1)*sizeof(int));
+  if (par == NULL) return -1;
+  mem = par + nvec + 1;
   for (i=0; i<nvec; i++) par[i] = -1;
-  j = 0;
-  //printf("nvec=%d, ndim=%d\n",nvec,ndim);
-  while (j < nvec) {
-    par[j] = j;
-    /* mark the close directions */
-    for (i=j+1; i<nvec; i++) {
-      p = dotprod(vec+j*ndim,1,vec+i*ndim,1,ndim);
-      //printf("Proj = %f, %f\n",p,tol);
-      if (p >= tol) {
-	//printf("setting %d = %d\n",i,j);
-	par[i] = j;
-      }
+
+  /* set up the grid */
+  nd = ndim < 3 ? ndim : 3;
+  if (nvec >= AVGDIR_BINNED_MIN && nd > 0) {
+    /* largest squared distance between vectors within tolerance */
+    r2 = 0.0;
+    for (i=0; i<nvec; i++) {
+      p = dotprod(VEC(i),1,VEC(i),1,ndim);
+      if (p > r2) r2 = p;
     }
-    /* average the close directions */
-    cnt = 1;
-    for (i=j+1; i<nvec; i++) {
-      if (par[i] == j) {
-	cnt++;
-	for (k=0; k<ndim; k++) vec[j*ndim+k] += vec[i*ndim+k];
-      }
+    hmax = sqrtf(r2);
+    r2 = 2 * (r2 - tol);
+    if (r2 > 0) {
+      h = sqrtf(r2) * 1.0001;
+      nb = (int) (2 * hmax / h);
     }
-    for (k=0; k<ndim; k++) vec[j*ndim+k] /= cnt;
-    /* check if untreated vectors left */
-    //for (i=0; i<nvec; i++) printf("par[%d] = %d\n",i,par[i]);
-    for (i=j+1; i<nvec; i++)
-      if (par[i] < 0)
-	break;
-    j = i;
-    //printf("Continuing from %d\n",j);
-  }
-  /* copy average vectors to other positions */
-  //for (i=0; i<nvec; i++) printf("par[%d] = %d\n",i,par[i]);
-  for (i=0; i<nvec; i++) {
-    j = par[i];
-    if (j < i) {
-      //printf("Copying %d to %d\n",j,i);
-      for (k=0; k<ndim; k++) vec[i*ndim+k] = vec[j*ndim+k];
+    if (nb > AVGDIR_MAXCELLS) nb = AVGDIR_MAXCELLS;
+    if (nb >= 3) {
+      /* bin the vectors */
+      h = 2 * hmax / nb;
+      for (nbuck=1; nbuck<2*(size_t)nvec; nbuck*=2);
+      cell = (int *) malloc(((size_t)3*nvec+nvec+nbuck)*sizeof(int));
+      if (cell == NULL) {
+	free(par);
+	return -1;
+      }
+      next = cell + 3*nvec;
+      head = next + nvec;
+      for (b=0; b<nbuck; b++) head[b] = -1;
+      for (i=nvec-1; i>=0; i--) {
+	v = VEC(i);
+	for (k=0; k<3; k++)
+	  cell[3*i+k] = k < nd ? (int) floorf((v[k] + hmax) / h) : 0;
+	b = cell_hash(cell[3*i],cell[3*i+1],cell[3*i+2],nbuck-1);
+	next[i] = head[b];
+	head[b] = i;
+      }
     }
   }
-  free(par);
-}
-
-void average_direction_indexed(float *vec, int ndim, int*ind, int nvec, float tol)
-{
-  int i,j,k, cnt, *par;
-  float p;
 
-  par = (int *) malloc(nvec*sizeof(int));
-
-  for (i=0; i<nvec; i++) par[i] = -1;
   j = 0;
-  //printf("nvec=%d, ndim=%d\n",nvec,ndim);
   while (j < nvec) {
     par[j] = j;
+    w = VEC(j);
     /* mark the close directions */
-    for (i=j+1; i<nvec; i++) {
-      p = dotprod(vec+ind[j]*ndim,1,vec+ind[i]*ndim,1,ndim);
-      //printf("Proj = %f, %f\n",p,tol);
-      if (p >= tol) {
-	//printf("setting %d = %d\n",i,j);
-	par[i] = j;
+    nmem = 0;
+    if (cell) {
+      for (d[0]=-1; d[0]<=1; d[0]++)
+	for (d[1]=-1; d[1]<=1; d[1]++)
+	  for (d[2]=-1; d[2]<=1; d[2]++) {
+	    if ((nd < 2 && d[1]) || (nd < 3 && d[2])) continue;
+	    for (k=0; k<3; k++) c[k] = cell[3*j+k] + d[k];
+	    b = cell_hash(c[0],c[1],c[2],nbuck-1);
+	    for (i=head[b]; i>=0; i=next[i]) {
+	      if (i <= j || cell[3*i] != c[0] || cell[3*i+1] != c[1] || cell[3*i+2] != c[2])
+		continue;
+	      p = dotprod(w,1,VEC(i),1,ndim);
+	      if (p >= tol) {
+		par[i] = j;
+		mem[nmem++] = i;
+	      }
+	    }
+	  }
+      /* keep the summation order of the full comparison */
+      qsort(mem,nmem,sizeof(int),compare_int);
+    } else {
+      for (i=j+1; i<nvec; i++) {
+	p = dotprod(w,1,VEC(i),1,ndim);
+	if (p >= tol) {
+	  par[i] = j;
+	  mem[nmem++] = i;
+	}
       }
     }
     /* average the close directions */
     cnt = 1;
-    for (i=j+1; i<nvec; i++) {
-      if (par[i] == j) {
-	cnt++;
-	for (k=0; k<ndim; k++) vec[ind[j]*ndim+k] += vec[ind[i]*ndim+k];
-      }
+    for (m=0; m<nmem; m++) {
+      cnt++;
+      v = VEC(mem[m]);
+      for (k=0; k<ndim; k++) w[k] += v[k];
     }
-    for (k=0; k<ndim; k++) vec[ind[j]*ndim+k] /= cnt;
+    for (k=0; k<ndim; k++) w[k] /= cnt;
     /* check if untreated vectors left */
-    //for (i=0; i<nvec; i++) printf("par[%d] = %d\n",i,par[i]);
     for (i=j+1; i<nvec; i++)
       if (par[i] < 0)
 	break;
     j = i;
-    //printf("Continuing from %d\n",j);
   }
   /* copy average vectors to other positions */
-  //for (i=0; i<nvec; i++) printf("par[%d] = %d\n",i,par[i]);
   for (i=0; i<nvec; i++) {
-    j = par[i];
-    if (j < i) {
-      //printf("Copying %d to %d\n",j,i);
-      for (k=0; k<ndim; k++) vec[ind[i]*ndim+k] = vec[ind[j]*ndim+k];
+    n = par[i];
+    if (n < i) {
+      v = VEC(i);
+      w = VEC(n);
+      for (k=0; k<ndim; k++) v[k] = w[k];
     }
   }
+#undef VEC
+  free(cell);
   free(par);
+  return 0;
 }
 
 
@@ -380,7 +1031,7 @@ static PyObject * averageDirection(PyObject *dummy, PyObject *args)
   PyObject *arr1=NULL;
   float *vec, tol;
   if (!PyArg_ParseTuple(args, "Of", &arg1, &tol)) return NULL;
-  arr1 = PyArray_FROM_OTF(arg1, NPY_FLOAT, NPY_ARRAY_INOUT_ARRAY);
+  arr1 = pf_from_otf(arg1, NPY_FLOAT, NPY_ARRAY_INOUT_ARRAY);
   if (arr1 == NULL) return NULL;
 
   npy_intp * dims;
@@ -390,7 +1041,14 @@ static PyObject * averageDirection(PyObject *dummy, PyObject *args)
   ndim = dims[1];
 
   vec = (float *)PYARRAY_DATA(arr1);
-  average_direction(vec,nvec,ndim,tol);
+  int error;
+  Py_BEGIN_ALLOW_THREADS
+  error = average_direction_group(vec,ndim,NULL,nvec,tol);
+  Py_END_ALLOW_THREADS
+  if (error) {
+    Py_DECREF(arr1);
+    return PyErr_NoMemory();
+  }
 
   /* Clean up and return */
   Py_DECREF(arr1);
@@ -406,9 +1064,9 @@ static PyObject * averageDirectionIndexed(PyObject *dummy, PyObject *args)
   int *ind;
   float *vec, tol;
   if (!PyArg_ParseTuple(args, "OOf", &arg1, &arg2, &tol)) return NULL;
-  arr1 = PyArray_FROM_OTF(arg1, NPY_FLOAT, NPY_ARRAY_INOUT_ARRAY);
+  arr1 = pf_from_otf(arg1, NPY_FLOAT, NPY_ARRAY_INOUT_ARRAY);
   if (arr1 == NULL) return NULL;
-  arr2 = PyArray_FROM_OTF(arg2, NPY_INT, NPY_ARRAY_INOUT_ARRAY);
+  arr2 = pf_from_otf(arg2, NPY_INT, NPY_ARRAY_INOUT_ARRAY);
   if (arr2 == NULL) goto fail;
 
   npy_intp * dims;
@@ -420,7 +1078,14 @@ static PyObject * averageDirectionIndexed(PyObject *dummy, PyObject *args)
 
   vec = (float *)PYARRAY_DATA(arr1);
   ind = (int *)PYARRAY_DATA(arr2);
-  average_direction_indexed(vec,ndim,ind,nvec,tol);
+  int error;
+  Py_BEGIN_ALLOW_THREADS
+  error = average_direction_group(vec,ndim,ind,nvec,tol);
+  Py_END_ALLOW_THREADS
+  if (error) {
+    PyErr_NoMemory();
+    goto fail;
+  }
 
   /* Clean up and return */
   Py_DECREF(arr1);
@@ -434,16 +1099,274 @@ static PyObject * averageDirectionIndexed(PyObject *dummy, PyObject *args)
 }
 
 
-/**************************************************** isoline ****/
-/* Create an isocontour through data at given level */
-/* args: data, level
-   data  : (nx,ny) shaped array of data values at points with
-           coordinates equal to their indices. This defines a 2D area
-           [0,nx-1], [0,ny-1]
-   level : data value at which the isocontour is to be constructed
-
-   Returns an (ntr,2,3) array defining the segments of the isocontour.
-   The result may be empty (if level is outside the data range).
+static char averageDirectionGroups_doc[] = "\
+averageDirectionGroups(vec, offsets, index, tol)\n\
+\n\n\
+Average close directions in groups of vectors.\n\
+\n\
+Parameters\n\
+----------\n\
+vec: float32 array (nvec,ndim)\n\
+    Normalized vectors. The array is changed in-place.\n\
+offsets: int32 array (ngroups+1,)\n\
+    The group g holds the entries offsets[g] <= i < offsets[g+1].\n\
+index: int32 array (nind,) or None\n\
+    The row numbers in vec of the group entries, like returned by\n\
+    :func:`nodalindex`. No row should appear in more than one group.\n\
+    If None, the entries are the rows of vec.\n\
+tol: float\n\
+    Tolerance on the projection of two vectors in the same direction.\n\
+\n\
+Notes\n\
+-----\n\
+In each group, the vectors with a mutual projection >= tol are replaced\n\
+with their average, as :func:`averageDirectionIndexed` does for a\n\
+single group. The groups are processed in parallel.\n\
+";
+
+static PyObject * averageDirectionGroups(PyObject *dummy, PyObject *args)
+{
+  PyObject *arg1=NULL, *arg2=NULL, *arg3=NULL;
+  PyObject *arr1=NULL, *arr2=NULL, *arr3=NULL;
+  int *offsets, *ind=NULL;
+  float *vec, tol;
+  if (!PyArg_ParseTuple(args, "OOOf", &arg1, &arg2, &arg3, &tol)) return NULL;
+  arr1 = pf_from_otf(arg1, NPY_FLOAT, NPY_ARRAY_INOUT_ARRAY);
+  if (arr1 == NULL) return NULL;
+  arr2 = pf_from_otf(arg2, NPY_INT, NPY_ARRAY_IN_ARRAY);
+  if (arr2 == NULL) goto fail;
+  if (arg3 != Py_None) {
+    arr3 = pf_from_otf(arg3, NPY_INT, NPY_ARRAY_IN_ARRAY);
+    if (arr3 == NULL) goto fail;
+  }
+
+  npy_intp i, nvec, nind, *dims;
+  int g, ngroups, ndim, error=0;
+  dims = PYARRAY_DIMS(arr1);
+  nvec = dims[0];
+  ndim = PyArray_NDIM((PyArrayObject *)arr1) > 1 ? dims[1] : 1;
+  ngroups = PyArray_SIZE((PyArrayObject *)arr2) - 1;
+  nind = arr3 ? PyArray_SIZE((PyArrayObject *)arr3) : nvec;
+  vec = (float *)PYARRAY_DATA(arr1);
+  offsets = (int *)PYARRAY_DATA(arr2);
+  if (arr3) ind = (int *)PYARRAY_DATA(arr3);
+
+  /* check the offsets and index */
+  for (g=0; g<ngroups; g++)
+    if (offsets[g] < 0 || offsets[g] > offsets[g+1] || offsets[g+1] > nind) {
+      PyErr_SetString(PyExc_ValueError, "invalid offsets");
+      goto fail;
+    }
+  if (ind)
+    for (i=0; i<nind; i++)
+      if (ind[i] < 0 || ind[i] >= nvec) {
+	PyErr_SetString(PyExc_ValueError, "index out of range");
+	goto fail;
+      }
+
+  Py_BEGIN_ALLOW_THREADS
+#pragma omp parallel for schedule(dynamic,64) reduction(|:error) num_threads(pf_threads())
+  for (g=0; g<ngroups; g++) {
+    if (ind)
+      error |= average_direction_group(vec,ndim,ind+offsets[g],offsets[g+1]-offsets[g],tol);
+    else
+      error |= average_direction_group(vec+(npy_intp)offsets[g]*ndim,ndim,NULL,offsets[g+1]-offsets[g],tol);
+  }
+  Py_END_ALLOW_THREADS
+  if (error) {
+    PyErr_NoMemory();
+    goto fail;
+  }
+
+  /* Clean up and return */
+  Py_DECREF(arr1);
+  Py_DECREF(arr2);
+  Py_XDECREF(arr3);
+  Py_INCREF(Py_None);
+  return Py_None;
+ fail:
+  Py_XDECREF(arr1);
+  Py_XDECREF(arr2);
+  Py_XDECREF(arr3);
+  return NULL;
+}
+
+
+/**************************************************** minmaxblocks ****/
+/* Minimum and maximum data values in blocks of grid cells */
+
+/* Number of blocks of bs cells along an axis with n points */
+static int nblocks(int n, int bs)
+{
+  return n > 1 ? (n-2) / bs + 1 : 1;
+}
+
+
+/*
+   Compute the minimum and maximum of the data values in blocks of
+   bs*bs*bs grid cells. The block (bz,by,bx) holds the cells
+   bz*bs <= iz < (bz+1)*bs, etcetera. The values at the points on the
+   boundary between two blocks are included in both of them.
+   bmin and bmax are (nbz,nby,nbx) arrays.
+*/
+void minmax_blocks(float *data, int nx, int ny, int nz, int bs, float *bmin, float *bmax)
+{
+  int nbx = nblocks(nx,bs), nby = nblocks(ny,bs), nbz = nblocks(nz,bs);
+  int b;
+#pragma omp parallel for schedule(dynamic) num_threads(pf_threads())
+  for (b=0; b<nbz*nby; b++) {
+    int bx, ix, iy, iz, ix1, iy0, iy1, iz0, iz1;
+    float v, vmin, vmax, *row;
+    iz0 = (b / nby) * bs;
+    iz1 = iz0 + bs < nz-1 ? iz0 + bs : nz-1;
+    iy0 = (b % nby) * bs;
+    iy1 = iy0 + bs < ny-1 ? iy0 + bs : ny-1;
+    for (bx=0; bx<nbx; bx++) {
+      ix1 = bx*bs + bs < nx-1 ? bx*bs + bs : nx-1;
+      vmin = INFINITY;
+      vmax = -INFINITY;
+      for (iz=iz0; iz<=iz1; iz++)
+	for (iy=iy0; iy<=iy1; iy++) {
+	  row = data + ((npy_intp)iz*ny + iy)*nx;
+	  for (ix=bx*bs; ix<=ix1; ix++) {
+	    v = row[ix];
+	    if (v < vmin) vmin = v;
+	    if (v > vmax) vmax = v;
+	  }
+	}
+      bmin[(npy_intp)b*nbx+bx] = vmin;
+      bmax[(npy_intp)b*nbx+bx] = vmax;
+    }
+  }
+}
+
+
+static char minmaxblocks_doc[] = "\
+minmaxblocks(data, bs)\n\
+\n\n\
+Compute the range of the data values in blocks of grid cells.\n\
+\n\
+Parameters\n\
+----------\n\
+data: float32 array (ny,nx) or (nz,ny,nx)\n\
+    Data values at the points of a 2D or 3D grid.\n\
+bs: int\n\
+    The number of cells along each axis of a block.\n\
+\n\
+Returns\n\
+-------\n\
+bmin: float32 array (nby,nbx) or (nbz,nby,nbx)\n\
+    The minimum data value in each block. The number of blocks along\n\
+    an axis with n points is (n-2)//bs + 1. The block (by,bx) contains\n\
+    the points by*bs <= iy <= (by+1)*bs, bx*bs <= ix <= (bx+1)*bs.\n\
+bmax: float32 array (nby,nbx) or (nbz,nby,nbx)\n\
+    The maximum data value in each block.\n\
+\n\
+See Also\n\
+--------\n\
+:class:`plugins.isosurface.MinMaxTree`: the user oriented class to use this\n\
+";
+
+static PyObject * minmaxblocks(PyObject *dummy, PyObject *args)
+{
+  PyObject *arg1=NULL;
+  PyObject *arr1=NULL, *ret1=NULL, *ret2=NULL;
+  int bs;
+  if (!PyArg_ParseTuple(args, "Oi", &arg1, &bs)) return NULL;
+  if (bs < 1) {
+    PyErr_SetString(PyExc_ValueError, "bs should be positive");
+    return NULL;
+  }
+  arr1 = pf_from_otf(arg1, NPY_FLOAT, NPY_ARRAY_IN_ARRAY);
+  if (arr1 == NULL) return NULL;
+
+  npy_intp *dims, dim[3];
+  int i, ndim, nx, ny, nz;
+  ndim = PyArray_NDIM((PyArrayObject *)arr1);
+  if (ndim != 2 && ndim != 3) {
+    PyErr_SetString(PyExc_ValueError, "data should be a 2D or 3D array");
+    goto fail;
+  }
+  dims = PYARRAY_DIMS(arr1);
+  nz = ndim == 3 ? dims[0] : 1;
+  ny = dims[ndim-2];
+  nx = dims[ndim-1];
+  for (i=0; i<ndim; i++) dim[i] = nblocks(dims[i],bs);
+
+  /* create return arrays */
+  ret1 = PyArray_SimpleNew(ndim,dim, NPY_FLOAT);
+  ret2 = PyArray_SimpleNew(ndim,dim, NPY_FLOAT);
+  if (ret1 == NULL || ret2 == NULL) goto fail;
+  float *data = (float *)PYARRAY_DATA(arr1);
+  float *bmin = (float *)PYARRAY_DATA(ret1);
+  float *bmax = (float *)PYARRAY_DATA(ret2);
+
+  Py_BEGIN_ALLOW_THREADS
+  minmax_blocks(data,nx,ny,nz,bs,bmin,bmax);
+  Py_END_ALLOW_THREADS
+
+  /* Clean up and return */
+  Py_DECREF(arr1);
+  return Py_BuildValue("NN",ret1,ret2);
+ fail:
+  Py_XDECREF(arr1);
+  Py_XDECREF(ret1);
+  Py_XDECREF(ret2);
+  return NULL;
+}
+
+
+/*
+   Convert the active blocks argument of isoline and isosurface.
+   The blocks should be an int array (nblk,ndim) of block indices,
+   sorted on the first index. Returns the converted array or NULL.
+*/
+static PyObject * check_blocks(PyObject *arg, int ndim, npy_intp *dims, int bs)
+{
+  PyObject *arr;
+  npy_intp *bdims, b, nblk;
+  int i, *blk;
+  if (bs < 1) {
+    PyErr_SetString(PyExc_ValueError, "bs should be positive");
+    return NULL;
+  }
+  arr = pf_from_otf(arg, NPY_INT, NPY_ARRAY_IN_ARRAY);
+  if (arr == NULL) return NULL;
+  bdims = PYARRAY_DIMS(arr);
+  if (PyArray_NDIM((PyArrayObject *)arr) != 2 || bdims[1] != ndim) {
+    PyErr_Format(PyExc_ValueError, "blocks should be an (nblk,%d) array", ndim);
+    goto fail;
+  }
+  nblk = bdims[0];
+  blk = (int *)PYARRAY_DATA(arr);
+  for (b=0; b<nblk; b++) {
+    for (i=0; i<ndim; i++)
+      if (blk[b*ndim+i] < 0 || blk[b*ndim+i] >= nblocks(dims[i],bs)) {
+	PyErr_SetString(PyExc_ValueError, "block index out of range");
+	goto fail;
+      }
+    if (b > 0 && blk[b*ndim] < blk[(b-1)*ndim]) {
+      PyErr_SetString(PyExc_ValueError, "blocks should be sorted");
+      goto fail;
+    }
+  }
+  return arr;
+ fail:
+  Py_DECREF(arr);
+  return NULL;
+}
+
+
+/**************************************************** isoline ****/
+/* Create an isocontour through data at given level */
+/* args: data, level
+   data  : (nx,ny) shaped array of data values at points with
+           coordinates equal to their indices. This defines a 2D area
+           [0,nx-1], [0,ny-1]
+   level : data value at which the isocontour is to be constructed
+
+   Returns an (ntr,2,3) array defining the segments of the isocontour.
+   The result may be empty (if level is outside the data range).
 
 */
 #define FLOAT float
@@ -551,7 +1474,7 @@ int Polygonise2(FLOAT *segments, XY *pos, FLOAT *val, FLOAT level)
 
 /**************************************************** isoline ****/
 static char isoline_doc[] = "\
-isoline(data, level)\n\
+isoline(data, level, blocks=None, bs=8)\n\
 \n\n\
 Create an isocontour through data at given level.\n\
 \n\
@@ -562,6 +1485,12 @@ data: float32 array (nx,ny)\n\
     This defines a 2D area (0..nx-1, 0..ny-1)\n\
 level: float\n\
     Data value at which the isocontour is to be constructed\n\
+blocks: int32 array (nblk,2), optional\n\
+    If provided, only the cells in these blocks of bs*bs cells are\n\
+    processed. The blocks are numbered as in :func:`minmaxblocks`\n\
+    and should be sorted.\n\
+bs: int\n\
+    The block size used in blocks.\n\
 \n\
 Returns\n\
 -------\n\
@@ -581,27 +1510,39 @@ This function uses a marching square algorithm.\n\
 
 static PyObject * isoline(PyObject *dummy, PyObject *args)
 {
-  PyObject *arg1=NULL;
-  PyObject *arr1=NULL;
+  PyObject *arg1=NULL, *arg2=Py_None;
+  PyObject *arr1=NULL, *arr2=NULL;
   float *data;
   float level;
+  int bs=8;
   //printf("ISOLINE\n");
-  if (!PyArg_ParseTuple(args, "Of", &arg1, &level)) return NULL;
-  arr1 = PyArray_FROM_OTF(arg1, NPY_FLOAT, NPY_ARRAY_INOUT_ARRAY);
+  if (!PyArg_ParseTuple(args, "Of|Oi", &arg1, &level, &arg2, &bs)) return NULL;
+  arr1 = pf_from_otf(arg1, NPY_FLOAT, NPY_ARRAY_IN_ARRAY);
   if (arr1 == NULL) return NULL;
 
   npy_intp * dims;
   int nx,ny;
-  dims = PYARRAY_DIMS(arg1);
+  dims = PYARRAY_DIMS(arr1);
   ny = dims[0];
   nx = dims[1];
   data = (float *)PYARRAY_DATA(arr1);
 
+  /* the active blocks, if given */
+  int *blocks = NULL;
+  npy_intp b, nbox = 1;
+  if (arg2 != Py_None) {
+    arr2 = check_blocks(arg2,2,dims,bs);
+    if (arr2 == NULL) goto fail;
+    blocks = (int *)PYARRAY_DATA(arr2);
+    nbox = PYARRAY_DIMS(arr2)[0];
+  }
+
   /* allocate memory for segments */
   int niseg = nx*ny; /* initial guess for number of segments */
   int nseg = 0;   /* size of storage available */
   int iseg = 0;   /* size of storage filled */
   float *segments = NULL; /* pointer to storage size */
+  if (blocks) niseg = nbox*bs*bs;
 
   /* vertex coordinates with respect to ix,iy */
   int grid[4][2] = {
@@ -619,32 +1560,56 @@ static PyObject * isoline(PyObject *dummy, PyObject *args)
     //printf("%d\n",ofs[i]);
   }
 
-  /* loop over cells */
+  /* loop over cells, or over the cells of the active blocks */
   int mseg;
-  int ix,iy;
+  int ix,iy,ix0,ix1,iy0,iy1;
   XY pos[4];   /* coordinates of the cell vertices */
   FLOAT val[4]; /* data values at the cell vertices */
-  int iofs;     /* data offset of vertex ix,iy */
-  for (iy=0; iy<ny-1; iy++) {
-    for (i=0; i<4; i++) pos[i].y = iy + grid[i][1];
-    for (ix=0; ix<nx-1; ix++) {
-      for (i=0; i<4; i++) pos[i].x = ix + grid[i][0];
-      iofs = iy*nx + ix;
-      for (i=0; i<4; i++) val[i] = data[iofs + ofs[i]];
-      if (iseg+2 > nseg) {
-	/* need to enlarge storage */
-	nseg += niseg;
-	segments = (float*) realloc(segments,nseg*2*2*sizeof(float));
+  npy_intp iofs;     /* data offset of vertex ix,iy */
+  float *p;
+  int nomem = 0;
+  Py_BEGIN_ALLOW_THREADS
+  for (b=0; b<nbox; b++) {
+    if (blocks) {
+      iy0 = blocks[2*b] * bs;
+      ix0 = blocks[2*b+1] * bs;
+      iy1 = iy0 + bs < ny-1 ? iy0 + bs : ny-1;
+      ix1 = ix0 + bs < nx-1 ? ix0 + bs : nx-1;
+    } else {
+      iy0 = ix0 = 0;
+      iy1 = ny-1;
+      ix1 = nx-1;
+    }
+    for (iy=iy0; iy<iy1; iy++) {
+      for (i=0; i<4; i++) pos[i].y = iy + grid[i][1];
+      for (ix=ix0; ix<ix1; ix++) {
+	for (i=0; i<4; i++) pos[i].x = ix + grid[i][0];
+	iofs = (npy_intp)iy*nx + ix;
+	for (i=0; i<4; i++) val[i] = data[iofs + ofs[i]];
+	while (iseg+2 > nseg) {
+	  /* need to enlarge storage */
+	  nseg += niseg;
+	  p = (float*) realloc(segments,nseg*2*2*sizeof(float));
+	  if (p == NULL) {
+	    free(segments);
+	    nomem = 1;
+	    goto done;
+	  }
+	  segments = p;
+	}
+	mseg = Polygonise2(segments+iseg*2*2,pos,val,level);
+	iseg += mseg;
       }
-      //printf("Values\n");
-      //for (i=0; i<4; i++) {
-      //	printf("%f, %f : %f\n",pos[i].x,pos[i].y,val[i]);
-      //}
-      mseg = Polygonise2(segments+iseg*2*2,pos,val,level);
-      iseg += mseg;
-      //printf("%d new segments; %d total segments; %d max segments\n",mseg,iseg,nseg);
     }
   }
+ done:
+  Py_END_ALLOW_THREADS
+  if (nomem) {
+    PyErr_NoMemory();
+    goto fail;
+  }
+  PF_STAT_SCRATCH(nseg*2*2*sizeof(float));
+  PF_STAT_ITEMS(iseg);
 
   /* create return array */
   npy_intp dim[3];
@@ -652,12 +1617,20 @@ static PyObject * isoline(PyObject *dummy, PyObject *args)
   dim[1] = 2;
   dim[2] = 2;
   PyObject *ret = PyArray_SimpleNew(3,dim, NPY_FLOAT);
-  float *out = (float *)PYARRAY_DATA(ret);
-  memcpy(out,segments,iseg*2*2*sizeof(float));
+  if (ret != NULL) {
+    float *out = (float *)PYARRAY_DATA(ret);
+    memcpy(out,segments,iseg*2*2*sizeof(float));
+  }
+  free(segments);
 
   /* Clean up and return */
   Py_DECREF(arr1);
+  Py_XDECREF(arr2);
   return ret;
+ fail:
+  Py_XDECREF(arr1);
+  Py_XDECREF(arr2);
+  return NULL;
 }
 
 
@@ -714,6 +1687,315 @@ XYZ VertexInterp(XYZ p1, XYZ p2, FLOAT v1, FLOAT v2, FLOAT level)
   return(p);
 }
 
+/* Marching cubes tables */
+static const int edgeTable[256] = {
+  0x0  , 0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c,
+  0x80c, 0x905, 0xa0f, 0xb06, 0xc0a, 0xd03, 0xe09, 0xf00,
+  0x190, 0x99 , 0x393, 0x29a, 0x596, 0x49f, 0x795, 0x69c,
+  0x99c, 0x895, 0xb9f, 0xa96, 0xd9a, 0xc93, 0xf99, 0xe90,
+  0x230, 0x339, 0x33 , 0x13a, 0x636, 0x73f, 0x435, 0x53c,
+  0xa3c, 0xb35, 0x83f, 0x936, 0xe3a, 0xf33, 0xc39, 0xd30,
+  0x3a0, 0x2a9, 0x1a3, 0xaa , 0x7a6, 0x6af, 0x5a5, 0x4ac,
+  0xbac, 0xaa5, 0x9af, 0x8a6, 0xfaa, 0xea3, 0xda9, 0xca0,
+  0x460, 0x569, 0x663, 0x76a, 0x66 , 0x16f, 0x265, 0x36c,
+  0xc6c, 0xd65, 0xe6f, 0xf66, 0x86a, 0x963, 0xa69, 0xb60,
+  0x5f0, 0x4f9, 0x7f3, 0x6fa, 0x1f6, 0xff , 0x3f5, 0x2fc,
+  0xdfc, 0xcf5, 0xfff, 0xef6, 0x9fa, 0x8f3, 0xbf9, 0xaf0,
+  0x650, 0x759, 0x453, 0x55a, 0x256, 0x35f, 0x55 , 0x15c,
+  0xe5c, 0xf55, 0xc5f, 0xd56, 0xa5a, 0xb53, 0x859, 0x950,
+  0x7c0, 0x6c9, 0x5c3, 0x4ca, 0x3c6, 0x2cf, 0x1c5, 0xcc ,
+  0xfcc, 0xec5, 0xdcf, 0xcc6, 0xbca, 0xac3, 0x9c9, 0x8c0,
+  0x8c0, 0x9c9, 0xac3, 0xbca, 0xcc6, 0xdcf, 0xec5, 0xfcc,
+  0xcc , 0x1c5, 0x2cf, 0x3c6, 0x4ca, 0x5c3, 0x6c9, 0x7c0,
+  0x950, 0x859, 0xb53, 0xa5a, 0xd56, 0xc5f, 0xf55, 0xe5c,
+  0x15c, 0x55 , 0x35f, 0x256, 0x55a, 0x453, 0x759, 0x650,
+  0xaf0, 0xbf9, 0x8f3, 0x9fa, 0xef6, 0xfff, 0xcf5, 0xdfc,
+  0x2fc, 0x3f5, 0xff , 0x1f6, 0x6fa, 0x7f3, 0x4f9, 0x5f0,
+  0xb60, 0xa69, 0x963, 0x86a, 0xf66, 0xe6f, 0xd65, 0xc6c,
+  0x36c, 0x265, 0x16f, 0x66 , 0x76a, 0x663, 0x569, 0x460,
+  0xca0, 0xda9, 0xea3, 0xfaa, 0x8a6, 0x9af, 0xaa5, 0xbac,
+  0x4ac, 0x5a5, 0x6af, 0x7a6, 0xaa , 0x1a3, 0x2a9, 0x3a0,
+  0xd30, 0xc39, 0xf33, 0xe3a, 0x936, 0x83f, 0xb35, 0xa3c,
+  0x53c, 0x435, 0x73f, 0x636, 0x13a, 0x33 , 0x339, 0x230,
+  0xe90, 0xf99, 0xc93, 0xd9a, 0xa96, 0xb9f, 0x895, 0x99c,
+  0x69c, 0x795, 0x49f, 0x596, 0x29a, 0x393, 0x99 , 0x190,
+  0xf00, 0xe09, 0xd03, 0xc0a, 0xb06, 0xa0f, 0x905, 0x80c,
+  0x70c, 0x605, 0x50f, 0x406, 0x30a, 0x203, 0x109, 0x0   };
+
+static const int triTable[256][16] = {
+  {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {1, 8, 3, 9, 8, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 8, 3, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {9, 2, 10, 0, 2, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {2, 8, 3, 2, 10, 8, 10, 9, 8, -1, -1, -1, -1, -1, -1, -1},
+  {3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 11, 2, 8, 11, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {1, 9, 0, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {1, 11, 2, 1, 9, 11, 9, 8, 11, -1, -1, -1, -1, -1, -1, -1},
+  {3, 10, 1, 11, 10, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 10, 1, 0, 8, 10, 8, 11, 10, -1, -1, -1, -1, -1, -1, -1},
+  {3, 9, 0, 3, 11, 9, 11, 10, 9, -1, -1, -1, -1, -1, -1, -1},
+  {9, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {4, 3, 0, 7, 3, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 1, 9, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {4, 1, 9, 4, 7, 1, 7, 3, 1, -1, -1, -1, -1, -1, -1, -1},
+  {1, 2, 10, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {3, 4, 7, 3, 0, 4, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1},
+  {9, 2, 10, 9, 0, 2, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
+  {2, 10, 9, 2, 9, 7, 2, 7, 3, 7, 9, 4, -1, -1, -1, -1},
+  {8, 4, 7, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {11, 4, 7, 11, 2, 4, 2, 0, 4, -1, -1, -1, -1, -1, -1, -1},
+  {9, 0, 1, 8, 4, 7, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
+  {4, 7, 11, 9, 4, 11, 9, 11, 2, 9, 2, 1, -1, -1, -1, -1},
+  {3, 10, 1, 3, 11, 10, 7, 8, 4, -1, -1, -1, -1, -1, -1, -1},
+  {1, 11, 10, 1, 4, 11, 1, 0, 4, 7, 11, 4, -1, -1, -1, -1},
+  {4, 7, 8, 9, 0, 11, 9, 11, 10, 11, 0, 3, -1, -1, -1, -1},
+  {4, 7, 11, 4, 11, 9, 9, 11, 10, -1, -1, -1, -1, -1, -1, -1},
+  {9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {9, 5, 4, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 5, 4, 1, 5, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {8, 5, 4, 8, 3, 5, 3, 1, 5, -1, -1, -1, -1, -1, -1, -1},
+  {1, 2, 10, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {3, 0, 8, 1, 2, 10, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
+  {5, 2, 10, 5, 4, 2, 4, 0, 2, -1, -1, -1, -1, -1, -1, -1},
+  {2, 10, 5, 3, 2, 5, 3, 5, 4, 3, 4, 8, -1, -1, -1, -1},
+  {9, 5, 4, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 11, 2, 0, 8, 11, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
+  {0, 5, 4, 0, 1, 5, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
+  {2, 1, 5, 2, 5, 8, 2, 8, 11, 4, 8, 5, -1, -1, -1, -1},
+  {10, 3, 11, 10, 1, 3, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1},
+  {4, 9, 5, 0, 8, 1, 8, 10, 1, 8, 11, 10, -1, -1, -1, -1},
+  {5, 4, 0, 5, 0, 11, 5, 11, 10, 11, 0, 3, -1, -1, -1, -1},
+  {5, 4, 8, 5, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1},
+  {9, 7, 8, 5, 7, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {9, 3, 0, 9, 5, 3, 5, 7, 3, -1, -1, -1, -1, -1, -1, -1},
+  {0, 7, 8, 0, 1, 7, 1, 5, 7, -1, -1, -1, -1, -1, -1, -1},
+  {1, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {9, 7, 8, 9, 5, 7, 10, 1, 2, -1, -1, -1, -1, -1, -1, -1},
+  {10, 1, 2, 9, 5, 0, 5, 3, 0, 5, 7, 3, -1, -1, -1, -1},
+  {8, 0, 2, 8, 2, 5, 8, 5, 7, 10, 5, 2, -1, -1, -1, -1},
+  {2, 10, 5, 2, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1},
+  {7, 9, 5, 7, 8, 9, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1},
+  {9, 5, 7, 9, 7, 2, 9, 2, 0, 2, 7, 11, -1, -1, -1, -1},
+  {2, 3, 11, 0, 1, 8, 1, 7, 8, 1, 5, 7, -1, -1, -1, -1},
+  {11, 2, 1, 11, 1, 7, 7, 1, 5, -1, -1, -1, -1, -1, -1, -1},
+  {9, 5, 8, 8, 5, 7, 10, 1, 3, 10, 3, 11, -1, -1, -1, -1},
+  {5, 7, 0, 5, 0, 9, 7, 11, 0, 1, 0, 10, 11, 10, 0, -1},
+  {11, 10, 0, 11, 0, 3, 10, 5, 0, 8, 0, 7, 5, 7, 0, -1},
+  {11, 10, 5, 7, 11, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 8, 3, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {9, 0, 1, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {1, 8, 3, 1, 9, 8, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+  {1, 6, 5, 2, 6, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {1, 6, 5, 1, 2, 6, 3, 0, 8, -1, -1, -1, -1, -1, -1, -1},
+  {9, 6, 5, 9, 0, 6, 0, 2, 6, -1, -1, -1, -1, -1, -1, -1},
+  {5, 9, 8, 5, 8, 2, 5, 2, 6, 3, 2, 8, -1, -1, -1, -1},
+  {2, 3, 11, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {11, 0, 8, 11, 2, 0, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
+  {0, 1, 9, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+  {5, 10, 6, 1, 9, 2, 9, 11, 2, 9, 8, 11, -1, -1, -1, -1},
+  {6, 3, 11, 6, 5, 3, 5, 1, 3, -1, -1, -1, -1, -1, -1, -1},
+  {0, 8, 11, 0, 11, 5, 0, 5, 1, 5, 11, 6, -1, -1, -1, -1},
+  {3, 11, 6, 0, 3, 6, 0, 6, 5, 0, 5, 9, -1, -1, -1, -1},
+  {6, 5, 9, 6, 9, 11, 11, 9, 8, -1, -1, -1, -1, -1, -1, -1},
+  {5, 10, 6, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {4, 3, 0, 4, 7, 3, 6, 5, 10, -1, -1, -1, -1, -1, -1, -1},
+  {1, 9, 0, 5, 10, 6, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
+  {10, 6, 5, 1, 9, 7, 1, 7, 3, 7, 9, 4, -1, -1, -1, -1},
+  {6, 1, 2, 6, 5, 1, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1},
+  {1, 2, 5, 5, 2, 6, 3, 0, 4, 3, 4, 7, -1, -1, -1, -1},
+  {8, 4, 7, 9, 0, 5, 0, 6, 5, 0, 2, 6, -1, -1, -1, -1},
+  {7, 3, 9, 7, 9, 4, 3, 2, 9, 5, 9, 6, 2, 6, 9, -1},
+  {3, 11, 2, 7, 8, 4, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
+  {5, 10, 6, 4, 7, 2, 4, 2, 0, 2, 7, 11, -1, -1, -1, -1},
+  {0, 1, 9, 4, 7, 8, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1},
+  {9, 2, 1, 9, 11, 2, 9, 4, 11, 7, 11, 4, 5, 10, 6, -1},
+  {8, 4, 7, 3, 11, 5, 3, 5, 1, 5, 11, 6, -1, -1, -1, -1},
+  {5, 1, 11, 5, 11, 6, 1, 0, 11, 7, 11, 4, 0, 4, 11, -1},
+  {0, 5, 9, 0, 6, 5, 0, 3, 6, 11, 6, 3, 8, 4, 7, -1},
+  {6, 5, 9, 6, 9, 11, 4, 7, 9, 7, 11, 9, -1, -1, -1, -1},
+  {10, 4, 9, 6, 4, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {4, 10, 6, 4, 9, 10, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1},
+  {10, 0, 1, 10, 6, 0, 6, 4, 0, -1, -1, -1, -1, -1, -1, -1},
+  {8, 3, 1, 8, 1, 6, 8, 6, 4, 6, 1, 10, -1, -1, -1, -1},
+  {1, 4, 9, 1, 2, 4, 2, 6, 4, -1, -1, -1, -1, -1, -1, -1},
+  {3, 0, 8, 1, 2, 9, 2, 4, 9, 2, 6, 4, -1, -1, -1, -1},
+  {0, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {8, 3, 2, 8, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1},
+  {10, 4, 9, 10, 6, 4, 11, 2, 3, -1, -1, -1, -1, -1, -1, -1},
+  {0, 8, 2, 2, 8, 11, 4, 9, 10, 4, 10, 6, -1, -1, -1, -1},
+  {3, 11, 2, 0, 1, 6, 0, 6, 4, 6, 1, 10, -1, -1, -1, -1},
+  {6, 4, 1, 6, 1, 10, 4, 8, 1, 2, 1, 11, 8, 11, 1, -1},
+  {9, 6, 4, 9, 3, 6, 9, 1, 3, 11, 6, 3, -1, -1, -1, -1},
+  {8, 11, 1, 8, 1, 0, 11, 6, 1, 9, 1, 4, 6, 4, 1, -1},
+  {3, 11, 6, 3, 6, 0, 0, 6, 4, -1, -1, -1, -1, -1, -1, -1},
+  {6, 4, 8, 11, 6, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {7, 10, 6, 7, 8, 10, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1},
+  {0, 7, 3, 0, 10, 7, 0, 9, 10, 6, 7, 10, -1, -1, -1, -1},
+  {10, 6, 7, 1, 10, 7, 1, 7, 8, 1, 8, 0, -1, -1, -1, -1},
+  {10, 6, 7, 10, 7, 1, 1, 7, 3, -1, -1, -1, -1, -1, -1, -1},
+  {1, 2, 6, 1, 6, 8, 1, 8, 9, 8, 6, 7, -1, -1, -1, -1},
+  {2, 6, 9, 2, 9, 1, 6, 7, 9, 0, 9, 3, 7, 3, 9, -1},
+  {7, 8, 0, 7, 0, 6, 6, 0, 2, -1, -1, -1, -1, -1, -1, -1},
+  {7, 3, 2, 6, 7, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {2, 3, 11, 10, 6, 8, 10, 8, 9, 8, 6, 7, -1, -1, -1, -1},
+  {2, 0, 7, 2, 7, 11, 0, 9, 7, 6, 7, 10, 9, 10, 7, -1},
+  {1, 8, 0, 1, 7, 8, 1, 10, 7, 6, 7, 10, 2, 3, 11, -1},
+  {11, 2, 1, 11, 1, 7, 10, 6, 1, 6, 7, 1, -1, -1, -1, -1},
+  {8, 9, 6, 8, 6, 7, 9, 1, 6, 11, 6, 3, 1, 3, 6, -1},
+  {0, 9, 1, 11, 6, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {7, 8, 0, 7, 0, 6, 3, 11, 0, 11, 6, 0, -1, -1, -1, -1},
+  {7, 11, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {3, 0, 8, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 1, 9, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {8, 1, 9, 8, 3, 1, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
+  {10, 1, 2, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {1, 2, 10, 3, 0, 8, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
+  {2, 9, 0, 2, 10, 9, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
+  {6, 11, 7, 2, 10, 3, 10, 8, 3, 10, 9, 8, -1, -1, -1, -1},
+  {7, 2, 3, 6, 2, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {7, 0, 8, 7, 6, 0, 6, 2, 0, -1, -1, -1, -1, -1, -1, -1},
+  {2, 7, 6, 2, 3, 7, 0, 1, 9, -1, -1, -1, -1, -1, -1, -1},
+  {1, 6, 2, 1, 8, 6, 1, 9, 8, 8, 7, 6, -1, -1, -1, -1},
+  {10, 7, 6, 10, 1, 7, 1, 3, 7, -1, -1, -1, -1, -1, -1, -1},
+  {10, 7, 6, 1, 7, 10, 1, 8, 7, 1, 0, 8, -1, -1, -1, -1},
+  {0, 3, 7, 0, 7, 10, 0, 10, 9, 6, 10, 7, -1, -1, -1, -1},
+  {7, 6, 10, 7, 10, 8, 8, 10, 9, -1, -1, -1, -1, -1, -1, -1},
+  {6, 8, 4, 11, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {3, 6, 11, 3, 0, 6, 0, 4, 6, -1, -1, -1, -1, -1, -1, -1},
+  {8, 6, 11, 8, 4, 6, 9, 0, 1, -1, -1, -1, -1, -1, -1, -1},
+  {9, 4, 6, 9, 6, 3, 9, 3, 1, 11, 3, 6, -1, -1, -1, -1},
+  {6, 8, 4, 6, 11, 8, 2, 10, 1, -1, -1, -1, -1, -1, -1, -1},
+  {1, 2, 10, 3, 0, 11, 0, 6, 11, 0, 4, 6, -1, -1, -1, -1},
+  {4, 11, 8, 4, 6, 11, 0, 2, 9, 2, 10, 9, -1, -1, -1, -1},
+  {10, 9, 3, 10, 3, 2, 9, 4, 3, 11, 3, 6, 4, 6, 3, -1},
+  {8, 2, 3, 8, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1},
+  {0, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {1, 9, 0, 2, 3, 4, 2, 4, 6, 4, 3, 8, -1, -1, -1, -1},
+  {1, 9, 4, 1, 4, 2, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1},
+  {8, 1, 3, 8, 6, 1, 8, 4, 6, 6, 10, 1, -1, -1, -1, -1},
+  {10, 1, 0, 10, 0, 6, 6, 0, 4, -1, -1, -1, -1, -1, -1, -1},
+  {4, 6, 3, 4, 3, 8, 6, 10, 3, 0, 3, 9, 10, 9, 3, -1},
+  {10, 9, 4, 6, 10, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {4, 9, 5, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 8, 3, 4, 9, 5, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
+  {5, 0, 1, 5, 4, 0, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
+  {11, 7, 6, 8, 3, 4, 3, 5, 4, 3, 1, 5, -1, -1, -1, -1},
+  {9, 5, 4, 10, 1, 2, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
+  {6, 11, 7, 1, 2, 10, 0, 8, 3, 4, 9, 5, -1, -1, -1, -1},
+  {7, 6, 11, 5, 4, 10, 4, 2, 10, 4, 0, 2, -1, -1, -1, -1},
+  {3, 4, 8, 3, 5, 4, 3, 2, 5, 10, 5, 2, 11, 7, 6, -1},
+  {7, 2, 3, 7, 6, 2, 5, 4, 9, -1, -1, -1, -1, -1, -1, -1},
+  {9, 5, 4, 0, 8, 6, 0, 6, 2, 6, 8, 7, -1, -1, -1, -1},
+  {3, 6, 2, 3, 7, 6, 1, 5, 0, 5, 4, 0, -1, -1, -1, -1},
+  {6, 2, 8, 6, 8, 7, 2, 1, 8, 4, 8, 5, 1, 5, 8, -1},
+  {9, 5, 4, 10, 1, 6, 1, 7, 6, 1, 3, 7, -1, -1, -1, -1},
+  {1, 6, 10, 1, 7, 6, 1, 0, 7, 8, 7, 0, 9, 5, 4, -1},
+  {4, 0, 10, 4, 10, 5, 0, 3, 10, 6, 10, 7, 3, 7, 10, -1},
+  {7, 6, 10, 7, 10, 8, 5, 4, 10, 4, 8, 10, -1, -1, -1, -1},
+  {6, 9, 5, 6, 11, 9, 11, 8, 9, -1, -1, -1, -1, -1, -1, -1},
+  {3, 6, 11, 0, 6, 3, 0, 5, 6, 0, 9, 5, -1, -1, -1, -1},
+  {0, 11, 8, 0, 5, 11, 0, 1, 5, 5, 6, 11, -1, -1, -1, -1},
+  {6, 11, 3, 6, 3, 5, 5, 3, 1, -1, -1, -1, -1, -1, -1, -1},
+  {1, 2, 10, 9, 5, 11, 9, 11, 8, 11, 5, 6, -1, -1, -1, -1},
+  {0, 11, 3, 0, 6, 11, 0, 9, 6, 5, 6, 9, 1, 2, 10, -1},
+  {11, 8, 5, 11, 5, 6, 8, 0, 5, 10, 5, 2, 0, 2, 5, -1},
+  {6, 11, 3, 6, 3, 5, 2, 10, 3, 10, 5, 3, -1, -1, -1, -1},
+  {5, 8, 9, 5, 2, 8, 5, 6, 2, 3, 8, 2, -1, -1, -1, -1},
+  {9, 5, 6, 9, 6, 0, 0, 6, 2, -1, -1, -1, -1, -1, -1, -1},
+  {1, 5, 8, 1, 8, 0, 5, 6, 8, 3, 8, 2, 6, 2, 8, -1},
+  {1, 5, 6, 2, 1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {1, 3, 6, 1, 6, 10, 3, 8, 6, 5, 6, 9, 8, 9, 6, -1},
+  {10, 1, 0, 10, 0, 6, 9, 5, 0, 5, 6, 0, -1, -1, -1, -1},
+  {0, 3, 8, 5, 6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {10, 5, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {11, 5, 10, 7, 5, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {11, 5, 10, 11, 7, 5, 8, 3, 0, -1, -1, -1, -1, -1, -1, -1},
+  {5, 11, 7, 5, 10, 11, 1, 9, 0, -1, -1, -1, -1, -1, -1, -1},
+  {10, 7, 5, 10, 11, 7, 9, 8, 1, 8, 3, 1, -1, -1, -1, -1},
+  {11, 1, 2, 11, 7, 1, 7, 5, 1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 8, 3, 1, 2, 7, 1, 7, 5, 7, 2, 11, -1, -1, -1, -1},
+  {9, 7, 5, 9, 2, 7, 9, 0, 2, 2, 11, 7, -1, -1, -1, -1},
+  {7, 5, 2, 7, 2, 11, 5, 9, 2, 3, 2, 8, 9, 8, 2, -1},
+  {2, 5, 10, 2, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1},
+  {8, 2, 0, 8, 5, 2, 8, 7, 5, 10, 2, 5, -1, -1, -1, -1},
+  {9, 0, 1, 5, 10, 3, 5, 3, 7, 3, 10, 2, -1, -1, -1, -1},
+  {9, 8, 2, 9, 2, 1, 8, 7, 2, 10, 2, 5, 7, 5, 2, -1},
+  {1, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 8, 7, 0, 7, 1, 1, 7, 5, -1, -1, -1, -1, -1, -1, -1},
+  {9, 0, 3, 9, 3, 5, 5, 3, 7, -1, -1, -1, -1, -1, -1, -1},
+  {9, 8, 7, 5, 9, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {5, 8, 4, 5, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1},
+  {5, 0, 4, 5, 11, 0, 5, 10, 11, 11, 3, 0, -1, -1, -1, -1},
+  {0, 1, 9, 8, 4, 10, 8, 10, 11, 10, 4, 5, -1, -1, -1, -1},
+  {10, 11, 4, 10, 4, 5, 11, 3, 4, 9, 4, 1, 3, 1, 4, -1},
+  {2, 5, 1, 2, 8, 5, 2, 11, 8, 4, 5, 8, -1, -1, -1, -1},
+  {0, 4, 11, 0, 11, 3, 4, 5, 11, 2, 11, 1, 5, 1, 11, -1},
+  {0, 2, 5, 0, 5, 9, 2, 11, 5, 4, 5, 8, 11, 8, 5, -1},
+  {9, 4, 5, 2, 11, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {2, 5, 10, 3, 5, 2, 3, 4, 5, 3, 8, 4, -1, -1, -1, -1},
+  {5, 10, 2, 5, 2, 4, 4, 2, 0, -1, -1, -1, -1, -1, -1, -1},
+  {3, 10, 2, 3, 5, 10, 3, 8, 5, 4, 5, 8, 0, 1, 9, -1},
+  {5, 10, 2, 5, 2, 4, 1, 9, 2, 9, 4, 2, -1, -1, -1, -1},
+  {8, 4, 5, 8, 5, 3, 3, 5, 1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 4, 5, 1, 0, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {8, 4, 5, 8, 5, 3, 9, 0, 5, 0, 3, 5, -1, -1, -1, -1},
+  {9, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {4, 11, 7, 4, 9, 11, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1},
+  {0, 8, 3, 4, 9, 7, 9, 11, 7, 9, 10, 11, -1, -1, -1, -1},
+  {1, 10, 11, 1, 11, 4, 1, 4, 0, 7, 4, 11, -1, -1, -1, -1},
+  {3, 1, 4, 3, 4, 8, 1, 10, 4, 7, 4, 11, 10, 11, 4, -1},
+  {4, 11, 7, 9, 11, 4, 9, 2, 11, 9, 1, 2, -1, -1, -1, -1},
+  {9, 7, 4, 9, 11, 7, 9, 1, 11, 2, 11, 1, 0, 8, 3, -1},
+  {11, 7, 4, 11, 4, 2, 2, 4, 0, -1, -1, -1, -1, -1, -1, -1},
+  {11, 7, 4, 11, 4, 2, 8, 3, 4, 3, 2, 4, -1, -1, -1, -1},
+  {2, 9, 10, 2, 7, 9, 2, 3, 7, 7, 4, 9, -1, -1, -1, -1},
+  {9, 10, 7, 9, 7, 4, 10, 2, 7, 8, 7, 0, 2, 0, 7, -1},
+  {3, 7, 10, 3, 10, 2, 7, 4, 10, 1, 10, 0, 4, 0, 10, -1},
+  {1, 10, 2, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {4, 9, 1, 4, 1, 7, 7, 1, 3, -1, -1, -1, -1, -1, -1, -1},
+  {4, 9, 1, 4, 1, 7, 0, 8, 1, 8, 7, 1, -1, -1, -1, -1},
+  {4, 0, 3, 7, 4, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {4, 8, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {9, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {3, 0, 9, 3, 9, 11, 11, 9, 10, -1, -1, -1, -1, -1, -1, -1},
+  {0, 1, 10, 0, 10, 8, 8, 10, 11, -1, -1, -1, -1, -1, -1, -1},
+  {3, 1, 10, 11, 3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {1, 2, 11, 1, 11, 9, 9, 11, 8, -1, -1, -1, -1, -1, -1, -1},
+  {3, 0, 9, 3, 9, 11, 1, 2, 9, 2, 11, 9, -1, -1, -1, -1},
+  {0, 2, 11, 8, 0, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {3, 2, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {2, 3, 8, 2, 8, 10, 10, 8, 9, -1, -1, -1, -1, -1, -1, -1},
+  {9, 10, 2, 0, 9, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {2, 3, 8, 2, 8, 10, 0, 1, 8, 1, 10, 8, -1, -1, -1, -1},
+  {1, 10, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {1, 3, 8, 9, 1, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 9, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+  {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}};
+
+/* Edge connections: 2 vertices per edge*/
+static const int edge_con[12][2] = {
+  {0,1},
+  {1,2},
+  {2,3},
+  {3,0},
+  {4,5},
+  {5,6},
+  {6,7},
+  {7,4},
+  {0,4},
+  {1,5},
+  {2,6},
+  {3,7}};
+
+
 /*
    Given a grid cell and an isolevel, calculate the triangular
    facets required to represent the isosurface through the cell.
@@ -724,313 +2006,6 @@ XYZ VertexInterp(XYZ p1, XYZ p2, FLOAT v1, FLOAT v2, FLOAT level)
 */
 int Polygonise(FLOAT *triangles, XYZ *pos, FLOAT *val, FLOAT level)
 {
-  int edgeTable[256] = {
-    0x0  , 0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c,
-    0x80c, 0x905, 0xa0f, 0xb06, 0xc0a, 0xd03, 0xe09, 0xf00,
-    0x190, 0x99 , 0x393, 0x29a, 0x596, 0x49f, 0x795, 0x69c,
-    0x99c, 0x895, 0xb9f, 0xa96, 0xd9a, 0xc93, 0xf99, 0xe90,
-    0x230, 0x339, 0x33 , 0x13a, 0x636, 0x73f, 0x435, 0x53c,
-    0xa3c, 0xb35, 0x83f, 0x936, 0xe3a, 0xf33, 0xc39, 0xd30,
-    0x3a0, 0x2a9, 0x1a3, 0xaa , 0x7a6, 0x6af, 0x5a5, 0x4ac,
-    0xbac, 0xaa5, 0x9af, 0x8a6, 0xfaa, 0xea3, 0xda9, 0xca0,
-    0x460, 0x569, 0x663, 0x76a, 0x66 , 0x16f, 0x265, 0x36c,
-    0xc6c, 0xd65, 0xe6f, 0xf66, 0x86a, 0x963, 0xa69, 0xb60,
-    0x5f0, 0x4f9, 0x7f3, 0x6fa, 0x1f6, 0xff , 0x3f5, 0x2fc,
-    0xdfc, 0xcf5, 0xfff, 0xef6, 0x9fa, 0x8f3, 0xbf9, 0xaf0,
-    0x650, 0x759, 0x453, 0x55a, 0x256, 0x35f, 0x55 , 0x15c,
-    0xe5c, 0xf55, 0xc5f, 0xd56, 0xa5a, 0xb53, 0x859, 0x950,
-    0x7c0, 0x6c9, 0x5c3, 0x4ca, 0x3c6, 0x2cf, 0x1c5, 0xcc ,
-    0xfcc, 0xec5, 0xdcf, 0xcc6, 0xbca, 0xac3, 0x9c9, 0x8c0,
-    0x8c0, 0x9c9, 0xac3, 0xbca, 0xcc6, 0xdcf, 0xec5, 0xfcc,
-    0xcc , 0x1c5, 0x2cf, 0x3c6, 0x4ca, 0x5c3, 0x6c9, 0x7c0,
-    0x950, 0x859, 0xb53, 0xa5a, 0xd56, 0xc5f, 0xf55, 0xe5c,
-    0x15c, 0x55 , 0x35f, 0x256, 0x55a, 0x453, 0x759, 0x650,
-    0xaf0, 0xbf9, 0x8f3, 0x9fa, 0xef6, 0xfff, 0xcf5, 0xdfc,
-    0x2fc, 0x3f5, 0xff , 0x1f6, 0x6fa, 0x7f3, 0x4f9, 0x5f0,
-    0xb60, 0xa69, 0x963, 0x86a, 0xf66, 0xe6f, 0xd65, 0xc6c,
-    0x36c, 0x265, 0x16f, 0x66 , 0x76a, 0x663, 0x569, 0x460,
-    0xca0, 0xda9, 0xea3, 0xfaa, 0x8a6, 0x9af, 0xaa5, 0xbac,
-    0x4ac, 0x5a5, 0x6af, 0x7a6, 0xaa , 0x1a3, 0x2a9, 0x3a0,
-    0xd30, 0xc39, 0xf33, 0xe3a, 0x936, 0x83f, 0xb35, 0xa3c,
-    0x53c, 0x435, 0x73f, 0x636, 0x13a, 0x33 , 0x339, 0x230,
-    0xe90, 0xf99, 0xc93, 0xd9a, 0xa96, 0xb9f, 0x895, 0x99c,
-    0x69c, 0x795, 0x49f, 0x596, 0x29a, 0x393, 0x99 , 0x190,
-    0xf00, 0xe09, 0xd03, 0xc0a, 0xb06, 0xa0f, 0x905, 0x80c,
-    0x70c, 0x605, 0x50f, 0x406, 0x30a, 0x203, 0x109, 0x0   };
-
-  int triTable[256][16] = {
-    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {1, 8, 3, 9, 8, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 8, 3, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {9, 2, 10, 0, 2, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {2, 8, 3, 2, 10, 8, 10, 9, 8, -1, -1, -1, -1, -1, -1, -1},
-    {3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 11, 2, 8, 11, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {1, 9, 0, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {1, 11, 2, 1, 9, 11, 9, 8, 11, -1, -1, -1, -1, -1, -1, -1},
-    {3, 10, 1, 11, 10, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 10, 1, 0, 8, 10, 8, 11, 10, -1, -1, -1, -1, -1, -1, -1},
-    {3, 9, 0, 3, 11, 9, 11, 10, 9, -1, -1, -1, -1, -1, -1, -1},
-    {9, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {4, 3, 0, 7, 3, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 1, 9, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {4, 1, 9, 4, 7, 1, 7, 3, 1, -1, -1, -1, -1, -1, -1, -1},
-    {1, 2, 10, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {3, 4, 7, 3, 0, 4, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1},
-    {9, 2, 10, 9, 0, 2, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
-    {2, 10, 9, 2, 9, 7, 2, 7, 3, 7, 9, 4, -1, -1, -1, -1},
-    {8, 4, 7, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {11, 4, 7, 11, 2, 4, 2, 0, 4, -1, -1, -1, -1, -1, -1, -1},
-    {9, 0, 1, 8, 4, 7, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
-    {4, 7, 11, 9, 4, 11, 9, 11, 2, 9, 2, 1, -1, -1, -1, -1},
-    {3, 10, 1, 3, 11, 10, 7, 8, 4, -1, -1, -1, -1, -1, -1, -1},
-    {1, 11, 10, 1, 4, 11, 1, 0, 4, 7, 11, 4, -1, -1, -1, -1},
-    {4, 7, 8, 9, 0, 11, 9, 11, 10, 11, 0, 3, -1, -1, -1, -1},
-    {4, 7, 11, 4, 11, 9, 9, 11, 10, -1, -1, -1, -1, -1, -1, -1},
-    {9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {9, 5, 4, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 5, 4, 1, 5, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {8, 5, 4, 8, 3, 5, 3, 1, 5, -1, -1, -1, -1, -1, -1, -1},
-    {1, 2, 10, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {3, 0, 8, 1, 2, 10, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
-    {5, 2, 10, 5, 4, 2, 4, 0, 2, -1, -1, -1, -1, -1, -1, -1},
-    {2, 10, 5, 3, 2, 5, 3, 5, 4, 3, 4, 8, -1, -1, -1, -1},
-    {9, 5, 4, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 11, 2, 0, 8, 11, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
-    {0, 5, 4, 0, 1, 5, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
-    {2, 1, 5, 2, 5, 8, 2, 8, 11, 4, 8, 5, -1, -1, -1, -1},
-    {10, 3, 11, 10, 1, 3, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1},
-    {4, 9, 5, 0, 8, 1, 8, 10, 1, 8, 11, 10, -1, -1, -1, -1},
-    {5, 4, 0, 5, 0, 11, 5, 11, 10, 11, 0, 3, -1, -1, -1, -1},
-    {5, 4, 8, 5, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1},
-    {9, 7, 8, 5, 7, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {9, 3, 0, 9, 5, 3, 5, 7, 3, -1, -1, -1, -1, -1, -1, -1},
-    {0, 7, 8, 0, 1, 7, 1, 5, 7, -1, -1, -1, -1, -1, -1, -1},
-    {1, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {9, 7, 8, 9, 5, 7, 10, 1, 2, -1, -1, -1, -1, -1, -1, -1},
-    {10, 1, 2, 9, 5, 0, 5, 3, 0, 5, 7, 3, -1, -1, -1, -1},
-    {8, 0, 2, 8, 2, 5, 8, 5, 7, 10, 5, 2, -1, -1, -1, -1},
-    {2, 10, 5, 2, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1},
-    {7, 9, 5, 7, 8, 9, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1},
-    {9, 5, 7, 9, 7, 2, 9, 2, 0, 2, 7, 11, -1, -1, -1, -1},
-    {2, 3, 11, 0, 1, 8, 1, 7, 8, 1, 5, 7, -1, -1, -1, -1},
-    {11, 2, 1, 11, 1, 7, 7, 1, 5, -1, -1, -1, -1, -1, -1, -1},
-    {9, 5, 8, 8, 5, 7, 10, 1, 3, 10, 3, 11, -1, -1, -1, -1},
-    {5, 7, 0, 5, 0, 9, 7, 11, 0, 1, 0, 10, 11, 10, 0, -1},
-    {11, 10, 0, 11, 0, 3, 10, 5, 0, 8, 0, 7, 5, 7, 0, -1},
-    {11, 10, 5, 7, 11, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 8, 3, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {9, 0, 1, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {1, 8, 3, 1, 9, 8, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
-    {1, 6, 5, 2, 6, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {1, 6, 5, 1, 2, 6, 3, 0, 8, -1, -1, -1, -1, -1, -1, -1},
-    {9, 6, 5, 9, 0, 6, 0, 2, 6, -1, -1, -1, -1, -1, -1, -1},
-    {5, 9, 8, 5, 8, 2, 5, 2, 6, 3, 2, 8, -1, -1, -1, -1},
-    {2, 3, 11, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {11, 0, 8, 11, 2, 0, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
-    {0, 1, 9, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
-    {5, 10, 6, 1, 9, 2, 9, 11, 2, 9, 8, 11, -1, -1, -1, -1},
-    {6, 3, 11, 6, 5, 3, 5, 1, 3, -1, -1, -1, -1, -1, -1, -1},
-    {0, 8, 11, 0, 11, 5, 0, 5, 1, 5, 11, 6, -1, -1, -1, -1},
-    {3, 11, 6, 0, 3, 6, 0, 6, 5, 0, 5, 9, -1, -1, -1, -1},
-    {6, 5, 9, 6, 9, 11, 11, 9, 8, -1, -1, -1, -1, -1, -1, -1},
-    {5, 10, 6, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {4, 3, 0, 4, 7, 3, 6, 5, 10, -1, -1, -1, -1, -1, -1, -1},
-    {1, 9, 0, 5, 10, 6, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
-    {10, 6, 5, 1, 9, 7, 1, 7, 3, 7, 9, 4, -1, -1, -1, -1},
-    {6, 1, 2, 6, 5, 1, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1},
-    {1, 2, 5, 5, 2, 6, 3, 0, 4, 3, 4, 7, -1, -1, -1, -1},
-    {8, 4, 7, 9, 0, 5, 0, 6, 5, 0, 2, 6, -1, -1, -1, -1},
-    {7, 3, 9, 7, 9, 4, 3, 2, 9, 5, 9, 6, 2, 6, 9, -1},
-    {3, 11, 2, 7, 8, 4, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
-    {5, 10, 6, 4, 7, 2, 4, 2, 0, 2, 7, 11, -1, -1, -1, -1},
-    {0, 1, 9, 4, 7, 8, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1},
-    {9, 2, 1, 9, 11, 2, 9, 4, 11, 7, 11, 4, 5, 10, 6, -1},
-    {8, 4, 7, 3, 11, 5, 3, 5, 1, 5, 11, 6, -1, -1, -1, -1},
-    {5, 1, 11, 5, 11, 6, 1, 0, 11, 7, 11, 4, 0, 4, 11, -1},
-    {0, 5, 9, 0, 6, 5, 0, 3, 6, 11, 6, 3, 8, 4, 7, -1},
-    {6, 5, 9, 6, 9, 11, 4, 7, 9, 7, 11, 9, -1, -1, -1, -1},
-    {10, 4, 9, 6, 4, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {4, 10, 6, 4, 9, 10, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1},
-    {10, 0, 1, 10, 6, 0, 6, 4, 0, -1, -1, -1, -1, -1, -1, -1},
-    {8, 3, 1, 8, 1, 6, 8, 6, 4, 6, 1, 10, -1, -1, -1, -1},
-    {1, 4, 9, 1, 2, 4, 2, 6, 4, -1, -1, -1, -1, -1, -1, -1},
-    {3, 0, 8, 1, 2, 9, 2, 4, 9, 2, 6, 4, -1, -1, -1, -1},
-    {0, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {8, 3, 2, 8, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1},
-    {10, 4, 9, 10, 6, 4, 11, 2, 3, -1, -1, -1, -1, -1, -1, -1},
-    {0, 8, 2, 2, 8, 11, 4, 9, 10, 4, 10, 6, -1, -1, -1, -1},
-    {3, 11, 2, 0, 1, 6, 0, 6, 4, 6, 1, 10, -1, -1, -1, -1},
-    {6, 4, 1, 6, 1, 10, 4, 8, 1, 2, 1, 11, 8, 11, 1, -1},
-    {9, 6, 4, 9, 3, 6, 9, 1, 3, 11, 6, 3, -1, -1, -1, -1},
-    {8, 11, 1, 8, 1, 0, 11, 6, 1, 9, 1, 4, 6, 4, 1, -1},
-    {3, 11, 6, 3, 6, 0, 0, 6, 4, -1, -1, -1, -1, -1, -1, -1},
-    {6, 4, 8, 11, 6, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {7, 10, 6, 7, 8, 10, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1},
-    {0, 7, 3, 0, 10, 7, 0, 9, 10, 6, 7, 10, -1, -1, -1, -1},
-    {10, 6, 7, 1, 10, 7, 1, 7, 8, 1, 8, 0, -1, -1, -1, -1},
-    {10, 6, 7, 10, 7, 1, 1, 7, 3, -1, -1, -1, -1, -1, -1, -1},
-    {1, 2, 6, 1, 6, 8, 1, 8, 9, 8, 6, 7, -1, -1, -1, -1},
-    {2, 6, 9, 2, 9, 1, 6, 7, 9, 0, 9, 3, 7, 3, 9, -1},
-    {7, 8, 0, 7, 0, 6, 6, 0, 2, -1, -1, -1, -1, -1, -1, -1},
-    {7, 3, 2, 6, 7, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {2, 3, 11, 10, 6, 8, 10, 8, 9, 8, 6, 7, -1, -1, -1, -1},
-    {2, 0, 7, 2, 7, 11, 0, 9, 7, 6, 7, 10, 9, 10, 7, -1},
-    {1, 8, 0, 1, 7, 8, 1, 10, 7, 6, 7, 10, 2, 3, 11, -1},
-    {11, 2, 1, 11, 1, 7, 10, 6, 1, 6, 7, 1, -1, -1, -1, -1},
-    {8, 9, 6, 8, 6, 7, 9, 1, 6, 11, 6, 3, 1, 3, 6, -1},
-    {0, 9, 1, 11, 6, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {7, 8, 0, 7, 0, 6, 3, 11, 0, 11, 6, 0, -1, -1, -1, -1},
-    {7, 11, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {3, 0, 8, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 1, 9, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {8, 1, 9, 8, 3, 1, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
-    {10, 1, 2, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {1, 2, 10, 3, 0, 8, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
-    {2, 9, 0, 2, 10, 9, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
-    {6, 11, 7, 2, 10, 3, 10, 8, 3, 10, 9, 8, -1, -1, -1, -1},
-    {7, 2, 3, 6, 2, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {7, 0, 8, 7, 6, 0, 6, 2, 0, -1, -1, -1, -1, -1, -1, -1},
-    {2, 7, 6, 2, 3, 7, 0, 1, 9, -1, -1, -1, -1, -1, -1, -1},
-    {1, 6, 2, 1, 8, 6, 1, 9, 8, 8, 7, 6, -1, -1, -1, -1},
-    {10, 7, 6, 10, 1, 7, 1, 3, 7, -1, -1, -1, -1, -1, -1, -1},
-    {10, 7, 6, 1, 7, 10, 1, 8, 7, 1, 0, 8, -1, -1, -1, -1},
-    {0, 3, 7, 0, 7, 10, 0, 10, 9, 6, 10, 7, -1, -1, -1, -1},
-    {7, 6, 10, 7, 10, 8, 8, 10, 9, -1, -1, -1, -1, -1, -1, -1},
-    {6, 8, 4, 11, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {3, 6, 11, 3, 0, 6, 0, 4, 6, -1, -1, -1, -1, -1, -1, -1},
-    {8, 6, 11, 8, 4, 6, 9, 0, 1, -1, -1, -1, -1, -1, -1, -1},
-    {9, 4, 6, 9, 6, 3, 9, 3, 1, 11, 3, 6, -1, -1, -1, -1},
-    {6, 8, 4, 6, 11, 8, 2, 10, 1, -1, -1, -1, -1, -1, -1, -1},
-    {1, 2, 10, 3, 0, 11, 0, 6, 11, 0, 4, 6, -1, -1, -1, -1},
-    {4, 11, 8, 4, 6, 11, 0, 2, 9, 2, 10, 9, -1, -1, -1, -1},
-    {10, 9, 3, 10, 3, 2, 9, 4, 3, 11, 3, 6, 4, 6, 3, -1},
-    {8, 2, 3, 8, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1},
-    {0, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {1, 9, 0, 2, 3, 4, 2, 4, 6, 4, 3, 8, -1, -1, -1, -1},
-    {1, 9, 4, 1, 4, 2, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1},
-    {8, 1, 3, 8, 6, 1, 8, 4, 6, 6, 10, 1, -1, -1, -1, -1},
-    {10, 1, 0, 10, 0, 6, 6, 0, 4, -1, -1, -1, -1, -1, -1, -1},
-    {4, 6, 3, 4, 3, 8, 6, 10, 3, 0, 3, 9, 10, 9, 3, -1},
-    {10, 9, 4, 6, 10, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {4, 9, 5, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 8, 3, 4, 9, 5, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
-    {5, 0, 1, 5, 4, 0, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
-    {11, 7, 6, 8, 3, 4, 3, 5, 4, 3, 1, 5, -1, -1, -1, -1},
-    {9, 5, 4, 10, 1, 2, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
-    {6, 11, 7, 1, 2, 10, 0, 8, 3, 4, 9, 5, -1, -1, -1, -1},
-    {7, 6, 11, 5, 4, 10, 4, 2, 10, 4, 0, 2, -1, -1, -1, -1},
-    {3, 4, 8, 3, 5, 4, 3, 2, 5, 10, 5, 2, 11, 7, 6, -1},
-    {7, 2, 3, 7, 6, 2, 5, 4, 9, -1, -1, -1, -1, -1, -1, -1},
-    {9, 5, 4, 0, 8, 6, 0, 6, 2, 6, 8, 7, -1, -1, -1, -1},
-    {3, 6, 2, 3, 7, 6, 1, 5, 0, 5, 4, 0, -1, -1, -1, -1},
-    {6, 2, 8, 6, 8, 7, 2, 1, 8, 4, 8, 5, 1, 5, 8, -1},
-    {9, 5, 4, 10, 1, 6, 1, 7, 6, 1, 3, 7, -1, -1, -1, -1},
-    {1, 6, 10, 1, 7, 6, 1, 0, 7, 8, 7, 0, 9, 5, 4, -1},
-    {4, 0, 10, 4, 10, 5, 0, 3, 10, 6, 10, 7, 3, 7, 10, -1},
-    {7, 6, 10, 7, 10, 8, 5, 4, 10, 4, 8, 10, -1, -1, -1, -1},
-    {6, 9, 5, 6, 11, 9, 11, 8, 9, -1, -1, -1, -1, -1, -1, -1},
-    {3, 6, 11, 0, 6, 3, 0, 5, 6, 0, 9, 5, -1, -1, -1, -1},
-    {0, 11, 8, 0, 5, 11, 0, 1, 5, 5, 6, 11, -1, -1, -1, -1},
-    {6, 11, 3, 6, 3, 5, 5, 3, 1, -1, -1, -1, -1, -1, -1, -1},
-    {1, 2, 10, 9, 5, 11, 9, 11, 8, 11, 5, 6, -1, -1, -1, -1},
-    {0, 11, 3, 0, 6, 11, 0, 9, 6, 5, 6, 9, 1, 2, 10, -1},
-    {11, 8, 5, 11, 5, 6, 8, 0, 5, 10, 5, 2, 0, 2, 5, -1},
-    {6, 11, 3, 6, 3, 5, 2, 10, 3, 10, 5, 3, -1, -1, -1, -1},
-    {5, 8, 9, 5, 2, 8, 5, 6, 2, 3, 8, 2, -1, -1, -1, -1},
-    {9, 5, 6, 9, 6, 0, 0, 6, 2, -1, -1, -1, -1, -1, -1, -1},
-    {1, 5, 8, 1, 8, 0, 5, 6, 8, 3, 8, 2, 6, 2, 8, -1},
-    {1, 5, 6, 2, 1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {1, 3, 6, 1, 6, 10, 3, 8, 6, 5, 6, 9, 8, 9, 6, -1},
-    {10, 1, 0, 10, 0, 6, 9, 5, 0, 5, 6, 0, -1, -1, -1, -1},
-    {0, 3, 8, 5, 6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {10, 5, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {11, 5, 10, 7, 5, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {11, 5, 10, 11, 7, 5, 8, 3, 0, -1, -1, -1, -1, -1, -1, -1},
-    {5, 11, 7, 5, 10, 11, 1, 9, 0, -1, -1, -1, -1, -1, -1, -1},
-    {10, 7, 5, 10, 11, 7, 9, 8, 1, 8, 3, 1, -1, -1, -1, -1},
-    {11, 1, 2, 11, 7, 1, 7, 5, 1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 8, 3, 1, 2, 7, 1, 7, 5, 7, 2, 11, -1, -1, -1, -1},
-    {9, 7, 5, 9, 2, 7, 9, 0, 2, 2, 11, 7, -1, -1, -1, -1},
-    {7, 5, 2, 7, 2, 11, 5, 9, 2, 3, 2, 8, 9, 8, 2, -1},
-    {2, 5, 10, 2, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1},
-    {8, 2, 0, 8, 5, 2, 8, 7, 5, 10, 2, 5, -1, -1, -1, -1},
-    {9, 0, 1, 5, 10, 3, 5, 3, 7, 3, 10, 2, -1, -1, -1, -1},
-    {9, 8, 2, 9, 2, 1, 8, 7, 2, 10, 2, 5, 7, 5, 2, -1},
-    {1, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 8, 7, 0, 7, 1, 1, 7, 5, -1, -1, -1, -1, -1, -1, -1},
-    {9, 0, 3, 9, 3, 5, 5, 3, 7, -1, -1, -1, -1, -1, -1, -1},
-    {9, 8, 7, 5, 9, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {5, 8, 4, 5, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1},
-    {5, 0, 4, 5, 11, 0, 5, 10, 11, 11, 3, 0, -1, -1, -1, -1},
-    {0, 1, 9, 8, 4, 10, 8, 10, 11, 10, 4, 5, -1, -1, -1, -1},
-    {10, 11, 4, 10, 4, 5, 11, 3, 4, 9, 4, 1, 3, 1, 4, -1},
-    {2, 5, 1, 2, 8, 5, 2, 11, 8, 4, 5, 8, -1, -1, -1, -1},
-    {0, 4, 11, 0, 11, 3, 4, 5, 11, 2, 11, 1, 5, 1, 11, -1},
-    {0, 2, 5, 0, 5, 9, 2, 11, 5, 4, 5, 8, 11, 8, 5, -1},
-    {9, 4, 5, 2, 11, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {2, 5, 10, 3, 5, 2, 3, 4, 5, 3, 8, 4, -1, -1, -1, -1},
-    {5, 10, 2, 5, 2, 4, 4, 2, 0, -1, -1, -1, -1, -1, -1, -1},
-    {3, 10, 2, 3, 5, 10, 3, 8, 5, 4, 5, 8, 0, 1, 9, -1},
-    {5, 10, 2, 5, 2, 4, 1, 9, 2, 9, 4, 2, -1, -1, -1, -1},
-    {8, 4, 5, 8, 5, 3, 3, 5, 1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 4, 5, 1, 0, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {8, 4, 5, 8, 5, 3, 9, 0, 5, 0, 3, 5, -1, -1, -1, -1},
-    {9, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {4, 11, 7, 4, 9, 11, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1},
-    {0, 8, 3, 4, 9, 7, 9, 11, 7, 9, 10, 11, -1, -1, -1, -1},
-    {1, 10, 11, 1, 11, 4, 1, 4, 0, 7, 4, 11, -1, -1, -1, -1},
-    {3, 1, 4, 3, 4, 8, 1, 10, 4, 7, 4, 11, 10, 11, 4, -1},
-    {4, 11, 7, 9, 11, 4, 9, 2, 11, 9, 1, 2, -1, -1, -1, -1},
-    {9, 7, 4, 9, 11, 7, 9, 1, 11, 2, 11, 1, 0, 8, 3, -1},
-    {11, 7, 4, 11, 4, 2, 2, 4, 0, -1, -1, -1, -1, -1, -1, -1},
-    {11, 7, 4, 11, 4, 2, 8, 3, 4, 3, 2, 4, -1, -1, -1, -1},
-    {2, 9, 10, 2, 7, 9, 2, 3, 7, 7, 4, 9, -1, -1, -1, -1},
-    {9, 10, 7, 9, 7, 4, 10, 2, 7, 8, 7, 0, 2, 0, 7, -1},
-    {3, 7, 10, 3, 10, 2, 7, 4, 10, 1, 10, 0, 4, 0, 10, -1},
-    {1, 10, 2, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {4, 9, 1, 4, 1, 7, 7, 1, 3, -1, -1, -1, -1, -1, -1, -1},
-    {4, 9, 1, 4, 1, 7, 0, 8, 1, 8, 7, 1, -1, -1, -1, -1},
-    {4, 0, 3, 7, 4, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {4, 8, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {9, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {3, 0, 9, 3, 9, 11, 11, 9, 10, -1, -1, -1, -1, -1, -1, -1},
-    {0, 1, 10, 0, 10, 8, 8, 10, 11, -1, -1, -1, -1, -1, -1, -1},
-    {3, 1, 10, 11, 3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {1, 2, 11, 1, 11, 9, 9, 11, 8, -1, -1, -1, -1, -1, -1, -1},
-    {3, 0, 9, 3, 9, 11, 1, 2, 9, 2, 11, 9, -1, -1, -1, -1},
-    {0, 2, 11, 8, 0, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {3, 2, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {2, 3, 8, 2, 8, 10, 10, 8, 9, -1, -1, -1, -1, -1, -1, -1},
-    {9, 10, 2, 0, 9, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {2, 3, 8, 2, 8, 10, 0, 1, 8, 1, 10, 8, -1, -1, -1, -1},
-    {1, 10, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {1, 3, 8, 9, 1, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 9, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
-    {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}};
-
-  /* Edge connections: 2 vertices per edge*/
-  int edge_con[12][2] = {
-    {0,1},
-    {1,2},
-    {2,3},
-    {3,0},
-    {4,5},
-    {5,6},
-    {6,7},
-    {7,4},
-    {0,4},
-    {1,5},
-    {2,6},
-    {3,7}};
-
   int i,j,k,ntriang;
   int cubeindex;
   POINT vertlist[12];
@@ -1070,6 +2045,42 @@ int Polygonise(FLOAT *triangles, XYZ *pos, FLOAT *val, FLOAT level)
 
 
 
+/* Marching tetrahedrons tables */
+
+/* number of triangles for each case, cumulative */
+static const int casetri[9] = { 0, 0, 1, 2, 4, 5, 7, 9, 10 };
+static const int caseind[10][6] = {
+  {0,1,0,3,0,2},   // case 1
+  {1,0,1,2,1,3},   // case 2
+  {3,0,2,0,1,3},   // case 3
+  {2,0,2,1,1,3},   // case 3
+  {2,0,2,3,2,1},   // case 4
+  {3,0,1,2,1,0},   // case 5
+  {1,2,3,0,2,3},   // case 5
+  {0,1,0,2,1,3},   // case 6
+  {1,3,0,2,3,2},   // case 6
+  {3,0,3,2,3,1},   // case 7
+};
+
+/* definition of tetrahedrons in the cell */
+/* static const int tetind[6][4] = { */
+/*   {0,7,3,2}, */
+/*   {0,7,2,6}, */
+/*   {0,4,7,6}, */
+/*   {0,1,6,2}, */
+/*   {0,4,6,1}, */
+/*   {5,1,6,4}, */
+/* }; */
+static const int tetind[6][4] = {
+  {0,2,3,7},
+  {0,2,7,6},
+  {0,4,6,7},
+  {0,6,1,2},
+  {0,6,4,1},
+  {5,6,1,4},
+};
+
+
 /*
    Polygonise a tetrahedron given its vertices within a cube
    This is an alternative algorithm to polygonisegrid.
@@ -1102,28 +2113,13 @@ int Polygonise(FLOAT *triangles, XYZ *pos, FLOAT *val, FLOAT level)
       PolygoniseTri(grid,iso,triangles,0,6,1,4);
       PolygoniseTri(grid,iso,triangles,5,6,1,4);
 */
-int PolygoniseTet1(FLOAT *triangles, XYZ *pos, FLOAT *val, FLOAT level, int* ind)
+int PolygoniseTet1(FLOAT *triangles, XYZ *pos, FLOAT *val, FLOAT level, const int* ind)
 {
   int i,i0,i1,k,l,it;
   int ntri = 0;
   int tetindex,caseindex;
   POINT vert[6]; /* We have at most 2 triangles */
 
-  /* number of triangles for each case, cumulative */
-  int casetri[9] = { 0, 0, 1, 2, 4, 5, 7, 9, 10 };
-  int caseind[10][6] = {
-    {0,1,0,3,0,2},   // case 1
-    {1,0,1,2,1,3},   // case 2
-    {3,0,2,0,1,3},   // case 3
-    {2,0,2,1,1,3},   // case 3
-    {2,0,2,3,2,1},   // case 4
-    {3,0,1,2,1,0},   // case 5
-    {1,2,3,0,2,3},   // case 5
-    {0,1,0,2,1,3},   // case 6
-    {1,3,0,2,3,2},   // case 6
-    {3,0,3,2,3,1},   // case 7
-  };
-
   /*
     Determine which of the 16 cases we have given which vertices
     are above or below the isosurface
@@ -1169,24 +2165,6 @@ int PolygoniseTet1(FLOAT *triangles, XYZ *pos, FLOAT *val, FLOAT level, int* ind
 */
 int PolygoniseTet(FLOAT *triangles, XYZ *pos, FLOAT *val, FLOAT level)
 {
-  /* definition of tetrahedrons in the cell */
-  /* int tetind[6][4] = { */
-  /*   {0,7,3,2}, */
-  /*   {0,7,2,6}, */
-  /*   {0,4,7,6}, */
-  /*   {0,1,6,2}, */
-  /*   {0,4,6,1}, */
-  /*   {5,1,6,4}, */
-  /* }; */
-  int tetind[6][4] = {
-    {0,2,3,7},
-    {0,2,7,6},
-    {0,4,6,7},
-    {0,6,1,2},
-    {0,6,4,1},
-    {5,6,1,4},
-  };
-
   int i, ntri, ntriangles = 0;
   for (i=0; i<6; ++i) {
     ntri = PolygoniseTet1(triangles+ntriangles*3*3,pos,val,level,tetind[i]);
@@ -1196,137 +2174,1601 @@ int PolygoniseTet(FLOAT *triangles, XYZ *pos, FLOAT *val, FLOAT level)
 }
 
 
-static char isosurface_doc[] = "\
-isosurface(data, level, tet)\n\
-\n\n\
-Create an isosurface through data at given level.\n\
-\n\
-Parameters\n\
-----------\n\
-data: float32 array (nx,ny,nz)\n\
-    The data values at points with coordinates equal to their indices.\n\
-    This defines a 3D volume (0..nx-1, 0..ny-1, 0..nz-1)\n\
-level: float\n\
-    The data value at which the isosurface is to be constructed\n\
-tet: int\n\
-    If zero, a marching cubes algorithm is used. If nonzero,\n\
-    a marching tetrahedrons algorithm is used. The latter is slower and\n\
-    produces a lot more triangles, but results in a smoother surface.\n\
-\n\
-Returns\n\
--------\n\
-float32 array (ntri, 3, 3)\n\
-    The triangles defining the isosurface. Each triangle consists of\n\
-    3 points with 3 coordinates.\n\
-    The result is empty if level is outside the data range.\n\
-\n\
-See Also\n\
---------\n\
-:meth:`plugins.isosurface.isosurface`: the user oriented function to use this\n\
-\n\
-Notes\n\
------\n\
-The algorithms are based on those from\n\
-http://paulbourke.net/geometry/polygonise/ \n\
-";
-
-static PyObject * isosurface(PyObject *dummy, PyObject *args)
+/*
+   Like Polygonise, but instead of computing the vertex coordinates,
+   store for each vertex of the triangles the two cell vertices of the
+   edge on which it lies. The array "corners" will be loaded up with
+   2 values per triangle vertex for at most 5 triangles.
+   Return the number of triangular facets.
+*/
+int PolygoniseEdges(int *corners, FLOAT *val, FLOAT level)
 {
-  PyObject *arg1=NULL;
-  PyObject *arr1=NULL;
-  float *data;
-  float level;
-  int tet;
-  if (!PyArg_ParseTuple(args, "Ofi", &arg1, &level, &tet)) return NULL;
-  arr1 = PyArray_FROM_OTF(arg1, NPY_FLOAT, NPY_ARRAY_INOUT_ARRAY);
-  if (arr1 == NULL) return NULL;
-
-  npy_intp * dims;
-  int nx,ny,nz;
-  dims = PYARRAY_DIMS(arg1);
-  nz = dims[0];
-  ny = dims[1];
-  nx = dims[2];
-  data = (float *)PYARRAY_DATA(arr1);
-
-  /* allocate memory for triangles */
-  int nitri = 2*nx*ny*nz; /* initial guess for number of triangles */
-  int ntri = 0;   /* size of storage available */
-  int itri = 0;   /* size of storage filled */
-  float *triangles = NULL; /* pointer to storage size */
-  int ktri; /* max number of triangles per voxel */
-  if (tet) ktri = 12;
-  else ktri = 5;
+  int i,j,e,ntriang;
+  int cubeindex;
 
-  /* vertex coordinates with respect to ix,iy,iz */
-  int grid[8][3] = {
-    {0,0,0},
-    {1,0,0},
-    {1,1,0},
-    {0,1,0},
-    {0,0,1},
-    {1,0,1},
-    {1,1,1},
-    {0,1,1},
-  };
+  cubeindex = 0;
+  for (i=0; i<8; i++)
+    if (val[i] < level)
+      cubeindex |= 1 << i;
 
-  /* data offsets with respect to first vertex data */
-  int i,ofs[8];
-  for (i=0; i<8; i++) {
-    ofs[i] = ( grid[i][2]*ny + grid[i][1] )*nx + grid[i][0];
-  }
+  /* Cube is entirely in/out of the surface */
+  if (edgeTable[cubeindex] == 0)
+    return(0);
 
-  /* loop over cells */
-  int mtri;
-  int ix,iy,iz;
-  XYZ pos[8];   /* coordinates of the cell vertices */
-  FLOAT val[8]; /* data values at the cell vertices */
-  int iofs;     /* data offset of vertex ix,iy,iz */
-  for (iz=0; iz<nz-1; iz++) {
-    for (i=0; i<8; i++) pos[i].z = iz + grid[i][2];
-    for (iy=0; iy<ny-1; iy++) {
-      for (i=0; i<8; i++) pos[i].y = iy + grid[i][1];
-      for (ix=0; ix<nx-1; ix++) {
-	for (i=0; i<8; i++) pos[i].x = ix + grid[i][0];
-	iofs = (iz*ny + iy)*nx + ix;
-	for (i=0; i<8; i++) val[i] = data[iofs + ofs[i]];
-	if (itri+ktri > ntri) {
-	  /* need to enlarge storage */
-	  /* enlarge with same number as initial guess */
-	  ntri += nitri;
-	  triangles = (float*) realloc(triangles,ntri*3*3*sizeof(float));
-	}
-	if (tet) mtri = PolygoniseTet(triangles+itri*3*3,pos,val,level);
-	else mtri = Polygonise(triangles+itri*3*3,pos,val,level);
-	itri += mtri;
-      }
+  ntriang = 0;
+  for (i=0; triTable[cubeindex][i]!=-1; i+=3) {
+    for (j=0; j<3; j++) {  /* loop over vertices */
+      e = triTable[cubeindex][i+j];
+      *corners++ = edge_con[e][0];
+      *corners++ = edge_con[e][1];
     }
+    ntriang++;
   }
+  return(ntriang);
+}
 
-  /* create return array */
-  npy_intp dim[3];
-  dim[0] = itri;
-  dim[1] = 3;
-  dim[2] = 3;
-  PyObject *ret = PyArray_SimpleNew(3,dim, NPY_FLOAT);
-  float *out = (float *)PYARRAY_DATA(ret);
-  memcpy(out,triangles,itri*3*3*sizeof(float));
 
-  /* Clean up and return */
-  Py_DECREF(arr1);
-  return ret;
-}
+/*
+   Like PolygoniseTet1, but storing the cell vertices of the edges
+   instead of the vertex coordinates (see PolygoniseEdges).
+*/
+int PolygoniseTetEdges1(int *corners, FLOAT *val, FLOAT level, const int* ind)
+{
+  int i,k,l,it;
+  int ntri = 0;
+  int tetindex,caseindex;
+
+  tetindex = 0;
+  for (i=0; i<4; i++)
+    if (val[ind[i]] < level)
+      tetindex |= 1 << i;
+
+  if (tetindex < 8) caseindex = tetindex;
+  else caseindex = 15-tetindex;
 
+  for (it=casetri[caseindex]; it<casetri[caseindex+1]; ++it) {
+    for (k=0; k<6; k+=2) {
+      if (tetindex < 8) l = k;
+      else l = 4-k;
+      *corners++ = ind[caseind[it][l]];
+      *corners++ = ind[caseind[it][l+1]];
+    }
+    ntri++;
+  };
+  return(ntri);
+}
+
+
+/*
+   Like PolygoniseTet, but storing the cell vertices of the edges
+   instead of the vertex coordinates (see PolygoniseEdges).
+*/
+int PolygoniseTetEdges(int *corners, FLOAT *val, FLOAT level)
+{
+  int i, ntri, ntriangles = 0;
+  for (i=0; i<6; ++i) {
+    ntri = PolygoniseTetEdges1(corners+ntriangles*3*2,val,level,tetind[i]);
+    ntriangles += ntri;
+  }
+  return ntriangles;
+}
+
+
+/*
+   The isosurface extraction is done in slabs of cell layers along
+   the z-axis. Each slab has its own output buffers, so that the slabs
+   can be processed in parallel. Afterwards the slabs are merged.
+
+   For an indexed output, every vertex is identified by the grid edge
+   on which it lies. The edge key is computed from the global indices
+   a < b of the two grid points: key = a * npts + b. A hash table maps
+   the keys to the vertices already created in the slab.
+*/
+typedef struct {
+  int iz0, iz1;         /* range of cell layers: iz0 <= iz < iz1 */
+  npy_intp b0, b1;      /* range of active blocks in the slab (if any) */
+  npy_intp ntri, maxtri;  /* number of triangles, available storage */
+  FLOAT *tri;           /* triangle coordinates (ntri,3,3) (if not indexed) */
+  int *elems;           /* triangle vertex numbers (ntri,3) (if indexed) */
+  npy_intp nvert, maxvert;  /* number of vertices, available storage */
+  FLOAT *vert;          /* vertex coordinates (nvert,3) */
+  long long *vkey;      /* edge key of the vertices (nvert) */
+  int *htab;            /* hash table of vertex numbers, -1 if empty */
+  size_t hsize;         /* size of the hash table (a power of 2) */
+  int *gid;             /* global vertex number of the vertices */
+  int error;            /* set nonzero if out of memory */
+} ISOSLAB;
+
+
+/* Free the storage of a slab */
+static void iso_free(ISOSLAB *S)
+{
+  free(S->tri);
+  free(S->elems);
+  free(S->vert);
+  free(S->vkey);
+  free(S->htab);
+  free(S->gid);
+  S->tri = S->vert = NULL;
+  S->elems = S->htab = S->gid = NULL;
+  S->vkey = NULL;
+}
+
+/* Number of bytes of storage allocated by a slab */
+static size_t iso_slab_bytes(ISOSLAB *S)
+{
+  size_t n = S->hsize*sizeof(int);
+  if (S->tri) n += S->maxtri*3*3*sizeof(FLOAT);
+  if (S->elems) n += S->maxtri*3*sizeof(int);
+  if (S->vert) n += S->maxvert*(3*sizeof(FLOAT)+sizeof(long long));
+  if (S->gid) n += (S->nvert > 0 ? S->nvert : 1)*sizeof(int);
+  return n;
+}
+
+
+/*
+   Make sure that the storage *p, with room for *max items of the given
+   size, can hold n items. The storage is grown by doubling.
+   Returns 0 on success, -1 if out of memory.
+*/
+static int iso_reserve(void **p, npy_intp *max, npy_intp n, size_t size)
+{
+  npy_intp m;
+  void *q;
+  if (n <= *max) return 0;
+  m = *max > 0 ? 2 * *max : 1024;
+  while (m < n) m *= 2;
+  q = realloc(*p, m*size);
+  if (q == NULL) return -1;
+  *p = q;
+  *max = m;
+  return 0;
+}
+
+
+/* Hash slot of an edge key */
+static size_t iso_hash(long long key, size_t hsize)
+{
+  return (size_t)(((unsigned long long)key * 11400714819323198485ull) >> 20) & (hsize-1);
+}
+
+
+/* Find the vertex with the given edge key in a slab, or -1 if absent */
+static int iso_find(ISOSLAB *S, long long key)
+{
+  size_t h;
+  int n;
+  if (S->hsize == 0) return -1;
+  for (h=iso_hash(key,S->hsize); (n=S->htab[h]) >= 0; h=(h+1) & (S->hsize-1))
+    if (S->vkey[n] == key) return n;
+  return -1;
+}
+
+
+/*
+   Return the number of the vertex on the grid edge with the given key,
+   creating it if it does not exist yet. p1,p2 and v1,v2 are the
+   coordinates and values at the ends of the edge.
+   Returns -1 if out of memory.
+*/
+static int iso_vertex(ISOSLAB *S, long long key, XYZ p1, XYZ p2, FLOAT v1, FLOAT v2, FLOAT level)
+{
+  size_t h, hsize;
+  int n, *htab;
+  npy_intp m;
+  XYZ p;
+
+  n = iso_find(S,key);
+  if (n >= 0) return n;
+
+  /* make room for a new vertex */
+  if (S->nvert >= S->maxvert) {
+    m = S->maxvert;
+    if (iso_reserve((void **)&S->vert,&m,S->nvert+1,3*sizeof(FLOAT))) return -1;
+    if (iso_reserve((void **)&S->vkey,&S->maxvert,S->nvert+1,sizeof(long long))) return -1;
+  }
+  if (2*(size_t)(S->nvert+1) > S->hsize) {
+    /* grow the hash table and rehash the existing vertices */
+    hsize = S->hsize > 0 ? 2*S->hsize : 4096;
+    htab = (int *) malloc(hsize*sizeof(int));
+    if (htab == NULL) return -1;
+    for (h=0; h<hsize; h++) htab[h] = -1;
+    for (n=0; n<S->nvert; n++) {
+      for (h=iso_hash(S->vkey[n],hsize); htab[h] >= 0; h=(h+1) & (hsize-1));
+      htab[h] = n;
+    }
+    free(S->htab);
+    S->htab = htab;
+    S->hsize = hsize;
+  }
+
+  /* create the vertex */
+  n = S->nvert++;
+  p = VertexInterp(p1,p2,v1,v2,level);
+  S->vert[3*n] = p.x;
+  S->vert[3*n+1] = p.y;
+  S->vert[3*n+2] = p.z;
+  S->vkey[n] = key;
+  for (h=iso_hash(key,S->hsize); S->htab[h] >= 0; h=(h+1) & (S->hsize-1));
+  S->htab[h] = n;
+  return n;
+}
+
+
+/*
+   Extract the isosurface in the box of cells of a slab defined by
+   box[0] <= ix < box[1], box[2] <= iy < box[3], box[4] <= iz < box[5]
+*/
+static void iso_box(ISOSLAB *S, FLOAT *data, int nx, int ny, int nz, FLOAT level, int tet, int indexed, int *box)
+{
+  /* vertex coordinates with respect to ix,iy,iz */
+  int grid[8][3] = {
+    {0,0,0},
+    {1,0,0},
+    {1,1,0},
+    {0,1,0},
+    {0,0,1},
+    {1,0,1},
+    {1,1,1},
+    {0,1,1},
+  };
+  int ktri; /* max number of triangles per voxel */
+  if (tet) ktri = 12;
+  else ktri = 5;
+
+  /* data offsets with respect to first vertex data */
+  int i,ofs[8];
+  for (i=0; i<8; i++) {
+    ofs[i] = ( grid[i][2]*ny + grid[i][1] )*nx + grid[i][0];
+  }
+
+  /* loop over cells */
+  int mtri,j,k,n;
+  int ix,iy,iz;
+  XYZ pos[8];   /* coordinates of the cell vertices */
+  FLOAT val[8]; /* data values at the cell vertices */
+  int corners[12*3*2]; /* cell vertices of the triangle edges */
+  npy_intp iofs;     /* data offset of vertex ix,iy,iz */
+  long long a,b,npts = (long long)nx*ny*nz;
+  for (iz=box[4]; iz<box[5]; iz++) {
+    for (i=0; i<8; i++) pos[i].z = iz + grid[i][2];
+    for (iy=box[2]; iy<box[3]; iy++) {
+      for (i=0; i<8; i++) pos[i].y = iy + grid[i][1];
+      for (ix=box[0]; ix<box[1]; ix++) {
+	for (i=0; i<8; i++) pos[i].x = ix + grid[i][0];
+	iofs = ((npy_intp)iz*ny + iy)*nx + ix;
+	for (i=0; i<8; i++) val[i] = data[iofs + ofs[i]];
+	if (indexed) {
+	  if (tet) mtri = PolygoniseTetEdges(corners,val,level);
+	  else mtri = PolygoniseEdges(corners,val,level);
+	  if (mtri == 0) continue;
+	  if (iso_reserve((void **)&S->elems,&S->maxtri,S->ntri+mtri,3*sizeof(int))) goto fail;
+	  for (i=0; i<3*mtri; i++) {
+	    j = corners[2*i];
+	    k = corners[2*i+1];
+	    /* orient the edge from lowest to highest grid point */
+	    if (ofs[j] > ofs[k]) {
+	      n = j; j = k; k = n;
+	    }
+	    a = iofs + ofs[j];
+	    b = iofs + ofs[k];
+	    n = iso_vertex(S,a*npts+b,pos[j],pos[k],val[j],val[k],level);
+	    if (n < 0) goto fail;
+	    S->elems[3*S->ntri+i] = n;
+	  }
+	} else {
+	  if (iso_reserve((void **)&S->tri,&S->maxtri,S->ntri+ktri,3*3*sizeof(FLOAT))) goto fail;
+	  if (tet) mtri = PolygoniseTet(S->tri+S->ntri*3*3,pos,val,level);
+	  else mtri = Polygonise(S->tri+S->ntri*3*3,pos,val,level);
+	}
+	S->ntri += mtri;
+      }
+    }
+  }
+  return;
+ fail:
+  S->error = 1;
+}
+
+
+/*
+   Extract the isosurface in a slab of cell layers. If blocks is not
+   NULL, only the cells in the active blocks b0 <= b < b1 of size bs
+   are processed.
+*/
+static void iso_slab(ISOSLAB *S, FLOAT *data, int nx, int ny, int nz, FLOAT level, int tet, int indexed, int *blocks, int bs)
+{
+  int i, *blk, box[6];
+  int n[3] = { nx-1, ny-1, nz-1 };  /* number of cells along the axes */
+  npy_intp b;
+  if (blocks == NULL) {
+    box[0] = box[2] = 0;
+    box[1] = n[0];
+    box[3] = n[1];
+    box[4] = S->iz0;
+    box[5] = S->iz1;
+    iso_box(S,data,nx,ny,nz,level,tet,indexed,box);
+    return;
+  }
+  for (b=S->b0; b<S->b1 && !S->error; b++) {
+    /* block indices are in the order bz,by,bx */
+    blk = blocks + 3*b;
+    for (i=0; i<3; i++) {
+      box[2*i] = blk[2-i] * bs;
+      box[2*i+1] = box[2*i] + bs < n[i] ? box[2*i] + bs : n[i];
+    }
+    iso_box(S,data,nx,ny,nz,level,tet,indexed,box);
+  }
+}
+
+
+/*
+   Number the vertices of all the slabs globally. The vertices on the
+   bottom plane of a slab that were also created in the previous slab
+   get the number of that vertex. Returns the total number of unique
+   vertices, or -1 if out of memory.
+*/
+static npy_intp iso_number(ISOSLAB *slabs, int nslab, int nx, int ny, int nz)
+{
+  int s,n,m;
+  npy_intp nvert = 0;
+  long long a,b,key,npts = (long long)nx*ny*nz, nplane = (long long)nx*ny;
+  ISOSLAB *S;
+  for (s=0; s<nslab; s++) {
+    S = slabs+s;
+    S->gid = (int *) malloc((S->nvert > 0 ? S->nvert : 1)*sizeof(int));
+    if (S->gid == NULL) return -1;
+    for (n=0; n<S->nvert; n++) {
+      m = -1;
+      if (s > 0) {
+	key = S->vkey[n];
+	a = key / npts;
+	b = key % npts;
+	if (a / nplane == S->iz0 && b / nplane == S->iz0)
+	  m = iso_find(S-1,key);
+      }
+      if (m >= 0) {
+	/* shared vertex: store the encoded number of the original */
+	m = (S-1)->gid[m];
+	S->gid[n] = m < 0 ? m : -1-m;
+      }
+      else S->gid[n] = nvert++;
+    }
+  }
+  return nvert;
+}
+
+
+static char isosurface_doc[] = "\
+isosurface(data, level, tet, nthreads=1, indexed=0, blocks=None, bs=8)\n\
+\n\n\
+Create an isosurface through data at given level.\n\
+\n\
+Parameters\n\
+----------\n\
+data: float32 array (nx,ny,nz)\n\
+    The data values at points with coordinates equal to their indices.\n\
+    This defines a 3D volume (0..nx-1, 0..ny-1, 0..nz-1)\n\
+level: float\n\
+    The data value at which the isosurface is to be constructed\n\
+tet: int\n\
+    If zero, a marching cubes algorithm is used. If nonzero,\n\
+    a marching tetrahedrons algorithm is used. The latter is slower and\n\
+    produces a lot more triangles, but results in a smoother surface.\n\
+nthreads: int\n\
+    The number of threads to use. The volume is split in this number\n\
+    of slabs along the first axis, which are processed in parallel.\n\
+    If <= 0, the maximum number of available threads is used.\n\
+indexed: int\n\
+    If nonzero, the isosurface is returned as an indexed mesh, with\n\
+    unique vertices shared by the adjacent triangles.\n\
+blocks: int32 array (nblk,3), optional\n\
+    If provided, only the cells in these blocks of bs*bs*bs cells are\n\
+    processed. The blocks are numbered as in :func:`minmaxblocks`\n\
+    and should be sorted on their first index.\n\
+bs: int\n\
+    The block size used in blocks.\n\
+\n\
+Returns\n\
+-------\n\
+float32 array (ntri, 3, 3)\n\
+    If indexed is zero: the triangles defining the isosurface. Each\n\
+    triangle consists of 3 points with 3 coordinates.\n\
+    The result is empty if level is outside the data range.\n\
+(coords, elems): tuple of float32 array (nvert,3) and int32 array (ntri,3)\n\
+    If indexed is nonzero: the unique vertices of the isosurface, and\n\
+    the vertex numbers of the triangles.\n\
+\n\
+See Also\n\
+--------\n\
+:meth:`plugins.isosurface.isosurface`: the user oriented function to use this\n\
+:meth:`plugins.isosurface.isosurfaceIter`: streaming isosurface of large data\n\
+\n\
+Notes\n\
+-----\n\
+The data are only read. A C-contiguous float32 array (like a slice\n\
+along the first axis of a memory mapped file) is used without copying.\n\
+\n\
+The algorithms are based on those from\n\
+http://paulbourke.net/geometry/polygonise/ \n\
+";
+
+static PyObject * isosurface(PyObject *dummy, PyObject *args)
+{
+  PyObject *arg1=NULL, *arg2=Py_None;
+  PyObject *arr1=NULL, *arr2=NULL, *ret=NULL, *ret2=NULL;
+  float *data;
+  float level;
+  int tet, nthreads=1, indexed=0, bs=8;
+  if (!PyArg_ParseTuple(args, "Ofi|iiOi", &arg1, &level, &tet, &nthreads, &indexed, &arg2, &bs)) return NULL;
+  arr1 = pf_from_otf(arg1, NPY_FLOAT, NPY_ARRAY_IN_ARRAY);
+  if (arr1 == NULL) return NULL;
+
+  npy_intp * dims;
+  int nx,ny,nz;
+  dims = PYARRAY_DIMS(arr1);
+  nz = dims[0];
+  ny = dims[1];
+  nx = dims[2];
+  data = (float *)PYARRAY_DATA(arr1);
+
+  /* the active blocks, if given */
+  int *blocks = NULL;
+  npy_intp b, nblk = 0;
+  if (arg2 != Py_None) {
+    arr2 = check_blocks(arg2,3,dims,bs);
+    if (arr2 == NULL) {
+      Py_DECREF(arr1);
+      return NULL;
+    }
+    blocks = (int *)PYARRAY_DATA(arr2);
+    nblk = PYARRAY_DIMS(arr2)[0];
+  }
+
+  /* divide the cell layers in slabs; with blocks, slab boundaries
+     are at block boundaries */
+  int s, nslab, nrow, bsz;
+  bsz = blocks ? bs : 1;
+  nrow = blocks ? nblocks(nz,bs) : nz-1;
+  if (nthreads <= 0) nthreads = max_threads();
+  nslab = nthreads;
+  if (nslab > nrow) nslab = nrow;
+  if (nslab < 1) nslab = 1;
+  ISOSLAB *slabs = (ISOSLAB *) calloc(nslab,sizeof(ISOSLAB));
+  if (slabs == NULL) {
+    Py_DECREF(arr1);
+    Py_XDECREF(arr2);
+    return PyErr_NoMemory();
+  }
+  for (b=0, s=0; s<nslab; s++) {
+    slabs[s].iz0 = ((npy_intp)s*nrow) / nslab * bsz;
+    slabs[s].iz1 = ((npy_intp)(s+1)*nrow) / nslab * bsz;
+    if (slabs[s].iz1 > nz-1) slabs[s].iz1 = nz-1;
+    /* blocks are sorted on bz */
+    while (b < nblk && blocks[3*b]*bs < slabs[s].iz0) b++;
+    slabs[s].b0 = b;
+    while (b < nblk && blocks[3*b]*bs < slabs[s].iz1) b++;
+    slabs[s].b1 = b;
+  }
+  if (nz < 2) slabs[0].iz0 = slabs[0].iz1 = 0;
+
+  /* extract the isosurface in each slab */
+  int error = 0;
+  npy_intp ntri = 0, nvert = 0;
+  Py_BEGIN_ALLOW_THREADS
+#pragma omp parallel for schedule(dynamic,1) num_threads(nthreads)
+  for (s=0; s<nslab; s++)
+    iso_slab(slabs+s,data,nx,ny,nz,level,tet,indexed,blocks,bs);
+  for (s=0; s<nslab; s++) {
+    error |= slabs[s].error;
+    ntri += slabs[s].ntri;
+  }
+  if (indexed && !error) {
+    nvert = iso_number(slabs,nslab,nx,ny,nz);
+    if (nvert < 0) error = 1;
+  }
+  Py_END_ALLOW_THREADS
+  if (error) {
+    PyErr_NoMemory();
+    goto fail;
+  }
+  if (pf_cur) {
+    size_t bytes = 0;
+    for (s=0; s<nslab; s++)
+      bytes += iso_slab_bytes(slabs+s);
+    PF_STAT_SCRATCH(bytes);
+  }
+  PF_STAT_ITEMS(ntri);
+
+  /* create return arrays */
+  npy_intp i, n, dim[3];
+  dim[0] = ntri;
+  dim[1] = 3;
+  dim[2] = 3;
+  if (indexed) {
+    ret = PyArray_SimpleNew(2,dim, NPY_INT);
+    dim[0] = nvert;
+    ret2 = PyArray_SimpleNew(2,dim, NPY_FLOAT);
+    if (ret == NULL || ret2 == NULL) goto fail;
+    int *elems = (int *)PYARRAY_DATA(ret);
+    float *coords = (float *)PYARRAY_DATA(ret2);
+    for (s=0; s<nslab; s++) {
+      ISOSLAB *S = slabs+s;
+      for (i=0; i<S->nvert; i++)
+	if (S->gid[i] >= 0)
+	  memcpy(coords+3*S->gid[i],S->vert+3*i,3*sizeof(float));
+      for (i=0; i<3*S->ntri; i++) {
+	n = S->gid[S->elems[i]];
+	*elems++ = n >= 0 ? n : -1-n;
+      }
+      iso_free(S);
+    }
+  } else {
+    ret = PyArray_SimpleNew(3,dim, NPY_FLOAT);
+    if (ret == NULL) goto fail;
+    float *out = (float *)PYARRAY_DATA(ret);
+    for (s=0; s<nslab; s++) {
+      memcpy(out,slabs[s].tri,slabs[s].ntri*3*3*sizeof(float));
+      out += slabs[s].ntri*3*3;
+      iso_free(slabs+s);
+    }
+  }
+
+  /* Clean up and return */
+  free(slabs);
+  Py_DECREF(arr1);
+  Py_XDECREF(arr2);
+  if (indexed) return Py_BuildValue("NN",ret2,ret);
+  return ret;
+ fail:
+  for (s=0; s<nslab; s++) iso_free(slabs+s);
+  free(slabs);
+  Py_XDECREF(arr1);
+  Py_XDECREF(arr2);
+  Py_XDECREF(ret);
+  Py_XDECREF(ret2);
+  return NULL;
+}
+
+
+/**************************************************** isolines ****/
+/*
+   Sort the (nlev) levels and return in ind the original index of
+   the sorted levels. Insertion sort is fine for the usual numbers
+   of contour levels.
+*/
+static void sort_levels(float *lev, int *ind, int nlev)
+{
+  int i, j, k;
+  float v;
+  for (i=0; i<nlev; i++) ind[i] = i;
+  for (i=1; i<nlev; i++) {
+    v = lev[i];
+    k = ind[i];
+    for (j=i; j>0 && lev[j-1] > v; j--) {
+      lev[j] = lev[j-1];
+      ind[j] = ind[j-1];
+    }
+    lev[j] = v;
+    ind[j] = k;
+  }
+}
+
+
+static char isolines_doc[] = "\
+isolines(data, levels)\n\
+\n\n\
+Create isocontours through data at multiple levels.\n\
+\n\
+Parameters\n\
+----------\n\
+data: float32 array (nx,ny)\n\
+    The data values at points with coordinates equal to their indices.\n\
+    This defines a 2D area (0..nx-1, 0..ny-1)\n\
+levels: float32 array (nlev,)\n\
+    Data values at which the isocontours are to be constructed\n\
+\n\
+Returns\n\
+-------\n\
+seg: float32 array (nseg, 2, 2)\n\
+    The line segments of all the isocontours. Each segment consist of\n\
+    two points with two coordinates.\n\
+lev: int32 array (nseg,)\n\
+    The index in levels of the isocontour to which each segment belongs.\n\
+\n\
+See Also\n\
+--------\n\
+:meth:`plugins.isosurface.isolines`: the user oriented function to use this\n\
+\n\
+Notes\n\
+-----\n\
+The grid is traversed only once. The values at the corners of each cell\n\
+are tested against the sorted levels, and the segments are created for\n\
+the levels within the range of the cell, using the same marching square\n\
+algorithm as :func:`isoline`. The segments are ordered by cell, and by\n\
+increasing level within a cell.\n\
+";
+
+static PyObject * isolines(PyObject *dummy, PyObject *args)
+{
+  PyObject *arg1=NULL, *arg2=NULL;
+  PyObject *arr1=NULL, *arr2=NULL, *ret1=NULL, *ret2=NULL;
+  float *data, *lev=NULL, *segments=NULL;
+  int *ind=NULL, *seglev=NULL;
+  if (!PyArg_ParseTuple(args, "OO", &arg1, &arg2)) return NULL;
+  arr1 = pf_from_otf(arg1, NPY_FLOAT, NPY_ARRAY_IN_ARRAY);
+  if (arr1 == NULL) return NULL;
+  arr2 = pf_from_otf(arg2, NPY_FLOAT, NPY_ARRAY_IN_ARRAY);
+  if (arr2 == NULL) goto fail;
+
+  npy_intp * dims;
+  int nx,ny,nlev;
+  dims = PYARRAY_DIMS(arr1);
+  ny = dims[0];
+  nx = dims[1];
+  data = (float *)PYARRAY_DATA(arr1);
+  nlev = PyArray_SIZE((PyArrayObject *)arr2);
+
+  /* sorted copy of the levels */
+  lev = (float *) malloc((nlev+1)*sizeof(float));
+  ind = (int *) malloc((nlev+1)*sizeof(int));
+  if (lev == NULL || ind == NULL) {
+    PyErr_NoMemory();
+    goto fail;
+  }
+  memcpy(lev,PYARRAY_DATA(arr2),nlev*sizeof(float));
+  sort_levels(lev,ind,nlev);
+
+  /* vertex coordinates with respect to ix,iy */
+  int grid[4][2] = {
+    {0,0},
+    {1,0},
+    {1,1},
+    {0,1},
+  };
+
+  /* data offsets with respect to first vertex data */
+  int i,ofs[4];
+  for (i=0; i<4; i++) ofs[i] = grid[i][1] * nx + grid[i][0];
+
+  /* loop over cells */
+  int j,k,mseg,ix,iy,error=0;
+  XY pos[4];    /* coordinates of the cell vertices */
+  FLOAT val[4]; /* data values at the cell vertices */
+  FLOAT vmin, vmax;
+  npy_intp iofs, iseg=0, nseg=0, nlseg=0;
+  Py_BEGIN_ALLOW_THREADS
+  for (iy=0; iy<ny-1 && !error; iy++) {
+    for (i=0; i<4; i++) pos[i].y = iy + grid[i][1];
+    for (ix=0; ix<nx-1; ix++) {
+      iofs = (npy_intp)iy*nx + ix;
+      vmin = vmax = val[0] = data[iofs];
+      for (i=1; i<4; i++) {
+	val[i] = data[iofs + ofs[i]];
+	if (val[i] < vmin) vmin = val[i];
+	if (val[i] > vmax) vmax = val[i];
+      }
+      /* first level above the minimum */
+      j = 0;
+      k = nlev;
+      while (j < k) {
+	i = (j+k) / 2;
+	if (lev[i] > vmin) k = i;
+	else j = i+1;
+      }
+      if (j >= nlev || lev[j] > vmax) continue;
+      for (i=0; i<4; i++) pos[i].x = ix + grid[i][0];
+      /* all levels with vmin < level <= vmax */
+      for (; j<nlev && lev[j] <= vmax; j++) {
+	if (iso_reserve((void **)&segments,&nseg,iseg+2,2*2*sizeof(float)) ||
+	    iso_reserve((void **)&seglev,&nlseg,iseg+2,sizeof(int))) {
+	  error = 1;
+	  break;
+	}
+	mseg = Polygonise2(segments+iseg*2*2,pos,val,lev[j]);
+	for (i=0; i<mseg; i++) seglev[iseg+i] = ind[j];
+	iseg += mseg;
+      }
+    }
+  }
+  Py_END_ALLOW_THREADS
+  if (error) {
+    PyErr_NoMemory();
+    goto fail;
+  }
+  PF_STAT_SCRATCH(nseg*2*2*sizeof(float) + nlseg*sizeof(int));
+  PF_STAT_ITEMS(iseg);
+
+  /* create return arrays */
+  npy_intp dim[3];
+  dim[0] = iseg;
+  dim[1] = 2;
+  dim[2] = 2;
+  ret1 = PyArray_SimpleNew(3,dim, NPY_FLOAT);
+  ret2 = PyArray_SimpleNew(1,dim, NPY_INT);
+  if (ret1 == NULL || ret2 == NULL) goto fail;
+  memcpy(PYARRAY_DATA(ret1),segments,iseg*2*2*sizeof(float));
+  memcpy(PYARRAY_DATA(ret2),seglev,iseg*sizeof(int));
+
+  /* Clean up and return */
+  free(lev);
+  free(ind);
+  free(segments);
+  free(seglev);
+  Py_DECREF(arr1);
+  Py_DECREF(arr2);
+  return Py_BuildValue("NN",ret1,ret2);
+ fail:
+  free(lev);
+  free(ind);
+  free(segments);
+  free(seglev);
+  Py_XDECREF(arr1);
+  Py_XDECREF(arr2);
+  Py_XDECREF(ret1);
+  Py_XDECREF(ret2);
+  return NULL;
+}
+
+
+/**************************************************** transform ****/
+/* Fused transformations and reductions of (npts,3) coordinate arrays */
+
+/*
+   These kernels handle the points in a single pass, without any
+   intermediate arrays. The arithmetic is done in double precision.
+   If the points are stored contiguously, typed loops are used, which
+   the compiler vectorizes. With GCC on x86_64, these loops are compiled
+   for AVX2 as well as for the baseline instruction set, and the best
+   version is selected at load time. Large arrays are divided over
+   multiple threads, each handling a contiguous range of points.
+*/
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define SIMD_CLONES __attribute__((target_clones("avx2","default")))
+#else
+#define SIMD_CLONES
+#endif
+
+/* Minimal number of points to use multiple threads */
+#define XFORM_PARALLEL_MIN 65536
+
+/* The range of points [i0,i1) to be handled by the current thread */
+static void thread_range(npy_intp n, npy_intp *i0, npy_intp *i1)
+{
+#ifdef _OPENMP
+  npy_intp nt = omp_get_num_threads(), it = omp_get_thread_num();
+  *i0 = n * it / nt;
+  *i1 = n * (it+1) / nt;
+#else
+  *i0 = 0;
+  *i1 = n;
+#endif
+}
+
+/* Check that an ARRAY view holds contiguous points */
+static int contiguous_points(const ARRAY *x)
+{
+  return x->strides[1] == x->itemsize && x->strides[0] == 3*x->itemsize;
+}
+
+/* Check whether the memory block [data,data+nbytes) overlaps the points x */
+static int overlaps(const ARRAY *x, const char *data, npy_intp nbytes)
+{
+  const char *lo = x->data, *hi = x->data + x->itemsize;
+  npy_intp s0 = (x->dims[0]-1) * x->strides[0], s1 = 2 * x->strides[1];
+  if (x->dims[0] == 0) return 0;
+  if (s0 < 0) lo += s0; else hi += s0;
+  if (s1 < 0) lo += s1; else hi += s1;
+  return data < hi && lo < data + nbytes;
+}
+
+/*
+   y = x * m + t for n contiguous points x, where m is a (3,3) matrix
+   and t a (3,) vector. y may be the same array as x.
+*/
+#define DEFINE_TRANSFORM(NAME,TI,TO)					\
+  static SIMD_CLONES void NAME(const TI *x, TO *y, npy_intp n,		\
+			       const double *m, const double *t)	\
+  {									\
+    npy_intp i;								\
+    _Pragma("omp simd")							\
+    for (i=0; i<n; i++) {						\
+      double x0 = x[3*i], x1 = x[3*i+1], x2 = x[3*i+2];		\
+      y[3*i]   = (TO)(x0*m[0] + x1*m[3] + x2*m[6] + t[0]);		\
+      y[3*i+1] = (TO)(x0*m[1] + x1*m[4] + x2*m[7] + t[1]);		\
+      y[3*i+2] = (TO)(x0*m[2] + x1*m[5] + x2*m[8] + t[2]);		\
+    }									\
+  }
+
+DEFINE_TRANSFORM(transform_ff,float,float)
+DEFINE_TRANSFORM(transform_fd,float,double)
+DEFINE_TRANSFORM(transform_df,double,float)
+DEFINE_TRANSFORM(transform_dd,double,double)
+
+/*
+   Transform the points x (npts,3) into y (npts,3): y = x * m + t.
+   y is a contiguous float32 or float64 array.
+*/
+void transform_points(ARRAY *x, ARRAY *y, const double *m, const double *t)
+{
+  npy_intp n = x->dims[0];
+  int contig = contiguous_points(x);
+
+#pragma omp parallel if (n >= XFORM_PARALLEL_MIN) num_threads(pf_threads())
+  {
+    npy_intp i, i0, i1;
+    thread_range(n,&i0,&i1);
+    if (contig) {
+      char *xd = x->data + 3*i0*x->itemsize;
+      char *yd = y->data + 3*i0*y->itemsize;
+      if (x->itemsize == 4) {
+	if (y->itemsize == 4) transform_ff((float *)xd,(float *)yd,i1-i0,m,t);
+	else transform_fd((float *)xd,(double *)yd,i1-i0,m,t);
+      } else {
+	if (y->itemsize == 4) transform_df((double *)xd,(float *)yd,i1-i0,m,t);
+	else transform_dd((double *)xd,(double *)yd,i1-i0,m,t);
+      }
+    } else {
+      for (i=i0; i<i1; i++) {
+	double x0 = getf(x,OFS2(x,i,0));
+	double x1 = getf(x,OFS2(x,i,1));
+	double x2 = getf(x,OFS2(x,i,2));
+	double v[3];
+	int k;
+	for (k=0; k<3; k++) v[k] = x0*m[k] + x1*m[3+k] + x2*m[6+k] + t[k];
+	if (y->itemsize == 4) for (k=0; k<3; k++) ((float *)y->data)[3*i+k] = (float)v[k];
+	else for (k=0; k<3; k++) ((double *)y->data)[3*i+k] = v[k];
+      }
+    }
+  }
+}
+
+/*
+   Minimum and maximum coordinates of n contiguous points.
+   The NaN flags are set if NaN values occur in the coordinates:
+   the min/max reductions themselves would skip them.
+*/
+#define DEFINE_BBOX(NAME,T)						\
+  static SIMD_CLONES void NAME(const T *x, npy_intp n,			\
+			       double *bmin, double *bmax, int *nan)	\
+  {									\
+    npy_intp i;								\
+    T a0 = x[0], a1 = x[1], a2 = x[2], b0 = a0, b1 = a1, b2 = a2;	\
+    int n0 = 0, n1 = 0, n2 = 0;						\
+    _Pragma("omp simd reduction(min:a0,a1,a2) reduction(max:b0,b1,b2) reduction(|:n0,n1,n2)") \
+    for (i=0; i<n; i++) {						\
+      T x0 = x[3*i], x1 = x[3*i+1], x2 = x[3*i+2];			\
+      a0 = x0 < a0 ? x0 : a0;  b0 = x0 > b0 ? x0 : b0;  n0 |= x0 != x0; \
+      a1 = x1 < a1 ? x1 : a1;  b1 = x1 > b1 ? x1 : b1;  n1 |= x1 != x1; \
+      a2 = x2 < a2 ? x2 : a2;  b2 = x2 > b2 ? x2 : b2;  n2 |= x2 != x2; \
+    }									\
+    bmin[0] = a0; bmin[1] = a1; bmin[2] = a2;				\
+    bmax[0] = b0; bmax[1] = b1; bmax[2] = b2;				\
+    nan[0] = n0; nan[1] = n1; nan[2] = n2;				\
+  }
+
+DEFINE_BBOX(bbox_f,float)
+DEFINE_BBOX(bbox_d,double)
+
+/*
+   Compute the bounding box (min and max coordinates) of the points
+   x (npts,3), with npts > 0. Like numpy's min and max, a coordinate
+   direction containing a NaN gets NaN limits.
+*/
+void bbox_points(ARRAY *x, double *bmin, double *bmax)
+{
+  npy_intp n = x->dims[0];
+  int contig = contiguous_points(x);
+  int k, nan[3] = {0,0,0};
+  for (k=0; k<3; k++) {
+    bmin[k] = INFINITY;
+    bmax[k] = -INFINITY;
+  }
+
+#pragma omp parallel if (n >= XFORM_PARALLEL_MIN) num_threads(pf_threads())
+  {
+    npy_intp i, i0, i1;
+    double tmin[3], tmax[3];
+    int tnan[3] = {0,0,0};
+    thread_range(n,&i0,&i1);
+    if (i1 > i0) {
+      if (contig) {
+	char *xd = x->data + 3*i0*x->itemsize;
+	if (x->itemsize == 4) bbox_f((float *)xd,i1-i0,tmin,tmax,tnan);
+	else bbox_d((double *)xd,i1-i0,tmin,tmax,tnan);
+      } else {
+	for (k=0; k<3; k++) tmin[k] = tmax[k] = getf(x,OFS2(x,i0,k));
+	for (i=i0; i<i1; i++)
+	  for (k=0; k<3; k++) {
+	    double v = getf(x,OFS2(x,i,k));
+	    if (v < tmin[k]) tmin[k] = v;
+	    if (v > tmax[k]) tmax[k] = v;
+	    if (v != v) tnan[k] = 1;
+	  }
+      }
+#pragma omp critical
+      for (k=0; k<3; k++) {
+	if (tmin[k] < bmin[k]) bmin[k] = tmin[k];
+	if (tmax[k] > bmax[k]) bmax[k] = tmax[k];
+	nan[k] |= tnan[k];
+      }
+    }
+  }
+  for (k=0; k<3; k++)
+    if (nan[k]) bmin[k] = bmax[k] = NAN;
+}
+
+/*
+   Signed distance of n contiguous points from the plane through p
+   with unit normal u, or (line != 0) the distance from the line
+   through p with unit direction u.
+*/
+#define DEFINE_DISTANCE(NAME,T)						\
+  static SIMD_CLONES void NAME(const T *x, double *d, npy_intp n,	\
+			       const double *p, const double *u, int line) \
+  {									\
+    npy_intp i;								\
+    if (line) {								\
+      _Pragma("omp simd")						\
+      for (i=0; i<n; i++) {						\
+	double y0 = x[3*i]-p[0], y1 = x[3*i+1]-p[1], y2 = x[3*i+2]-p[2]; \
+	double s = y0*u[0] + y1*u[1] + y2*u[2];				\
+	double a = y0*y0 + y1*y1 + y2*y2 - s*s;				\
+	d[i] = sqrt(a > 0.0 ? a : 0.0);					\
+      }									\
+    } else {								\
+      double s0 = p[0]*u[0] + p[1]*u[1] + p[2]*u[2];			\
+      _Pragma("omp simd")						\
+      for (i=0; i<n; i++)						\
+	d[i] = x[3*i]*u[0] + x[3*i+1]*u[1] + x[3*i+2]*u[2] - s0;	\
+    }									\
+  }
+
+DEFINE_DISTANCE(distance_f,float)
+DEFINE_DISTANCE(distance_d,double)
+
+/*
+   Compute the distances d (npts) of the points x (npts,3) from the
+   plane or line (p,u), where u is a unit vector.
+*/
+void distance_points(ARRAY *x, double *d, const double *p, const double *u, int line)
+{
+  npy_intp n = x->dims[0];
+  int contig = contiguous_points(x);
+
+#pragma omp parallel if (n >= XFORM_PARALLEL_MIN) num_threads(pf_threads())
+  {
+    npy_intp i, i0, i1;
+    thread_range(n,&i0,&i1);
+    if (contig) {
+      char *xd = x->data + 3*i0*x->itemsize;
+      if (x->itemsize == 4) distance_f((float *)xd,d+i0,i1-i0,p,u,line);
+      else distance_d((double *)xd,d+i0,i1-i0,p,u,line);
+    } else {
+      for (i=i0; i<i1; i++) {
+	double y0 = getf(x,OFS2(x,i,0)) - p[0];
+	double y1 = getf(x,OFS2(x,i,1)) - p[1];
+	double y2 = getf(x,OFS2(x,i,2)) - p[2];
+	double s = y0*u[0] + y1*u[1] + y2*u[2];
+	if (line) {
+	  double a = y0*y0 + y1*y1 + y2*y2 - s*s;
+	  d[i] = sqrt(a > 0.0 ? a : 0.0);
+	} else d[i] = s;
+      }
+    }
+  }
+}
+
+/*
+   Convert obj to a contiguous float64 array with size items,
+   and copy the items to v. Returns 0 on success, -1 on failure.
+*/
+static int get_doubles(PyObject *obj, int size, double *v, char *name)
+{
+  PyObject *arr;
+  arr = pf_from_otf(obj, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  if (arr == NULL) return -1;
+  if (PyArray_SIZE((PyArrayObject *)arr) != size) {
+    PyErr_Format(PyExc_ValueError, "%s should have %d items", name, size);
+    Py_DECREF(arr);
+    return -1;
+  }
+  memcpy(v,PYARRAY_DATA(arr),size*sizeof(double));
+  Py_DECREF(arr);
+  return 0;
+}
+
+static char transform_doc[] = "\
+transform(x, mat, trl, out=None)\n\
+\n\n\
+Apply an affine transformation to a set of points.\n\
+\n\
+Parameters\n\
+----------\n\
+x: float32 or float64 array (npts, 3)\n\
+    The coordinates of the points. The array is read in place,\n\
+    with any strides.\n\
+mat: float array_like (3, 3)\n\
+    The matrix post-multiplying the points.\n\
+trl: float array_like (3,)\n\
+    The translation added after the multiplication.\n\
+out: float32 or float64 array (npts, 3), optional\n\
+    A C-contiguous array to store the result. It may be x itself.\n\
+    If not provided, a new array with the type of x is created.\n\
+\n\
+Returns\n\
+-------\n\
+out: float array (npts, 3)\n\
+    The transformed points ``x * mat + trl``, computed in a single\n\
+    pass in double precision.\n\
+";
+
+static PyObject * transform(PyObject *dummy, PyObject *args)
+{
+  PyObject *arg1=NULL, *arg2=NULL, *arg3=NULL, *arg4=Py_None;
+  PyObject *arr1=NULL, *ret=NULL;
+  ARRAY x, y;
+  double m[9], t[3];
+  if (!PyArg_ParseTuple(args, "OOO|O", &arg1, &arg2, &arg3, &arg4)) return NULL;
+  if (get_doubles(arg2,9,m,"mat") < 0 || get_doubles(arg3,3,t,"trl") < 0)
+    return NULL;
+  arr1 = array_view(arg1, 'f', 2, &x);
+  if (arr1 == NULL) return NULL;
+  if (check_points(&x) < 0) goto fail;
+
+  if (arg4 == Py_None) {
+    ret = PyArray_SimpleNew(2,x.dims, x.itemsize == 8 ? NPY_DOUBLE : NPY_FLOAT);
+    if (ret == NULL) goto fail;
+  } else {
+    PyArrayObject *p = (PyArrayObject *)arg4;
+    if (!PyArray_Check(arg4) || !PyArray_ISCARRAY(p) ||
+	!PyArray_ISNOTSWAPPED(p) || !PyArray_ISFLOAT(p) ||
+	(PyArray_ITEMSIZE(p) != 4 && PyArray_ITEMSIZE(p) != 8) ||
+	PyArray_NDIM(p) != 2 || PyArray_DIM(p,0) != x.dims[0] ||
+	PyArray_DIM(p,1) != 3) {
+      PyErr_SetString(PyExc_ValueError,
+		      "out should be a writable contiguous float array like x");
+      goto fail;
+    }
+    if (overlaps(&x,PyArray_BYTES(p),PyArray_NBYTES(p)) &&
+	!(PyArray_BYTES(p) == x.data && PyArray_ITEMSIZE(p) == x.itemsize &&
+	  contiguous_points(&x))) {
+      PyErr_SetString(PyExc_ValueError, "out overlaps x, but is not x");
+      goto fail;
+    }
+    Py_INCREF(arg4);
+    ret = arg4;
+  }
+  y.data = PYARRAY_DATA(ret);
+  y.itemsize = PyArray_ITEMSIZE((PyArrayObject *)ret);
+
+  Py_BEGIN_ALLOW_THREADS
+  transform_points(&x,&y,m,t);
+  Py_END_ALLOW_THREADS
+
+  /* Clean up and return */
+  Py_DECREF(arr1);
+  return ret;
+ fail:
+  Py_XDECREF(arr1);
+  Py_XDECREF(ret);
+  return NULL;
+}
+
+static char bbox_doc[] = "\
+bbox(x)\n\
+\n\n\
+Compute the bounding box of a set of points.\n\
+\n\
+Parameters\n\
+----------\n\
+x: float32 or float64 array (npts, 3)\n\
+    The coordinates of the points, with npts > 0. The array is read\n\
+    in place, with any strides.\n\
+\n\
+Returns\n\
+-------\n\
+bb: float array (2, 3)\n\
+    The minimal and maximal coordinates of the points, with the type\n\
+    of x. A NaN value in x makes both limits of its direction NaN.\n\
+";
+
+static PyObject * bbox(PyObject *dummy, PyObject *args)
+{
+  PyObject *arg1=NULL;
+  PyObject *arr1=NULL, *ret=NULL;
+  ARRAY x;
+  double bmin[3], bmax[3];
+  int k;
+  if (!PyArg_ParseTuple(args, "O", &arg1)) return NULL;
+  arr1 = array_view(arg1, 'f', 2, &x);
+  if (arr1 == NULL) return NULL;
+  if (check_points(&x) < 0) goto fail;
+  if (x.dims[0] == 0) {
+    PyErr_SetString(PyExc_ValueError, "can not compute bbox of zero points");
+    goto fail;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  bbox_points(&x,bmin,bmax);
+  Py_END_ALLOW_THREADS
+
+  /* create return array */
+  npy_intp dim[2] = {2,3};
+  ret = PyArray_SimpleNew(2,dim, x.itemsize == 8 ? NPY_DOUBLE : NPY_FLOAT);
+  if (ret == NULL) goto fail;
+  for (k=0; k<3; k++) {
+    if (x.itemsize == 8) {
+      ((double *)PYARRAY_DATA(ret))[k] = bmin[k];
+      ((double *)PYARRAY_DATA(ret))[3+k] = bmax[k];
+    } else {
+      ((float *)PYARRAY_DATA(ret))[k] = (float)bmin[k];
+      ((float *)PYARRAY_DATA(ret))[3+k] = (float)bmax[k];
+    }
+  }
+
+  /* Clean up and return */
+  Py_DECREF(arr1);
+  return ret;
+ fail:
+  Py_XDECREF(arr1);
+  return NULL;
+}
+
+/* Common implementation of distanceFromPlane and distanceFromLine */
+static PyObject * distance_from(PyObject *args, int line)
+{
+  PyObject *arg1=NULL, *arg2=NULL, *arg3=NULL;
+  PyObject *arr1=NULL, *ret=NULL;
+  ARRAY x;
+  double p[3], u[3], l;
+  if (!PyArg_ParseTuple(args, "OOO", &arg1, &arg2, &arg3)) return NULL;
+  if (get_doubles(arg2,3,p,"p") < 0 || get_doubles(arg3,3,u,"n") < 0)
+    return NULL;
+  l = sqrt(u[0]*u[0] + u[1]*u[1] + u[2]*u[2]);
+  u[0] /= l;
+  u[1] /= l;
+  u[2] /= l;
+  arr1 = array_view(arg1, 'f', 2, &x);
+  if (arr1 == NULL) return NULL;
+  if (check_points(&x) < 0) goto fail;
+
+  /* create return array */
+  ret = PyArray_SimpleNew(1,x.dims, NPY_DOUBLE);
+  if (ret == NULL) goto fail;
+
+  Py_BEGIN_ALLOW_THREADS
+  distance_points(&x,(double *)PYARRAY_DATA(ret),p,u,line);
+  Py_END_ALLOW_THREADS
+
+  /* Clean up and return */
+  Py_DECREF(arr1);
+  return ret;
+ fail:
+  Py_XDECREF(arr1);
+  return NULL;
+}
+
+static char distanceFromPlane_doc[] = "\
+distanceFromPlane(x, p, n)\n\
+\n\n\
+Compute the signed distance of points from a plane.\n\
+\n\
+Parameters\n\
+----------\n\
+x: float32 or float64 array (npts, 3)\n\
+    The coordinates of the points. The array is read in place,\n\
+    with any strides.\n\
+p: float array_like (3,)\n\
+    A point in the plane.\n\
+n: float array_like (3,)\n\
+    The normal to the plane. It does not have to be normalized.\n\
+\n\
+Returns\n\
+-------\n\
+d: float64 array (npts,)\n\
+    The distances of the points from the plane, positive at the side\n\
+    of the normal.\n\
+";
+
+static PyObject * distanceFromPlane(PyObject *dummy, PyObject *args)
+{
+  return distance_from(args,0);
+}
+
+static char distanceFromLine_doc[] = "\
+distanceFromLine(x, p, n)\n\
+\n\n\
+Compute the distance of points from a line.\n\
+\n\
+Parameters\n\
+----------\n\
+x: float32 or float64 array (npts, 3)\n\
+    The coordinates of the points. The array is read in place,\n\
+    with any strides.\n\
+p: float array_like (3,)\n\
+    A point on the line.\n\
+n: float array_like (3,)\n\
+    The direction of the line. It does not have to be normalized.\n\
+\n\
+Returns\n\
+-------\n\
+d: float64 array (npts,)\n\
+    The distances of the points from the line. All values are positive\n\
+    or zero.\n\
+";
+
+static PyObject * distanceFromLine(PyObject *dummy, PyObject *args)
+{
+  return distance_from(args,1);
+}
+
+
+/************************************************ insideSurface ****/
+/* Batched point in closed surface test */
+
+/*
+   A ray is shot from each point in the positive direction of one of
+   the global axes, and the intersections with the surface triangles
+   are counted: an odd count means that the point is inside.
+
+   The triangles are stored in a flat bounding volume hierarchy (BVH):
+   the nodes are in depth first order, so that the left child of an
+   inner node directly follows it. As all rays are parallel to the
+   axis, a node only needs its bounds in the two other directions
+   (the ray plane) and its maximal coordinate along the ray. The
+   triangle coordinates are stored per component in the order of the
+   leaves, so that the triangles of a leaf are tested in a single
+   vectorized loop.
+
+   A ray hits a triangle if the point lies inside the projection of
+   the triangle on the ray plane. This is decided from the signs of
+   the three edge functions of the projected triangle. The edge
+   function of a shared edge is computed from the same expression in
+   both triangles, so the values are exactly opposite. A zero value (a
+   ray through an edge or a vertex) gets the sign it would have if the
+   point were moved over an infinitesimal distance (eps,eps^2) in the
+   ray plane. Thus a ray through an edge or vertex hits exactly one of
+   the triangles sharing it, and the count is not affected by the
+   cases where gtsinside can fail. Points on the surface itself are
+   classified arbitrarily.
+*/
+
+/* Floating point contraction (FMA) would break the exact opposite
+   values of the edge functions */
+#if defined(__GNUC__) && !defined(__clang__)
+#define NO_FP_CONTRACT __attribute__((optimize("fp-contract=off")))
+#else
+#define NO_FP_CONTRACT
+#endif
+
+/* Maximal number of triangles in a leaf node */
+#define BVH_LEAFSIZE 8
+/* Depth after which nodes are split in two equal halves */
+#define BVH_MAXSPLIT 48
+/* Size of the traversal stack: BVH_MAXSPLIT + 64 is enough */
+#define BVH_STACKSIZE 128
+/* Minimal number of points to use multiple threads */
+#define INSIDE_PARALLEL_MIN 1024
+
+typedef struct {
+  double lo[2], hi[2];  /* bounds in the ray plane */
+  double xmax;          /* maximal coordinate along the ray */
+  npy_intp first;       /* leaf: first triangle; inner: right child */
+  npy_intp count;       /* leaf: number of triangles; inner: 0 */
+} BvhNode;
+
+typedef struct {
+  BvhNode *nodes;
+  npy_intp nnodes;
+  double *t;            /* 9 arrays of ntri triangle coordinates */
+  npy_intp ntri;
+  /* only used during the build */
+  double *tb;           /* per triangle: lo[2], hi[2], xmax, center[2] */
+  npy_intp *ind;        /* triangle numbers in leaf order */
+} Bvh;
+
+/* The coordinate arrays: component c (0 = along the ray) of vertex v */
+#define TRI(b,v,c) ((b)->t + (3*(v)+(c))*(b)->ntri)
+
+/* Build the subtree of the triangles ind[i0:i1]; returns its node */
+static npy_intp bvh_build(Bvh *b, npy_intp i0, npy_intp i1, int depth)
+{
+  npy_intp i, m, node = b->nnodes++;
+  BvhNode *nd = b->nodes + node;
+  double cmin[2] = {INFINITY,INFINITY}, cmax[2] = {-INFINITY,-INFINITY};
+  int k;
+  for (k=0; k<2; k++) {
+    nd->lo[k] = INFINITY;
+    nd->hi[k] = -INFINITY;
+  }
+  nd->xmax = -INFINITY;
+  for (i=i0; i<i1; i++) {
+    double *tb = b->tb + 7*b->ind[i];
+    for (k=0; k<2; k++) {
+      if (tb[k] < nd->lo[k]) nd->lo[k] = tb[k];
+      if (tb[2+k] > nd->hi[k]) nd->hi[k] = tb[2+k];
+      if (tb[5+k] < cmin[k]) cmin[k] = tb[5+k];
+      if (tb[5+k] > cmax[k]) cmax[k] = tb[5+k];
+    }
+    if (tb[4] > nd->xmax) nd->xmax = tb[4];
+  }
+  if (i1-i0 <= BVH_LEAFSIZE) {
+    nd->first = i0;
+    nd->count = i1-i0;
+    return node;
+  }
+  /* split at the middle of the centers in the largest direction */
+  k = cmax[1]-cmin[1] > cmax[0]-cmin[0];
+  double mid = 0.5*(cmin[k]+cmax[k]);
+  m = i0;
+  for (i=i0; i<i1; i++)
+    if (b->tb[7*b->ind[i]+5+k] < mid) {
+      npy_intp tmp = b->ind[i];
+      b->ind[i] = b->ind[m];
+      b->ind[m++] = tmp;
+    }
+  if (m == i0 || m == i1 || depth >= BVH_MAXSPLIT) m = (i0+i1)/2;
+  bvh_build(b,i0,m,depth+1);
+  i = bvh_build(b,m,i1,depth+1);
+  /* b->nodes was not reallocated: it has room for all nodes */
+  b->nodes[node].first = i;
+  b->nodes[node].count = 0;
+  return node;
+}
+
+/*
+   Build the BVH of the triangles elems (ntri,3) with vertices x (nnod,3),
+   for rays along axis dir. Returns 0 on success, -1 if the memory
+   allocation failed, or 1 if elems contains invalid node numbers.
+*/
+static int bvh_create(Bvh *b, ARRAY *x, ARRAY *elems, int dir)
+{
+  npy_intp i, nnod = x->dims[0], ntri = elems->dims[0];
+  int v, c, ax[3] = {dir, (dir+1)%3, (dir+2)%3}, res = 0;
+  b->ntri = ntri;
+  b->nnodes = 0;
+  /* a binary tree with leaves of at least one triangle */
+  b->nodes = malloc((2*ntri+1)*sizeof(BvhNode));
+  b->t = malloc(9*ntri*sizeof(double));
+  b->tb = malloc(7*ntri*sizeof(double));
+  b->ind = malloc(ntri*sizeof(npy_intp));
+  if (!b->nodes || !b->t || !b->tb || !b->ind) {
+    res = -1;
+    goto done;
+  }
+  /* triangle coordinates in input order and triangle bounds */
+  for (i=0; i<ntri; i++) {
+    double *tb = b->tb + 7*i;
+    for (v=0; v<3; v++) {
+      npy_intp n = geti(elems,OFS2(elems,i,v));
+      if (n < 0 || n >= nnod) {
+	res = 1;
+	goto done;
+      }
+      for (c=0; c<3; c++)
+	TRI(b,v,c)[i] = getf(x,OFS2(x,n,ax[c]));
+    }
+    for (c=0; c<2; c++) {
+      double p = TRI(b,0,c+1)[i], q = TRI(b,1,c+1)[i], r = TRI(b,2,c+1)[i];
+      tb[c] = fmin(p,fmin(q,r));
+      tb[2+c] = fmax(p,fmax(q,r));
+      tb[5+c] = (p+q+r)/3.;
+    }
+    tb[4] = fmax(TRI(b,0,0)[i],fmax(TRI(b,1,0)[i],TRI(b,2,0)[i]));
+    b->ind[i] = i;
+  }
+  if (ntri > 0) bvh_build(b,0,ntri,0);
+  /* reorder the triangle coordinates to the leaf order */
+  for (v=0; v<9; v++) {
+    double *t = b->t + v*ntri;
+    for (i=0; i<ntri; i++) b->tb[i] = t[b->ind[i]];
+    memcpy(t,b->tb,ntri*sizeof(double));
+  }
+ done:
+  free(b->tb);
+  free(b->ind);
+  b->tb = NULL;
+  b->ind = NULL;
+  return res;
+}
+
+static void bvh_free(Bvh *b)
+{
+  free(b->nodes);
+  free(b->t);
+}
+
+/* The sign of an edge function e of an edge with direction (dy,dz),
+   with zero values replaced by their perturbed sign */
+#define EDGE_SIGN(e,dy,dz) ((e) != 0. ? (e) : (dz) != 0. ? -(dz) : (dy))
+
+/*
+   Count the hits of the ray from p along the first axis with the n
+   triangles starting at k0.
+*/
+static SIMD_CLONES NO_FP_CONTRACT
+int leaf_hits(const Bvh *b, npy_intp k0, npy_intp n, const double *p)
+{
+  const double *ax = TRI(b,0,0)+k0, *ay = TRI(b,0,1)+k0, *az = TRI(b,0,2)+k0;
+  const double *bx = TRI(b,1,0)+k0, *by = TRI(b,1,1)+k0, *bz = TRI(b,1,2)+k0;
+  const double *cx = TRI(b,2,0)+k0, *cy = TRI(b,2,1)+k0, *cz = TRI(b,2,2)+k0;
+  npy_intp k;
+  int hits = 0;
+  _Pragma("omp simd reduction(+:hits)")
+  for (k=0; k<n; k++) {
+    double ay1 = ay[k]-p[1], az1 = az[k]-p[2];
+    double by1 = by[k]-p[1], bz1 = bz[k]-p[2];
+    double cy1 = cy[k]-p[1], cz1 = cz[k]-p[2];
+    /* edge functions of the edges opposite to a, b, c */
+    double ea = by1*cz1 - bz1*cy1;
+    double eb = cy1*az1 - cz1*ay1;
+    double ec = ay1*bz1 - az1*by1;
+    double sa = EDGE_SIGN(ea, cy[k]-by[k], cz[k]-bz[k]);
+    double sb = EDGE_SIGN(eb, ay[k]-cy[k], az[k]-cz[k]);
+    double sc = EDGE_SIGN(ec, by[k]-ay[k], bz[k]-az[k]);
+    /* the intersection is beyond p if num has the sign of the area */
+    double num = ea*(ax[k]-p[0]) + eb*(bx[k]-p[0]) + ec*(cx[k]-p[0]);
+    int pos = sa > 0. && sb > 0. && sc > 0. && num > 0.;
+    int neg = sa < 0. && sb < 0. && sc < 0. && num < 0.;
+    hits += pos | neg;
+  }
+  return hits;
+}
+
+/* Test whether the point p (with the ray along the first axis) is inside */
+static int bvh_inside(const Bvh *b, const double *p)
+{
+  npy_intp stack[BVH_STACKSIZE];
+  npy_intp node = 0;
+  int sp = 0, hits = 0;
+  if (b->nnodes == 0) return 0;
+  for (;;) {
+    const BvhNode *nd = b->nodes + node;
+    if (p[1] >= nd->lo[0] && p[1] <= nd->hi[0] &&
+	p[2] >= nd->lo[1] && p[2] <= nd->hi[1] && p[0] < nd->xmax) {
+      if (nd->count) {
+	hits += leaf_hits(b,nd->first,nd->count,p);
+      } else {
+	stack[sp++] = nd->first;
+	node++;
+	continue;
+      }
+    }
+    if (sp == 0) break;
+    node = stack[--sp];
+  }
+  return hits % 2;
+}
+
+/* Test the points pts (npts,3) against the BVH built for axis dir */
+static void inside_points(const Bvh *b, ARRAY *pts, int dir, npy_bool *ins)
+{
+  npy_intp i, npts = pts->dims[0];
+  int ax[3] = {dir, (dir+1)%3, (dir+2)%3};
+#pragma omp parallel for schedule(dynamic,256) if (npts >= INSIDE_PARALLEL_MIN) num_threads(pf_threads())
+  for (i=0; i<npts; i++) {
+    double p[3];
+    int c;
+    for (c=0; c<3; c++) p[c] = getf(pts,OFS2(pts,i,ax[c]));
+    ins[i] = bvh_inside(b,p);
+  }
+}
+
+static char insideSurface_doc[] = "\
+insideSurface(x, elems, pts, dir)\n\
+\n\n\
+Test which points are inside a closed triangulated surface.\n\
+\n\
+A ray is shot from each point in the positive direction of a global\n\
+axis, and the number of intersections with the surface is counted.\n\
+Rays through edges or vertices of the surface are counted exactly\n\
+once, but points on (or very close to) the surface may be classified\n\
+either way.\n\
+\n\
+Parameters\n\
+----------\n\
+x: float array (nnod, 3)\n\
+    The coordinates of the vertices of the surface.\n\
+elems: int array (ntri, 3)\n\
+    The vertex numbers of the triangles. The triangles should form a\n\
+    closed surface, but their orientation does not matter.\n\
+pts: float array (npts, 3)\n\
+    The coordinates of the points to test.\n\
+dir: int\n\
+    The global axis (0, 1 or 2) along which the rays are shot.\n\
+\n\
+The float arrays can be float32 or float64, the int array int32 or\n\
+int64. All arrays are read in place, with any strides.\n\
+\n\
+Returns\n\
+-------\n\
+bool array (npts,)\n\
+    True for the points that are inside the surface.\n\
+\n\
+See Also\n\
+--------\n\
+:meth:`trisurface.TriSurface.inside`: the user oriented method\n\
+";
+
+static PyObject * insideSurface(PyObject *dummy, PyObject *args)
+{
+  PyObject *arg1=NULL, *arg2=NULL, *arg3=NULL;
+  PyObject *arr1=NULL, *arr2=NULL, *arr3=NULL, *ret=NULL;
+  ARRAY x, elems, pts;
+  Bvh b;
+  int dir, res;
+  if (!PyArg_ParseTuple(args, "OOOi", &arg1, &arg2, &arg3, &dir)) return NULL;
+  if (dir < 0 || dir > 2) {
+    PyErr_SetString(PyExc_ValueError, "dir should be 0, 1 or 2");
+    return NULL;
+  }
+  arr1 = array_view(arg1, 'f', 2, &x);
+  if (arr1 == NULL) goto fail;
+  arr2 = array_view(arg2, 'i', 2, &elems);
+  if (arr2 == NULL) goto fail;
+  arr3 = array_view(arg3, 'f', 2, &pts);
+  if (arr3 == NULL) goto fail;
+  if (check_points(&x) < 0 || check_points(&pts) < 0) goto fail;
+  if (elems.dims[1] != 3) {
+    PyErr_SetString(PyExc_ValueError, "elems should have shape (ntri,3)");
+    goto fail;
+  }
+
+  /* create return array */
+  ret = PyArray_SimpleNew(1,pts.dims, NPY_BOOL);
+  if (ret == NULL) goto fail;
+
+  Py_BEGIN_ALLOW_THREADS
+  res = bvh_create(&b,&x,&elems,dir);
+  if (res == 0) inside_points(&b,&pts,dir,(npy_bool *)PYARRAY_DATA(ret));
+  bvh_free(&b);
+  Py_END_ALLOW_THREADS
+
+  if (res < 0) {
+    PyErr_NoMemory();
+    goto fail;
+  }
+  if (res > 0) {
+    PyErr_SetString(PyExc_ValueError, "elems contains invalid vertex numbers");
+    goto fail;
+  }
+
+  /* Clean up and return */
+  Py_DECREF(arr1);
+  Py_DECREF(arr2);
+  Py_DECREF(arr3);
+  return ret;
+ fail:
+  Py_XDECREF(arr1);
+  Py_XDECREF(arr2);
+  Py_XDECREF(arr3);
+  Py_XDECREF(ret);
+  return NULL;
+}
 
 /********************************************************/
 /* The methods defined in this module */
 static PyMethodDef extension_methods[] = {
   {"coordsfuse", coordsfuse, METH_VARARGS, coordsfuse_doc},
+  {"hashfuse", hashfuse, METH_VARARGS, hashfuse_doc},
   {"nodalsum", nodalsum, METH_VARARGS, nodalsum_doc},
+  {"nodalindex", nodalindex, METH_VARARGS, nodalindex_doc},
+  {"nodalreduce", nodalreduce, METH_VARARGS, nodalreduce_doc},
   {"averageDirection", averageDirection, METH_VARARGS, "_Average directions."},
   {"averageDirectionIndexed", averageDirectionIndexed, METH_VARARGS, "_Average directions."},
+  {"averageDirectionGroups", averageDirectionGroups, METH_VARARGS, averageDirectionGroups_doc},
+  {"minmaxblocks", minmaxblocks, METH_VARARGS, minmaxblocks_doc},
   {"isoline", isoline, METH_VARARGS, isoline_doc},
+  {"isolines", isolines, METH_VARARGS, isolines_doc},
   {"isosurface", isosurface, METH_VARARGS, isosurface_doc},
+  {"transform", transform, METH_VARARGS, transform_doc},
+  {"bbox", bbox, METH_VARARGS, bbox_doc},
+  {"distanceFromPlane", distanceFromPlane, METH_VARARGS, distanceFromPlane_doc},
+  {"distanceFromLine", distanceFromLine, METH_VARARGS, distanceFromLine_doc},
+  {"insideSurface", insideSurface, METH_VARARGS, insideSurface_doc},
+  PF_THREAD_METHODS
   {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
@@ -1353,6 +3795,7 @@ PyMODINIT_FUNC PyInit_misc_c(void)
   PyModule_AddStringConstant(m,"__doc__",__doc__);
   PyModule_AddIntConstant(m,"_accelerated",1);
   import_array(); /* Get access to numpy array API */
+  pf_instrument(m, extension_methods);
   return m;
 }
 
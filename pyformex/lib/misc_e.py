@@ -62,6 +62,57 @@ def coordsfuse(x, val, flag, sel, tol):
             nexti += 1
 
 
+def hashfuse(x, tol, unique=0):
+    """Fusing nodes using a spatial hash grid.
+
+    This is a low level function performing a single pass fuse operation
+    on unsorted points. It is not intended to be called by the user.
+
+    Returns a tuple (sel, flag) or, if unique is nonzero,
+    (sel, flag, coords).
+    """
+    x = _points(x)
+    npts = x.shape[0]
+    sel = np.zeros((npts,), dtype=np.int32)
+    flag = np.zeros((npts,), dtype=np.int32)
+    if npts > 0:
+        xmin, xmax = x.min(axis=0), x.max(axis=0)
+        h = max(tol, ((xmax-xmin) / 1048576).max())
+        if h <= 0.:
+            h = 1.
+        cells = {}
+        nuniq = 0
+        offsets = [(i, j, k) for i in (-1, 0, 1)
+                   for j in (-1, 0, 1) for k in (-1, 0, 1)]
+        for i in range(npts):
+            c = tuple(np.floor((x[i]-xmin) / h).astype(int))
+            for o in offsets:
+                cell = (c[0]+o[0], c[1]+o[1], c[2]+o[2])
+                # latest points first, like the C version
+                match = [j for j in reversed(cells.get(cell, []))
+                         if abs(x[i]-x[j]).max() < tol]
+                if match:
+                    sel[i] = sel[match[0]]
+                    break
+            else:
+                # node i is a new node
+                flag[i] = 1
+                sel[i] = nuniq
+                nuniq += 1
+                cells.setdefault(c, []).append(i)
+    if unique:
+        return sel, flag, x[flag>0]
+    return sel, flag
+
+
+def _float_array(a):
+    """Return a float32 or float64 array, like the compiled library reads"""
+    a = np.asarray(a)
+    if a.dtype not in (np.float32, np.float64):
+        a = a.astype(np.float32)
+    return a
+
+
 def nodalsum(val, elems, nnod):
     """Compute the nodal sum of values defined on elements.
 
@@ -72,30 +123,201 @@ def nodalsum(val, elems, nnod):
     - `elems` : int (nelems,nplex): node indices of the elements.
     - `nnod`  : int: the number of nodes. Should be higher than the maxnod,
       the highest node number in elems. If negative, will be set to
-      maxnod+1.
+      maxnod+1. Entries in elems outside the range 0..nnod-1 are ignored.
 
     Returns a tuple of two arrays:
 
-    - `sum`: float: (nnod, nval): sum of all the values at same node
+    - `sum`: float: (nnod, nval): sum of all the values at same node,
+      float64 if val is float64, else float32
     - `cnt`: int: (nnod): number of values summed at each node
 
     """
+    val = _float_array(val)
     if nnod < 0:
         nnod = elems.max() + 1
 
     # create return arrays
     nval = val.shape[2]
-    sum = np.zeros((nnod, nval), dtype=np.float32)
+    sum = np.zeros((nnod, nval), dtype=val.dtype)
     cnt = np.zeros((nnod,), dtype=np.int32)
 
     for i, elem in enumerate(elems):
         for j, node in enumerate(elem):
-            sum[node] += val[i, j].reshape(nval)
-            cnt[node] += 1
+            if 0 <= node < nnod:
+                sum[node] += val[i, j].reshape(nval)
+                cnt[node] += 1
 
     return sum, cnt
 
 
+def nodalindex(elems, nnod):
+    """Create an inverse index from nodes to element nodes.
+
+    Parameters:
+
+    - `elems` : int (nelems,nplex): node indices of the elements.
+      Values outside the range 0..nnod-1 are ignored.
+    - `nnod`  : int: the number of nodes. If negative, will be set to
+      maxnod+1.
+
+    Returns a tuple of two arrays:
+
+    - `offsets`: int (nnod+1): start of the entries of each node in index
+    - `index`: int (nind): flat positions in elems where each node appears
+
+    """
+    elems = np.asarray(elems).reshape(-1)
+    if nnod < 0:
+        nnod = elems.max() + 1
+    valid = (elems >= 0) & (elems < nnod)
+    cnt = np.bincount(elems[valid], minlength=nnod)
+    offsets = np.concatenate([[0], np.cumsum(cnt)]).astype(np.int32)
+    index = np.arange(elems.shape[0])[valid]
+    index = index[np.argsort(elems[valid], kind='stable')].astype(np.int32)
+    return offsets, index
+
+
+def nodalreduce(val, offsets, index, op):
+    """Reduce values defined on element nodes to the nodes.
+
+    Parameters:
+
+    - `val`   : float (nelems,nplex,nval): nval values at nplex nodes
+      of nelems elements.
+    - `offsets`, `index`: the inverse index returned by :func:`nodalindex`
+    - `op`: int: 0 = sum, 1 = average, 2 = maximum, 3 = minimum
+
+    Returns a float array (nnod, nval) with the reduced values at each node,
+    float64 if val is float64, else float32.
+    """
+    if op not in (0, 1, 2, 3):
+        raise ValueError("op should be 0, 1, 2 or 3")
+    offsets = np.asarray(offsets)
+    if offsets.ndim != 1 or len(offsets) < 1:
+        raise ValueError("offsets should have shape (nnod+1,)")
+    if offsets[0] < 0 or offsets[-1] > len(index):
+        raise ValueError("offsets out of range")
+    if (np.diff(offsets) < 0).any():
+        raise ValueError("offsets should be nondecreasing")
+    val = _float_array(val)
+    nval = val.shape[2]
+    val = val.reshape(-1, nval)[index[offsets[0]:offsets[-1]]]
+    nnod = offsets.shape[0] - 1
+    cnt = np.diff(offsets)
+    nodes = np.repeat(np.arange(nnod), cnt)
+    if op < 2:
+        out = np.zeros((nnod, nval), dtype=val.dtype)
+        np.add.at(out, nodes, val)
+        if op == 1:
+            with np.errstate(all='ignore'):
+                out /= cnt[:, np.newaxis]
+    else:
+        ufunc, init = (np.maximum, -np.inf) if op == 2 else (np.minimum, np.inf)
+        out = np.full((nnod, nval), init, dtype=val.dtype)
+        ufunc.at(out, nodes, val)
+        out[cnt==0] = np.nan
+    return out
+
+
+def averageDirectionIndexed(vec, ind, tol):
+    """Average close directions in a group of vectors.
+
+    - `vec`: float (nvec,ndim): normalized vectors. Changed in-place.
+    - `ind`: int (n,): the rows of vec forming the group.
+    - `tol`: float: tolerance on the projection of two vectors.
+
+    The first vector not yet treated collects all following vectors with
+    a projection >= tol on it, and is replaced with their average.
+    Finally all the vectors of a cluster are set to the average.
+    """
+    ind = np.asarray(ind).reshape(-1)
+    nvec = ind.shape[0]
+    par = np.full((nvec,), -1)
+    j = 0
+    while j < nvec:
+        par[j] = j
+        w = vec[ind[j]]
+        close = np.dot(vec[ind[j+1:]], w) >= tol
+        par[j+1:][close] = j
+        for i in ind[j+1:][close]:
+            w += vec[i]
+        w /= close.sum() + 1
+        untreated = np.where(par[j+1:] < 0)[0]
+        j = j + 1 + untreated[0] if len(untreated) > 0 else nvec
+    for i in range(nvec):
+        if par[i] < i:
+            vec[ind[i]] = vec[ind[par[i]]]
+
+
+def averageDirection(vec, tol):
+    """Average close directions in a set of vectors.
+
+    This is :func:`averageDirectionIndexed` on all the rows of vec.
+    """
+    averageDirectionIndexed(vec, np.arange(vec.shape[0]), tol)
+
+
+def averageDirectionGroups(vec, offsets, index, tol):
+    """Average close directions in groups of vectors.
+
+    - `vec`: float (nvec,ndim): normalized vectors. Changed in-place.
+    - `offsets`: int (ngroups+1,): the group g holds the entries
+      offsets[g] <= i < offsets[g+1].
+    - `index`: int (nind,) or None: row numbers in vec of the group
+      entries, as returned by :func:`nodalindex`. If None, the entries
+      are the rows of vec.
+    - `tol`: float: tolerance on the projection of two vectors.
+    """
+    if index is None:
+        index = np.arange(vec.shape[0])
+    for g in range(len(offsets)-1):
+        averageDirectionIndexed(vec, index[offsets[g]:offsets[g+1]], tol)
+
+
+def minmaxblocks(data, bs):
+    """Compute the range of the data values in blocks of grid cells.
+
+    Parameters:
+
+    - `data`: float (ny,nx) or (nz,ny,nx): data values at grid points.
+    - `bs`: int: the number of cells along each axis of a block.
+
+    Returns a tuple of float arrays (bmin, bmax) with the minimum and
+    maximum data value in each block. The number of blocks along an axis
+    with n points is (n-2)//bs + 1. A block contains the points
+    b*bs <= i <= (b+1)*bs along each axis.
+    """
+    data = np.asarray(data, dtype=np.float32)
+    if bs < 1:
+        raise ValueError("bs should be positive")
+    if data.ndim not in (2, 3):
+        raise ValueError("data should be a 2D or 3D array")
+    nb = tuple((n-2)//bs + 1 if n > 1 else 1 for n in data.shape)
+    bmin = np.empty(nb, dtype=np.float32)
+    bmax = np.empty(nb, dtype=np.float32)
+    for b in np.ndindex(nb):
+        blk = data[tuple(slice(i*bs, i*bs+bs+1) for i in b)]
+        bmin[b] = blk.min()
+        bmax[b] = blk.max()
+    return bmin, bmax
+
+
+def _cells(shape, blocks, bs):
+    """Iterate over the cells of a grid, or of the given blocks of it.
+
+    Returns the cell indices in the same order as the compiled library.
+    """
+    ncells = [n-1 for n in shape]
+    if blocks is None:
+        yield from np.ndindex(*ncells)
+        return
+    for b in np.asarray(blocks):
+        start = [i*bs for i in b]
+        size = [min(bs, n-i) for i, n in zip(start, ncells)]
+        for c in np.ndindex(*size):
+            yield tuple(i+j for i, j in zip(start, c))
+
+
 ########## isoline #############################################
 
 from pyformex import olist
@@ -130,25 +352,26 @@ def splitSquare(pos, val, level):
     vertlist = []
 
     for edges in olist.group(linetable[cubeindex], 2):
-        print("edges: %s" % str(edges))
         for e in edges:
             verts = vertextable[e]
             p1, p2 = pos[verts]
             v1, v2 = val[verts]
-            print("INTERPOL %s, %s, %s, %s" % (p1, p2, v1, v2))
             vert = vertexinterp(level, p1, p2, v1, v2)
             vertlist.append(vert)
 
     return vertlist
 
 
-def isoline(data, level):
+def isoline(data, level, blocks=None, bs=8):
     """Create an isoline through data at given level.
 
     - `data`: (nx,ny) shaped array of data values at points with
       coordinates equal to their indices. This defines a 2D area
       [0,nx-1], [0,ny-1],
     - `level`: data value at which the isoline is to be constructed
+    - `blocks`: int (nblk,2): if provided, only the cells in these
+      blocks of bs*bs cells are processed (see :func:`minmaxblocks`).
+    - `bs`: int: the block size used in blocks.
 
     Returns an (nseg,2,2) array defining the segments of the isoline.
     The result may be empty (if level is outside the data range).
@@ -163,18 +386,53 @@ def isoline(data, level):
     def addSegments(x, y):
         pos = grid + [x, y]
         val = data[pos[:, 1], pos[:, 0]]
-        print("pos, val\n%s\n%s" % (pos, val))
         verts = splitSquare(pos, val, level)
         segments.extend(verts)
         return len(segments)
 
-    [[addSegments(x, y)
-        for x in range(data.shape[1]-1)]
-      for y in range(data.shape[0]-1)]
+    for y, x in _cells(data.shape, blocks, bs):
+        addSegments(x, y)
 
     segments = np.asarray(segments).reshape(-1, 2, 2)
     return segments
 
+def isolines(data, levels):
+    """Create isolines through data at multiple levels.
+
+    - `data`: (nx,ny) shaped array of data values at points with
+      coordinates equal to their indices. This defines a 2D area
+      [0,nx-1], [0,ny-1],
+    - `levels`: (nlev,) array of data values at which the isolines
+      are to be constructed
+
+    Returns a tuple of an (nseg,2,2) array defining the segments of all
+    the isolines, and an (nseg,) int array with the index in levels of
+    the isoline of each segment. The segments are ordered by cell, and
+    by increasing level within a cell.
+    """
+    grid = np.array([
+        [0, 0],
+        [1, 0],
+        [1, 1],
+        [0, 1],
+        ])
+    levels = np.asarray(levels, dtype=np.float32).reshape(-1)
+    order = np.argsort(levels, kind='stable')
+    sorted_levels = levels[order]
+    segments = []
+    index = []
+    for y, x in np.ndindex(data.shape[0]-1, data.shape[1]-1):
+        pos = grid + [x, y]
+        val = data[pos[:, 1], pos[:, 0]]
+        j = np.searchsorted(sorted_levels, val.min(), side='right')
+        k = np.searchsorted(sorted_levels, val.max(), side='right')
+        for i in range(j, k):
+            verts = splitSquare(pos, val, sorted_levels[i])
+            segments.extend(verts)
+            index.extend([order[i]] * (len(verts) // 2))
+    segments = np.asarray(segments, dtype=np.float32).reshape(-1, 2, 2)
+    return segments, np.asarray(index, dtype=np.int32)
+
 ########## isosurface #############################################
 
 #  edgeTable[256].  It corresponds to the 2^8 possible combinations of
@@ -605,7 +863,24 @@ grid = np.array([
     [0, 1, 1],
     ])
 
-def isosurface(data, level, tet=False):
+def indexTriangles(tri):
+    """Convert a triangle soup into an indexed mesh.
+
+    Returns a tuple (coords, elems) with the unique vertices, numbered
+    in order of first occurrence, and the vertex numbers of the triangles.
+    """
+    x = tri.reshape(-1, 3)
+    uniq, first, inv = np.unique(x, axis=0, return_index=True,
+                                 return_inverse=True)
+    order = np.argsort(first)
+    rank = np.empty_like(order)
+    rank[order] = np.arange(order.shape[0])
+    return (uniq[order].astype(np.float32),
+            rank[inv.reshape(-1)].reshape(-1, 3).astype(np.int32))
+
+
+def isosurface(data, level, tet=False, nthreads=1, indexed=0,
+               blocks=None, bs=8):
     """Create an isosurface through data at given level.
 
     Parameters
@@ -616,12 +891,25 @@ def isosurface(data, level, tet=False):
         [0,nx-1], [0,ny-1], [0,nz-1]
     level: float
         Data value at which the isosurface is to be constructed.
+    tet: bool
+        Use marching tetrahedrons. Not available in the emulation.
+    nthreads: int
+        Not used in the emulation.
+    indexed: bool
+        If True, return an indexed mesh instead of the triangle coordinates.
+    blocks: int array (nblk,3), optional
+        If provided, only the cells in these blocks of bs*bs*bs cells
+        are processed (see :func:`minmaxblocks`).
+    bs: int
+        The block size used in blocks.
 
     Returns
     -------
     array
         An (ntr,3,3) array defining the triangles of the isosurface.
         The result is empty if level is outside the data range.
+        If indexed is True, returns a tuple (coords, elems) with the
+        unique vertices and the vertex numbers of the triangles.
 
     See Also
     --------
@@ -649,13 +937,157 @@ def isosurface(data, level, tet=False):
         triangles.extend(t)
         return len(triangles)
 
-    [[[addTriangles(x, y, z)
-          for x in range(data.shape[2]-1)]
-        for y in range(data.shape[1]-1)]
-      for z in range(data.shape[0]-1)]
+    for z, y, x in _cells(data.shape, blocks, bs):
+        addTriangles(x, y, z)
 
     triangles = np.asarray(triangles).reshape(-1, 3, 3)
+    if indexed:
+        return indexTriangles(triangles)
     return triangles
 
 
+def _points(x):
+    """Check a points array (npts,3) like the compiled library does"""
+    x = _float_array(x)
+    if x.ndim != 2 or x.shape[1] != 3:
+        raise ValueError("points should have shape (npts,3)")
+    return x
+
+
+def transform(x, mat, trl, out=None):
+    """Apply an affine transformation to a set of points.
+
+    Parameters:
+
+    - `x`: float (npts,3): the coordinates of the points.
+    - `mat`: float (3,3): matrix post-multiplying the points.
+    - `trl`: float (3,): translation added after the multiplication.
+    - `out`: float (npts,3), optional: contiguous array to store the
+      result. It may be x itself.
+
+    Returns the transformed points ``x * mat + trl``, in out if provided,
+    else in a new array with the type of x.
+    """
+    x = _points(x)
+    mat = np.asarray(mat, dtype=np.float64).reshape(3, 3)
+    trl = np.asarray(trl, dtype=np.float64).reshape(3)
+    y = np.dot(x.astype(np.float64), mat) + trl
+    if out is None:
+        return y.astype(x.dtype)
+    out[...] = y
+    return out
+
+
+def bbox(x):
+    """Compute the bounding box of a set of points.
+
+    Parameters:
+
+    - `x`: float (npts,3): the coordinates of the points, with npts > 0.
+
+    Returns a float array (2,3) with the minimal and maximal coordinates,
+    with the type of x.
+    """
+    x = _points(x)
+    if x.shape[0] == 0:
+        raise ValueError("can not compute bbox of zero points")
+    return np.stack([x.min(axis=0), x.max(axis=0)])
+
+
+def _unit(p, n):
+    p = np.asarray(p, dtype=np.float64).reshape(3)
+    n = np.asarray(n, dtype=np.float64).reshape(3)
+    return p, n / np.sqrt((n*n).sum())
+
+
+def distanceFromPlane(x, p, n):
+    """Compute the signed distance of points from the plane (p,n).
+
+    Parameters:
+
+    - `x`: float (npts,3): the coordinates of the points.
+    - `p`: float (3,): a point in the plane.
+    - `n`: float (3,): the normal to the plane, not necessarily normalized.
+
+    Returns a float64 array (npts,) with the distances, positive at the
+    side of the normal.
+    """
+    x = _points(x)
+    p, n = _unit(p, n)
+    return np.dot(x.astype(np.float64), n) - np.dot(p, n)
+
+
+def distanceFromLine(x, p, n):
+    """Compute the distance of points from the line (p,n).
+
+    Parameters:
+
+    - `x`: float (npts,3): the coordinates of the points.
+    - `p`: float (3,): a point on the line.
+    - `n`: float (3,): the direction of the line, not necessarily normalized.
+
+    Returns a float64 array (npts,) with the distances.
+    """
+    x = _points(x)
+    p, n = _unit(p, n)
+    xp = x.astype(np.float64) - p
+    s = np.dot(xp, n)
+    a = (xp*xp).sum(axis=-1) - s*s
+    return np.sqrt(a.clip(0.))
+
+
+
+def _edge_sign(e, d):
+    """Edge function values with zeros replaced by their perturbed sign"""
+    dy, dz = d[..., 0], d[..., 1]
+    return np.where(e != 0., e, np.where(dz != 0., -dz, dy))
+
+
+def insideSurface(x, elems, pts, dir):
+    """Test which points are inside a closed triangulated surface.
+
+    Parameters:
+
+    - `x`: float (nnod,3): the coordinates of the vertices.
+    - `elems`: int (ntri,3): the vertex numbers of the triangles.
+    - `pts`: float (npts,3): the points to test.
+    - `dir`: int: the global axis along which the rays are shot.
+
+    Returns a bool array (npts,) that is True for the points inside.
+    This brute force version tests all points against all triangles.
+    """
+    x = _points(x)
+    pts = _points(pts)
+    elems = np.asarray(elems)
+    if dir not in (0, 1, 2):
+        raise ValueError("dir should be 0, 1 or 2")
+    if elems.ndim != 2 or elems.shape[1] != 3:
+        raise ValueError("elems should have shape (ntri,3)")
+    if elems.size > 0 and (elems.min() < 0 or elems.max() >= len(x)):
+        raise ValueError("elems contains invalid vertex numbers")
+    ax = [dir, (dir+1) % 3, (dir+2) % 3]
+    T = x.astype(np.float64)[elems][..., ax]
+    P = pts.astype(np.float64)[:, ax]
+    ins = np.zeros(len(P), dtype=bool)
+    # edges opposite to the vertices a, b, c
+    d = np.stack([T[:, 2, 1:] - T[:, 1, 1:], T[:, 0, 1:] - T[:, 2, 1:],
+                  T[:, 1, 1:] - T[:, 0, 1:]], axis=1)
+    chunk = max(1, 1000000 // max(len(T), 1))
+    for i in range(0, len(P), chunk):
+        p = P[i:i+chunk, np.newaxis, np.newaxis, :]
+        t = T[np.newaxis] - p
+        a, b, c = t[:, :, 0], t[:, :, 1], t[:, :, 2]
+        ea = b[..., 1]*c[..., 2] - b[..., 2]*c[..., 1]
+        eb = c[..., 1]*a[..., 2] - c[..., 2]*a[..., 1]
+        ec = a[..., 1]*b[..., 2] - a[..., 2]*b[..., 1]
+        sa = _edge_sign(ea, d[:, 0])
+        sb = _edge_sign(eb, d[:, 1])
+        sc = _edge_sign(ec, d[:, 2])
+        num = ea*a[..., 0] + eb*b[..., 0] + ec*c[..., 0]
+        pos = (sa > 0.) & (sb > 0.) & (sc > 0.) & (num > 0.)
+        neg = (sa < 0.) & (sb < 0.) & (sc < 0.) & (num < 0.)
+        ins[i:i+chunk] = (pos | neg).sum(axis=1) % 2 == 1
+    return ins
+
+
 # End
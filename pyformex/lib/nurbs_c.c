@@ -33,11 +33,15 @@
 #define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
 #include "numpy/arrayobject.h"
 #include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "pflib.h"
 
 // cast pointers to avoid warnings
 #define PYARRAY_DATA(p) PyArray_DATA((PyArrayObject *)p)
 #define PYARRAY_DIMS(p) PyArray_DIMS((PyArrayObject *)p)
-#define PYARRAY_FROM_OTF(p,q,r) (PyArrayObject *) PyArray_FROM_OTF(p,q,r)
+#define PYARRAY_FROM_OTF(p,q,r) (PyArrayObject *) pf_from_otf(p,q,r)
 
 /****************** LIBRARY VERSION AND DOCSTRING *******************/
 
@@ -70,6 +74,54 @@ int max(int a, int b)
   return a;
 }
 
+/*
+   The basis functions are evaluated by inline kernels, which are called
+   with a constant degree for the common degrees 1 to 5. The compiler
+   then fully unrolls the recurrences. Up to degree BASIS_MAXDEG, the
+   work arrays are fixed size arrays on the stack. Higher degrees take
+   their work space from the scratch arena (see below).
+*/
+#define BASIS_MAXDEG 15
+
+#ifdef __GNUC__
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE static inline
+#endif
+
+/* Call KERNEL(deg,...), with deg as a constant for degrees 1..5 */
+#define SWITCH_DEGREE(deg,KERNEL,...)		\
+  switch (deg) {				\
+  case 1: KERNEL(1,__VA_ARGS__); break;		\
+  case 2: KERNEL(2,__VA_ARGS__); break;		\
+  case 3: KERNEL(3,__VA_ARGS__); break;		\
+  case 4: KERNEL(4,__VA_ARGS__); break;		\
+  case 5: KERNEL(5,__VA_ARGS__); break;		\
+  default: KERNEL(deg,__VA_ARGS__);		\
+  }
+
+/*
+   The evaluation functions split the parametric values over the OpenMP
+   threads if there are at least NURBS_PARALLEL_MIN of them. Their Python
+   wrappers release the GIL during the computation, so that multiple
+   Python threads can evaluate at the same time. Each thread uses its
+   own scratch arena for its work space.
+*/
+#define NURBS_PARALLEL_MIN 1024
+
+/* The range of values [i0,i1) to be handled by the current thread */
+static void thread_range(int n, int *i0, int *i1)
+{
+#ifdef _OPENMP
+  long nt = omp_get_num_threads(), it = omp_get_thread_num();
+  *i0 = n * it / nt;
+  *i1 = n * (it+1) / nt;
+#else
+  *i0 = 0;
+  *i1 = n;
+#endif
+}
+
 /* cumsum of a list of integer values */
 /* v and cs have same length */
 static void cumsum(int *v, int nv, int *cs)
@@ -131,24 +183,207 @@ static double distance4d(double *a, double *b, int n)
 /*   return mat; */
 /* } */
 
-static double **newmatrix(int nrows, int ncols)
+/*
+   Scratch arena
+
+   All temporary work space of the NURBS functions is taken from a
+   thread local scratch arena instead of the heap. Allocation just bumps
+   a pointer in the current block. A function takes a mark at entry and
+   releases it at exit, which frees everything allocated since the mark.
+   When the current block is full, a new one is chained to it. When the
+   arena is released completely and its block is not large enough for
+   the peak usage seen so far, all blocks are freed, and the next
+   allocation creates a single block that holds the peak usage. After a few calls the
+   arena thus settles on one block, and no more heap allocations occur.
+
+   While the statistics are enabled, the wrapper of a module function
+   resets the high-water mark before the call and reads it afterwards:
+   this gives the scratch statistic, the peak number of bytes in use
+   during the call, over all threads of its parallel regions. Each thread
+   keeps its own mark (scratch_hwm) of the current generation
+   (scratch_gen), and only takes a lock when that mark grows beyond the
+   largest peak so far. Running several functions concurrently from
+   different Python threads combines their peaks.
+
+   A failed allocation returns NULL and is counted in scratch_nfail.
+   The kernels check their allocations and skip their work when one
+   failed, also inside the parallel regions. The module functions take
+   the count before the computation, and raise a MemoryError from
+   scratch_check() when it changed.
+*/
+#define SCRATCH_ALIGN 16
+#define SCRATCH_MINSIZE 65536
+
+typedef struct ScratchBlock {
+  struct ScratchBlock *prev;	/* previous block in the chain */
+  size_t size;			/* size of data */
+  size_t used;			/* bytes in use */
+  size_t pad;			/* keep data aligned */
+  char data[];
+} ScratchBlock;
+
+typedef struct {
+  ScratchBlock *block;
+  size_t used;			/* bytes in use in block */
+  size_t inuse;			/* total bytes in use */
+} ScratchMark;
+
+static PF_THREAD_LOCAL ScratchBlock *scratch = NULL;
+static PF_THREAD_LOCAL size_t scratch_inuse = 0;
+static PF_THREAD_LOCAL size_t scratch_peak = 0;
+static PF_THREAD_LOCAL size_t scratch_hwm = 0;	/* high-water mark */
+static PF_THREAD_LOCAL unsigned scratch_hwm_gen = 0; /* generation of mark */
+static unsigned scratch_gen = 0;	/* incremented at each reset */
+static size_t scratch_call_peak = 0;	/* peak of all threads since reset */
+static int scratch_tracking = 0;	/* set at the first reset */
+static int scratch_nfail = 0;		/* number of failed allocations */
+
+/* Return the number of failed scratch allocations in all threads */
+static int scratch_failures(void)
+{
+  int n;
+#pragma omp atomic read
+  n = scratch_nfail;
+  return n;
+}
+
+/* Set a MemoryError if an allocation failed since scratch_failures()
+   returned nfail. Returns -1 in that case, else 0. */
+static int scratch_check(int nfail)
+{
+  if (scratch_failures() == nfail) return 0;
+  PyErr_NoMemory();
+  return -1;
+}
+
+/* Update the high-water mark with the current use of this thread */
+static void scratch_track(void)
+{
+  unsigned gen;
+#pragma omp atomic read
+  gen = scratch_gen;
+  if (scratch_hwm_gen != gen) {
+    scratch_hwm_gen = gen;
+    scratch_hwm = 0;
+  }
+  if (scratch_inuse > scratch_hwm) {
+    scratch_hwm = scratch_inuse;
+#pragma omp critical (scratch_track)
+    if (scratch_hwm > scratch_call_peak) scratch_call_peak = scratch_hwm;
+  }
+}
+
+/* Start a new high-water mark (pf_scratch_reset) */
+static void scratch_stat_reset(void)
+{
+#pragma omp critical (scratch_track)
+  scratch_call_peak = 0;
+#pragma omp atomic
+  scratch_gen++;
+  scratch_tracking = 1;
+}
+
+/* Return the high-water mark since the last reset (pf_scratch_peak) */
+static size_t scratch_stat_peak(void)
+{
+  size_t n;
+#pragma omp critical (scratch_track)
+  n = scratch_call_peak;
+  return n;
+}
+
+/* Mark the current state of the scratch arena */
+static ScratchMark scratch_mark(void)
+{
+  ScratchMark m;
+  m.block = scratch;
+  m.used = scratch ? scratch->used : 0;
+  m.inuse = scratch_inuse;
+  return m;
+}
+
+/* Allocate n bytes from the scratch arena */
+static void *scratch_alloc(size_t n)
+{
+  ScratchBlock *b = scratch;
+  void *p;
+  n = (n + SCRATCH_ALIGN-1) & ~(size_t)(SCRATCH_ALIGN-1);
+  if (!b || b->used + n > b->size) {
+    size_t size = b ? 2*b->size : SCRATCH_MINSIZE;
+    if (size < scratch_peak) size = scratch_peak;
+    while (size < n) size *= 2;
+    b = (ScratchBlock*) malloc(sizeof(ScratchBlock)+size);
+    if (!b) {
+#pragma omp atomic
+      scratch_nfail++;
+      return NULL;
+    }
+    b->prev = scratch;
+    b->size = size;
+    b->used = 0;
+    scratch = b;
+  }
+  p = b->data + b->used;
+  b->used += n;
+  scratch_inuse += n;
+  if (scratch_inuse > scratch_peak) scratch_peak = scratch_inuse;
+  if (scratch_tracking) scratch_track();
+  return p;
+}
+
+/* Release everything allocated from the scratch arena since mark m */
+static void scratch_release(ScratchMark m)
+{
+  ScratchBlock *b;
+  if (m.inuse == 0) {
+    /* Arena becomes empty: keep it only if one block holds the peak */
+    if (scratch && (scratch->prev || scratch->size < scratch_peak)) {
+      while ((b = scratch)) {
+	scratch = b->prev;
+	free(b);
+      }
+    }
+    if (scratch) scratch->used = 0;
+    scratch_inuse = 0;
+    return;
+  }
+  while (scratch != m.block) {
+    b = scratch;
+    scratch = b->prev;
+    free(b);
+  }
+  scratch->used = m.used;
+  scratch_inuse = m.inuse;
+}
+
+/* Allocate n doubles from the scratch arena */
+static double *scratch_doubles(size_t n)
+{
+  return (double*) scratch_alloc(n*sizeof(double));
+}
+
+/* Allocate n ints from the scratch arena */
+static int *scratch_ints(size_t n)
+{
+  return (int*) scratch_alloc(n*sizeof(int));
+}
+
+/* Allocate a (nrows,ncols) matrix from the scratch arena */
+/* The rows are contiguous, and also addressable as mat[i][j]. */
+static double **scratch_matrix(int nrows, int ncols)
 {
   int row;
   double **mat;
 
-  mat = (double**) malloc (nrows*sizeof(double*));
-  mat[0] = (double*) malloc (nrows*ncols*sizeof(double));
+  mat = (double**) scratch_alloc(nrows*sizeof(double*));
+  if (!mat) return NULL;
+  mat[0] = scratch_doubles((size_t)nrows*ncols);
+  if (!mat[0]) return NULL;
   for (row = 1; row < nrows; row++)
     mat[row] = mat[row-1] + ncols;
   return mat;
 }
 
-static void freematrix(double **mat)
-{
-  free(mat[0]);
-  free(mat);
-}
-
 /* static void print_mat(double *mat,int nrows,int ncols) */
 /* { */
 /*   int i,j; */
@@ -175,20 +410,26 @@ static double _gammaln(double xx)
   return -tmp+log(2.5066282746310005*ser/x);
 }
 
+// Table of ln(n!) for n <= FACTLN_MAX, filled once by _factln_init
+// at module init, so that the kernels running without the GIL only
+// read it.
+#define FACTLN_MAX 100
+static double factln_table[FACTLN_MAX+1];
+
+static void _factln_init(void)
+{
+  int n;
+  for (n=0; n<=FACTLN_MAX; n++)
+    factln_table[n] = n <= 1 ? 0.0 : _gammaln(n+1.0);
+}
+
 // computes ln(n!)
 // Algorithm from 'Numerical Recipes in C, 2nd Edition' p.215.
 static double _factln(int n)
 {
-  static int ntop = 0;
-  static double a[101];
-
   if (n <= 1) return 0.0;
-  while (n > ntop)
-  {
-    ++ntop;
-    a[ntop] = _gammaln(ntop+1.0);
-  }
-  return a[n];
+  if (n <= FACTLN_MAX) return factln_table[n];
+  return _gammaln(n+1.0);
 }
 
 //Computes the binomial coefficient.
@@ -245,16 +486,23 @@ Algorithm A1.2 from 'The NURBS Book' p.20.
 
 static double _bernstein(int i, int n, double u)
 {
+  ScratchMark mark = scratch_mark();
   int j, k;
   double u1;
-  double *temp  = (double*) malloc((n+1)*sizeof(double));
+  double *temp  = scratch_doubles(n+1);
+  if (!temp) {
+    scratch_release(mark);
+    return 0.0;
+  }
   for (j=0; j<=n; j++) temp[j] = 0.0;
   temp[n-i] = 1.0;
   u1 = 1.0-u;
   for (k=1; k<=n; k++)
     for (j=n; j>=k; j--)
       temp[j] = u1*temp[j] + u*temp[j-1];
-  return temp[n];
+  u1 = temp[n];
+  scratch_release(mark);
+  return u1;
 }
 
 
@@ -273,7 +521,7 @@ at parameter value u.
 Algorithm A1.3 from 'The NURBS Book' p.20.
 */
 
-static void all_bernstein(int n, double u, double *B)
+ALWAYS_INLINE void all_bernstein_kernel(int n, double u, double *B)
 {
   int j, k;
   double u1, temp, saved;
@@ -290,6 +538,11 @@ static void all_bernstein(int n, double u, double *B)
   }
 }
 
+static void all_bernstein(int n, double u, double *B)
+{
+  SWITCH_DEGREE(n,all_bernstein_kernel,u,B)
+}
+
 
 
 /* /\* Find last occurrence of u in U *\/ */
@@ -350,6 +603,24 @@ static int find_span(double *U, double u, int p, int n)
   return(mid);
 }
 
+/* next_span */
+/*
+Find the knot span index for a parametric value, starting from the
+span s of a previous (smaller) value. For non-decreasing parametric
+values this walks forward over the knots, instead of doing a binary
+search for every value. If u is smaller than the previous value
+(or s < p), a normal binary search is done.
+
+Returns the same span index as find_span.
+*/
+static int next_span(double *U, double u, int p, int n, int s)
+{
+  if (s < p || u < U[s]) return find_span(U,u,p,n);
+  while (s < n && u >= U[s+1]) s++;
+  return s;
+}
+
+
 /* basis_funs */
 /*
 Compute the nonvanishing B-spline basis functions for index span i.
@@ -366,15 +637,11 @@ Output:
 
 Algorithm A2.2 from 'The NURBS Book' p.70.
 */
-static void basis_funs(double *U, double u, int p, int i, double *N)
+ALWAYS_INLINE void basis_funs_kernel(int p, double *U, double u, int i, double *N, double *left, double *right)
 {
   int j,r;
   double saved, temp;
 
-  // work space
-  double *left  = (double*) malloc((p+1)*sizeof(double));
-  double *right = (double*) malloc((p+1)*sizeof(double));
-
   N[0] = 1.0;
   for (j = 1; j <= p; j++) {
     left[j]  = u - U[i+1-j];
@@ -387,9 +654,48 @@ static void basis_funs(double *U, double u, int p, int i, double *N)
     }
     N[j] = saved;
   }
+}
+
+/* Use stack work arrays for the kernel */
+#define BASIS_FUNS(p,U,u,i,N) {					\
+    double left[BASIS_MAXDEG+1], right[BASIS_MAXDEG+1];		\
+    basis_funs_kernel(p,U,u,i,N,left,right);			\
+  }
+
+static void basis_funs(double *U, double u, int p, int i, double *N)
+{
+  if (p > BASIS_MAXDEG) {
+    ScratchMark mark = scratch_mark();
+    double *left  = scratch_doubles(p+1);
+    double *right = scratch_doubles(p+1);
+    if (left && right) basis_funs_kernel(p,U,u,i,N,left,right);
+    scratch_release(mark);
+    return;
+  }
+  SWITCH_DEGREE(p,BASIS_FUNS,U,u,i,N)
+}
+
+/* basis_funs_many */
+/*
+Compute the nonvanishing B-spline basis functions for nu parametric
+values u, with spans s, into N (nu,p+1). This is basis_funs for all the
+values, but for the degrees up to 5 the loop over the values is
+vectorized.
+*/
+#define BASIS_FUNS_MANY(p,U,u,nu,s,N) {				\
+    int j_;								\
+    _Pragma("omp simd")							\
+    for (j_=0; j_<nu; j_++) BASIS_FUNS(p,U,u[j_],s[j_],N+j_*(p+1));	\
+  }
 
-  free(left);
-  free(right);
+static void basis_funs_many(double *U, double *u, int nu, int p, int *s, double *N)
+{
+  int j;
+  if (p > 5) {
+    for (j=0; j<nu; j++) basis_funs(U,u[j],p,s[j],N+j*(p+1));
+    return;
+  }
+  SWITCH_DEGREE(p,BASIS_FUNS_MANY,U,u,nu,s,N)
 }
 
 /* basis_derivs */
@@ -410,34 +716,30 @@ Output:
 
 Algorithm A2.3 from 'The NURBS Book' p.72.
 */
-static void basis_derivs(double *U, double u, int p, int i, int n, double *dN)
+/* ndu is a (p+1,p+1) matrix, a has length 2*(p+1) */
+#define NDU(i,j) ndu[(i)*(p+1)+(j)]
+ALWAYS_INLINE void basis_derivs_kernel(int p, double *U, double u, int i, int n, double *dN, double *ndu, double *a, double *left, double *right)
 {
     int j,k,r,s1,s2,rk,pk,j1,j2;
     double temp, saved, der;
-    double **ndu, *a, *left, *right;
 
-    ndu = newmatrix(p+1, p+1);
-    a = (double *) malloc(2*(p+1)*sizeof(double));
-    left = (double *) malloc((p+1)*sizeof(double));
-    right = (double *) malloc((p+1)*sizeof(double));
-
-    ndu[0][0] = 1.0;
+    NDU(0,0) = 1.0;
     for (j=1; j<=p; j++) {
 	left[j] = u - U[i+1-j];
 	right[j] = U[i+j]-u;
 	saved = 0.0;
 	for (r=0; r<j; r++) {
 	    /* Lower triangle */
-	    ndu[j][r] = right[r+1] + left[j-r];
-	    temp = ndu[r][j-1]/ndu[j][r];
+	    NDU(j,r) = right[r+1] + left[j-r];
+	    temp = NDU(r,j-1)/NDU(j,r);
 	    /* Upper Triangle */
-	    ndu[r][j] = saved + right[r+1]*temp;
+	    NDU(r,j) = saved + right[r+1]*temp;
 	    saved = left[j-r]*temp;
 	}
-	ndu[j][j] = saved;
+	NDU(j,j) = saved;
     }
     /* Load the basis functions */
-    for (j=0; j<=p; j++) dN[j] = ndu[j][p];
+    for (j=0; j<=p; j++) dN[j] = NDU(j,p);
 
     /* Compute the derivatives (Eq. 2.9) */
     for (r=0; r<=p; r++) {   /* Loop over function index */
@@ -449,20 +751,20 @@ static void basis_derivs(double *U, double u, int p, int i, int n, double *dN)
 	    der = 0.0;
 	    rk = r-k;  pk = p-k;
 	    if (r >= k) {
-		a[s2] = a[s1] / ndu[pk+1][rk];
-		der = a[s2] * ndu[rk][pk];
+		a[s2] = a[s1] / NDU(pk+1,rk);
+		der = a[s2] * NDU(rk,pk);
 	    }
 	    if (rk >= -1) j1 = 1;
 	    else j1 = -rk;
 	    if (r-1 <= pk) j2 = k-1;
 	    else j2 = p-r;
 	    for (j=j1; j<=j2; j++) {
-		a[s2+j] = (a[s1+j] - a[s1+j-1]) / ndu[pk+1][rk+j];
-		der += a[s2+j] * ndu[rk+j][pk];
+		a[s2+j] = (a[s1+j] - a[s1+j-1]) / NDU(pk+1,rk+j);
+		der += a[s2+j] * NDU(rk+j,pk);
 	    }
 	    if (r <= pk) {
-		a[s2+k] = -a[s1+k-1] / ndu[pk+1][r];
-		der += a[s2+k] * ndu[r][pk];
+		a[s2+k] = -a[s1+k-1] / NDU(pk+1,r);
+		der += a[s2+k] * NDU(r,pk);
 	    }
 	    dN[k*(p+1)+r] = der;
 	    /* Switch rows */
@@ -477,10 +779,30 @@ static void basis_derivs(double *U, double u, int p, int i, int n, double *dN)
 	r *= (p-k);
     }
 
-    freematrix(ndu);
-    free(a);
-    free(left);
-    free(right);
+}
+#undef NDU
+
+/* Use stack work arrays for the kernel */
+#define BASIS_DERIVS(p,U,u,i,n,dN) {					\
+    double ndu[(BASIS_MAXDEG+1)*(BASIS_MAXDEG+1)], a[2*(BASIS_MAXDEG+1)]; \
+    double left[BASIS_MAXDEG+1], right[BASIS_MAXDEG+1];		\
+    basis_derivs_kernel(p,U,u,i,n,dN,ndu,a,left,right);		\
+  }
+
+static void basis_derivs(double *U, double u, int p, int i, int n, double *dN)
+{
+  if (p > BASIS_MAXDEG) {
+    ScratchMark mark = scratch_mark();
+    double *ndu = scratch_doubles((p+1)*(p+1));
+    double *a = scratch_doubles(2*(p+1));
+    double *left = scratch_doubles(p+1);
+    double *right = scratch_doubles(p+1);
+    if (ndu && a && left && right)
+      basis_derivs_kernel(p,U,u,i,n,dN,ndu,a,left,right);
+    scratch_release(mark);
+    return;
+  }
+  SWITCH_DEGREE(p,BASIS_DERIVS,U,u,i,n,dN)
 }
 
 
@@ -507,30 +829,45 @@ Output:
 - pnt: (nu,nd) points on the B-spline
 
 Modified algorithm A3.1 from 'The NURBS Book' p.82.
+The parametric values are processed in blocks of CURVE_BLOCK: the spans
+of a block are found first, then the basis functions of the whole block
+are computed at once with basis_funs_many.
 */
+#define CURVE_BLOCK 64
 static void curve_points(double *P, int nc, int nd, double *U, int nk, double *u, int nu, double *pnt)
 {
-  int i, j, p, s, t;
-
   /* degree of the spline */
-  p = nk - nc - 1;
-
-  /* space for the basis functions */
-  double *N = (double*) malloc((p+1)*sizeof(double));
-
-  /* for each parametric point j */
-  for (j=0; j<nu; ++j) {
-
-    /* find the span index of u[j] */
-    s = find_span(U,u[j],p,nc-1);
-    basis_funs(U,u[j],p,s,N);
+  int p = nk - nc - 1;
 
-    t = (s-p) * nd;
-    for (i=0; i<nd; ++i) {
-      pnt[j*nd+i] = dotprod(N,1,P+t+i,nd,p+1);
+#pragma omp parallel if (nu >= NURBS_PARALLEL_MIN) num_threads(pf_threads())
+  {
+    ScratchMark mark = scratch_mark();
+    int i, j, j0, j1, jb, nb, s, t;
+    int span[CURVE_BLOCK];
+
+    /* space for the basis functions of a block */
+    double *N = scratch_doubles(CURVE_BLOCK*(p+1));
+
+    thread_range(nu,&j0,&j1);
+    if (!N) j1 = j0;		/* out of memory: skip the work */
+    s = -1;
+    for (jb=j0; jb<j1; jb+=CURVE_BLOCK) {
+      nb = min(CURVE_BLOCK,j1-jb);
+
+      /* find the span indices of the block */
+      for (j=0; j<nb; ++j) span[j] = s = next_span(U,u[jb+j],p,nc-1,s);
+      basis_funs_many(U,u+jb,nb,p,span,N);
+
+      /* for each parametric point j */
+      for (j=0; j<nb; ++j) {
+	t = (span[j]-p) * nd;
+	for (i=0; i<nd; ++i) {
+	  pnt[(jb+j)*nd+i] = dotprod(N+j*(p+1),1,P+t+i,nd,p+1);
+	}
+      }
     }
+    scratch_release(mark);
   }
-  free(N);
 }
 
 
@@ -556,37 +893,110 @@ Modified algorithm A3.2 from 'The NURBS Book' p.93.
 */
 static void curve_derivs(int n, double *P, int nc, int nd, double *U, int nk, double *u, int nu, double *pnt)
 {
-  int i, j, l, p, s, t;
-
   /* degree of the spline */
-  p = nk - nc - 1;
+  int p = nk - nc - 1;
 
   /* number of nonzero derivatives to compute */
   int du = min(p,n);
 
-  /* space for the basis functions and derivs (du+1,p+1) */
-  double *dN = (double *) malloc((du+1)*(p+1)*sizeof(double));
-  for (i = 0; i < (du+1)*(p+1); i++) dN[i] = 0.0;
+#pragma omp parallel if (nu >= NURBS_PARALLEL_MIN) num_threads(pf_threads())
+  {
+    ScratchMark mark = scratch_mark();
+    int i, j, j0, j1, l, s, t;
+
+    /* space for the basis functions and derivs (du+1,p+1) */
+    double *dN = scratch_doubles((du+1)*(p+1));
+    if (dN) for (i = 0; i < (du+1)*(p+1); i++) dN[i] = 0.0;
+
+    /* for each parametric point r */
+    thread_range(nu,&j0,&j1);
+    if (!dN) j1 = j0;		/* out of memory: skip the work */
+    s = -1;
+    for (j = j0; j < j1; j++) {
+      s = next_span(U,u[j],p,nc-1,s);
+      basis_derivs(U,u[j],p,s,du,dN);
+
+      /* for each nonzero derivative */
+      for (l = 0; l <= du; l++) {
+	t = (s-p) * nd;
+	for (i = 0; i < nd; i++) {
+	  pnt[(l*nu+j)*nd+i] = dotprod(dN+l*(p+1),1,P+t+i,nd,p+1);
+	}
+      }
+    }
+    /* clear remainder */
+    for (l = du+1; l <= n; l++)
+      for (j = j0; j < j1; j++)
+	for (i = 0; i < nd; i++)
+	  pnt[(l*nu+j)*nd+i] = 0.0;
+    scratch_release(mark);
+  }
+}
+
+
+/* curves_derivs */
+/*
+Compute points and derivatives of multiple B-spline curves with the
+same knot sequence.
+
+Input:
+
+- n: number of derivatives to compute (0 for points only)
+- P: control points P(ncv,nc,nd)
+- ncv: number of curves
+- nc: number of control points of each curve
+- nd: dimension of the points (3 or 4)
+- U: knot sequence: U[0] .. U[m]
+- nk: number of knot values = m+1
+- u: parametric values: U[0] <= ui <= U[m]
+- nu: number of parametric values
+
+Output:
+- pnt: (n+1,ncv,nu,nd) points and derivatives on the B-splines
+
+The span and basis functions are computed once for each parametric
+value and then applied to all the curves.
+*/
+static void curves_derivs(int n, double *P, int ncv, int nc, int nd, double *U, int nk, double *u, int nu, double *pnt)
+{
+  /* degree of the spline */
+  int p = nk - nc - 1;
 
-  /* for each parametric point r */
-  for (j = 0; j < nu; j++) {
-    s = find_span(U,u[j],p,nc-1);
-    basis_derivs(U,u[j],p,s,du,dN);
+  /* number of nonzero derivatives to compute */
+  int du = min(p,n);
 
-    /* for each nonzero derivative */
-    for (l = 0; l <= du; l++) {
+#pragma omp parallel if ((long)nu*ncv >= NURBS_PARALLEL_MIN) num_threads(pf_threads())
+  {
+    ScratchMark mark = scratch_mark();
+    int c, i, j, j0, j1, l, s, t;
+
+    /* space for the basis functions and derivs (du+1,p+1) */
+    double *dN = scratch_doubles((du+1)*(p+1));
+
+    thread_range(nu,&j0,&j1);
+    if (!dN) j1 = j0;		/* out of memory: skip the work */
+    s = -1;
+    for (j = j0; j < j1; j++) {
+      s = next_span(U,u[j],p,nc-1,s);
+      if (n == 0) basis_funs(U,u[j],p,s,dN);
+      else basis_derivs(U,u[j],p,s,du,dN);
       t = (s-p) * nd;
-      for (i = 0; i < nd; i++) {
-	pnt[(l*nu+j)*nd+i] = dotprod(dN+l*(p+1),1,P+t+i,nd,p+1);
-      }
+
+      /* apply to all curves */
+      for (l = 0; l <= du; l++)
+	for (c = 0; c < ncv; c++)
+	  for (i = 0; i < nd; i++)
+	    pnt[((l*ncv+c)*nu+j)*nd+i] =
+	      dotprod(dN+l*(p+1),1,P+c*nc*nd+t+i,nd,p+1);
     }
+    /* clear remainder */
+    for (l = du+1; l <= n; l++)
+      for (c = 0; c < ncv; c++)
+	for (j = j0; j < j1; j++)
+	  for (i = 0; i < nd; i++)
+	    pnt[((l*ncv+c)*nu+j)*nd+i] = 0.0;
+    scratch_release(mark);
   }
-  /* clear remainder */
-  for (l = du+1; l <= n; l++)
-    for (j = 0; j < nu; j++)
-      for (i = 0; i < nd; i++)
-	pnt[(l*nu+j)*nd+i] = 0.0;
-  free(dN);
 }
 
 
@@ -722,6 +1132,7 @@ Modified algorithm A5.6 from 'The NURBS Book' p.173.
 */
 static void curve_decompose(double *P, int nc, int nd, double *U, int nk, double *newP)
 {
+  ScratchMark mark = scratch_mark();
   int i, j, k, p, s, m, r, a, b, mult, n, nb, ii, save;
   double numer, alpha, *alfa;
 
@@ -729,7 +1140,11 @@ static void curve_decompose(double *P, int nc, int nd, double *U, int nk, double
   m = nk - 1;
   p = m - n - 1;
 
-  alfa = (double *) malloc(p*sizeof(double));
+  alfa = scratch_doubles(p);
+  if (!alfa) {
+    scratch_release(mark);
+    return;
+  }
 
   a = p;
   b = p+1;
@@ -739,17 +1154,14 @@ static void curve_decompose(double *P, int nc, int nd, double *U, int nk, double
   for (i = 0; i < (p+1)*nd; i++) newP[i] = P[i];
 
   // Loop through knot vector
-
-  // INITIALIZE r in case it would not happen below.
-  // To AVOID COMPILER WARNING
-  // we should check this with the Nurbs book
-  r = 0;
-
   while (b < m) {
     i = b;
     while (b < m && U[b] == U[b+1]) b++;
     mult = b-i+1;
 
+    /* Number of knot insertions; the next segment gets its control
+       points from P from index r on */
+    r = 0;
     if (mult < p) {
       //printf("mult at %d is %d < %d\n",b,mult,p);
       /* compute alfas */
@@ -778,7 +1190,6 @@ static void curve_decompose(double *P, int nc, int nd, double *U, int nk, double
 	  }
       }
     }
-    /* NOTE: if mult >= p, r is not initialized */
     /* Bezier segment completed */
     nb += p;
     if (b < m) {
@@ -793,7 +1204,95 @@ static void curve_decompose(double *P, int nc, int nd, double *U, int nk, double
     }
   }
 
-  free(alfa);
+  scratch_release(mark);
+}
+
+
+/* bezier_spans */
+/*
+Find the Bezier segments of a B-spline basis.
+
+Input:
+
+- U: knot sequence: U[0] .. U[m]
+- nk: number of knot values = m+1
+- p: degree of the B-spline
+
+Output:
+
+- span: (nb) knot span index of each Bezier segment. If NULL, only
+  the number of segments is returned.
+
+Returns the number of Bezier segments nb. The segments are found in
+the same way as in curve_decompose.
+*/
+static int bezier_spans(double *U, int nk, int p, int *span)
+{
+  int m, a, b, nb;
+
+  m = nk - 1;
+  a = p;
+  b = p+1;
+  nb = 0;
+  while (b < m) {
+    while (b < m && U[b] == U[b+1]) b++;
+    if (span) span[nb] = a;
+    nb++;
+    if (b < m) {
+      a = b;
+      b++;
+    }
+  }
+  return nb;
+}
+
+
+/* bezier_extraction */
+/*
+Compute the Bezier extraction operator of a B-spline basis.
+
+Input:
+
+- U: knot sequence: U[0] .. U[m]
+- nk: number of knot values = m+1
+- p: degree of the B-spline
+- nb: number of Bezier segments (from bezier_spans())
+- span: (nb) knot span index of each Bezier segment (from bezier_spans())
+
+Output:
+
+- C: (nb,p+1,p+1) extraction matrices. The Bezier control points of
+  segment e are C[e] . P[span[e]-p:span[e]+1].
+
+The operator is obtained by decomposing a curve with p+1 dimensional
+control points, where point i is the unit vector along axis i%(p+1).
+As the p+1 control points of a segment have different unit vectors,
+the decomposed points directly contain the matrix elements. The
+result is thus exactly the linear map applied by curve_decompose.
+*/
+static void bezier_extraction(double *U, int nk, int p, int nb, int *span, double *C)
+{
+  ScratchMark mark = scratch_mark();
+  int e, i, j, k, nc, n1;
+
+  nc = nk - p - 1;
+  n1 = p + 1;
+
+  double *E = scratch_doubles(nc*n1);
+  double *B = scratch_doubles((nb*p+1)*n1);
+  if (!E || !B) {
+    scratch_release(mark);
+    return;
+  }
+  for (i=0; i<nc*n1; ++i) E[i] = 0.0;
+  for (i=0; i<nc; ++i) E[i*n1+i%n1] = 1.0;
+  curve_decompose(E, nc, n1, U, nk, B);
+
+  for (e=0; e<nb; ++e)
+    for (j=0; j<n1; ++j)
+      for (k=0; k<n1; ++k)
+	C[(e*n1+j)*n1+k] = B[(e*p+j)*n1+(span[e]-p+k)%n1];
+  scratch_release(mark);
 }
 
 
@@ -823,6 +1322,7 @@ Modified algorithm A5.8 from 'The NURBS Book' p.185.
 */
 static int curve_knot_remove(double *P, int nc, int nd, double *U, int nk, double u, int num, int r, int s, double tol)
 {
+  ScratchMark mark = scratch_mark();
   int n,m,p,ord,fout,last,first,t,off,i,j,ii,jj,k,kk,remflag;
   double alfi,alfj;
 
@@ -830,8 +1330,12 @@ static int curve_knot_remove(double *P, int nc, int nd, double *U, int nk, doubl
   m = nk - 1;
   p = m - n - 1;
 
-  double *temp = (double*) malloc((2*p+1)*nd*sizeof(double));
-  double *xtemp = (double*) malloc(nd*sizeof(double));
+  double *temp = scratch_doubles((2*p+1)*nd);
+  double *xtemp = scratch_doubles(nd);
+  if (!temp || !xtemp) {
+    scratch_release(mark);
+    return 0;
+  }
 
 
   /* printf("Knots: "); */
@@ -911,10 +1415,7 @@ static int curve_knot_remove(double *P, int nc, int nd, double *U, int nk, doubl
       ++j;
     }
   }
-
-  free(temp);
-  free(xtemp);
-
+  scratch_release(mark);
   return t;
 }
 
@@ -944,6 +1445,7 @@ Modified algorithm A5.9 from 'The NURBS Book' p.206.
 */
 static void curve_degree_elevate(double *P, int nc, int nd, double *U, int nk, int t, double *Pw, double* Uw, int *nq, int *nu)
 {
+  ScratchMark mark = scratch_mark();
   int n,m,p,mh,ph,ph2,i,j,mpi,kind,r,a,b,cind,kk,oldr,mul,lbz,rbz,k,save,s,first,last,tr,kj;
   double inv,ua,ub,den,alf,bet,gam,numer;
 
@@ -955,11 +1457,16 @@ static void curve_degree_elevate(double *P, int nc, int nd, double *U, int nk, i
   ph2 = ph/2;
 
   /* Create local storage */
-  double **bezalfs = newmatrix(ph+1,p+1);
-  double *bpts = (double *) malloc((p+1)*nd*sizeof(double));
-  double *ebpts = (double *) malloc((ph+1)*nd*sizeof(double));
-  double *nbpts = (double *) malloc((p-1)*nd*sizeof(double));
-  double *alfs = (double *) malloc((p-1)*sizeof(double));
+  double **bezalfs = scratch_matrix(ph+1,p+1);
+  double *bpts = scratch_doubles((p+1)*nd);
+  double *ebpts = scratch_doubles((ph+1)*nd);
+  double *nbpts = scratch_doubles((p-1)*nd);
+  double *alfs = scratch_doubles(p-1);
+  if (!bezalfs || !bpts || !ebpts || !nbpts || !alfs) {
+    *nq = *nu = 0;
+    scratch_release(mark);
+    return;
+  }
 
   /* Compute Bezier degree elevation coefficients */
   //printf("Bezier degree elevation coefficients\n");
@@ -1135,11 +1642,7 @@ static void curve_degree_elevate(double *P, int nc, int nd, double *U, int nk, i
 //  print_mat(Uw,1,*nu);
 
 //  printf("Free the work spaces\n");
-  freematrix(bezalfs);
-  free(bpts);
-  free(ebpts);
-  free(nbpts);
-  free(alfs);
+  scratch_release(mark);
 }
 
 
@@ -1161,6 +1664,7 @@ Based on eqs. 5.41 .. 5.46 from 'The NURBS Book' p.220.
 */
 static void bezier_degree_reduce(double* Q, int nc, int nd, double* P, double *maxerr)
 {
+  ScratchMark mark = scratch_mark();
   int p, r, i, kk;
   double PrR[4];
 
@@ -1168,7 +1672,11 @@ static void bezier_degree_reduce(double* Q, int nc, int nd, double* P, double *m
   r = (p-1) / 2;
 
   /* Degree elevation coeffs for p-1 -> p */
-  double *alfs = (double *) malloc(p*sizeof(double));
+  double *alfs = scratch_doubles(p);
+  if (!alfs) {
+    scratch_release(mark);
+    return;
+  }
   for (i=0; i<p; ++i) alfs[i] = (double) i / p;
   /* printf("Bezier alfs; p = %d; r = %d\n",p,r); */
   /* print_mat(alfs,1,p); */
@@ -1198,6 +1706,7 @@ static void bezier_degree_reduce(double* Q, int nc, int nd, double* P, double *m
   /* printf("Output P\n"); */
   /* print_mat(P,p,nd); */
 
+  scratch_release(mark);
 }
 
 /* curve_degree_reduce */
@@ -1224,6 +1733,7 @@ Modified algorithm A5.9 from 'The NURBS Book' p.206.
 */
 static void curve_degree_reduce(double *P, int nc, int nd, double *U, int nk, double *Pw, double* Uw, int *nq, int *nu)
 {
+  ScratchMark mark = scratch_mark();
   int n,m,p,mh,ph,i,j,kind,r,a,b,cind,kk,oldr,mul,lbz,k,save,s,first,last,kj;
   double ua,ub,alfa,beta,numer,maxerr;
 
@@ -1234,11 +1744,16 @@ static void curve_degree_reduce(double *P, int nc, int nd, double *U, int nk, do
   ph = p-1;
 
   /* Create local storage */
-  double *bpts = (double *) malloc((p+1)*nd*sizeof(double));
-  double *rbpts = (double *) malloc(p*nd*sizeof(double));
-  double *nbpts = (double *) malloc((p-1)*nd*sizeof(double));
-  double *alfs = (double *) malloc((p-1)*sizeof(double));
-  double *err = (double *) malloc(m*sizeof(double));
+  double *bpts = scratch_doubles((p+1)*nd);
+  double *rbpts = scratch_doubles(p*nd);
+  double *nbpts = scratch_doubles((p-1)*nd);
+  double *alfs = scratch_doubles(p-1);
+  double *err = scratch_doubles(m);
+  if (!bpts || !rbpts || !nbpts || !alfs || !err) {
+    *nq = *nu = 0;
+    scratch_release(mark);
+    return;
+  }
 
   /* Initialize some variables */
   mh = ph;
@@ -1375,11 +1890,7 @@ static void curve_degree_reduce(double *P, int nc, int nd, double *U, int nk, do
   /* print_mat(Uw,1,*nu); */
 
   /* printf("Free the work spaces\n"); */
-  free(bpts);
-  free(rbpts);
-  free(nbpts);
-  free(alfs);
-  free(err);
+  scratch_release(mark);
 }
 
 
@@ -1406,10 +1917,10 @@ Output:
 
 Modified algorithm A9.1 from 'The NURBS Book' p.369.
 */
-static void curve_global_interp_mat(int p, int nc, int nu, int t0, int t1,
-				    double *u, double *U, double *A)
+static void curve_global_interp_knots(int p, int nc, int nu, int t0, int t1,
+				      double *u, double *U)
 {
-    int m,i,j,s;
+    int m,i,j;
 
     m = nu + p;
     /* Compute the knot vector U by averaging (9.8) */
@@ -1419,6 +1930,15 @@ static void curve_global_interp_mat(int p, int nc, int nu, int t0, int t1,
 	for (i=j; i<j+p; ++i) U[j+p+t0] += u[i];
 	U[j+p+t0] /= p;
     }
+}
+
+static void curve_global_interp_mat(int p, int nc, int nu, int t0, int t1,
+				    double *u, double *U, double *A)
+{
+    int i,s;
+
+    curve_global_interp_knots(p, nc, nu, t0, t1, u, U);
+
     /* Set up coefficient matrix A */
     for (i=0; i<nu*nu; ++i) A[i] = 0.0;
     A[0] = A[nu*nu-1] = 1.0;
@@ -1436,60 +1956,276 @@ static void curve_global_interp_mat(int p, int nc, int nu, int t0, int t1,
     }
 }
 
-/* cubic_spline_interpolate(Q, t0, t1, U, nc, nd, P) */
+
+/* band_lu */
 /*
-Compute the control points of a cubic spline interpolate.
+LU factorization of a banded matrix with partial pivoting.
 
 Input:
-- Q(nc,nd): Points to interpolate
-- t0(nd):   Start tangent
-- t1(nd):   End tangent
-- U(nc+6):  Knots
-- nc:       Number of points
-- nd:       Dimension of points
+
+- n: order of the matrix
+- kl: number of subdiagonals
+- ku: number of superdiagonals
+- AB: (n,2*kl+ku+1) banded storage of the matrix: element A(i,j) is
+  stored in AB[j*(2*kl+ku+1)+kl+ku+i-j]. The first kl elements of each
+  column hold no matrix elements, but are used for the fill-in.
 
 Output:
-- P(nc+2, nd): Computed control points
 
-Based on algorithm A9.2 of 'The Nurbs Book', p. 373
+- AB: the factors L and U, with U having kl+ku superdiagonals.
+- ipiv: (n) the pivot row of each column
+
+Returns 0 on success, or -1 if the matrix is singular.
+
+This is the unblocked algorithm of LAPACK's dgbtf2. It takes
+O(n*kl*(kl+ku)) operations.
 */
-static void cubic_spline_interpolation(double *Q, double *t0, double *t1,
-				       double *U, int nc, int nd, double *P)
+#define AB(i,j) AB[(j)*ldab+kv+(i)-(j)]
+static int band_lu(int n, int kl, int ku, double *AB, int *ipiv)
 {
-    int n, i, j;
-    double den, abc[4];
-    /* Initialize */
-    n = nc - 1;
-    /* Create local storage */
-    double *dd = (double *) malloc(nc*sizeof(double));
+  int i, j, jp, c, ju, km, kv, ldab;
+  double t, piv;
+
+  kv = kl + ku;
+  ldab = 2*kl + ku + 1;
+  ju = 0;
+  for (j=0; j<n; ++j) {
+    /* find the pivot in column j */
+    km = min(kl, n-1-j);
+    jp = 0;
+    for (i=1; i<=km; ++i)
+      if (fabs(AB(j+i,j)) > fabs(AB(j+jp,j))) jp = i;
+    ipiv[j] = j + jp;
+    if (AB(j+jp,j) == 0.0) return -1;
+
+    /* columns affected by the elimination */
+    ju = max(ju, min(j+ku+jp, n-1));
+
+    /* interchange the rows */
+    if (jp != 0)
+      for (c=j; c<=ju; ++c) {
+	t = AB(j,c);
+	AB(j,c) = AB(j+jp,c);
+	AB(j+jp,c) = t;
+      }
 
-    for (j=0; j<nd; ++j) {
-	P[j] = Q[j];
-        P[nd+j] = P[j] + U[4] / 3 * t0[j];
-        P[(n+2)*nd+j] = Q[n*nd+j];
-	P[(n+1)*nd+j] = P[(n+2)*nd+j] - (1-U[n+2]) / 3 * t1[j];
-    }
-    basis_funs(U, U[4], 3, 4, abc);
-    den = abc[1];
-    for (j=0; j<nd; ++j) {
-	P[2*nd+j] = (Q[nd+j] - abc[0]*P[nd+j]) / den;
-    }
-    for (i=3; i<n; ++i) {
-        dd[i] = abc[2]/den;
-        basis_funs(U, U[i+2], 3, i+2, abc);
-        den = abc[1] - abc[0]*dd[i];
-	for (j=0; j<nd; ++j) {
-	    P[i*nd+j] = (Q[(i-1)*nd+j] - abc[0]*P[(i-1)*nd+j]) / den;
-	}
+    /* compute the multipliers and update the remaining submatrix */
+    piv = AB(j,j);
+    for (i=1; i<=km; ++i) AB(j+i,j) /= piv;
+    for (c=j+1; c<=ju; ++c) {
+      t = AB(j,c);
+      if (t != 0.0)
+	for (i=1; i<=km; ++i) AB(j+i,c) -= AB(j+i,j) * t;
     }
-    dd[n] = abc[2]/den;
-    basis_funs(U, U[n+2], 3, n+2, abc);
-    den = abc[1] - abc[0]*dd[n];
-    for (j=0; j<nd; ++j)
-	P[n*nd+j] = (Q[(n-1)*nd+j] - abc[2]*P[(n+1)*nd+j] - abc[0]*P[(n-1)*nd+j]) / den;
-    for (i=n-1; i>1; --i)
-	for (j=0; j<nd; ++j)
+  }
+  return 0;
+}
+
+/* band_solve */
+/*
+Solve a banded system of equations with the factors from band_lu.
+
+Input:
+
+- n, kl, ku, AB, ipiv: the factored matrix, as returned by band_lu
+- B: (n,nd) right hand side
+
+Output:
+
+- B: (n,nd) the solution
+*/
+static void band_solve(int n, int kl, int ku, double *AB, int *ipiv, double *B, int nd)
+{
+  int i, j, k, l, km, kv, ldab;
+  double t;
+
+  kv = kl + ku;
+  ldab = 2*kl + ku + 1;
+
+  /* Solve L*X = B, applying the row interchanges */
+  for (j=0; j<n-1; ++j) {
+    km = min(kl, n-1-j);
+    l = ipiv[j];
+    if (l != j)
+      for (k=0; k<nd; ++k) {
+	t = B[l*nd+k];
+	B[l*nd+k] = B[j*nd+k];
+	B[j*nd+k] = t;
+      }
+    for (i=1; i<=km; ++i)
+      for (k=0; k<nd; ++k) B[(j+i)*nd+k] -= AB(j+i,j) * B[j*nd+k];
+  }
+
+  /* Solve U*X = B */
+  for (j=n-1; j>=0; --j) {
+    for (k=0; k<nd; ++k) B[j*nd+k] /= AB(j,j);
+    for (i=max(0,j-kv); i<j; ++i)
+      for (k=0; k<nd; ++k) B[i*nd+k] -= AB(i,j) * B[j*nd+k];
+  }
+}
+#undef AB
+
+
+/* curve_global_interp */
+/*
+Compute the global curve interpolation.
+
+Input:
+
+- p: degree of the B-spline
+- nc: number of points through which the curve should pass
+- nd: dimension of the points
+- Q: points through which the curve should pass (nc,nd)
+- u: parameter values at the points (nc)
+- D0: derivative at the start point (nd), or NULL
+- D1: derivative at the end point (nd), or NULL
+
+Output:
+- U: knot sequence: U[0] .. U[m]   m = nu+p, nu = nc + (D0!=NULL) + (D1!=NULL)
+- P: control points P(nu,nd)
+
+Returns 0 on success, -1 if the system is singular.
+
+This is like solving the system from curve_global_interp_mat, but the
+coefficient matrix is built in banded storage and solved with a banded
+LU decomposition. The bandwidth follows from the spans of the parameter
+values, and is normally p. The memory use is O(nu*p) and the work
+O(nu*p*p), instead of O(nu*nu) and O(nu*nu*nu) for the full matrix.
+
+Modified algorithm A9.1 from 'The NURBS Book' p.369.
+*/
+static int curve_global_interp(int p, int nc, int nd, double *Q, double *u,
+			       double *D0, double *D1, double *U, double *P)
+{
+    ScratchMark mark = scratch_mark();
+    int i, j, k, r, s, nu, t0, t1, kl, ku, ldab, ret;
+
+    t0 = D0 != NULL;
+    t1 = D1 != NULL;
+    nu = nc + t0 + t1;
+    curve_global_interp_knots(p, nc, nu, t0, t1, u, U);
+
+    /* the spans of the interior points determine the bandwidth */
+    int *span = scratch_ints(nc);
+    if (!span) {
+	scratch_release(mark);
+	return -1;
+    }
+    kl = t0;
+    ku = t1;
+    for (i=1; i<nc-1; ++i) {
+	span[i] = s = find_span(U,u[i],p,nu-1);
+	r = i + t0;
+	kl = max(kl, r-(s-p));
+	ku = max(ku, s-r);
+    }
+
+    /* Set up the coefficient matrix in banded storage */
+    ldab = 2*kl + ku + 1;
+    double *AB = scratch_doubles(nu*ldab);
+    double *N = scratch_doubles(p+1);
+    int *ipiv = scratch_ints(nu);
+    if (!AB || !N || !ipiv) {
+	scratch_release(mark);
+	return -1;
+    }
+    for (i=0; i<nu*ldab; ++i) AB[i] = 0.0;
+#define A(i,j) AB[(j)*ldab+kl+ku+(i)-(j)]
+    A(0,0) = A(nu-1,nu-1) = 1.0;
+    if (t0) {
+	A(1,0) = -1.0;
+	A(1,1) = 1.0;
+    }
+    if (t1) {
+	A(nu-2,nu-2) = -1.0;
+	A(nu-2,nu-1) = 1.0;
+    }
+    for (i=1; i<nc-1; ++i) {
+	s = span[i];
+	basis_funs(U,u[i],p,s,N);
+	for (j=0; j<=p; ++j) A(i+t0,s-p+j) = N[j];
+    }
+#undef A
+
+    /* Set up the right hand side */
+    for (k=0; k<nd; ++k) {
+	P[k] = Q[k];
+	P[(nu-1)*nd+k] = Q[(nc-1)*nd+k];
+    }
+    for (i=1; i<nc-1; ++i)
+	for (k=0; k<nd; ++k) P[(i+t0)*nd+k] = Q[i*nd+k];
+    if (t0)
+	for (k=0; k<nd; ++k) P[nd+k] = D0[k] * U[p+1] / p;
+    if (t1)
+	for (k=0; k<nd; ++k) P[(nu-2)*nd+k] = D1[k] * (1.0-U[nu-1]) / p;
+
+    /* Solve */
+    ret = band_lu(nu, kl, ku, AB, ipiv);
+    if (ret == 0) band_solve(nu, kl, ku, AB, ipiv, P, nd);
+    scratch_release(mark);
+    return ret;
+}
+
+/* cubic_spline_interpolate(Q, t0, t1, U, nc, nd, P) */
+/*
+Compute the control points of a cubic spline interpolate.
+
+Input:
+- Q(nc,nd): Points to interpolate
+- t0(nd):   Start tangent
+- t1(nd):   End tangent
+- U(nc+6):  Knots
+- nc:       Number of points
+- nd:       Dimension of points
+
+Output:
+- P(nc+2, nd): Computed control points
+
+Based on algorithm A9.2 of 'The Nurbs Book', p. 373
+*/
+static void cubic_spline_interpolation(double *Q, double *t0, double *t1,
+				       double *U, int nc, int nd, double *P)
+{
+    ScratchMark mark = scratch_mark();
+    int n, i, j;
+    double den, abc[4];
+    /* Initialize */
+    n = nc - 1;
+    /* Create local storage */
+    double *dd = scratch_doubles(nc);
+    if (!dd) {
+	scratch_release(mark);
+	return;
+    }
+
+    for (j=0; j<nd; ++j) {
+	P[j] = Q[j];
+        P[nd+j] = P[j] + U[4] / 3 * t0[j];
+        P[(n+2)*nd+j] = Q[n*nd+j];
+	P[(n+1)*nd+j] = P[(n+2)*nd+j] - (1-U[n+2]) / 3 * t1[j];
+    }
+    basis_funs(U, U[4], 3, 4, abc);
+    den = abc[1];
+    for (j=0; j<nd; ++j) {
+	P[2*nd+j] = (Q[nd+j] - abc[0]*P[nd+j]) / den;
+    }
+    for (i=3; i<n; ++i) {
+        dd[i] = abc[2]/den;
+        basis_funs(U, U[i+2], 3, i+2, abc);
+        den = abc[1] - abc[0]*dd[i];
+	for (j=0; j<nd; ++j) {
+	    P[i*nd+j] = (Q[(i-1)*nd+j] - abc[0]*P[(i-1)*nd+j]) / den;
+	}
+    }
+    dd[n] = abc[2]/den;
+    basis_funs(U, U[n+2], 3, n+2, abc);
+    den = abc[1] - abc[0]*dd[n];
+    for (j=0; j<nd; ++j)
+	P[n*nd+j] = (Q[(n-1)*nd+j] - abc[2]*P[(n+1)*nd+j] - abc[0]*P[(n-1)*nd+j]) / den;
+    for (i=n-1; i>1; --i)
+	for (j=0; j<nd; ++j)
 	    P[i*nd+j] = P[i*nd+j] - dd[i+1]*P[(i+1)*nd+j];
+    scratch_release(mark);
 }
 
 /********************************************************/
@@ -1521,40 +2257,45 @@ Modified algorithm A3.5 from 'The NURBS Book' p.103.
 */
 static void surface_points(double *P, int ns, int nt, int nd, double *U, int nU, double *V, int nV, double *u, int nu, double *pnt)
 {
-  int i, j, p, q, r, su, sv, iu, iv;
-  double S;
-
   /* degrees of the spline */
-  p = nU - ns - 1;
-  q = nV - nt - 1;
-
-  /* space for the basis functions */
-  double *Nu = (double*) malloc((p+1)*sizeof(double));
-  double *Nv = (double*) malloc((q+1)*sizeof(double));
-
-  /* for each parametric point j */
-  for (j=0; j<nu; ++j) {
-
-    /* find the span index of u[j] */
-    su = find_span(U,u[2*j],p,ns-1);
-    basis_funs(U,u[2*j],p,su,Nu);
+  int p = nU - ns - 1;
+  int q = nV - nt - 1;
 
-    /* find the span index of v[j] */
-    sv = find_span(V,u[2*j+1],q,nt-1);
-    basis_funs(V,u[2*j+1],q,sv,Nv);
-
-    iu = su-p;
-    iv = sv-q;
-    for (i=0; i<nd; ++i) {
-      S = 0.0;
-      for (r=0; r<=p; ++r) {
-	S += Nu[r] * dotprod(Nv,1,P+((iu+r)*nt+iv)*nd+i,nd,q+1);
+#pragma omp parallel if (nu >= NURBS_PARALLEL_MIN) num_threads(pf_threads())
+  {
+    ScratchMark mark = scratch_mark();
+    int i, j, j0, j1, r, su, sv, iu, iv;
+    double S;
+
+    /* space for the basis functions */
+    double *Nu = scratch_doubles(p+1);
+    double *Nv = scratch_doubles(q+1);
+
+    /* for each parametric point j */
+    thread_range(nu,&j0,&j1);
+    if (!Nu || !Nv) j1 = j0;		/* out of memory: skip the work */
+    for (j=j0; j<j1; ++j) {
+
+      /* find the span index of u[j] */
+      su = find_span(U,u[2*j],p,ns-1);
+      basis_funs(U,u[2*j],p,su,Nu);
+
+      /* find the span index of v[j] */
+      sv = find_span(V,u[2*j+1],q,nt-1);
+      basis_funs(V,u[2*j+1],q,sv,Nv);
+
+      iu = su-p;
+      iv = sv-q;
+      for (i=0; i<nd; ++i) {
+	S = 0.0;
+	for (r=0; r<=p; ++r) {
+	  S += Nu[r] * dotprod(Nv,1,P+((iu+r)*nt+iv)*nd+i,nd,q+1);
+	}
+	pnt[j*nd+i] = S;
       }
-      pnt[j*nd+i] = S;
     }
+    scratch_release(mark);
   }
-  free(Nu);
-  free(Nv);
 }
 
 
@@ -1583,62 +2324,146 @@ Modified algorithm A3.6 from 'The NURBS Book' p.111.
 */
 static void surface_derivs(int mu, int mv, double *P,int ns, int nt, int nd, double *U, int nU, double *V, int nV, double *u, int nu, double *pnt)
 {
-  int p,q,du,dv,su,sv,i,j,k,l,iu,iv,r;
-  double S, *qnt;
-
   /* degrees of the spline */
-  p = nU - ns - 1;
-  q = nV - nt - 1;
+  int p = nU - ns - 1;
+  int q = nV - nt - 1;
 
   /* number of nonzero derivatives to compute */
-  du = min(p,mu);
-  dv = min(q,mv);
-
-  /* space for the basis functions and derivatives */
-  double *Nu = (double*) malloc((du+1)*(p+1)*sizeof(double));
-  double *Nv = (double*) malloc((dv+1)*(q+1)*sizeof(double));
-
-  /* clear everything */
-  for (i=0; i<(mu+1)*(mv+1)*nu*nd; ++i) pnt[i] = 0;
-
-  /* for each parametric point j */
-  for (j=0; j<nu; ++j) {
-
-    /* find the span index of u[j] */
-    su = find_span(U,u[2*j],p,ns-1);
-    basis_derivs(U,u[2*j],p,su,du,Nu);
-    //printf("Nu (%d,%d)\n",du+1,p+1);
-    //print_mat(Nu,du+1,p+1);
-
-    /* find the span index of v[j] */
-    sv = find_span(V,u[2*j+1],q,nt-1);
-    basis_derivs(V,u[2*j+1],q,sv,dv,Nv);
-    //printf("Nv (%d,%d)\n",du+1,p+1);
-    //print_mat(Nv,dv+1,q+1);
-
-    /* for each nonzero derivative */
-    for (k=0; k<=du; ++k) {
-      for (l=0; l<=dv; ++l) {
-	qnt = pnt + (k*(mv+1) + l) *nu*nd;
-
-	iu = su-p;
-	iv = sv-q;
-	//printf("k=%d, l=%d\n",k,l);
-	//printf("offset %d\n", (k*(mv+1) + l) *nu*nd);
-	for (i=0; i<nd; ++i) {
-	  S = 0.0;
-	  for (r=0; r<=p; ++r) {
-	    S += Nu[k*(p+1)+r] * dotprod(Nv+l*(q+1),1,P+((iu+r)*nt+iv)*nd+i,nd,q+1);
+  int du = min(p,mu);
+  int dv = min(q,mv);
+
+#pragma omp parallel if (nu >= NURBS_PARALLEL_MIN) num_threads(pf_threads())
+  {
+    ScratchMark mark = scratch_mark();
+    int su,sv,i,j,j0,j1,k,l,iu,iv,r;
+    double S, *qnt;
+
+    /* space for the basis functions and derivatives */
+    double *Nu = scratch_doubles((du+1)*(p+1));
+    double *Nv = scratch_doubles((dv+1)*(q+1));
+
+    /* clear everything */
+    thread_range(nu,&j0,&j1);
+    if (!Nu || !Nv) j1 = j0;		/* out of memory: skip the work */
+    for (k=0; k<(mu+1)*(mv+1); ++k)
+      for (i=j0*nd; i<j1*nd; ++i) pnt[k*nu*nd+i] = 0;
+
+    /* for each parametric point j */
+    for (j=j0; j<j1; ++j) {
+
+      /* find the span index of u[j] */
+      su = find_span(U,u[2*j],p,ns-1);
+      basis_derivs(U,u[2*j],p,su,du,Nu);
+
+      /* find the span index of v[j] */
+      sv = find_span(V,u[2*j+1],q,nt-1);
+      basis_derivs(V,u[2*j+1],q,sv,dv,Nv);
+
+      /* for each nonzero derivative */
+      for (k=0; k<=du; ++k) {
+	for (l=0; l<=dv; ++l) {
+	  qnt = pnt + (k*(mv+1) + l) *nu*nd;
+
+	  iu = su-p;
+	  iv = sv-q;
+	  for (i=0; i<nd; ++i) {
+	    S = 0.0;
+	    for (r=0; r<=p; ++r) {
+	      S += Nu[k*(p+1)+r] * dotprod(Nv+l*(q+1),1,P+((iu+r)*nt+iv)*nd+i,nd,q+1);
+	    }
+	    qnt[j*nd+i] = S;
 	  }
-	  //printf("S = %f\n",S);
-	  qnt[j*nd+i] = S;
 	}
-	//print_mat(pnt,(mu+1)*(mv+1)*nu,nd);
       }
     }
+    scratch_release(mark);
+  }
+}
+
+
+/* surface_grid_points */
+/*
+Compute points on a B-spline surface at a grid of parametric values.
+
+Input:
+
+- P: control points P(ns,nt,nd)
+- ns,nt: number of control points
+- nd: dimension of the points (3 or 4)
+- U: knot sequence: U[0] .. U[m]
+- nU: number of knot values U = m+1
+- V: knot sequence: V[0] .. V[n]
+- nV: number of knot values V = n+1
+- u: parametric values in direction u: U[0] <= ui <= U[m]
+- nu: number of parametric values u
+- v: parametric values in direction v: V[0] <= vj <= V[n]
+- nv: number of parametric values v
+
+Output:
+- pnt: (nu,nv,nd) points on the B-spline at the parameters (ui,vj)
+
+The spans and basis functions are computed only once for each ui and
+each vj. For each ui, the control points are first contracted with the
+u basis functions into a row of nt points, which is then contracted
+with the v basis functions for all the vj. This reduces the work for a
+grid of points from O(nu*nv*(p+1)*(q+1)) to O(nu*(nt*(p+1)+nv*(q+1))).
+*/
+static void surface_grid_points(double *P, int ns, int nt, int nd, double *U, int nU, double *V, int nV, double *u, int nu, double *v, int nv, double *pnt)
+{
+  ScratchMark mark = scratch_mark();
+  int j, p, q, iv;
+
+  /* degrees of the spline */
+  p = nU - ns - 1;
+  q = nV - nt - 1;
+
+  /* space for the spans and basis functions in direction v */
+  int *sv = scratch_ints(nv);
+  double *Nv = scratch_doubles(nv*(q+1));
+  if (!sv || !Nv) {
+    scratch_release(mark);
+    return;
+  }
+
+  /* the spans and basis functions in direction v */
+  iv = -1;
+  for (j=0; j<nv; ++j) sv[j] = iv = next_span(V,v[j],q,nt-1,iv);
+  basis_funs_many(V,v,nv,q,sv,Nv);
+
+#pragma omp parallel if ((long)nu*nv >= NURBS_PARALLEL_MIN) num_threads(pf_threads())
+  {
+    ScratchMark tmark = scratch_mark();
+    int i, i0, i1, j, k, r, iu, iv;
+    double S, *Q;
+    double *Nu = scratch_doubles(p+1);
+    double *row = scratch_doubles(nt*nd);
+
+    /* for each parametric value ui */
+    thread_range(nu,&i0,&i1);
+    if (!Nu || !row) i1 = i0;		/* out of memory: skip the work */
+    iu = -1;
+    for (i=i0; i<i1; ++i) {
+      iu = next_span(U,u[i],p,ns-1,iu);
+      basis_funs(U,u[i],p,iu,Nu);
+
+      /* contract the control points in direction u */
+      for (k=0; k<nt*nd; ++k) {
+	S = 0.0;
+	for (r=0; r<=p; ++r) S += Nu[r] * P[(iu-p+r)*nt*nd+k];
+	row[k] = S;
+      }
+
+      /* contract the row in direction v */
+      for (j=0; j<nv; ++j) {
+	iv = sv[j]-q;
+	Q = pnt + (i*nv+j)*nd;
+	for (k=0; k<nd; ++k)
+	  Q[k] = dotprod(Nv+j*(q+1),1,row+iv*nd+k,nd,q+1);
+      }
+    }
+    scratch_release(tmark);
   }
-  free(Nu);
-  free(Nv);
+  scratch_release(mark);
 }
 
 
@@ -1809,10 +2634,10 @@ static PyObject * horner(PyObject *self, PyObject *args)
 
   if (!PyArg_ParseTuple(args, "OO", &arg1, &arg2))
     return NULL;
-  arr1 = PyArray_FROM_OTF(arg1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr1 = pf_from_otf(arg1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr1 == NULL)
     return NULL;
-  arr2 = PyArray_FROM_OTF(arg2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr2 = pf_from_otf(arg2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr2 == NULL)
     goto fail;
 
@@ -1888,7 +2713,9 @@ static PyObject * bernstein(PyObject *self, PyObject *args)
   if(!PyArg_ParseTuple(args, "iid", &i, &n, &u))
     return NULL;
 
+  int nfail = scratch_failures();
   ret = _bernstein(i, n, u);
+  if (scratch_check(nfail) < 0) return NULL;
   return Py_BuildValue("d", ret);
 }
 
@@ -1975,7 +2802,7 @@ static PyObject * basisDerivs(PyObject *self, PyObject *args)
 
     if(!PyArg_ParseTuple(args, "Odiii", &a1, &u, &p, &i, &n))
 	return NULL;
-    arr1 = PyArray_FROM_OTF(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+    arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
     if(arr1 == NULL)
 	return NULL;
     U = (double *)PYARRAY_DATA(arr1);
@@ -1986,7 +2813,13 @@ static PyObject * basisDerivs(PyObject *self, PyObject *args)
     fd = (double *)PYARRAY_DATA(ret);
 
     /* Compute */
+    int nfail = scratch_failures();
     basis_derivs(U, u, p, i, n, fd);
+    if (scratch_check(nfail) < 0) {
+	Py_DECREF(arr1);
+	Py_DECREF(ret);
+	return NULL;
+    }
     /* Clean up and return */
     Py_DECREF(arr1);
     return ret;
@@ -2041,13 +2874,13 @@ static PyObject * curvePoints(PyObject *self, PyObject *args)
 
   if (!PyArg_ParseTuple(args, "OOO", &a1, &a2, &a3))
     return NULL;
-  arr1 = PyArray_FROM_OTF(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr1 == NULL)
     return NULL;
-  arr2 = PyArray_FROM_OTF(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr2 = pf_from_otf(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr2 == NULL)
     goto fail;
-  arr3 = PyArray_FROM_OTF(a3, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr3 = pf_from_otf(a3, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr3 == NULL)
     goto fail;
 
@@ -2069,7 +2902,14 @@ static PyObject * curvePoints(PyObject *self, PyObject *args)
   pnt = (double *)PYARRAY_DATA(ret);
 
   /* Compute */
+  int nfail = scratch_failures();
+  Py_BEGIN_ALLOW_THREADS
   curve_points(P, nc, nd, U, nk, u, nu, pnt);
+  Py_END_ALLOW_THREADS
+  if (scratch_check(nfail) < 0) {
+    Py_DECREF(ret);
+    goto fail;
+  }
 
   /* Clean up and return */
   Py_DECREF(arr1);
@@ -2130,13 +2970,13 @@ static PyObject * curveDerivs(PyObject *self, PyObject *args)
 
   if(!PyArg_ParseTuple(args, "OOOi", &a1, &a2, &a3, &n))
     return NULL;
-  arr1 = PyArray_FROM_OTF(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr1 == NULL)
     return NULL;
-  arr2 = PyArray_FROM_OTF(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr2 = pf_from_otf(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr2 == NULL)
     goto fail;
-  arr3 = PyArray_FROM_OTF(a3, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr3 = pf_from_otf(a3, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr3 == NULL)
     goto fail;
 
@@ -2159,7 +2999,121 @@ static PyObject * curveDerivs(PyObject *self, PyObject *args)
   pnt = (double *)PYARRAY_DATA(ret);
 
   /* Compute */
+  int nfail = scratch_failures();
+  Py_BEGIN_ALLOW_THREADS
   curve_derivs(n, P, nc, nd, U, nk, u, nu, pnt);
+  Py_END_ALLOW_THREADS
+  if (scratch_check(nfail) < 0) {
+    Py_DECREF(ret);
+    goto fail;
+  }
+
+  /* Clean up and return */
+  Py_DECREF(arr1);
+  Py_DECREF(arr2);
+  Py_DECREF(arr3);
+  return ret;
+
+ fail:
+  Py_XDECREF(arr1);
+  Py_XDECREF(arr2);
+  Py_XDECREF(arr3);
+  return NULL;
+}
+
+
+static char curvesDerivs_doc[] = "\
+curvesDerivs(P, U, u, n)\n\
+\n\n\
+Compute points and derivatives of multiple B-spline curves.\n\
+\n\
+All the curves have the same knot sequence U (and thus the same degree)\n\
+and are evaluated at the same parametric values u. The span and basis\n\
+functions are computed only once for each parametric value. This is a\n\
+lot faster than calling :func:`curveDerivs` for every curve. If u is\n\
+sorted, the spans are found by walking forward through the knots.\n\
+\n\
+Parameters\n\
+----------\n\
+P: float array (ncurves, nc, nd)\n\
+    The nc control points (with nd being 3 or 4) of ncurves curves\n\
+U: float array (m+1)\n\
+    The knot sequence: U[0] .. U[m]\n\
+u: float array (nu)\n\
+    Parametric values where the curves are to be evaluated. All values\n\
+    should be in the range U[0] <= ui <= U[m].\n\
+n: int\n\
+    Highest derivative to compute. With n=0, only the points\n\
+    are computed.\n\
+\n\
+Returns\n\
+-------\n\
+float array (n+1, ncurves, nu, nd)\n\
+    Points and derivatives on the B-splines\n\
+\n\
+See Also\n\
+--------\n\
+:func:`plugins.nurbs.curvesPointsAt`: \n\
+    the safe way to use this function\n\
+";
+
+static PyObject * curvesDerivs(PyObject *self, PyObject *args)
+{
+  int ncv, nc, nd, nk, nu, n;
+  npy_intp *P_dim, dim[4];
+  double *P, *U, *u, *pnt;
+  PyObject *a1, *a2, *a3;
+  PyObject *arr1=NULL, *arr2=NULL, *arr3=NULL, *ret=NULL;
+
+  if(!PyArg_ParseTuple(args, "OOOi", &a1, &a2, &a3, &n))
+    return NULL;
+  if (n < 0) {
+    PyErr_SetString(PyExc_ValueError, "n should not be negative");
+    return NULL;
+  }
+  arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  if(arr1 == NULL)
+    return NULL;
+  arr2 = pf_from_otf(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  if(arr2 == NULL)
+    goto fail;
+  arr3 = pf_from_otf(a3, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  if(arr3 == NULL)
+    goto fail;
+  if (PyArray_NDIM((PyArrayObject *)arr1) != 3) {
+    PyErr_SetString(PyExc_ValueError, "P should be a 3-dim array");
+    goto fail;
+  }
+
+  P_dim = PYARRAY_DIMS(arr1);
+  ncv = P_dim[0];
+  nc = P_dim[1];
+  nd = P_dim[2];
+  nk = PyArray_SIZE((PyArrayObject *)arr2);
+  nu = PyArray_SIZE((PyArrayObject *)arr3);
+  P = (double *)PYARRAY_DATA(arr1);
+  U = (double *)PYARRAY_DATA(arr2);
+  u = (double *)PYARRAY_DATA(arr3);
+
+  /* Create the return array */
+  dim[0] = n+1;
+  dim[1] = ncv;
+  dim[2] = nu;
+  dim[3] = nd;
+  ret = PyArray_SimpleNew(4,dim, NPY_DOUBLE);
+  if (ret == NULL)
+    goto fail;
+  pnt = (double *)PYARRAY_DATA(ret);
+
+  /* Compute */
+  int nfail = scratch_failures();
+  Py_BEGIN_ALLOW_THREADS
+  curves_derivs(n, P, ncv, nc, nd, U, nk, u, nu, pnt);
+  Py_END_ALLOW_THREADS
+  if (scratch_check(nfail) < 0) {
+    Py_DECREF(ret);
+    goto fail;
+  }
 
   /* Clean up and return */
   Py_DECREF(arr1);
@@ -2207,10 +3161,10 @@ static PyObject * curveDecompose(PyObject *self, PyObject *args)
 
   if(!PyArg_ParseTuple(args, "OO", &a1, &a2))
     return NULL;
-  arr1 = PyArray_FROM_OTF(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr1 == NULL)
     return NULL;
-  arr2 = PyArray_FROM_OTF(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr2 = pf_from_otf(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr2 == NULL)
     goto fail;
 
@@ -2245,7 +3199,14 @@ static PyObject * curveDecompose(PyObject *self, PyObject *args)
   newP = (double *)PYARRAY_DATA(ret);
 
   /* Compute */
+  int nfail = scratch_failures();
+  Py_BEGIN_ALLOW_THREADS
   curve_decompose(P, nc, nd, U, nk, newP);
+  Py_END_ALLOW_THREADS
+  if (scratch_check(nfail) < 0) {
+    Py_DECREF(ret);
+    goto fail;
+  }
   //print_mat(newP,nc+count,nd);
 
   /* Clean up and return */
@@ -2260,6 +3221,87 @@ static PyObject * curveDecompose(PyObject *self, PyObject *args)
 }
 
 
+static char bezierExtraction_doc[] = "\
+bezierExtraction(U, p)\n\
+\n\n\
+Compute the Bezier extraction operator of a B-spline basis.\n\
+\n\
+Parameters\n\
+----------\n\
+U: float array (m+1)\n\
+    The knot sequence: U[0] .. U[m]\n\
+p: int\n\
+    The degree of the B-spline.\n\
+\n\
+Returns\n\
+-------\n\
+C: float array (nb, p+1, p+1)\n\
+    The extraction matrices of the nb Bezier segments.\n\
+span: int array (nb)\n\
+    The knot span index of each Bezier segment.\n\
+\n\
+Notes\n\
+-----\n\
+The Bezier control points of segment e of a curve with control points P\n\
+are C[e] @ P[span[e]-p:span[e]+1]. Subsequent segments share their end\n\
+points. The operator only depends on the knots and the degree, and gives\n\
+the same result as curveDecompose for any P.\n\
+";
+
+static PyObject * bezierExtraction(PyObject *self, PyObject *args)
+{
+  int nk, nb, p, *span;
+  npy_intp *U_dim, dim[3];
+  double *U, *C;
+  PyObject *a1;
+  PyObject *arr1=NULL, *ret1=NULL, *ret2=NULL;
+
+  if(!PyArg_ParseTuple(args, "Oi", &a1, &p))
+    return NULL;
+  arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  if(arr1 == NULL)
+    return NULL;
+
+  U_dim = PYARRAY_DIMS(arr1);
+  nk = U_dim[0];
+  U = (double *)PYARRAY_DATA(arr1);
+  if (p < 1 || nk < 2*(p+1)) {
+    PyErr_SetString(PyExc_ValueError, "Invalid degree or too few knots");
+    goto fail;
+  }
+
+  /* Create the return arrays */
+  nb = bezier_spans(U, nk, p, NULL);
+  dim[0] = nb;
+  dim[1] = p+1;
+  dim[2] = p+1;
+  ret1 = PyArray_SimpleNew(3, dim, NPY_DOUBLE);
+  ret2 = PyArray_SimpleNew(1, dim, NPY_INT);
+  if (ret1 == NULL || ret2 == NULL)
+    goto fail;
+  C = (double *)PYARRAY_DATA(ret1);
+  span = (int *)PYARRAY_DATA(ret2);
+
+  /* Compute */
+  bezier_spans(U, nk, p, span);
+  int nfail = scratch_failures();
+  Py_BEGIN_ALLOW_THREADS
+  bezier_extraction(U, nk, p, nb, span, C);
+  Py_END_ALLOW_THREADS
+  if (scratch_check(nfail) < 0) goto fail;
+
+  /* Clean up and return */
+  Py_DECREF(arr1);
+  return Py_BuildValue("NN", ret1, ret2);
+
+ fail:
+  Py_XDECREF(arr1);
+  Py_XDECREF(ret1);
+  Py_XDECREF(ret2);
+  return NULL;
+}
+
+
 static char curveKnotRefine_doc[] = "\
 curveKnotRefine(P, U, u)\n\
 \n\n\
@@ -2304,13 +3346,13 @@ static PyObject * curveKnotRefine(PyObject *self, PyObject *args)
 
   if(!PyArg_ParseTuple(args, "OOO", &a1, &a2, &a3))
     return NULL;
-  arr1 = PyArray_FROM_OTF(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr1 == NULL)
     return NULL;
-  arr2 = PyArray_FROM_OTF(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr2 = pf_from_otf(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr2 == NULL)
     goto fail;
-  arr3 = PyArray_FROM_OTF(a3, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr3 = pf_from_otf(a3, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr3 == NULL)
     goto fail;
 
@@ -2335,7 +3377,9 @@ static PyObject * curveKnotRefine(PyObject *self, PyObject *args)
   newU = (double *)PYARRAY_DATA(ret2);
 
   /* Compute */
+  Py_BEGIN_ALLOW_THREADS
   curve_knot_refine(P, nc, nd, U, nk, u, nu, newP, newU);
+  Py_END_ALLOW_THREADS
 
   /* Clean up and return */
   Py_DECREF(arr1);
@@ -2396,6 +3440,7 @@ Modified algorithm A5.8 from 'The NURBS Book' p.185.\n\
 
 static PyObject * curveKnotRemove(PyObject *self, PyObject *args)
 {
+  ScratchMark mark = scratch_mark();
   int *Um, iv, num, nd, nc, nv, nk, t, i, j, k, r, s;
   npy_intp *P_dim, *U_dim, dim[2];
   double *P, *Uv, tol, u, *newP, *newU;
@@ -2404,13 +3449,13 @@ static PyObject * curveKnotRemove(PyObject *self, PyObject *args)
 
   if(!PyArg_ParseTuple(args, "OOOiid", &a1, &a2, &a3, &iv, &num, &tol))
     return NULL;
-  arr1 = PyArray_FROM_OTF(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr1 == NULL)
     return NULL;
-  arr2 = PyArray_FROM_OTF(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr2 = pf_from_otf(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr2 == NULL)
     goto fail;
-  arr3 = PyArray_FROM_OTF(a3, NPY_INT, NPY_ARRAY_IN_ARRAY);
+  arr3 = pf_from_otf(a3, NPY_INT, NPY_ARRAY_IN_ARRAY);
   if(arr3 == NULL)
     goto fail;
 
@@ -2424,13 +3469,21 @@ static PyObject * curveKnotRemove(PyObject *self, PyObject *args)
   Um = (int *)PYARRAY_DATA(arr3);
 
   /* Compute derived data as needed by curve_knot_remove */
-  int *Sm = (int*) malloc(nv*sizeof(int));
+  int *Sm = scratch_ints(nv);
+  if (!Sm) {
+    PyErr_NoMemory();
+    goto fail;
+  }
   cumsum(Um,nv,Sm);
   /* printf("Cumsum: "); */
   /* for (i=0; i<nv; ++i) printf("%d, ",Sm[i]); */
   /* printf("\n"); */
   nk = Sm[nv-1];
-  double *U = (double*) malloc(nk*sizeof(double));
+  double *U = scratch_doubles(nk);
+  if (!U) {
+    PyErr_NoMemory();
+    goto fail;
+  }
   k = 0;
   for (i=0; i<nv; ++i)
     for (j=0; j<Um[i]; ++j)
@@ -2444,7 +3497,11 @@ static PyObject * curveKnotRemove(PyObject *self, PyObject *args)
   /* for (i=0; i<nk; ++i) printf("%f, ",U[i]); */
   /* printf("\n"); */
   /* printf("Remove knot value %f, index %d, multiplicity %d\n",u,r,s); */
+  int nfail = scratch_failures();
+  Py_BEGIN_ALLOW_THREADS
   t = curve_knot_remove(P, nc, nd, U, nk, u, num, r, s, tol);
+  Py_END_ALLOW_THREADS
+  if (scratch_check(nfail) < 0) goto fail;
 
   /* Create the return arrays */
   dim[0] = nc-t;
@@ -2458,15 +3515,15 @@ static PyObject * curveKnotRemove(PyObject *self, PyObject *args)
   for (i=0; i<dim[0]; ++i) newU[i] = U[i];
 
   /* Clean up and return */
-  free(U);
-  free(Sm);
   Py_DECREF(arr1);
   Py_DECREF(arr2);
+  scratch_release(mark);
   return Py_BuildValue("iOO",t,ret1,ret2);
 
  fail:
   Py_XDECREF(arr1);
   Py_XDECREF(arr2);
+  scratch_release(mark);
   return NULL;
 }
 
@@ -2505,6 +3562,7 @@ Modified algorithm A5.9 from 'The NURBS Book' p.206.\n\
 
 static PyObject * curveDegreeElevate(PyObject *self, PyObject *args)
 {
+  ScratchMark mark = scratch_mark();
   int nd, nc, nk, t, nq, nu, i;
   npy_intp *P_dim, *U_dim, dim[2];
   double *P, *U, *newP, *newU;
@@ -2513,10 +3571,10 @@ static PyObject * curveDegreeElevate(PyObject *self, PyObject *args)
 
   if(!PyArg_ParseTuple(args, "OOi", &a1, &a2, &t))
     return NULL;
-  arr1 = PyArray_FROM_OTF(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr1 == NULL)
     return NULL;
-  arr2 = PyArray_FROM_OTF(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr2 = pf_from_otf(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr2 == NULL)
     goto fail;
 
@@ -2532,11 +3590,19 @@ static PyObject * curveDegreeElevate(PyObject *self, PyObject *args)
   nq = nc*(t+1);
   nu = (t+1)*nk;
   /* printf("Create work spaces for %d new control points and %d new knots\n",nq,nu); */
-  double *Pw = (double*) malloc(nq*nd*sizeof(double));
-  double *Uw = (double*) malloc(nu*sizeof(double));
+  double *Pw = scratch_doubles(nq*nd);
+  double *Uw = scratch_doubles(nu);
+  if (!Pw || !Uw) {
+    PyErr_NoMemory();
+    goto fail;
+  }
 
   /* Compute */
+  int nfail = scratch_failures();
+  Py_BEGIN_ALLOW_THREADS
   curve_degree_elevate(P, nc, nd, U, nk, t, Pw, Uw, &nq, &nu);
+  Py_END_ALLOW_THREADS
+  if (scratch_check(nfail) < 0) goto fail;
   /* printf("Computed %d new control points\n",nq); */
   /* print_mat(Pw,nq,nd); */
   /* printf("Computed %d new knots\n",nu); */
@@ -2555,18 +3621,16 @@ static PyObject * curveDegreeElevate(PyObject *self, PyObject *args)
   for (i=0; i<nq*nd; ++i) newP[i] = Pw[i];
   for (i=0; i<nu; ++i) newU[i] = Uw[i];
 
-  /* free thw work spaces */
-  free(Pw);
-  free(Uw);
-
   /* Clean up and return */
   Py_DECREF(arr1);
   Py_DECREF(arr2);
+  scratch_release(mark);
   return Py_BuildValue("OO",ret1,ret2);
 
  fail:
   Py_XDECREF(arr1);
   Py_XDECREF(arr2);
+  scratch_release(mark);
   return NULL;
 }
 
@@ -2603,6 +3667,7 @@ Modified algorithm A5.9 from 'The NURBS Book' p.206.\n\
 
 static PyObject * curveDegreeReduce(PyObject *self, PyObject *args)
 {
+  ScratchMark mark = scratch_mark();
   int nd, nc, nk, nq, nu, i;
   npy_intp *P_dim, *U_dim, dim[2];
   double *P, *U, *newP, *newU;
@@ -2611,10 +3676,10 @@ static PyObject * curveDegreeReduce(PyObject *self, PyObject *args)
 
   if(!PyArg_ParseTuple(args, "OO", &a1, &a2))
     return NULL;
-  arr1 = PyArray_FROM_OTF(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr1 == NULL)
     return NULL;
-  arr2 = PyArray_FROM_OTF(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr2 = pf_from_otf(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr2 == NULL)
     goto fail;
 
@@ -2630,11 +3695,19 @@ static PyObject * curveDegreeReduce(PyObject *self, PyObject *args)
   nq = 2*nc;
   nu = 2*nk;
   /* printf("Create work spaces for %d new control points and %d new knots\n",nq,nu); */
-  double *Pw = (double*) malloc(nq*nd*sizeof(double));
-  double *Uw = (double*) malloc(nu*sizeof(double));
+  double *Pw = scratch_doubles(nq*nd);
+  double *Uw = scratch_doubles(nu);
+  if (!Pw || !Uw) {
+    PyErr_NoMemory();
+    goto fail;
+  }
 
   /* Compute */
+  int nfail = scratch_failures();
+  Py_BEGIN_ALLOW_THREADS
   curve_degree_reduce(P, nc, nd, U, nk, Pw, Uw, &nq, &nu);
+  Py_END_ALLOW_THREADS
+  if (scratch_check(nfail) < 0) goto fail;
   /* printf("Computed %d new control points\n",nq); */
   /* print_mat(Pw,nq,nd); */
   /* printf("Computed %d new knots\n",nu); */
@@ -2653,18 +3726,16 @@ static PyObject * curveDegreeReduce(PyObject *self, PyObject *args)
   for (i=0; i<nq*nd; ++i) newP[i] = Pw[i];
   for (i=0; i<nu; ++i) newU[i] = Uw[i];
 
-  /* free thw work spaces */
-  free(Pw);
-  free(Uw);
-
   /* Clean up and return */
   Py_DECREF(arr1);
   Py_DECREF(arr2);
+  scratch_release(mark);
   return Py_BuildValue("OO", ret1, ret2);
 
  fail:
   Py_XDECREF(arr1);
   Py_XDECREF(arr2);
+  scratch_release(mark);
   return NULL;
 }
 
@@ -2713,7 +3784,7 @@ static PyObject * curveGlobalInterpolationMatrix(PyObject *self, PyObject *args)
 
     if (!PyArg_ParseTuple(args, "Oiii", &a1, &p, &t0, &t1))
 	return NULL;
-    arr1 = PyArray_FROM_OTF(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+    arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
     if(arr1 == NULL)
 	return NULL;
     u = (double *)PYARRAY_DATA(arr1);
@@ -2735,7 +3806,16 @@ static PyObject * curveGlobalInterpolationMatrix(PyObject *self, PyObject *args)
     A = (double *)PYARRAY_DATA(ret2);
 
     /* Compute */
+    int nfail = scratch_failures();
+    Py_BEGIN_ALLOW_THREADS
     curve_global_interp_mat(p, nc, nu, t0, t1, u, U, A);
+    Py_END_ALLOW_THREADS
+    if (scratch_check(nfail) < 0) {
+	Py_DECREF(arr1);
+	Py_DECREF(ret1);
+	Py_DECREF(ret2);
+	return NULL;
+    }
 
     /* Clean up and return */
     Py_DECREF(arr1);
@@ -2745,6 +3825,138 @@ static PyObject * curveGlobalInterpolationMatrix(PyObject *self, PyObject *args)
 
 
 
+static char curveGlobalInterpolation_doc[] = "\
+curveGlobalInterpolation(Q, u, p, D0=None, D1=None)\n\
+\n\n\
+Compute a global interpolation curve through a set of points.\n\
+\n\
+Parameters\n\
+----------\n\
+Q: float array (nc, nd)\n\
+    The nc points through which the curve should pass.\n\
+u: float array (nc)\n\
+    The parameter values at the nc points\n\
+p: int\n\
+    The degree of the B-spline to construct.\n\
+D0: float array (nd), optional\n\
+    The derivative of the curve at the start point Q[0].\n\
+D1: float array (nd), optional\n\
+    The derivative of the curve at the end point Q[nc-1].\n\
+\n\
+Returns\n\
+-------\n\
+U: float array (nu+p+1)\n\
+    The knot sequence, with nu = nc + 1 for each end derivative given.\n\
+P: float array (nu, nd)\n\
+    The control points of the interpolating curve.\n\
+\n\
+See Also\n\
+--------\n\
+curveGlobalInterpolationMatrix: the full coefficient matrix of the system\n\
+\n\
+Notes\n\
+-----\n\
+This solves the same system as curveGlobalInterpolationMatrix, but\n\
+stores the coefficient matrix in banded form and uses a banded LU\n\
+solver. It needs O(nc*p) memory and O(nc*p*p) time, and can be used\n\
+for a very large number of points.\n\
+\n\
+Modified algorithm A9.1 from 'The NURBS Book' p.369.\n\
+";
+
+static PyObject * curveGlobalInterpolation(PyObject *self, PyObject *args)
+{
+    int p, nc, nd, nu, ret;
+    npy_intp *Q_dim, *u_dim, dim[2];
+    double *Q, *u, *D0=NULL, *D1=NULL, *U, *P;
+    PyObject *a1, *a2, *a3=Py_None, *a4=Py_None;
+    PyObject *arr1=NULL, *arr2=NULL, *arr3=NULL, *arr4=NULL, *ret1=NULL, *ret2=NULL;
+
+    if (!PyArg_ParseTuple(args, "OOi|OO", &a1, &a2, &p, &a3, &a4))
+	return NULL;
+    arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+    if(arr1 == NULL)
+	return NULL;
+    arr2 = pf_from_otf(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+    if(arr2 == NULL)
+	goto fail;
+    if (PyArray_NDIM((PyArrayObject *)arr1) != 2) {
+	PyErr_SetString(PyExc_ValueError, "Q should be a 2-dim array");
+	goto fail;
+    }
+    if (PyArray_NDIM((PyArrayObject *)arr2) != 1) {
+	PyErr_SetString(PyExc_ValueError, "u should be a 1-dim array");
+	goto fail;
+    }
+    Q_dim = PYARRAY_DIMS(arr1);
+    u_dim = PYARRAY_DIMS(arr2);
+    nc = Q_dim[0];
+    nd = Q_dim[1];
+    if (u_dim[0] != nc || nc < 2 || p < 1) {
+	PyErr_SetString(PyExc_ValueError, "Invalid number of points or parameter values");
+	goto fail;
+    }
+    Q = (double *)PYARRAY_DATA(arr1);
+    u = (double *)PYARRAY_DATA(arr2);
+    if (a3 != Py_None) {
+	arr3 = pf_from_otf(a3, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+	if(arr3 == NULL)
+	    goto fail;
+	D0 = (double *)PYARRAY_DATA(arr3);
+    }
+    if (a4 != Py_None) {
+	arr4 = pf_from_otf(a4, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+	if(arr4 == NULL)
+	    goto fail;
+	D1 = (double *)PYARRAY_DATA(arr4);
+    }
+    if ((arr3 && PyArray_SIZE((PyArrayObject *)arr3) != nd) ||
+	(arr4 && PyArray_SIZE((PyArrayObject *)arr4) != nd)) {
+	PyErr_SetString(PyExc_ValueError, "The end derivatives should have the dimension of the points");
+	goto fail;
+    }
+    nu = nc + (D0 != NULL) + (D1 != NULL);
+
+    /* Create the return arrays */
+    dim[0] = nu + p + 1;
+    ret1 = PyArray_SimpleNew(1, dim, NPY_DOUBLE);
+    dim[0] = nu;
+    dim[1] = nd;
+    ret2 = PyArray_SimpleNew(2, dim, NPY_DOUBLE);
+    if (ret1 == NULL || ret2 == NULL)
+	goto fail;
+    U = (double *)PYARRAY_DATA(ret1);
+    P = (double *)PYARRAY_DATA(ret2);
+
+    /* Compute */
+    int nfail = scratch_failures();
+    Py_BEGIN_ALLOW_THREADS
+    ret = curve_global_interp(p, nc, nd, Q, u, D0, D1, U, P);
+    Py_END_ALLOW_THREADS
+    if (scratch_check(nfail) < 0) goto fail;
+    if (ret != 0) {
+	PyErr_SetString(PyExc_ValueError, "Singular interpolation system");
+	goto fail;
+    }
+
+    /* Clean up and return */
+    Py_DECREF(arr1);
+    Py_DECREF(arr2);
+    Py_XDECREF(arr3);
+    Py_XDECREF(arr4);
+    return Py_BuildValue("NN", ret1, ret2);
+
+ fail:
+    Py_XDECREF(arr1);
+    Py_XDECREF(arr2);
+    Py_XDECREF(arr3);
+    Py_XDECREF(arr4);
+    Py_XDECREF(ret1);
+    Py_XDECREF(ret2);
+    return NULL;
+}
+
+
 static char cubicSplineInterpolation_doc[] = "\
 cubicSplineInterpolation(Q, t0, t1, U)\n\
 \n\n\
@@ -2784,16 +3996,16 @@ static PyObject * cubicSplineInterpolation(PyObject *self, PyObject *args)
 
     if(!PyArg_ParseTuple(args, "OOOO", &a1, &a2, &a3, &a4))
 	return NULL;
-    arr1 = PyArray_FROM_OTF(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+    arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
     if(arr1 == NULL)
 	return NULL;
-    arr2 = PyArray_FROM_OTF(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+    arr2 = pf_from_otf(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
     if(arr2 == NULL)
 	goto fail;
-    arr3 = PyArray_FROM_OTF(a3, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+    arr3 = pf_from_otf(a3, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
     if(arr3 == NULL)
 	goto fail;
-    arr4 = PyArray_FROM_OTF(a4, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+    arr4 = pf_from_otf(a4, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
     if(arr4 == NULL)
 	goto fail;
 
@@ -2816,7 +4028,14 @@ static PyObject * cubicSplineInterpolation(PyObject *self, PyObject *args)
     P = (double *)PYARRAY_DATA(ret1);
 
     /* Compute */
+    int nfail = scratch_failures();
+    Py_BEGIN_ALLOW_THREADS
     cubic_spline_interpolation(Q,t0,t1,U,nc,nd,P);
+    Py_END_ALLOW_THREADS
+    if (scratch_check(nfail) < 0) {
+      Py_DECREF(ret1);
+      goto fail;
+    }
 
     /* Clean up and return */
     Py_DECREF(arr1);
@@ -2887,16 +4106,16 @@ static PyObject * surfacePoints(PyObject *self, PyObject *args)
 
   if (!PyArg_ParseTuple(args, "OOOO", &a1, &a2, &a3, &a4))
     return NULL;
-  arr1 = PyArray_FROM_OTF(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr1 == NULL)
     return NULL;
-  arr2 = PyArray_FROM_OTF(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr2 = pf_from_otf(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr2 == NULL)
     goto fail;
-  arr3 = PyArray_FROM_OTF(a3, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr3 = pf_from_otf(a3, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr3 == NULL)
     goto fail;
-  arr4 = PyArray_FROM_OTF(a4, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr4 = pf_from_otf(a4, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr4 == NULL)
     goto fail;
 
@@ -2922,7 +4141,14 @@ static PyObject * surfacePoints(PyObject *self, PyObject *args)
   pnt = (double *)PYARRAY_DATA(ret);
 
   /* Compute */
+  int nfail = scratch_failures();
+  Py_BEGIN_ALLOW_THREADS
   surface_points(P,ns,nt,nd,U,nU,V,nV,u,nu,pnt);
+  Py_END_ALLOW_THREADS
+  if (scratch_check(nfail) < 0) {
+    Py_DECREF(ret);
+    goto fail;
+  }
 
   /* Clean up and return */
   Py_DECREF(arr1);
@@ -2941,6 +4167,124 @@ static PyObject * surfacePoints(PyObject *self, PyObject *args)
 }
 
 
+static char surfaceGridPoints_doc[] = "\
+surfaceGridPoints(P, U, V, u, v)\n\
+\n\n\
+Compute points on a B-spline surface at a grid of parametric values.\n\
+This is like :func:`surfacePoints`, but evaluates the surface at all\n\
+combinations (ui, vj) of nu parametric values u and nv values v.\n\
+The basis functions are computed only once for each ui and each vj,\n\
+making this much faster than surfacePoints for a grid of points.\n\
+\n\
+Parameters\n\
+----------\n\
+P: float array (ns, nt, nd)\n\
+    The grid of ns * nt control points of dimension 3 or 4\n\
+U: float array (nU)\n\
+    The knot sequence in direction u\n\
+V: float array (nV)\n\
+    The knot sequence in direction v\n\
+u: float array (nu)\n\
+    The parametric values in direction u.\n\
+v: float array (nv)\n\
+    The parametric values in direction v.\n\
+    All values should be in their respective parameter range.\n\
+\n\
+Returns\n\
+-------\n\
+float array (nu,nv,nd)\n\
+    The points on the B-spline surface: the item [i,j] is the\n\
+    point at (u[i], v[j]).\n\
+\n\
+See Also\n\
+--------\n\
+:func:`plugins.nurbs.NurbsSurface.gridPointsAt`: \n\
+    the safe way to use this function\n\
+surfacePoints: compute points on a B-spline surface\n\
+";
+
+
+static PyObject * surfaceGridPoints(PyObject *self, PyObject *args)
+{
+  int ns,nt,nd,nU,nV,nu,nv;
+  npy_intp *P_dim, dim[3];
+  double *P, *U, *V, *u, *v, *pnt;
+  PyObject *a1, *a2, *a3, *a4, *a5;
+  PyObject *arr1=NULL, *arr2=NULL, *arr3=NULL, *arr4=NULL, *arr5=NULL, *ret=NULL;
+
+  if (!PyArg_ParseTuple(args, "OOOOO", &a1, &a2, &a3, &a4, &a5))
+    return NULL;
+  arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  if(arr1 == NULL)
+    return NULL;
+  arr2 = pf_from_otf(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  if(arr2 == NULL)
+    goto fail;
+  arr3 = pf_from_otf(a3, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  if(arr3 == NULL)
+    goto fail;
+  arr4 = pf_from_otf(a4, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  if(arr4 == NULL)
+    goto fail;
+  arr5 = pf_from_otf(a5, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  if(arr5 == NULL)
+    goto fail;
+  if (PyArray_NDIM((PyArrayObject *)arr1) != 3) {
+    PyErr_SetString(PyExc_ValueError, "P should be a 3-dim array");
+    goto fail;
+  }
+
+  P_dim = PYARRAY_DIMS(arr1);
+  ns = P_dim[0];
+  nt = P_dim[1];
+  nd = P_dim[2];
+  nU = PyArray_SIZE((PyArrayObject *)arr2);
+  nV = PyArray_SIZE((PyArrayObject *)arr3);
+  nu = PyArray_SIZE((PyArrayObject *)arr4);
+  nv = PyArray_SIZE((PyArrayObject *)arr5);
+  P = (double *)PYARRAY_DATA(arr1);
+  U = (double *)PYARRAY_DATA(arr2);
+  V = (double *)PYARRAY_DATA(arr3);
+  u = (double *)PYARRAY_DATA(arr4);
+  v = (double *)PYARRAY_DATA(arr5);
+
+  /* Create the return array */
+  dim[0] = nu;
+  dim[1] = nv;
+  dim[2] = nd;
+  ret = PyArray_SimpleNew(3,dim, NPY_DOUBLE);
+  if (ret == NULL)
+    goto fail;
+  pnt = (double *)PYARRAY_DATA(ret);
+
+  /* Compute */
+  int nfail = scratch_failures();
+  Py_BEGIN_ALLOW_THREADS
+  surface_grid_points(P,ns,nt,nd,U,nU,V,nV,u,nu,v,nv,pnt);
+  Py_END_ALLOW_THREADS
+  if (scratch_check(nfail) < 0) {
+    Py_DECREF(ret);
+    goto fail;
+  }
+
+  /* Clean up and return */
+  Py_DECREF(arr1);
+  Py_DECREF(arr2);
+  Py_DECREF(arr3);
+  Py_DECREF(arr4);
+  Py_DECREF(arr5);
+  return ret;
+
+ fail:
+  Py_XDECREF(arr1);
+  Py_XDECREF(arr2);
+  Py_XDECREF(arr3);
+  Py_XDECREF(arr4);
+  Py_XDECREF(arr5);
+  return NULL;
+}
+
+
 static char surfaceDerivs_doc[] = "\
 surfaceDerivs(P, U, V, u, mu, mv)\n\
 \n\n\
@@ -2992,16 +4336,16 @@ static PyObject * surfaceDerivs(PyObject *self, PyObject *args)
 
   if(!PyArg_ParseTuple(args, "OOOOii", &a1, &a2, &a3, &a4, &mu, &mv))
     return NULL;
-  arr1 = PyArray_FROM_OTF(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr1 = pf_from_otf(a1, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr1 == NULL)
     return NULL;
-  arr2 = PyArray_FROM_OTF(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr2 = pf_from_otf(a2, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr2 == NULL)
     goto fail;
-  arr3 = PyArray_FROM_OTF(a3, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr3 = pf_from_otf(a3, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr3 == NULL)
     goto fail;
-  arr4 = PyArray_FROM_OTF(a4, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+  arr4 = pf_from_otf(a4, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
   if(arr4 == NULL)
     goto fail;
 
@@ -3029,7 +4373,14 @@ static PyObject * surfaceDerivs(PyObject *self, PyObject *args)
   pnt = (double *)PYARRAY_DATA(ret);
 
   /* Compute */
+  int nfail = scratch_failures();
+  Py_BEGIN_ALLOW_THREADS
   surface_derivs(mu,mv,P,ns,nt,nd,U,nU,V,nV,u,nu,pnt);
+  Py_END_ALLOW_THREADS
+  if (scratch_check(nfail) < 0) {
+    Py_DECREF(ret);
+    goto fail;
+  }
 
   /* Clean up and return */
   Py_DECREF(arr1);
@@ -3057,15 +4408,20 @@ static PyMethodDef extension_methods[] =
   {"basisDerivs", basisDerivs, METH_VARARGS, basisDerivs_doc},
   {"curvePoints", curvePoints, METH_VARARGS, curvePoints_doc},
   {"curveDerivs", curveDerivs, METH_VARARGS, curveDerivs_doc},
+  {"curvesDerivs", curvesDerivs, METH_VARARGS, curvesDerivs_doc},
   {"curveDecompose", curveDecompose, METH_VARARGS, curveDecompose_doc},
+  {"bezierExtraction", bezierExtraction, METH_VARARGS, bezierExtraction_doc},
   {"curveKnotRefine", curveKnotRefine, METH_VARARGS, curveKnotRefine_doc},
   {"curveKnotRemove", curveKnotRemove, METH_VARARGS, curveKnotRemove_doc},
   {"curveDegreeElevate", curveDegreeElevate, METH_VARARGS, curveDegreeElevate_doc},
   {"curveDegreeReduce", curveDegreeReduce, METH_VARARGS, curveDegreeReduce_doc},
   {"curveGlobalInterpolationMatrix", curveGlobalInterpolationMatrix, METH_VARARGS, curveGlobalInterpolationMatrix_doc},
+  {"curveGlobalInterpolation", curveGlobalInterpolation, METH_VARARGS, curveGlobalInterpolation_doc},
   {"cubicSplineInterpolation", cubicSplineInterpolation, METH_VARARGS, cubicSplineInterpolation_doc},
   {"surfacePoints", surfacePoints, METH_VARARGS, surfacePoints_doc},
+  {"surfaceGridPoints", surfaceGridPoints, METH_VARARGS, surfaceGridPoints_doc},
   {"surfaceDerivs", surfaceDerivs, METH_VARARGS, surfaceDerivs_doc},
+  PF_THREAD_METHODS
   {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
@@ -3092,6 +4448,10 @@ PyObject *PyInit_nurbs_c(void)
   PyModule_AddStringConstant(m,"__doc__",__doc__);
   PyModule_AddIntConstant(m,"_accelerated",1);
   import_array(); /* Get access to numpy array API */
+  pf_instrument(m, extension_methods);
+  pf_scratch_reset = scratch_stat_reset;
+  pf_scratch_peak = scratch_stat_peak;
+  _factln_init();
   return m;
 }
 
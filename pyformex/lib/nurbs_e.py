@@ -770,6 +770,50 @@ def curveGlobalInterpolationMatrix(u, p, t0, t1):
     return U, A
 
 
+def curveGlobalInterpolation(Q, u, p, D0=None, D1=None):
+    """Compute a global interpolation curve through a set of points.
+
+    Parameters
+    ----------
+    Q: float array (nc, nd)
+        The nc points through which the curve should pass.
+    u: float array (nc)
+        The parameter values at the nc points.
+    p: int
+        The degree of the B-spline to construct.
+    D0: float array (nd), optional
+        The derivative of the curve at the start point Q[0].
+    D1: float array (nd), optional
+        The derivative of the curve at the end point Q[nc-1].
+
+    Returns
+    -------
+    U: float array (nu+p+1)
+        The knot sequence, with nu = nc + 1 for each end derivative given.
+    P: float array (nu, nd)
+        The control points of the interpolating curve.
+
+    Notes
+    -----
+    The compiled version solves the system in banded form. This version
+    solves the full system from :func:`curveGlobalInterpolationMatrix`.
+    """
+    Q = np.asarray(Q, dtype=np.double)
+    u = np.asarray(u, dtype=np.double)
+    t0 = int(D0 is not None)
+    t1 = int(D1 is not None)
+    U, A = curveGlobalInterpolationMatrix(u, p, t0, t1)
+    B = [Q[:1]]
+    if t0:
+        B.append(np.reshape(D0, (1, -1)) * U[p+1] / p)
+    B.append(Q[1:-1])
+    if t1:
+        B.append(np.reshape(D1, (1, -1)) * (1.0-U[-(p+2)]) / p)
+    B.append(Q[-1:])
+    P = np.linalg.solve(A, np.concatenate(B))
+    return U, P
+
+
 # TODO: merge with curveGlobalInterpolationMatrix
 # TODO: implement in nurbs_c
 def curveGlobalInterpolationMatrix2(Q, D, u, p):
@@ -0,0 +1,323 @@
+/* */
+//
+//  SPDX-FileCopyrightText: © 2007-2023 Benedict Verhegghe <bverheg@gmail.com>
+//  SPDX-License-Identifier: GPL-3.0-or-later
+//
+//  This file is part of pyFormex 3.3  (Sun Mar 26 20:16:15 CEST 2023)
+//  pyFormex is a tool for generating, manipulating and transforming 3D
+//  geometrical models by sequences of mathematical operations.
+//  Home page: https://pyformex.org
+//  Project page: https://savannah.nongnu.org/projects/pyformex/
+//  Development: https://gitlab.com/bverheg/pyformex
+//  Distributed under the GNU General Public License version 3 or later.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see http://www.gnu.org/licenses/.
+//
+
+/*
+   Runtime support shared by the pyFormex C extensions (misc_c, nurbs_c,
+   clust_c). Include this after numpy/arrayobject.h.
+
+   Threads
+   -------
+   All parallel loops run on the OpenMP thread pool of the process.
+   The pool is shared by all extensions (they link the same OpenMP
+   runtime) and is started lazily, at the first parallel region.
+   The number of threads used by a module is set with its
+   set_num_threads() function; pyformex.lib calls it for all modules
+   from the 'lib/nthreads' setting or the PYFORMEX_NTHREADS environment
+   variable. Every parallel region should use num_threads(pf_threads()).
+
+   The long running kernels release the GIL while computing, so that
+   other Python threads can run alongside them.
+
+   Statistics
+   ----------
+   When enabled with enable_stats(1), the module functions are replaced
+   by wrappers that count the calls and their wall time, and make the
+   counters of the function current for the kernel. When disabled, the
+   original functions are put back, so the only cost left is a test of
+   pf_cur in the PF_STAT macros and pf_from_otf. The current function
+   is kept per thread: while a kernel has released the GIL, a function
+   called from another Python thread has its own pf_cur, and each
+   wrapper restores the pf_cur of its own thread. The counters are only
+   updated while holding the GIL: kernels that release it should
+   record their counts after Py_END_ALLOW_THREADS.
+*/
+#ifndef PFLIB_H
+#define PFLIB_H
+
+#include <string.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+/* Storage class for per thread variables */
+#if defined(_MSC_VER)
+#define PF_THREAD_LOCAL __declspec(thread)
+#else
+#define PF_THREAD_LOCAL __thread
+#endif
+
+/* Requested number of threads; 0 uses the OpenMP default */
+static int pf_nthreads = 0;
+
+/* Number of threads to be used in parallel regions */
+static int pf_threads(void)
+{
+#ifdef _OPENMP
+  return pf_nthreads > 0 ? pf_nthreads : omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+static char pf_set_num_threads_doc[] = "\
+set_num_threads(n)\n\
+\n\
+Set the number of threads used by the parallel loops of this module.\n\
+\n\
+A value <= 0 restores the OpenMP default (OMP_NUM_THREADS or the\n\
+number of processors). Returns the number of threads that will be used.\n\
+";
+
+static PyObject * pf_set_num_threads(PyObject *dummy, PyObject *args)
+{
+  int n;
+  if (!PyArg_ParseTuple(args, "i", &n)) return NULL;
+  pf_nthreads = n > 0 ? n : 0;
+  return Py_BuildValue("i", pf_threads());
+}
+
+static char pf_num_threads_doc[] = "\
+num_threads()\n\
+\n\
+Return the number of threads used by the parallel loops of this module.\n\
+";
+
+static PyObject * pf_num_threads(PyObject *dummy, PyObject *args)
+{
+  return Py_BuildValue("i", pf_threads());
+}
+
+/* Per function statistics */
+typedef struct {
+  PyMethodDef *def;		/* the original method */
+  long calls;			/* number of calls */
+  double time;			/* cumulative wall time (s) */
+  double copied;		/* bytes copied converting input arrays */
+  double scratch;		/* peak scratch memory allocated in a call */
+  double iters;			/* algorithm iterations */
+  double items;			/* output items (triangles, segments, ...) */
+} PF_STAT;
+
+#define PF_MAXSTAT 64
+
+static PyObject *pf_module = NULL;
+static PF_STAT pf_stat_table[PF_MAXSTAT];
+static PyMethodDef pf_stat_defs[PF_MAXSTAT];
+static int pf_nstat = 0;
+static int pf_stats_enabled = 0;
+
+/* Statistics of the function running in this thread, or NULL */
+static PF_THREAD_LOCAL PF_STAT *pf_cur = NULL;
+
+/* Optional scratch memory tracking of the module: pf_scratch_reset()
+   starts a new high-water mark, pf_scratch_peak() returns the peak
+   number of bytes in use since that reset */
+static void (*pf_scratch_reset)(void) = NULL;
+static size_t (*pf_scratch_peak)(void) = NULL;
+
+/* Counter updates, to be used while holding the GIL */
+#define PF_STAT_SCRATCH(n) \
+  if (pf_cur && (double)(n) > pf_cur->scratch) pf_cur->scratch = (double)(n)
+#define PF_STAT_ITERS(n) if (pf_cur) pf_cur->iters += (n)
+#define PF_STAT_ITEMS(n) if (pf_cur) pf_cur->items += (n)
+#define PF_STAT_COPIED(arr) \
+  if (pf_cur) pf_cur->copied += PyArray_NBYTES((PyArrayObject *)(arr))
+
+/* Monotonic wall clock time in seconds */
+static double pf_wtime(void)
+{
+#if defined(_OPENMP)
+  return omp_get_wtime();
+#elif defined(_WIN32)
+  LARGE_INTEGER freq, count;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1.e-9 * ts.tv_nsec;
+#endif
+}
+
+/* PyArray_FROM_OTF, counting the bytes if a copy is made */
+static PyObject * pf_from_otf(PyObject *obj, int type, int flags)
+{
+  PyObject *arr = PyArray_FROM_OTF(obj, type, flags);
+  if (arr != NULL && arr != obj) PF_STAT_COPIED(arr);
+  return arr;
+}
+
+/* Wrapper calling the method with index self and recording its stats */
+static PyObject * pf_stat_call(PyObject *self, PyObject *args)
+{
+  PF_STAT *st = &pf_stat_table[PyLong_AsLong(self)];
+  PF_STAT *prev = pf_cur;
+  PyObject *res;
+  size_t scratch;
+  double t;
+  if (pf_scratch_reset) pf_scratch_reset();
+  t = pf_wtime();
+  pf_cur = st;
+  res = st->def->ml_meth(pf_module, args);
+  pf_cur = prev;
+  st->time += pf_wtime() - t;
+  st->calls++;
+  if (pf_scratch_peak) {
+    scratch = pf_scratch_peak();
+    if ((double)scratch > st->scratch) st->scratch = (double)scratch;
+  }
+  return res;
+}
+
+/* Register the module functions to be instrumented. Call this from
+   the module init function, after creating the module. */
+static void pf_instrument(PyObject *module, PyMethodDef *methods)
+{
+  PyMethodDef *def;
+  pf_module = module;
+  for (def = methods; def->ml_name && pf_nstat < PF_MAXSTAT; def++) {
+    if (def->ml_meth == pf_set_num_threads) break;
+    if (def->ml_flags != METH_VARARGS) continue;
+    pf_stat_table[pf_nstat].def = def;
+    pf_stat_defs[pf_nstat] = *def;
+    pf_stat_defs[pf_nstat].ml_meth = pf_stat_call;
+    pf_nstat++;
+  }
+}
+
+static char pf_enable_stats_doc[] = "\
+enable_stats(flag)\n\
+\n\
+Enable (flag=1) or disable (flag=0) the statistics of this module.\n\
+\n\
+While enabled, the module functions are replaced with wrappers that\n\
+record the statistics. References to the functions obtained before\n\
+enabling are not counted. Returns the previous state.\n\
+";
+
+static PyObject * pf_enable_stats(PyObject *dummy, PyObject *args)
+{
+  int flag, i, prev = pf_stats_enabled;
+  PyObject *name, *func, *index;
+  if (!PyArg_ParseTuple(args, "p", &flag)) return NULL;
+  if (flag != prev && pf_module) {
+    name = PyModule_GetNameObject(pf_module);
+    if (name == NULL) return NULL;
+    for (i = 0; i < pf_nstat; i++) {
+      if (flag) {
+	index = PyLong_FromLong(i);
+	if (index == NULL) goto fail;
+	func = PyCFunction_NewEx(&pf_stat_defs[i], index, name);
+	Py_DECREF(index);
+      }
+      else
+	func = PyCFunction_NewEx(pf_stat_table[i].def, pf_module, name);
+      if (func == NULL) goto fail;
+      if (PyModule_AddObject(pf_module, pf_stat_table[i].def->ml_name, func) < 0) {
+	Py_DECREF(func);
+	goto fail;
+      }
+    }
+    Py_DECREF(name);
+    pf_stats_enabled = flag;
+  }
+  return PyBool_FromLong(prev);
+
+ fail:
+  Py_DECREF(name);
+  return NULL;
+}
+
+static char pf_stats_doc[] = "\
+stats()\n\
+\n\
+Return the statistics of the functions of this module.\n\
+\n\
+Returns a dict with the function names as keys and as values a dict\n\
+with the counters: calls, time (cumulative wall time in seconds),\n\
+copied (bytes copied while converting input arrays), scratch (the\n\
+largest scratch memory in use during a single call, in bytes), iters\n\
+(algorithm iterations) and items (output items, like triangles or\n\
+segments). Only functions that were called are included.\n\
+";
+
+static PyObject * pf_stats(PyObject *dummy, PyObject *args)
+{
+  int i;
+  PF_STAT *st;
+  PyObject *dict, *item;
+  dict = PyDict_New();
+  if (dict == NULL) return NULL;
+  for (i = 0; i < pf_nstat; i++) {
+    st = &pf_stat_table[i];
+    if (st->calls == 0) continue;
+    item = Py_BuildValue("{s:l,s:d,s:d,s:d,s:d,s:d}", "calls", st->calls,
+			 "time", st->time, "copied", st->copied,
+			 "scratch", st->scratch, "iters", st->iters,
+			 "items", st->items);
+    if (item == NULL || PyDict_SetItemString(dict, st->def->ml_name, item) < 0) {
+      Py_XDECREF(item);
+      Py_DECREF(dict);
+      return NULL;
+    }
+    Py_DECREF(item);
+  }
+  return dict;
+}
+
+static char pf_reset_stats_doc[] = "\
+reset_stats()\n\
+\n\
+Reset all the statistics of this module to zero.\n\
+";
+
+static PyObject * pf_reset_stats(PyObject *dummy, PyObject *args)
+{
+  int i;
+  PyMethodDef *def;
+  for (i = 0; i < pf_nstat; i++) {
+    def = pf_stat_table[i].def;
+    memset(&pf_stat_table[i], 0, sizeof(PF_STAT));
+    pf_stat_table[i].def = def;
+  }
+  Py_RETURN_NONE;
+}
+
+/* Entries for the module method table. These should come after the
+   functions to be instrumented. */
+#define PF_THREAD_METHODS \
+  {"set_num_threads", pf_set_num_threads, METH_VARARGS, pf_set_num_threads_doc}, \
+  {"num_threads", pf_num_threads, METH_NOARGS, pf_num_threads_doc}, \
+  {"enable_stats", pf_enable_stats, METH_VARARGS, pf_enable_stats_doc}, \
+  {"stats", pf_stats, METH_NOARGS, pf_stats_doc}, \
+  {"reset_stats", pf_reset_stats, METH_NOARGS, pf_reset_stats_doc},
+
+#endif /* PFLIB_H */
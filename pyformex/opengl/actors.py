@@ -31,6 +31,7 @@ This module defines all OpenGL Actors that are directly available to the users.
 """
 import numpy as np
 from numpy import int32, float32
+from OpenGL.arrays.vbo import VBO
 from .gl import GL
 
 import pyformex as pf
@@ -48,6 +49,7 @@ if not pf.sphinx and pf.options.gl3:
     from pyformex.opengl3.drawable import Actor
 else:
     from .drawable import Actor
+from .drawable import PatchDrawable
 
 # We import the other Actors, so they they all can be imported from actors.
 from .textext import *
@@ -75,4 +77,109 @@ class PlaneActor(Actor):
 
 
 
+class PatchActor(Actor):
+    """A NURBS surface rendered with hardware tessellation.
+
+    The surface is decomposed into Bezier patches, and only their control
+    points are uploaded. The patches are tessellated on the GPU with a
+    level of detail depending on their size on the screen.
+
+    A dense quad mesh approximation of the surface is only created when
+    it is needed: for drawing the wires, for picking and highlighting,
+    and for drawing the faces if tessellation shaders are not available.
+    Until then, the Actor geometry is a single quad per patch, through
+    the patch corners.
+
+    Parameters
+    ----------
+    surface: NurbsSurface
+        The surface to draw.
+    ndiv: int | tuple of int
+        The number of divisions of the quad mesh approximation.
+    **kargs:
+        Other Actor parameters.
+    """
+    def __init__(self, surface, ndiv=100, **kargs):
+        X = surface.bezierPatches()
+        # The patch corners are on the surface
+        corners = X[:, :, [0, 0, -1, -1], [0, -1, -1, 0]].reshape(-1, 4, 4)
+        F = Formex(corners.toCoords(), eltype='quad4')
+        F.attrib(**surface.attrib)
+        Actor.__init__(self, F, **kargs)
+        self.surface = surface
+        self.ndiv = ndiv
+        self.patchdegree = tuple(surface.degree)
+        self.patchvbo = VBO(X.reshape(-1, 4).astype(float32))
+        self.patchshader = None
+        self.meshed = False
+
+
+    def _mesh(self):
+        """Replace the patch corner geometry with the dense mesh"""
+        if self.meshed:
+            return
+        G = self.surface.approx(ndiv=self.ndiv)
+        A = Actor(G, name=self.name)
+        for key in ('object', 'eltype', 'fcoords', '_memory', 'vbo'):
+            self[key] = A[key]
+        self._normals = self._avgnormals = self._pickitems = None
+        self.meshed = True
+        if self.nbo is not None:
+            self._prepareNormals(pf.canvas)
+
+
+    def bbox(self):
+        """Return the bbox of the control points, which holds the surface"""
+        return self.surface.bbox()
+
+
+    def changeMode(self, canvas):
+        """Modify the actor according to the specified mode"""
+        if canvas.renderer is not None:
+            self.patchshader = canvas.renderer.patchShader(self.patchdegree)
+        rendermode = self.mode if self.mode else canvas.rendermode
+        if self.patchshader is None or rendermode.endswith('wire') or \
+               rendermode == 'wireframe':
+            self._mesh()
+        Actor.changeMode(self, canvas)
+
+
+    def _add_pick(self, start, mode):
+        self._mesh()
+        return Actor._add_pick(self, start, mode)
+
+
+    def inside(self, *args, **kargs):
+        self._mesh()
+        return Actor.inside(self, *args, **kargs)
+
+
+    def addHighlightElements(self, sel=None):
+        self._mesh()
+        return Actor.addHighlightElements(self, sel)
+
+
+    def addHighlightPoints(self, sel=None):
+        self._mesh()
+        return Actor.addHighlightPoints(self, sel)
+
+
+    def _addFaces(self):
+        """Draw the faces as tessellated patches, if possible"""
+        if self.patchshader is None:
+            return Actor._addFaces(self)
+        if self.rendertype > 1 or self.drawface == 0:
+            D = PatchDrawable(self, name=self.name, vbo=self.patchvbo,
+                              degree=self.patchdegree, cullface='',
+                              drawface=0)
+            self.drawable.append(D)
+        else:
+            for name, cullface, drawface in [
+                    ('_front', 'back', 1), ('_back', 'front', -1)]:
+                D = PatchDrawable(self, name=self.name+name,
+                                  vbo=self.patchvbo, degree=self.patchdegree,
+                                  cullface=cullface, drawface=drawface)
+                self.drawable.append(D)
+
+
 # End
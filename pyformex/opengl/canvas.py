@@ -172,6 +172,7 @@ class Canvas():
         self.mode2D = False
         self.setRenderMode(pf.cfg['draw/rendermode'])
         self.picking = False
+        self.pickbuffer = None  # ID buffer for GPU picking
         self.resetLighting()
         self._focus = None
         self.focus = False
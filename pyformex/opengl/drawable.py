@@ -27,6 +27,8 @@
 """OpenGL rendering objects for the new OpenGL2 engine.
 
 """
+import ctypes
+
 import numpy as np
 from numpy import int32, float32
 from .gl import GL
@@ -37,6 +39,7 @@ from pyformex import utils
 from pyformex import colors
 from pyformex import geomtools as gt
 from pyformex import arraytools as at
+from pyformex.coords import Coords
 from pyformex.formex import Formex
 from pyformex.mesh import Mesh
 from pyformex.polygons import Polygons
@@ -44,6 +47,8 @@ from pyformex.attributes import Attributes
 from pyformex.elements import ElementType
 from .sanitize import saneFloat, saneLineStipple, saneColor, saneColorSet
 from .texture import Texture
+from . import vertexformat as vf
+from .pickbuffer import idPicking
 
 
 ### Drawable Objects ###############################################
@@ -61,7 +66,7 @@ def glObjType(nplex):
 
 def _show_buffers(d):
     """Return a dict where the buffers are shown"""
-    for key in ['vbo', 'nbo', 'ibo', 'tbo']:
+    for key in ['vbo', 'nbo', 'ibo', 'tbo', 'xbo']:
         if key in d:
             d[key] = d[key].data
 
@@ -221,7 +226,10 @@ class Drawable(Attributes):
                     # Expand to 4 !!!
                     self.vertexColor = at.growAxis(self.vertexColor, 1,
                                                    fill=self.alpha)
-                self.cbo = VBO(self.vertexColor.astype(float32))
+                if vf.packAttributes():
+                    self.cbo = VBO(vf.packColors(self.vertexColor))
+                else:
+                    self.cbo = VBO(self.vertexColor.astype(float32))
                 #size_report("Created cbo VBO", self.cbo)
 
                 # print(f"{self.name=}, {self.useObjectColor=}, {self.objectColor=}")
@@ -250,7 +258,10 @@ class Drawable(Attributes):
         if self.useObjectColor:
             return
         self.vertexColor = self.color
-        self.cbo = VBO(color.astype(float32))
+        if vf.packAttributes():
+            self.cbo = VBO(vf.packColors(color))
+        else:
+            self.cbo = VBO(color.astype(float32))
         size_report('cbo', self.cbo)
 
 
@@ -261,7 +272,10 @@ class Drawable(Attributes):
                 #curshape = self.texcoords.shape
                 self.texcoords = at.multiplex(self.texcoords, self.object.nelems(), axis=-3, warn=False)
                 #print("Multiplexing texture coords: %s -> %s " % (curshape, self.texcoords.shape))
-        self.tbo = VBO(self.texcoords.astype(float32))
+        if vf.packAttributes():
+            self.tbo = VBO(vf.packTexCoords(self.texcoords))
+        else:
+            self.tbo = VBO(self.texcoords.astype(float32))
         self.texture.activate()
 
 
@@ -324,23 +338,22 @@ class Drawable(Attributes):
             self.ibo.bind()
 
         if self.nbo:
-            self.nbo.bind()
-            i = renderer.shader.attribute['vertexNormal']
-            GL.glEnableVertexAttribArray(i)
-            GL.glVertexAttribPointer(i, 3, GL.GL_FLOAT, False, 0, self.nbo)
+            renderer.shader.attribPointer('vertexNormal', self.nbo)
+            renderer.shader.uniformInt(
+                'normalformat', vf.normalFormat(self.nbo.data))
 
         if self.cbo:
-            self.cbo.bind()
-            i = renderer.shader.attribute['vertexColor']
-            GL.glEnableVertexAttribArray(i)
-            GL.glVertexAttribPointer(
-                i, self.cbo.shape[-1], GL.GL_FLOAT, False, 0, self.cbo)
+            renderer.shader.attribPointer('vertexColor', self.cbo)
 
         if self.tbo:
-            self.tbo.bind()
-            i = renderer.shader.attribute['vertexTexturePos']
-            GL.glEnableVertexAttribArray(i)
-            GL.glVertexAttribPointer(i, 2, GL.GL_FLOAT, False, 0, self.tbo)
+            renderer.shader.attribPointer('vertexTexturePos', self.tbo)
+
+        # Per-instance transforms
+        ninstances = 0
+        if self.xbo and renderer.shader.attribPointer(
+                'instanceTransform', self.xbo) >= 0:
+            renderer.shader.uniformInt('instancing', True)
+            ninstances = self.xbo.data.shape[0]
 
         if self.cullface == 'front':
             # Draw back faces
@@ -363,7 +376,9 @@ class Drawable(Attributes):
 
         ### RENDER ###
         # Render the geometry
-        if self.ibo is None:
+        if ninstances:
+            self._renderInstanced(ninstances)
+        elif self.ibo is None:
             GL.glDrawArrays(
                 self.glmode, 0, np.asarray(self.vbo.shape[:-1]).prod())
         else:
@@ -394,12 +409,38 @@ class Drawable(Attributes):
         if self.nbo:
             self.nbo.unbind()
             GL.glDisableVertexAttribArray(renderer.shader.attribute['vertexNormal'])
+            renderer.shader.uniformInt('normalformat', 0)
+        if self.xbo:
+            renderer.shader.disableAttrib('instanceTransform', self.xbo)
+            renderer.shader.uniformInt('instancing', False)
         self.vbo.unbind()
         GL.glDisableVertexAttribArray(renderer.shader.attribute['vertexCoords'])
         if self.offset:
             GL.glPolygonOffset(0.0, 0.0)
 
 
+    def _renderInstanced(self, ninstances):
+        """Draw ninstances copies of the geometry
+
+        The buffers should have been bound by :meth:`render`.
+        There is no instanced version of glMultiDrawElements, so
+        polygons with a variable plexitude are drawn per polygon.
+        """
+        if self.ibo is None:
+            GL.glDrawArraysInstanced(
+                self.glmode, 0, np.asarray(self.vbo.shape[:-1]).prod(),
+                ninstances)
+        elif self.counts is not None and self.indexptr is not None:
+            for count, ptr in zip(self.counts, self.indexptr):
+                GL.glDrawElementsInstanced(
+                    self.glmode, int(count), GL.GL_UNSIGNED_INT,
+                    ctypes.c_void_p(int(ptr)), ninstances)
+        else:
+            GL.glDrawElementsInstanced(
+                self.glmode, self.ibo.data.size, GL.GL_UNSIGNED_INT,
+                None, ninstances)
+
+
     def renderpick(self, renderer):
         """Render for picking"""
         renderer.shader.loadUniforms(self)
@@ -412,7 +453,10 @@ class Drawable(Attributes):
         if self.ibo:
             self.ibo.bind()
 
-        if self.pbo:   # we may also add drawables without pick buffers
+        if self.pbo is not None and self.pbo.data.dtype == np.int32:
+            # item numbers for ID-buffer picking
+            renderer.shader.attribPointer('pickId', self.pbo)
+        elif self.pbo:   # we may also add drawables without pick buffers
             self.pbo.bind()
             i = renderer.shader.attribute['pickColor']
             i = GL.glGetAttribLocation(renderer.shader.shader, 'pickColor')
@@ -421,8 +465,9 @@ class Drawable(Attributes):
                 GL.glVertexAttribPointer(
                     i, 4, GL.GL_FLOAT, False, 0, self.pbo)
             else:
+                # packed pick colors: normalized bytes give exactly c/255
                 GL.glVertexAttribPointer(
-                    i, 4, GL.GL_UNSIGNED_BYTE, False, 0, self.pbo)
+                    i, 4, GL.GL_UNSIGNED_BYTE, True, 0, self.pbo)
 
         if self.cullface == 'front':
             # Draw back faces
@@ -457,9 +502,14 @@ class Drawable(Attributes):
         # Cleanup
         if self.ibo:
             self.ibo.unbind()
-        if self.pbo:
-            self.pbo.unbind()
-        GL.glDisableVertexAttribArray(renderer.shader.attribute['pickColor'])
+        if self.pbo is not None and self.pbo.data.dtype == np.int32:
+            renderer.shader.disableAttrib('pickId', self.pbo)
+        else:
+            if self.pbo:
+                self.pbo.unbind()
+            if renderer.shader.attribute['pickColor'] >= 0:
+                GL.glDisableVertexAttribArray(
+                    renderer.shader.attribute['pickColor'])
         self.vbo.unbind()
         GL.glDisableVertexAttribArray(renderer.shader.attribute['vertexCoords'])
 
@@ -473,6 +523,70 @@ class Drawable(Attributes):
 
 ########################################################################
 
+class PatchDrawable(Drawable):
+    """A Drawable rendering Bezier patches with hardware tessellation.
+
+    The `vbo` holds the homogeneous control points (w*x,w*y,w*z,w) of
+    the patches, with the (degree[0]+1)*(degree[1]+1) points of each
+    patch stored contiguously, running fastest in the u direction.
+    The patches are rendered as GL_PATCHES with the shader program from
+    :meth:`Renderer.patchShader`, which is temporarily made the current
+    shader of the renderer.
+    """
+
+    def render(self, renderer):
+        """Render the patches"""
+        shader = renderer.patchShader(self.degree)
+        mainshader = renderer.shader
+        renderer.shader = shader
+        try:
+            shader.bind()
+            # Load the object transform, like renderObjects does for
+            # the main shader
+            if self.trl or self.rot or self.trl0:
+                renderer.loadMatrices(rot=self.rot, trl=self.trl,
+                                      trl0=self.trl0)
+            else:
+                renderer.loadMatrices()
+            renderer.setDefaults()
+            shader.uniformVec2('viewport', (renderer.canvas.width(),
+                                            renderer.canvas.height()))
+            shader.uniformFloat('tesspixels', pf.cfg['render/tesspixels'])
+            shader.loadUniforms(self)
+
+            if self.offset:
+                GL.glPolygonOffset(1.0, 1.0)
+
+            self.vbo.bind()
+            i = shader.attribute['vertexCoords']
+            GL.glEnableVertexAttribArray(i)
+            GL.glVertexAttribPointer(i, 4, GL.GL_FLOAT, False, 0, self.vbo)
+
+            if self.cullface == 'front':
+                GL.glEnable(GL.GL_CULL_FACE)
+                GL.glCullFace(GL.GL_FRONT)
+            elif self.cullface == 'back':
+                GL.glEnable(GL.GL_CULL_FACE)
+                GL.glCullFace(GL.GL_BACK)
+            else:
+                GL.glDisable(GL.GL_CULL_FACE)
+
+            if self.ontop:
+                GL.glDepthFunc(GL.GL_ALWAYS)
+
+            GL.glPatchParameteri(GL.GL_PATCH_VERTICES, shader.nvertices)
+            GL.glDrawArrays(GL.GL_PATCHES, 0, self.vbo.shape[0])
+
+            self.vbo.unbind()
+            GL.glDisableVertexAttribArray(i)
+            if self.offset:
+                GL.glPolygonOffset(0.0, 0.0)
+
+        finally:
+            renderer.shader = mainshader
+            mainshader.bind()
+
+
 class BaseActor(Attributes):
     """Base class for all drawn objects (Actors) in pyFormex.
 
@@ -579,6 +693,13 @@ class Actor(BaseActor):
     If the actor does not have a name, it will be given a
     default one.
 
+    If the actor has an `instances` attribute, holding (ninst,3)
+    translations or (ninst,4,4) transformation matrices, the geometry
+    is uploaded once and drawn at all instances with instanced rendering.
+    This requires the 330 shader. Picking only sees the original geometry.
+    The transformations should be rigid or uniformly scaled, as the normals
+    are transformed with the same matrices.
+
     The actor has the following attributes, initialized or computed on demand
 
     """
@@ -659,13 +780,18 @@ class Actor(BaseActor):
         self.vbo = VBO(self.fcoords)
         #print(f"vbo shape is {self.vbo.shape}")
 
+        # Repeated geometry: a single upload drawn at all instances
+        if self.instances is not None:
+            self.instances = vf.instanceMatrices(self.instances)
+            self.xbo = VBO(self.instances)
+
 
     def getType(self):
         return self.object.__class__
 
 
     def _fcoords_fuse(self):
-        coords, elems = self.fcoords.fuse()
+        coords, elems = self.fcoords.fuse(method='hash')
         if elems.ndim != 2:
             elems = elems[:, np.newaxis]
         self._memory['coords'] = coords
@@ -689,7 +815,14 @@ class Actor(BaseActor):
 
     def bbox(self):
         try:
-            return self.object.bbox()
+            bb = self.object.bbox()
+            if self.instances is not None:
+                # Transform the bbox corners to all instances
+                x = np.array([[bb[i, 0], bb[j, 1], bb[k, 2], 1.]
+                              for i in (0, 1) for j in (0, 1) for k in (0, 1)])
+                x = np.dot(x, self.instances)[..., :3].reshape(-1, 3)
+                bb = Coords([x.min(axis=0), x.max(axis=0)])
+            return bb
         except Exception as e:
             raise e
             return np.zeros(6).reshape(2, 3)
@@ -845,6 +978,9 @@ class Actor(BaseActor):
                 normals = self.b_normals
             # Normals are always full fcoords size
             #print("SIZE OF NORMALS: %s; COORDS: %s" % (normals.size,self.fcoords.size))
+            if vf.packAttributes():
+                normals = vf.packNormals(
+                    normals, pf.cfg['render/packnormals'])
             self.nbo = VBO(normals)
 
 
@@ -1021,6 +1157,13 @@ class Actor(BaseActor):
         parts by their pixel color. All parts of all objects thus need a unique
         integer identifier in order to be recognized.
 
+        With ID-buffer picking (see :mod:`opengl.pickbuffer`) the shader
+        derives the identifiers from the vertex index, and no colors are
+        stored: the pick drawables only get a `pickBase` (the identifier
+        of the first item) and a `pickDivisor` (the number of vertices
+        per item). Only Polygons, with their variable plexitude, need a
+        buffer with the item number for each vertex.
+
         Parameters
         ----------
         start: int
@@ -1041,27 +1184,50 @@ class Actor(BaseActor):
             The next available identifier. This means that all ids used
             by this actor are in ``range(start, next_start)``.
         """
+        idpick = idPicking()
         if mode in ['point', 'point0']:
             points = self.coords
             nitems = points.shape[0]
             next_start = start + nitems
-            color = np.arange(start, next_start, dtype=np.uint32)
-            color8 = color.view(np.uint8).reshape(-1, 4)
-            if pf.debugon(pf.DEBUG.PICK):
-                print("PICKCOLORS\n", color8)
-            color8f = (color8 / 255).astype(np.float32)
+            if idpick:
+                pick = {'pickBase': start, 'pickDivisor': 1}
+                hide = {'pickBase': 0, 'pickDivisor': 0}
+            else:
+                color = np.arange(start, next_start, dtype=np.uint32)
+                color8 = color.view(np.uint8).reshape(-1, 4)
+                if pf.debugon(pf.DEBUG.PICK):
+                    print("PICKCOLORS\n", color8)
+                if not vf.packAttributes():
+                    color8 = (color8 / 255).astype(np.float32)
+                pick = {'pbo': VBO(color8)}
+                hide = {}
             D0 = Drawable(
                 self, vbo=VBO(self.coords), name=self.name+"_pick", picking=True,
                 indices=np.arange(nitems).reshape(-1, 1), glmode=GL.GL_POINTS,
-                lighting=False, opak=True, pointsize=10, pbo=VBO(color8f),
-                color=None)
+                lighting=False, opak=True, pointsize=10,
+                color=None, **pick)
             self._pickitems = D0
             if mode == 'point':
                 D1 = Drawable(   # make faces opak
                     self, name=self.name+"_pick0", picking=True, lighting=False,
                     color=np.array(colors.black), alpha=1.0,
-                    opak=True, cullface='', drawface=0, **self.faces)
+                    opak=True, cullface='', drawface=0, **hide, **self.faces)
                 self._pickitems = [D0, D1]
+        elif idpick:
+            if self.eltype == 'polygon':
+                lengths = self.object.elems.lengths
+                nelems = len(lengths)
+                ids = np.repeat(np.arange(nelems, dtype=int32), lengths)
+                pick = {'pickBase': start, 'pickDivisor': -1,
+                        'pbo': VBO(ids)}
+            else:
+                nelems = self.fcoords.shape[0]
+                pick = {'pickBase': start,
+                        'pickDivisor': self.fcoords.shape[1]}
+            next_start = start + nelems
+            self._pickitems = Drawable(
+                self, name=self.name+"_pick", picking=True, lighting=False,
+                color=None, cullface='', drawface=0, **pick, **self.faces)
         else:
             faces = self.faces
             nelems = self.fcoords.shape[0]
@@ -1075,10 +1241,11 @@ class Actor(BaseActor):
             if pf.debugon(pf.DEBUG.PICK):
                 print("PICKCOLORS\n", color8)
             color8 = at.multiplex(color8, shape[1], 1).reshape(-1, 4)
-            color8f = (color8 / 255).astype(np.float32)
+            if not vf.packAttributes():
+                color8 = (color8 / 255).astype(np.float32)
             self._pickitems = Drawable(
                 self, name=self.name+"_pick", picking=True, lighting=False,
-                pbo = VBO(color8f), color=None,
+                pbo = VBO(color8), color=None,
                 cullface='', drawface=0, **faces)
         return next_start
 
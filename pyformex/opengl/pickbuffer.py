@@ -0,0 +1,223 @@
+#
+##
+##  SPDX-FileCopyrightText: © 2007-2023 Benedict Verhegghe <bverheg@gmail.com>
+##  SPDX-License-Identifier: GPL-3.0-or-later
+##
+##  This file is part of pyFormex 3.3  (Sun Mar 26 20:16:15 CEST 2023)
+##  pyFormex is a tool for generating, manipulating and transforming 3D
+##  geometrical models by sequences of mathematical operations.
+##  Home page: https://pyformex.org
+##  Project page: https://savannah.nongnu.org/projects/pyformex/
+##  Development: https://gitlab.com/bverheg/pyformex
+##  Distributed under the GNU General Public License version 3 or later.
+##
+##  This program is free software: you can redistribute it and/or modify
+##  it under the terms of the GNU General Public License as published by
+##  the Free Software Foundation, either version 3 of the License, or
+##  (at your option) any later version.
+##
+##  This program is distributed in the hope that it will be useful,
+##  but WITHOUT ANY WARRANTY; without even the implied warranty of
+##  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+##  GNU General Public License for more details.
+##
+##  You should have received a copy of the GNU General Public License
+##  along with this program.  If not, see http://www.gnu.org/licenses/.
+##
+"""GPU ID-buffer picking.
+
+With the 330 shader, picking does not render colors into the normal
+framebuffer. The shader derives an integer id for every pickable item
+from the vertex index (``gl_VertexID``) and a per-drawable base value,
+and writes it into an integer (R32UI) render target. Only the picking
+region is rendered (scissor test) and read back. The readback goes
+through a pixel buffer object, so that it does not stall the GL pipeline:
+:meth:`PickBuffer.start` returns as soon as the commands are queued,
+and :meth:`PickBuffer.result` maps the buffer when the GPU is done.
+The canvas starts the readback when the rubber band rectangle is
+released, and collects the ids when the pick loop processes the pick,
+keeping the GUI responsive while :meth:`PickBuffer.done` is False.
+
+The ids are the same as with color picking: 0 is the background and
+each pickable actor gets a consecutive range of ids
+(see :meth:`Canvas.create_pickitems`).
+"""
+
+import ctypes
+
+import numpy as np
+
+import pyformex as pf
+from .gl import GL
+
+
+def idPicking():
+    """Check whether ID-buffer picking is used
+
+    ID-buffer picking requires integer render targets and is only
+    implemented in the 330 shader. The other shaders use color picking.
+    """
+    return pf.options.shader == '330'
+
+
+class PickBuffer():
+    """An offscreen integer ID buffer with asynchronous readback
+
+    The buffer holds a framebuffer object with an R32UI color attachment
+    and a depth attachment, and a pixel pack buffer to read back the ids.
+    All GL objects are (re)created by :meth:`resize`, which should be
+    called with the OpenGL context current.
+    """
+
+    def __init__(self):
+        self.size = None
+        self.fbo = None
+        self.rbos = None
+        self.pbo = None
+        self.fence = None
+        self.region = None
+        self.pending = None
+
+
+    def resize(self, w, h):
+        """Make sure the buffer has size (w,h)"""
+        if self.size == (w, h):
+            return
+        self.delete()
+        prev = GL.glGetIntegerv(GL.GL_FRAMEBUFFER_BINDING)
+        self.fbo = GL.glGenFramebuffers(1)
+        GL.glBindFramebuffer(GL.GL_FRAMEBUFFER, self.fbo)
+        self.rbos = GL.glGenRenderbuffers(2)
+        for rbo, fmt, attachment in zip(
+                self.rbos,
+                (GL.GL_R32UI, GL.GL_DEPTH_COMPONENT24),
+                (GL.GL_COLOR_ATTACHMENT0, GL.GL_DEPTH_ATTACHMENT)):
+            GL.glBindRenderbuffer(GL.GL_RENDERBUFFER, rbo)
+            GL.glRenderbufferStorage(GL.GL_RENDERBUFFER, fmt, w, h)
+            GL.glFramebufferRenderbuffer(
+                GL.GL_FRAMEBUFFER, attachment, GL.GL_RENDERBUFFER, rbo)
+        GL.glBindRenderbuffer(GL.GL_RENDERBUFFER, 0)
+        status = GL.glCheckFramebufferStatus(GL.GL_FRAMEBUFFER)
+        GL.glBindFramebuffer(GL.GL_FRAMEBUFFER, prev)
+        if status != GL.GL_FRAMEBUFFER_COMPLETE:
+            self.delete()
+            raise RuntimeError(f"Incomplete pick framebuffer: {status}")
+        self.pbo = GL.glGenBuffers(1)
+        GL.glBindBuffer(GL.GL_PIXEL_PACK_BUFFER, self.pbo)
+        GL.glBufferData(GL.GL_PIXEL_PACK_BUFFER, 4*w*h, None,
+                        GL.GL_STREAM_READ)
+        GL.glBindBuffer(GL.GL_PIXEL_PACK_BUFFER, 0)
+        self.size = (w, h)
+
+
+    def delete(self):
+        """Delete the GL objects of the buffer"""
+        if self.fence is not None:
+            GL.glDeleteSync(self.fence)
+            self.fence = None
+        if self.pbo is not None:
+            GL.glDeleteBuffers(1, [self.pbo])
+            self.pbo = None
+        if self.rbos is not None:
+            GL.glDeleteRenderbuffers(2, self.rbos)
+            self.rbos = None
+        if self.fbo is not None:
+            GL.glDeleteFramebuffers(1, [self.fbo])
+            self.fbo = None
+        self.size = None
+
+
+    def start(self, canvas, obj_type, rect):
+        """Render the pick ids and start reading them back
+
+        Parameters
+        ----------
+        canvas: Canvas
+            The canvas to pick from. Its OpenGL context should be current.
+        obj_type: str
+            The type of items to pick: 'actor', 'element' or 'point'.
+        rect: tuple of int
+            The picking region (x, y, w, h) in pixels, with y upwards.
+
+        This only queues the GL commands: the results are available
+        when :meth:`done` returns True, and returned by :meth:`result`.
+        """
+        self.resize(canvas.width(), canvas.height())
+        x, y, w, h = rect
+        prev = GL.glGetIntegerv(GL.GL_FRAMEBUFFER_BINDING)
+        GL.glBindFramebuffer(GL.GL_FRAMEBUFFER, self.fbo)
+        # The fragment shader writes the ids to output location 1
+        GL.glDrawBuffers(2, np.array([GL.GL_NONE, GL.GL_COLOR_ATTACHMENT0],
+                                     dtype=np.uint32))
+        GL.glEnable(GL.GL_SCISSOR_TEST)
+        GL.glScissor(x, y, w, h)
+        GL.glClearBufferuiv(GL.GL_COLOR, 1, np.zeros(4, dtype=np.uint32))
+        GL.glClear(GL.GL_DEPTH_BUFFER_BIT)
+        canvas.create_pickitems(obj_type)
+        canvas.picking = True
+        try:
+            GL.glDisable(GL.GL_BLEND)
+            canvas.renderer.render(canvas.scene, True)
+        finally:
+            canvas.picking = False
+            GL.glDisable(GL.GL_SCISSOR_TEST)
+        GL.glReadBuffer(GL.GL_COLOR_ATTACHMENT0)
+        GL.glBindBuffer(GL.GL_PIXEL_PACK_BUFFER, self.pbo)
+        GL.glPixelStorei(GL.GL_PACK_ALIGNMENT, 4)
+        GL.glReadPixels(x, y, w, h, GL.GL_RED_INTEGER, GL.GL_UNSIGNED_INT,
+                        ctypes.c_void_p(0))
+        GL.glBindBuffer(GL.GL_PIXEL_PACK_BUFFER, 0)
+        if self.fence is not None:
+            GL.glDeleteSync(self.fence)
+        self.fence = GL.glFenceSync(GL.GL_SYNC_GPU_COMMANDS_COMPLETE, 0)
+        GL.glFlush()
+        GL.glBindFramebuffer(GL.GL_FRAMEBUFFER, prev)
+        self.region = (w, h)
+        self.pending = (obj_type, tuple(rect))
+
+
+    def done(self):
+        """Check whether the results of :meth:`start` are available"""
+        if self.fence is None:
+            return True
+        status = GL.glClientWaitSync(self.fence, 0, 0)
+        return status != GL.GL_TIMEOUT_EXPIRED
+
+
+    def result(self):
+        """Return the unique ids from the last :meth:`start`
+
+        Waits for the GPU if the readback has not finished yet.
+
+        Returns
+        -------
+        uint32 array
+            The unique ids in the picked region, sorted, including 0 if
+            some background pixels were picked.
+        """
+        self.pending = None
+        if self.region is None:
+            return np.zeros((0,), dtype=np.uint32)
+        if self.fence is not None:
+            while GL.glClientWaitSync(
+                    self.fence, GL.GL_SYNC_FLUSH_COMMANDS_BIT,
+                    1000000) == GL.GL_TIMEOUT_EXPIRED:
+                pass
+            GL.glDeleteSync(self.fence)
+            self.fence = None
+        w, h = self.region
+        n = w * h
+        GL.glBindBuffer(GL.GL_PIXEL_PACK_BUFFER, self.pbo)
+        ptr = GL.glMapBufferRange(GL.GL_PIXEL_PACK_BUFFER, 0, 4*n,
+                                  GL.GL_MAP_READ_BIT)
+        try:
+            ids = np.ctypeslib.as_array(
+                ctypes.cast(ptr, ctypes.POINTER(ctypes.c_uint32)), shape=(n,))
+            ids = np.unique(ids)   # this makes a copy
+        finally:
+            GL.glUnmapBuffer(GL.GL_PIXEL_PACK_BUFFER)
+            GL.glBindBuffer(GL.GL_PIXEL_PACK_BUFFER, 0)
+        return ids
+
+
+# End
@@ -46,6 +46,7 @@ if not pf.sphinx and pf.options.gl3:
     from opengl3.shader import Shader
 else:
     from .shader import Shader
+from .shader import PatchShader, tessellationAvailable
 
 
 class Renderer():
@@ -56,6 +57,37 @@ class Renderer():
             shader = Shader(self.canvas)
         self.shader = shader
         self.camera = self.canvas.camera
+        self._patchshaders = {}
+
+
+    def patchShader(self, degree):
+        """Return the shader program for tessellated Bezier patches.
+
+        Parameters
+        ----------
+        degree: tuple of int
+            The degrees (p,q) of the patches in u and v direction.
+
+        Returns
+        -------
+        :class:`PatchShader` | None
+            A shader program rendering patches of the specified degrees,
+            or None if hardware tessellation is not available for them.
+            The program is compiled on first use and then cached.
+        """
+        degree = tuple(degree)
+        if degree not in self._patchshaders:
+            shader = None
+            p, q = degree
+            if (min(p, q) > 0 and tessellationAvailable() and
+                (p+1)*(q+1) <= GL.glGetIntegerv(GL.GL_MAX_PATCH_VERTICES)):
+                try:
+                    shader = PatchShader(self.canvas, degree)
+                except Exception as e:
+                    pf.debug("Could not compile the patch shader: %s" % e,
+                             pf.DEBUG.OPENGL)
+            self._patchshaders[degree] = shader
+        return self._patchshaders[degree]
 
 
     def loadLightProfile(self):
@@ -117,7 +149,7 @@ class Renderer():
             GL.glDepthFunc(GL.GL_LESS)
             self.setDefaults()
             if obj.trl or obj.rot or obj.trl0:
-                self.loadMatrices(rot=self.rot, trl=self.trl, trl0=self.trl0)
+                self.loadMatrices(rot=obj.rot, trl=obj.trl, trl0=obj.trl0)
             obj.render(self)
             if obj.trl or obj.rot or obj.trl0:
                 self.loadMatrices()
@@ -129,7 +161,7 @@ class Renderer():
             GL.glDepthFunc(GL.GL_LESS)
             #self.setDefaults()
             if obj.trl or obj.rot or obj.trl0:
-                self.loadMatrices(rot=self.rot, trl=self.trl, trl0=self.trl0)
+                self.loadMatrices(rot=obj.rot, trl=obj.trl, trl0=obj.trl0)
             obj.renderpick(self)
             if obj.trl or obj.rot or obj.trl0:
                 self.loadMatrices()
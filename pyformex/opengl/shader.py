@@ -36,6 +36,8 @@ and its data onto the graphics system.
 
 """
 
+import numpy as np
+
 import pyformex as pf
 from pyformex.software import SaneVersion
 from pyformex.gui import qtgl
@@ -86,6 +88,46 @@ def defaultShaders():
     return vertexshader, fragmentshader
 
 
+def readShader(filename, defines=None):
+    """Read the source of a shader program
+
+    Parameters
+    ----------
+    filename: :term:`path_like`
+        The file containing the GLSL source.
+    defines: dict, optional
+        Preprocessor macros to be defined in the source. They are
+        inserted directly after the '#version' line.
+
+    Returns
+    -------
+    str
+        The shader source.
+    """
+    with open(filename) as f:
+        source = f.read()
+    if defines:
+        lines = source.split('\n')
+        i = [i for i, l in enumerate(lines) if l.startswith('#version')]
+        i = i[0]+1 if i else 0
+        lines[i:i] = ["#define %s %s" % item for item in defines.items()]
+        source = '\n'.join(lines)
+    return source
+
+
+def tessellationAvailable():
+    """Check whether tessellation shaders can be used
+
+    Tessellation shaders require OpenGL 4.0. They can be disabled
+    by the 'render/tessellation' setting.
+    """
+    if not pf.cfg['render/tessellation']:
+        return False
+    version = gl.gl_version()['version'].split()[0]
+    return (SaneVersion(version) >= SaneVersion('4.0') and
+            hasattr(GL, 'GL_PATCHES'))
+
+
 class Shader():
     """An OpenGL shader consisting of a vertex and a fragment shader pair.
 
@@ -105,12 +147,14 @@ class Shader():
     # Default attributes and uniforms
     attributes = [
     'pickColor',
+    'pickId',
     'vertexCoords',
     'vertexNormal',
     'vertexColor',
     'vertexTexturePos',
     'vertexScalar',
     'vertexOffset',
+    'instanceTransform',
     ]
 
     # int and bool uniforms
@@ -125,6 +169,10 @@ class Shader():
         'drawface',
         'lighting',
         'nlights',
+        'normalformat',
+        'instancing',
+        'pickBase',
+        'pickDivisor',
         ]
 
     uniforms_float = [
@@ -156,19 +204,18 @@ class Shader():
         'picking',
     ]
 
-    def __init__(self, canvas, vshader=None, fshader=None, attributes=None, uniforms=None):
+    def __init__(self, canvas, vshader=None, fshader=None, attributes=None,
+                 uniforms=None, tcshader=None, teshader=None, defines=None):
         _vertexshader, _fragmentshader = defaultShaders()
         if vshader is None:
             vshader = _vertexshader
         pf.debug("Using vertex shader %s" % vshader, pf.DEBUG.OPENGL)
-        with open(vshader) as f:
-            VertexShader = f.read()
+        VertexShader = readShader(vshader, defines)
 
         if fshader is None:
             fshader = _fragmentshader
         pf.debug("Using fragment shader %s" % fshader, pf.DEBUG.OPENGL)
-        with open(fshader) as f:
-            FragmentShader = f.read()
+        FragmentShader = readShader(fshader, defines)
 
         if attributes is None:
             attributes = Shader.attributes
@@ -176,9 +223,20 @@ class Shader():
         if uniforms is None:
             uniforms = Shader.uniforms
 
-        vertex_shader = shaders.compileShader(VertexShader, GL.GL_VERTEX_SHADER)
-        fragment_shader = shaders.compileShader(FragmentShader, GL.GL_FRAGMENT_SHADER)
-        self.shader = shaders.compileProgram(vertex_shader, fragment_shader)
+        stages = [
+            shaders.compileShader(VertexShader, GL.GL_VERTEX_SHADER),
+            shaders.compileShader(FragmentShader, GL.GL_FRAGMENT_SHADER),
+        ]
+        if tcshader is not None and teshader is not None:
+            pf.debug("Using tessellation shaders %s and %s" %
+                     (tcshader, teshader), pf.DEBUG.OPENGL)
+            stages += [
+                shaders.compileShader(readShader(tcshader, defines),
+                                      GL.GL_TESS_CONTROL_SHADER),
+                shaders.compileShader(readShader(teshader, defines),
+                                      GL.GL_TESS_EVALUATION_SHADER),
+            ]
+        self.shader = shaders.compileProgram(*stages)
 
         self.attribute = self.locations(GL.glGetAttribLocation, attributes)
         self.uniform = self.locations(GL.glGetUniformLocation, uniforms)
@@ -218,6 +276,12 @@ class Shader():
         GL.glUniform3fv(loc, n, value)
 
 
+    def uniformVec2(self, name, value):
+        """Load a uniform vec2 into the shader"""
+        loc = self.uniform[name]
+        GL.glUniform2f(loc, *value)
+
+
     def uniformMat4(self, name, value):
         """Load a uniform mat4 into the shader"""
         loc = self.uniform[name]
@@ -230,6 +294,75 @@ class Shader():
         GL.glUniformMatrix3fv(loc, 1, False, value)
 
 
+    def attribPointer(self, name, vbo):
+        """Bind a buffer object to a vertex attribute of the shader
+
+        The OpenGL data type, the number of components and the normalization
+        are derived from the dtype and shape of the buffer data, allowing
+        the compact formats from :mod:`opengl.vertexformat`:
+
+        - float32: plain floats (default),
+        - float16: half floats (GL_HALF_FLOAT),
+        - uint8: normalized unsigned bytes (colors),
+        - int16: normalized signed shorts (octahedral normals),
+        - uint32 with one value per vertex: normalized GL_INT_2_10_10_10_REV
+          (packed normals),
+        - int32: integers, not converted to float (item ids).
+
+        The 'instanceTransform' attribute is a mat4 occupying four
+        consecutive locations. It takes a (ninst,4,4) float32 buffer and
+        advances once per instance.
+
+        Returns the attribute location, or -1 if the attribute is not
+        used by the shader program.
+        """
+        i = self.attribute.get(name, -1)
+        if i < 0:
+            return i
+        vbo.bind()
+        data = vbo.data
+        if name == 'instanceTransform':
+            for k in range(4):
+                GL.glEnableVertexAttribArray(i+k)
+                GL.glVertexAttribPointer(
+                    i+k, 4, GL.GL_FLOAT, False, 64, vbo + 16*k)
+                GL.glVertexAttribDivisor(i+k, 1)
+            return i
+        GL.glEnableVertexAttribArray(i)
+        if data.dtype == np.int32:
+            size = data.shape[-1] if data.ndim > 1 else 1
+            GL.glVertexAttribIPointer(i, size, GL.GL_INT, 0, vbo)
+        elif data.dtype == np.uint32:
+            GL.glVertexAttribPointer(
+                i, 4, GL.GL_INT_2_10_10_10_REV, True, 0, vbo)
+        else:
+            gltype, normalized = {
+                'float16': (GL.GL_HALF_FLOAT, False),
+                'uint8': (GL.GL_UNSIGNED_BYTE, True),
+                'int16': (GL.GL_SHORT, True),
+            }.get(data.dtype.name, (GL.GL_FLOAT, False))
+            GL.glVertexAttribPointer(
+                i, data.shape[-1], gltype, normalized, 0, vbo)
+        return i
+
+
+    def disableAttrib(self, name, vbo):
+        """Unbind a buffer object from a vertex attribute of the shader
+
+        This undoes :meth:`attribPointer`.
+        """
+        i = self.attribute.get(name, -1)
+        vbo.unbind()
+        if i < 0:
+            return
+        if name == 'instanceTransform':
+            for k in range(4):
+                GL.glVertexAttribDivisor(i+k, 0)
+                GL.glDisableVertexAttribArray(i+k)
+        else:
+            GL.glDisableVertexAttribArray(i)
+
+
     def bind(self, picking=False):
         """Bind the shader program"""
         shaders.glUseProgram(self.shader)
@@ -266,4 +399,53 @@ class Shader():
         """
         self.unbind()
 
+class PatchShader(Shader):
+    """A shader program rendering Bezier patches with hardware tessellation.
+
+    The patch control points are rendered as GL_PATCHES. The tessellation
+    control shader sets view dependent tessellation levels and the
+    evaluation shader evaluates the (rational) Bezier patch, computes
+    its normal and does the lighting. The fragment shader is the normal
+    fragment_shader_330.
+
+    Parameters
+    ----------
+    canvas: Canvas
+        The canvas to render on.
+    degree: tuple of int
+        The degrees (p,q) of the patches in u and v direction. Both should
+        be at least 1 and (p+1)*(q+1) should not exceed the maximum number
+        of patch vertices (which is at least 32).
+
+    Notes
+    -----
+    A separate shader program is compiled for each combination of
+    degrees, as the number of patch vertices has to be known at compile
+    time. Use :meth:`Renderer.patchShader` to get a cached instance.
+    """
+
+    uniforms = Shader.uniforms + [
+        'viewport',
+        'tesspixels',
+    ]
+
+    def __init__(self, canvas, degree):
+        p, q = degree
+        self.degree = (p, q)
+        self.nvertices = (p+1) * (q+1)
+        dirname = pf.pyformexdir / 'glsl'
+        Shader.__init__(
+            self, canvas,
+            vshader=dirname / 'tess_vertex_shader_400.c',
+            fshader=dirname / 'fragment_shader_330.c',
+            tcshader=dirname / 'tess_control_shader_400.c',
+            teshader=dirname / 'tess_eval_shader_400.c',
+            uniforms=PatchShader.uniforms,
+            defines={
+                'DEGREE_U': p,
+                'DEGREE_V': q,
+                'PATCH_VERTICES': self.nvertices,
+            })
+
+
 # End
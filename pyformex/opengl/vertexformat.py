@@ -0,0 +1,217 @@
+#
+##
+##  SPDX-FileCopyrightText: © 2007-2023 Benedict Verhegghe <bverheg@gmail.com>
+##  SPDX-License-Identifier: GPL-3.0-or-later
+##
+##  This file is part of pyFormex 3.3  (Sun Mar 26 20:16:15 CEST 2023)
+##  pyFormex is a tool for generating, manipulating and transforming 3D
+##  geometrical models by sequences of mathematical operations.
+##  Home page: https://pyformex.org
+##  Project page: https://savannah.nongnu.org/projects/pyformex/
+##  Development: https://gitlab.com/bverheg/pyformex
+##  Distributed under the GNU General Public License version 3 or later.
+##
+##  This program is free software: you can redistribute it and/or modify
+##  it under the terms of the GNU General Public License as published by
+##  the Free Software Foundation, either version 3 of the License, or
+##  (at your option) any later version.
+##
+##  This program is distributed in the hope that it will be useful,
+##  but WITHOUT ANY WARRANTY; without even the implied warranty of
+##  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+##  GNU General Public License for more details.
+##
+##  You should have received a copy of the GNU General Public License
+##  along with this program.  If not, see http://www.gnu.org/licenses/.
+##
+"""Compact vertex formats for the OpenGL buffers.
+
+By default all vertex attributes are stored in the buffer objects as
+32-bit floats. For large models this wastes a lot of GPU memory and
+upload bandwidth. This module provides functions to pack the attributes
+in the compact formats accepted by :meth:`Shader.attribPointer`:
+
+- colors as normalized unsigned bytes (4 bytes per vertex),
+- normals as signed normalized 2-10-10-10 integers (4 bytes per vertex)
+  or as octahedral encoded signed shorts (4 bytes per vertex),
+- texture coordinates as half floats (4 bytes per vertex).
+
+Packing is used when the 'render/packattribs' setting is True and the
+330 shader is active. The packed formats are decoded on the GPU,
+partly by OpenGL itself (normalization), partly by the vertex shader
+(octahedral normals).
+
+The module also provides :func:`instanceMatrices` to create the
+per-instance transform buffer for instanced drawing.
+"""
+
+import numpy as np
+
+import pyformex as pf
+
+#: Codes for the `normalformat` uniform of the shader
+NORMAL_FORMATS = {
+    'float': 0,
+    'int2101010': 1,
+    'octahedral': 2,
+}
+
+
+def packAttributes():
+    """Check whether the vertex attributes should be packed
+
+    Returns True if the 'render/packattribs' setting is on and the
+    active shader is the 330 shader, which is the only one that
+    can decode all packed formats.
+    """
+    return bool(pf.cfg['render/packattribs']) and pf.options.shader == '330'
+
+
+def packColors(color):
+    """Pack float colors into normalized unsigned bytes
+
+    Parameters
+    ----------
+    color: float array (..., 3|4)
+        Color components in the range 0.0..1.0.
+
+    Returns
+    -------
+    uint8 array (..., 3|4)
+        The colors scaled to the range 0..255.
+
+    Examples
+    --------
+    >>> packColors([[1.0, 0.5, 0.0, 0.25]])
+    array([[255, 128,   0,  64]], dtype=uint8)
+    """
+    color = np.asarray(color, dtype=np.float32)
+    return np.rint(np.clip(color, 0., 1.) * 255.).astype(np.uint8)
+
+
+def packNormals(normals, format='int2101010'):
+    """Pack unit normals into a compact format
+
+    Parameters
+    ----------
+    normals: float array (..., 3)
+        The (unit) normal vectors.
+    format: str
+        The packed format: one of
+
+        - 'int2101010': each normal is packed into a single uint32 with
+          three signed 10-bit components (GL_INT_2_10_10_10_REV),
+        - 'octahedral': each normal is mapped onto the octahedron and
+          stored as two signed normalized shorts.
+
+    Returns
+    -------
+    uint32 array (...) or int16 array (..., 2)
+        The packed normals. The dtype identifies the format to
+        :meth:`Shader.attribPointer`.
+
+    Examples
+    --------
+    >>> n = np.array([[0., 0., 1.], [0., -1., 0.], [-0.6, 0., -0.8]])
+    >>> np.allclose(unpackNormals(packNormals(n)), n, atol=2e-3)
+    True
+    >>> np.allclose(unpackNormals(packNormals(n, 'octahedral')), n, atol=1e-3)
+    True
+    """
+    n = np.asarray(normals, dtype=np.float32)
+    if format == 'int2101010':
+        c = np.rint(np.clip(n, -1., 1.) * 511.).astype(np.int32) & 0x3FF
+        c = c.astype(np.uint32)
+        return c[..., 0] | (c[..., 1] << 10) | (c[..., 2] << 20)
+    elif format == 'octahedral':
+        s = np.abs(n).sum(axis=-1, keepdims=True)
+        p = n[..., :2] / np.where(s > 0., s, 1.)
+        sign = np.where(p >= 0., 1., -1.)
+        fold = (1. - np.abs(p[..., ::-1])) * sign
+        p = np.where(n[..., 2:] < 0., fold, p)
+        return np.rint(np.clip(p, -1., 1.) * 32767.).astype(np.int16)
+    else:
+        raise ValueError(f"Invalid normal format {format!r}")
+
+
+def unpackNormals(packed):
+    """Decode packed normals
+
+    This is the inverse of :func:`packNormals`, and does on the CPU what
+    OpenGL and the vertex shader do on the GPU. The format is derived
+    from the dtype of `packed`.
+    """
+    packed = np.asarray(packed)
+    if packed.dtype == np.uint32:
+        c = np.stack([(packed >> s) & 0x3FF for s in (0, 10, 20)], axis=-1)
+        c = c.astype(np.int32)
+        c = np.where(c >= 512, c - 1024, c)
+        return np.maximum(c / 511., -1.).astype(np.float32)
+    elif packed.dtype == np.int16:
+        p = np.maximum(packed / 32767., -1.)
+        z = 1. - np.abs(p).sum(axis=-1)
+        t = np.maximum(-z, 0.)[..., np.newaxis]
+        p = p - np.where(p >= 0., t, -t)
+        n = np.concatenate([p, z[..., np.newaxis]], axis=-1)
+        return (n / np.linalg.norm(n, axis=-1, keepdims=True)).astype(np.float32)
+    else:
+        return packed.astype(np.float32)
+
+
+def normalFormat(normals):
+    """Return the `normalformat` shader code for a normals array"""
+    if normals.dtype == np.int16:
+        return NORMAL_FORMATS['octahedral']
+    elif normals.dtype == np.uint32:
+        return NORMAL_FORMATS['int2101010']
+    return NORMAL_FORMATS['float']
+
+
+def packTexCoords(texcoords):
+    """Pack texture coordinates into half floats
+
+    Half floats have an 11 bit mantissa, which is ample for texture
+    coordinates in the range 0..1 on textures up to 2048 pixels.
+    """
+    return np.asarray(texcoords).astype(np.float16)
+
+
+def instanceMatrices(instances):
+    """Create the per-instance transform matrices for instanced drawing
+
+    Parameters
+    ----------
+    instances: float array (ninst, 3) or (ninst, 4, 4)
+        Either a translation vector for each instance, or a full 4x4
+        transformation matrix for each instance, in the post-multiplication
+        convention of :class:`~opengl.matrix.Matrix4` (translation in the
+        last row). The matrices should be rigid body motions, possibly
+        with a uniform scaling: the shader transforms the normals with
+        the same matrix, so that a nonuniform scaling or a shear would
+        give wrong lighting.
+
+    Returns
+    -------
+    float32 array (ninst, 4, 4)
+        The instance transforms, ready to be loaded into a buffer object.
+
+    Examples
+    --------
+    >>> instanceMatrices([[1., 2., 3.]])[0]
+    array([[1., 0., 0., 0.],
+           [0., 1., 0., 0.],
+           [0., 0., 1., 0.],
+           [1., 2., 3., 1.]], dtype=float32)
+    """
+    instances = np.asarray(instances, dtype=np.float32)
+    if instances.ndim == 2 and instances.shape[-1] == 3:
+        mat = np.zeros((instances.shape[0], 4, 4), dtype=np.float32)
+        mat[:] = np.eye(4, dtype=np.float32)
+        mat[:, 3, :3] = instances
+        return mat
+    elif instances.ndim == 3 and instances.shape[1:] == (4, 4):
+        return np.ascontiguousarray(instances)
+    raise ValueError("instances should be a (ninst,3) or (ninst,4,4) array")
+
+
+# End
@@ -637,7 +637,7 @@ class Actor(BaseActor):
 
 
     def _fcoords_fuse(self):
-        self._coords, self._elems = self._fcoords.fuse()
+        self._coords, self._elems = self._fcoords.fuse(method='hash')
         if self._elems.ndim != 2:
             self._elems = self._elems[:, np.newaxis]
 
@@ -51,7 +51,10 @@ def importDXF(filename):
     `filename`: name of a DXF file.
     The return value is a list of pyFormex objects.
 
-    Importing a DXF file is done in two steps:
+    If the installed `dxfparser` supports binary output (version 0.3 or
+    higher), the entities are read as arrays with :func:`readDXFArrays`
+    and converted with :func:`arraysToEntities`. Else, importing a DXF
+    file is done in two steps:
 
     - First the DXF file is scanned and the recognized entities are
       formatted into a text with standard function calling syntax.
@@ -61,6 +64,9 @@ def importDXF(filename):
       See :func:`convertDXF`.
 
     """
+    if utils.External.check('dxfparser', '>=0.3'):
+        D = readDXFArrays(filename)
+        return arraysToEntities(D) if D else []
     text = readDXF(filename)
     if text:
         return convertDXF(text)
@@ -94,6 +100,161 @@ def readDXF(filename):
         return ''
 
 
+# Magic string starting the binary output of 'dxfparser -b'
+_binary_magic = b'DXFPARSER-BIN1\n\0'
+
+def readDXFArrays(filename):
+    """Read a DXF file and return the recognized entities as arrays.
+
+    This function requires the external program `dxfparser` version 0.3 or
+    higher, which writes the entities in a compact binary format
+    if it is given the option ``-b``. The entities are collected per type
+    in contiguous arrays, avoiding the text conversion and Python
+    evaluation of :func:`readDXF` and :func:`convertDXF`.
+
+    Parameters
+    ----------
+    filename: :term:`path_like`
+        The name of a .DXF file.
+
+    Returns
+    -------
+    dict | None
+        A dict with the following items, or None if the file could not
+        be read:
+
+        - 'lines': float array (nlines,2,3): the end points of the lines,
+        - 'arcs': float array (narcs,6): center (3), radius and start and
+          end angles (in degrees) of the arcs. Circles are included as
+          arcs from 0 to 360 degrees.
+        - 'polyofs': int array (npolylines+1): the start offsets of the
+          polylines into 'vertices', in CSR style,
+        - 'vertices': float array (nvertices,3): the vertices of all
+          polylines,
+        - 'lineid', 'arcid', 'polyid': int arrays with the sequence numbers
+          of the entities in the DXF file.
+    """
+    if not utils.External.has('dxfparser'):
+        utils.warn('warn_dxf_noparser')
+        return None
+    P = utils.system(['pyformex-dxfparser', '-b', str(filename)],
+                     encoding=None)
+    if P.returncode:
+        return None
+    return parseDXFBinary(P.stdout)
+
+
+def parseDXFBinary(data):
+    """Convert the binary output of 'dxfparser -b' to arrays.
+
+    Parameters
+    ----------
+    data: bytes
+        The binary output of ``pyformex-dxfparser -b``.
+
+    Returns
+    -------
+    dict
+        The dict with entity arrays as described in :func:`readDXFArrays`.
+        The arrays are read-only views into `data`.
+    """
+    if data[:16] != _binary_magic:
+        raise ValueError("Invalid dxfparser binary data")
+    nlines, narcs, npoly, nvert = np.frombuffer(data, np.int64, 4, 16)
+    pos = 48
+    def take(dtype, *shape):
+        nonlocal pos
+        a = np.frombuffer(data, dtype, int(np.prod(shape)), pos)
+        pos += a.nbytes
+        return a.reshape(shape)
+    D = {}
+    D['lines'] = take(np.float64, nlines, 2, 3)
+    D['lineid'] = take(np.int64, nlines)
+    D['arcs'] = take(np.float64, narcs, 6)
+    D['arcid'] = take(np.int64, narcs)
+    D['polyofs'] = take(np.int64, npoly+1)
+    D['vertices'] = take(np.float64, nvert, 3)
+    D['polyid'] = take(np.int64, npoly)
+    return D
+
+
+def arraysToEntities(D):
+    """Convert the entity arrays from :func:`readDXFArrays` to objects.
+
+    Returns a list of pyFormex objects in the order of the DXF file,
+    like :func:`convertDXF` does.
+    """
+    n = len(D['lineid']) + len(D['arcid']) + len(D['polyid'])
+    Entities = [None] * n
+    for x, i in zip(D['lines'], D['lineid']):
+        part = curve.PolyLine(x).setProp(i)
+        part.dxftype = 'Line'
+        Entities[i] = part
+    for a, i in zip(D['arcs'], D['arcid']):
+        part = curve.Arc(center=a[:3], radius=a[3], angles=a[4:]).setProp(i)
+        part.dxftype = 'Arc'
+        Entities[i] = part
+    ofs = D['polyofs']
+    for j, i in enumerate(D['polyid']):
+        part = curve.PolyLine(D['vertices'][ofs[j]:ofs[j+1]]).setProp(i)
+        part.dxftype = 'Polyline'
+        Entities[i] = part
+    return Entities
+
+
+def arraysToLines(D, chordal=0.01, arcdiv=None):
+    """Convert the entity arrays from :func:`readDXFArrays` to a Formex.
+
+    This is the array equivalent of :func:`toLines`: Lines, Arcs and
+    PolyLines are converted to plex-2 elements and collected in a single
+    Formex. The prop values are the sequence numbers of the entities in
+    the DXF file. Lines and PolyLines are converted without creating
+    intermediate objects. The chordal and arcdiv parameters are passed to
+    :meth:`Arc.approx` to set the accuracy of the approximation of the
+    Arcs by line segments.
+
+    Examples
+    --------
+    The binary data for a Line, a PolyLine with 3 vertices, an Arc,
+    and PolyLines with 0 and 1 vertices:
+
+    >>> import struct
+    >>> def ints(*v): return struct.pack(f'{len(v)}q', *v)
+    >>> def floats(*v): return struct.pack(f'{len(v)}d', *v)
+    >>> data = (_binary_magic + ints(1, 1, 3, 4)
+    ...     + floats(0., 0., 0., 1., 0., 0.) + ints(0)
+    ...     + floats(0., 0., 0., 1., 0., 90.) + ints(2)
+    ...     + ints(0, 3, 3, 4)
+    ...     + floats(0., 1., 0., 1., 1., 0., 2., 1., 0., 5., 5., 0.)
+    ...     + ints(1, 3, 4))
+    >>> D = parseDXFBinary(data)
+    >>> print(D['lineid'], D['arcid'], D['polyid'], D['polyofs'])
+    [0] [2] [1 3 4] [0 3 3 4]
+    >>> F = arraysToLines(D, arcdiv=4)
+    >>> print(F.nelems(), F.prop)
+    7 [0 1 1 2 2 2 2]
+    >>> print(F.coords[:3].reshape(-1, 6))
+    [[0. 0. 0. 1. 0. 0.]
+     [0. 1. 0. 1. 1. 0.]
+     [1. 1. 0. 2. 1. 0.]]
+    """
+    # polylines: all segments between subsequent vertices of a polyline
+    ofs = D['polyofs']
+    nv = np.diff(ofs)
+    seg = np.arange(len(D['vertices'])-1)
+    start = ofs[1:-1]
+    keep = np.ones(len(seg), dtype=bool)
+    keep[start[(start > 0) & (start < len(D['vertices']))]-1] = False
+    seg = seg[keep]
+    polyprop = np.repeat(D['polyid'], np.maximum(nv-1, 0))
+    F = [Formex(D['lines'], D['lineid']),
+         Formex(D['vertices'][np.stack([seg, seg+1], axis=-1)], polyprop)]
+    for a, i in zip(D['arcs'], D['arcid']):
+        A = curve.Arc(center=a[:3], radius=a[3], angles=a[4:])
+        F.append(A.approx(ndiv=arcdiv, chordal=chordal).toFormex().setProp(i))
+    return Formex.concatenate(F)
+
+
 Entities = []
 Vertices = []
 
@@ -222,7 +383,8 @@ def toLines(coll, chordal=0.01, arcdiv=None):
         if k in ['Line', 'PolyLine']:
             Lines.extend([a.toFormex() for a in v])
         elif k == 'Arc':
-            Lines.extend([a.toFormex(chordal=chordal, ndiv=arcdiv) for a in v])
+            Lines.extend([a.approx(ndiv=arcdiv, chordal=chordal).toFormex()
+                          for a in v])
     return Formex.concatenate(Lines)
 
 
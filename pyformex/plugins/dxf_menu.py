@@ -38,6 +38,7 @@ While they are intende mostly to be imported in other applications, a plugin
 menu is provided for standard tasks.
 """
 
+from pyformex import utils
 from pyformex.gui import menu
 from pyformex.plugins import dxf, geometry_menu
 
@@ -62,11 +63,19 @@ def importDxf(convert=False, keep=False):
     =======     =====     ================================================
 
     If convert == False, this function returns the list imported DXF entities.
+    The default import reads the entities directly as arrays if the
+    installed dxfparser supports it (see :func:`dxf.importDXF`).
     """
     fn = askFilename(filter='dxf')
     if not fn:
         return
 
+    if not (convert or keep) and utils.External.check('dxfparser', '>=0.3'):
+        with busyCursor():
+            parts = dxf.importDXF(fn)
+            print("Imported %s entities" % len(parts))
+        return setDxfParts(parts)
+
     with busyCursor():
         text = dxf.readDXF(fn)
     if text:
@@ -115,6 +124,11 @@ def importDxfText(text=None):
         coll = dxf.collectByType(parts)
         parts = [p for p in parts if not isinstance(p, types.FunctionType)]
         print("Kept %s entities of type Arc, Line, PolyLine" % len(parts))
+    return setDxfParts(parts)
+
+
+def setDxfParts(parts):
+    """Export and draw a list of imported dxf entities."""
     export({'_dxf_import_': parts, '_dxf_sel_': parts})
     wireframe()
     drawDxf(zoom=True)
@@ -54,6 +54,12 @@ class FeResult():
 
     Then execute the created script `job.py` from inside pyFormex. This
     will create an FeResult instance with all the recognized results.
+    For large result files, use the binary mode instead::
+
+      postabq -b job.fil
+
+    This creates a directory `job.fepost` that can be loaded
+    with :func:`readPostabq`.
 
     The structure of the FeResult class very closely follows that
     of the Abaqus results database. There are some attributes
@@ -364,4 +370,81 @@ class FeResult():
     #     PzfFile(filename).save(_type="FeResult", **self.__dict__)
 
 
+def readPostabq(path, steps=None, mmap=True):
+    """Read the binary results written by `postabq -b`.
+
+    Parameters
+    ----------
+    path: :term:`path_like`
+        The directory created by ``postabq -b job.fil``, normally
+        `job.fepost`.
+    steps: list of int, optional
+        If specified, only the results of these steps are loaded.
+        The default loads all steps.
+    mmap: bool
+        If True (default), the results are memory mapped from the
+        results file, so that only the increments that are actually
+        used are read from disk. If False, all results are read into
+        memory.
+
+    Returns
+    -------
+    FeResult
+        The FeResult database with the model and the results,
+        aligned on the last increment. Contrary to the script created
+        by postabq, the database is not exported.
+    """
+    import json
+    path = pf.Path(path)
+    with open(path / 'info.json') as f:
+        info = json.load(f)
+    mmap_mode = 'r' if mmap else None
+
+    def load(fn):
+        return np.load(path / fn, mmap_mode=mmap_mode)
+
+    DB = FeResult()
+    DB.about.update({k: info[k] for k in
+                     ('creator', 'abqver', 'abqdate', 'abqtime', 'heading')
+                     if k in info})
+    DB.labels = info['labels']
+    DB.nelems = info.get('nelems', 0)
+    DB.length = info.get('length', 0.)
+    DB.nodid = load('nodid.npy')
+    DB.nodes = load('nodes.npy')
+    DB.nnodes = DB.nodes.shape[0]
+    if 'dofs' in info:
+        DB.Dofs(info['dofs'])
+    DB.elems = {k: load(v) for k, v in info['elems'].items()}
+    DB.nset = {k: np.unique(load(v)) for k, v in info['nsets'].items()}
+    DB.eset = {k: np.unique(load(v)) for k, v in info['esets'].items()}
+    DB.nid = at.inverseUniqueIndex(DB.nodid)
+    DB.modeldone = True
+    DB.res = {}
+    resfile = path / 'results.bin'
+    if resfile.size > 0:
+        if mmap:
+            res = np.memmap(resfile, dtype=np.float32, mode='r')
+        else:
+            res = np.fromfile(resfile, dtype=np.float32)
+    for inc in info['increments']:
+        if steps is not None and inc['step'] not in steps:
+            continue
+        R = DB.res.setdefault(inc['step'], {}).setdefault(inc['inc'], {})
+        for key, (offset, ncols) in inc['fields'].items():
+            start = offset // 4
+            R[key] = res[start:start+DB.nnodes*ncols].reshape(-1, ncols)
+            if key in ('U', 'S'):
+                DB.datasize[key] = ncols
+    try:
+        DB.step = list(DB.res.keys())[-1]
+        DB.inc = list(DB.res[DB.step].keys())[-1]
+        DB.R = DB.res[DB.step][DB.inc]
+    except Exception:
+        DB.step = None
+        DB.inc = None
+        DB.R = None
+    return DB
+
+
 # End
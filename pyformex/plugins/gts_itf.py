@@ -85,7 +85,9 @@ def gtsset(surf1, surf2, op, filt='', ext='', curve=False, check=False,
     The boolean operations are set operations on the enclosed volumes:
     union('+'), difference('-') or intersection('*').
 
-    This uses the external program ``gtsset`` to do the actual computation.
+    This uses the ``pyformex_gts`` extension module if it is installed
+    (see ``extra/pygts``), and else the external program ``gtsset`` to
+    do the actual computation.
 
     Parameters
     ----------
@@ -133,11 +135,30 @@ def gtsset(surf1, surf2, op, filt='', ext='', curve=False, check=False,
     methods: :meth:`TriSurface.gts_set`, :meth:`TriSurface.boolean and
     :meth:`TriSurface.intersection`.
 
-    """
-    utils.External.require('gts-extra')
+    The intersection curve (curve=True), a filter and the verbose
+    output are only available with the external program. If any of
+    them is requested, ``gtsset`` is used.
 
+    """
     # import here to avoid circular import
     from pyformex.trisurface import TriSurface
+    if not (curve or filt or verbose) and \
+       utils.Module.has('pyformex_gts', quiet=True):
+        import pyformex_gts
+        try:
+            res = pyformex_gts.boolean(surf1.coords, surf1.elems,
+                                       surf2.coords, surf2.elems, op,
+                                       check=check)
+        except ValueError as e:
+            print(e)
+            print("""The boolean procedure didn't return any results.""")
+            return None
+        if op == 'a':
+            return dict(zip(['s1in2', 's1out2', 's2in1', 's2out1'],
+                            [TriSurface(*r) for r in res]))
+        return TriSurface(*res)
+
+    utils.External.require('gts-extra')
     op = {
         '+': 'union',
         '-': 'diff',
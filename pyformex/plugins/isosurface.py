@@ -36,7 +36,7 @@ from pyformex.lib import misc
 from pyformex.multi import multitask, cpu_count, splitar
 
 
-def isosurface(data, level, nproc=-1, tet=0):
+def isosurface(data, level, nproc=-1, tet=0, indexed=False):
     """Create an isosurface through data at given level.
 
     Parameters
@@ -51,19 +51,26 @@ def isosurface(data, level, nproc=-1, tet=0):
         The number of parallel processes to use. On multiprocessor machines
         this may be used to speed up the processing. If <= 0 , the number of
         processes will be set equal to the number of available processors,
-        to achieve a maximal speedup.
+        to achieve a maximal speedup. With the compiled library, the
+        volume is split in slabs processed by as many threads in the
+        same process.
     tet: int
         If zero (default), a marching cubes algiorithm is used. If nonzero,
         a marching tetrahedrons algorithm is used. The latter is slower and
         produces a lot more triangles, but results in a smoother surface.
         The tetraeders algorithm is currently only available in the compiled
         pyFormex library.
+    indexed: bool
+        If True, return an indexed mesh instead of a triangle soup.
 
     Returns
     -------
     array:
         An (ntr,3,3) float array defining the triangles of the isosurface.
         The result may be empty (if level is outside the data range).
+        If indexed is True, a tuple (coords, elems) is returned instead,
+        with the (nvert,3) unique vertices and the (ntr,3) vertex numbers
+        of the triangles.
 
     Notes
     -----
@@ -72,14 +79,21 @@ def isosurface(data, level, nproc=-1, tet=0):
     """
     if nproc is None:
         nproc = -1
+
+    if misc._accelerated:
+        # Perform multithreaded isosurface in the compiled library
+        data = data.astype(np.float32)
+        level = np.float32(level)
+        return misc.isosurface(data, level, tet, max(nproc, 0), indexed)
+
     if nproc < 1:
         nproc = cpu_count()
 
     if nproc == 1:
-        # Perform single process isosurface (accelerated)
+        # Perform single process isosurface
         data = data.astype(np.float32)
         level = np.float32(level)
-        tri = misc.isosurface(data, level, tet)
+        return misc.isosurface(data, level, tet, 1, indexed)
 
     else:
         # Perform parallel isosurface
@@ -94,9 +108,93 @@ def isosurface(data, level, nproc=-1, tet=0):
             t[:, :, 2] += s
         tri = np.concatenate(tri, axis=0)
 
+    if indexed:
+        return misc.indexTriangles(tri)
     return tri
 
 
+def isosurfaceIter(data, level, tet=0, maxtri=1000000, nlayers=1, nproc=1):
+    """Create an isosurface through out-of-core data, in batches.
+
+    This is a streaming version of :func:`isosurface` for data that
+    do not fit in memory. The data are read a few z-planes at a time
+    and the triangles are returned in batches of bounded size.
+    The peak memory use is thus proportional to the size of a single
+    z-plane, not to that of the whole volume.
+
+    Parameters
+    ----------
+    data: :term:`array_like`
+        An (nz,ny,nx) shaped float array of data values, as in
+        :func:`isosurface`. Only the shape and slicing along the first
+        axis are used, so that this can be a :class:`numpy.memmap` or
+        any other array-like object that reads its data on demand.
+    level: float
+        The data value for which the isosurface is to be constructed.
+    tet: int
+        If nonzero, use a marching tetrahedrons algorithm.
+        See :func:`isosurface`.
+    maxtri: int
+        The maximum number of triangles in a batch.
+    nlayers: int
+        The number of cell layers processed together. The default
+        reads just two z-planes at a time. Larger values reduce the
+        overhead per call and allow using multiple threads.
+    nproc: int
+        The number of threads to use for each block of layers, if the
+        compiled library is available. If <= 0, all available
+        threads are used.
+
+    Yields
+    ------
+    array:
+        An (ntr,3,3) float array with ntr <= maxtri, defining a batch of
+        triangles of the isosurface. The concatenation of all batches is
+        equal to the result of :func:`isosurface`.
+
+    Examples
+    --------
+    >>> data = np.fromfunction(lambda z,y,x: (x-3)**2+(y-3)**2+(z-3)**2,
+    ...     (7,7,7), dtype=np.float32)
+    >>> tri = isosurface(data, 4., nproc=1)
+    >>> batches = list(isosurfaceIter(data, 4., maxtri=50))
+    >>> max(len(b) for b in batches) <= 50
+    True
+    >>> np.allclose(np.concatenate(batches), tri)
+    True
+
+    To stream the isosurface of a huge volume to a file::
+
+        data = np.memmap(fn, dtype=np.float32, mode='r', shape=(nz,ny,nx))
+        with open(outfn, 'wb') as fil:
+            for tri in isosurfaceIter(data, level):
+                tri.tofile(fil)
+    """
+    nz = data.shape[0]
+    nlayers = max(nlayers, 1)
+    level = np.float32(level)
+    nthreads = max(nproc, 0) if misc._accelerated else 1
+    batch = []
+    nbatch = 0
+    for iz in range(0, nz-1, nlayers):
+        block = np.ascontiguousarray(data[iz:iz+nlayers+1], dtype=np.float32)
+        tri = misc.isosurface(block, level, tet, nthreads)
+        if len(tri) == 0:
+            continue
+        tri[:, :, 2] += iz
+        batch.append(tri)
+        nbatch += len(tri)
+        if nbatch >= maxtri:
+            tri = np.concatenate(batch, axis=0)
+            n = len(tri) // maxtri * maxtri
+            for i in range(0, n, maxtri):
+                yield tri[i:i+maxtri]
+            batch = [tri[n:]]
+            nbatch = len(tri) - n
+    if nbatch > 0:
+        yield np.concatenate(batch, axis=0)
+
+
 def isoline(data, level, nproc=-1):
     """Create an isocontour through data at given level.
 
@@ -148,4 +246,138 @@ def isoline(data, level, nproc=-1):
     return seg
 
 
+def isolines(data, levels):
+    """Create isocontours through data at multiple levels.
+
+    This is equivalent to calling :func:`isoline` for each of the levels,
+    but the grid is traversed only once.
+
+    Parameters
+    ----------
+    data: :term:`array_like`
+        An (nx,ny) shaped array of data values at points with
+        coordinates equal to their indices. This defines a 2D area
+        [0,nx-1], [0,ny-1].
+    levels: :term:`array_like`
+        A list of data values for which the isocontours are to be
+        constructed.
+
+    Returns
+    -------
+    list of arrays:
+        A list with for each of the levels an (nseg,2,2) float array
+        defining the 2D coordinates of the segments of the isocontour.
+
+    Examples
+    --------
+    >>> data = np.fromfunction(lambda y,x: (x-4)**2+(y-4)**2, (9,9),
+    ...     dtype=np.float32)
+    >>> seg = isolines(data, [9., 4., 100.])
+    >>> [len(s) for s in seg]
+    [20, 12, 0]
+    >>> all(len(s) == len(isoline(data, lev, nproc=1))
+    ...     for s, lev in zip(seg, [9., 4., 100.]))
+    True
+    """
+    data = np.asarray(data, dtype=np.float32)
+    levels = np.asarray(levels, dtype=np.float32).reshape(-1)
+    seg, lev = misc.isolines(data, levels)
+    order = np.argsort(lev, kind='stable')
+    cnt = np.bincount(lev, minlength=len(levels))
+    return np.split(seg[order], cnt.cumsum()[:-1])
+
+
+class MinMaxTree():
+    """A min/max tree for fast repeated isosurface or isoline extraction.
+
+    The tree stores the range of the data values in blocks of bs cells
+    along each axis, and in coarser levels grouping 2 blocks along each
+    axis of the previous level (an octree in 3D, a quadtree in 2D).
+    It is built once for a data set, after which isosurfaces or isolines
+    at any level can be extracted while visiting only the blocks that
+    straddle the level.
+
+    Parameters
+    ----------
+    data: :term:`array_like`
+        An (nz,ny,nx) or (ny,nx) shaped float array of data values,
+        as in :func:`isosurface` or :func:`isoline`.
+    bs: int
+        The number of cells along each axis of the finest blocks.
+
+    Examples
+    --------
+    >>> data = np.fromfunction(lambda y,x: (x-8)**2+(y-8)**2, (17,17),
+    ...     dtype=np.float32)
+    >>> tree = MinMaxTree(data, bs=4)
+    >>> [lev[0].shape for lev in tree.levels]
+    [(4, 4), (2, 2), (1, 1)]
+    >>> tree.active(2.)
+    array([[1, 1],
+           [1, 2],
+           [2, 1],
+           [2, 2]], dtype=int32)
+    >>> seg = tree.isoline(20.)
+    >>> ref = isoline(data, 20., nproc=1)
+    >>> len(seg) == len(ref)
+    True
+    """
+    def __init__(self, data, bs=8):
+        self.data = np.ascontiguousarray(data, dtype=np.float32)
+        self.bs = bs
+        bmin, bmax = misc.minmaxblocks(self.data, bs)
+        self.levels = [(bmin, bmax)]
+        while max(bmin.shape) > 1:
+            bmin = MinMaxTree._coarsen(bmin, np.min)
+            bmax = MinMaxTree._coarsen(bmax, np.max)
+            self.levels.append((bmin, bmax))
+        self._children = np.array(
+            list(np.ndindex(*(2,)*self.data.ndim)), dtype=np.int32)
+
+    @staticmethod
+    def _coarsen(a, func):
+        """Reduce pairs of blocks along each axis"""
+        a = np.pad(a, [(0, n % 2) for n in a.shape], mode='edge')
+        shape = sum(((n//2, 2) for n in a.shape), ())
+        return func(a.reshape(shape), axis=tuple(range(1, 2*a.ndim, 2)))
+
+    def active(self, level):
+        """Find the blocks straddling a level.
+
+        Returns an int array (nblk,ndim) with the sorted indices of the
+        finest blocks containing cells with data values on both sides
+        of level.
+        """
+        level = np.float32(level)
+        ndim = self.data.ndim
+        cand = np.zeros((1, ndim), dtype=np.int32)
+        for i, (bmin, bmax) in enumerate(reversed(self.levels)):
+            if i > 0:
+                cand = (2*cand[:, np.newaxis] + self._children).reshape(-1, ndim)
+                cand = cand[(cand < bmin.shape).all(axis=1)]
+            idx = tuple(cand.T)
+            cand = cand[(bmin[idx] < level) & (bmax[idx] >= level)]
+        return cand[np.lexsort(cand.T[::-1])]
+
+    def isosurface(self, level, tet=0, nproc=-1, indexed=False):
+        """Create an isosurface at the given level.
+
+        Only the active blocks are processed. The parameters and the
+        result are as in :func:`isosurface`, though the order
+        of the triangles differs.
+        """
+        nthreads = max(nproc, 0) if misc._accelerated else 1
+        return misc.isosurface(self.data, np.float32(level), tet, nthreads,
+                               indexed, self.active(level), self.bs)
+
+    def isoline(self, level):
+        """Create an isoline at the given level.
+
+        Only the active blocks are processed. The result is as in
+        :func:`isoline`, though the order of the segments differs.
+        """
+        return misc.isoline(self.data, np.float32(level),
+                            self.active(level), self.bs)
+
+
 # End
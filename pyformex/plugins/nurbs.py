@@ -539,6 +539,175 @@ def genKnotVector(nctrl, degree, blended=True, closed=False):
     return KnotVector(val=val, mul=mul)
 
 
+class BezierExtraction():
+    """The Bezier extraction operator of a B-spline basis.
+
+    The Bezier extraction operator holds for every Bezier segment of a
+    B-spline basis the matrix that maps the control points of the
+    B-spline on that segment to the control points of an equivalent
+    Bezier curve. It only depends on the knot vector and the degree.
+    Once it is computed, decomposing a curve with the same knots in
+    Bezier segments is a (batched) matrix multiplication.
+
+    Use :func:`bezierExtraction` to get the operator: it keeps the
+    recently used operators in a cache, so that repeated decomposition
+    of unchanged or edited curves does not recompute the operator.
+
+    Parameters
+    ----------
+    knots: float array_like (nknots,)
+        The knot vector.
+    degree: int
+        The degree of the B-spline basis.
+
+    Attributes
+    ----------
+    C: float array (nb, degree+1, degree+1)
+        The extraction matrices of the nb Bezier segments.
+    span: int array (nb,)
+        The knot span index of each Bezier segment.
+
+    Examples
+    --------
+    >>> N = NurbsCurve(control=Coords('0121'), degree=2)
+    >>> E = bezierExtraction(N.knots, N.degree)
+    >>> E.nsegments
+    2
+    >>> print(E.C)
+    [[[1.  0.  0. ]
+      [0.  1.  0. ]
+      [0.  0.5 0.5]]
+    <BLANKLINE>
+     [[0.5 0.5 0. ]
+      [0.  1.  0. ]
+      [0.  0.  1. ]]]
+    >>> np.allclose(E.bezierPoints(N.coords4),
+    ...     lib.nurbs.curveDecompose(N.coords4, N.knots))
+    True
+    """
+
+    def __init__(self, knots, degree):
+        self.knots = np.asarray(knots, dtype=np.double).ravel()
+        self.degree = int(degree)
+        self.C, self.span = lib.nurbs.bezierExtraction(self.knots,
+                                                       self.degree)
+        self.index = self.span[:, np.newaxis] - self.degree + np.arange(
+            self.degree+1)
+
+
+    @property
+    def nsegments(self):
+        """The number of Bezier segments"""
+        return self.C.shape[0]
+
+
+    def segments(self, P):
+        """Compute the Bezier control points of all segments.
+
+        Parameters
+        ----------
+        P: float array (..., nctrl, nd)
+            The control points of one or more B-spline curves with the
+            knots and degree of the operator.
+
+        Returns
+        -------
+        float array (..., nsegments, degree+1, nd)
+            The control points of the Bezier segments. The last point of a
+            segment coincides with the first point of the next one.
+        """
+        P = np.asarray(P)
+        return np.einsum('ejk,...ekd->...ejd', self.C, P[..., self.index, :])
+
+
+    def bezierPoints(self, P):
+        """Compute the control points of the Bezier decomposition.
+
+        This is like :meth:`segments`, but removes the duplicate points
+        between subsequent segments. For a single curve, the result is
+        the same as that of :meth:`NurbsCurve.decompose`.
+
+        Parameters
+        ----------
+        P: float array (..., nctrl, nd)
+            The control points of one or more B-spline curves with the
+            knots and degree of the operator.
+
+        Returns
+        -------
+        float array (..., nsegments*degree+1, nd)
+            The control points of the chain of Bezier segments.
+        """
+        B = self.segments(P)
+        pts = B[..., :, :-1, :].reshape(B.shape[:-3] + (-1, B.shape[-1]))
+        return np.concatenate([pts, B[..., -1, -1:, :]], axis=-2)
+
+
+    def patches(self, Ev, P):
+        """Compute the Bezier patches of a tensor product surface.
+
+        Parameters
+        ----------
+        Ev: :class:`BezierExtraction`
+            The extraction operator in the second parametric direction.
+            The operator itself is used for the first direction.
+        P: float array (..., nctrlv, nctrlu, nd)
+            The control points of one or more B-spline surfaces, with the
+            first direction along the second axis.
+
+        Returns
+        -------
+        float array (..., nsegv, nsegu, degreev+1, degreeu+1, nd)
+            The control points of the Bezier patches.
+        """
+        P = np.asarray(P)
+        P = P[..., Ev.index[:, :, np.newaxis, np.newaxis],
+              self.index[np.newaxis, np.newaxis], :]
+        return np.einsum('fjl,ekm,...flemd->...fejkd', Ev.C, self.C, P)
+
+
+_bezier_extraction_cache = {}
+
+def bezierExtraction(knots, degree, cachesize=64):
+    """Return the Bezier extraction operator for a knot vector and degree.
+
+    The operators are kept in a cache keyed on the knot values and the
+    degree, so that subsequent calls with the same knots return the
+    same :class:`BezierExtraction` object.
+
+    Parameters
+    ----------
+    knots: float array_like (nknots,)
+        The knot vector.
+    degree: int
+        The degree of the B-spline basis.
+    cachesize: int
+        The maximum number of operators kept in the cache. If the cache
+        is full, the oldest entry is removed.
+
+    Returns
+    -------
+    :class:`BezierExtraction`
+        The extraction operator for the knots and degree.
+
+    Examples
+    --------
+    >>> E = bezierExtraction([0., 0., 0., 0.5, 1., 1., 1.], 2)
+    >>> E is bezierExtraction([0., 0., 0., 0.5, 1., 1., 1.], 2)
+    True
+    """
+    knots = np.asarray(knots, dtype=np.double).ravel()
+    key = (int(degree), knots.tobytes())
+    E = _bezier_extraction_cache.pop(key, None)
+    if E is None:
+        E = BezierExtraction(knots, degree)
+        while len(_bezier_extraction_cache) >= cachesize:
+            del _bezier_extraction_cache[next(iter(_bezier_extraction_cache))]
+    # (re)insert as most recent
+    _bezier_extraction_cache[key] = E
+    return E
+
+
 @utils.pzf_register
 class NurbsCurve(Geometry4):
     """A NURBS curve.
@@ -831,9 +1000,9 @@ class NurbsCurve(Geometry4):
         >>> N.pointsAt(0.5)
         Coords([[1. , 0.5, 0. ]])
         """
-        ctrl = self.ctrl.astype(np.double)
-        knots = self.knots.astype(np.double)
-        u = np.atleast_1d(u).astype(np.double)
+        ctrl = self.ctrl.astype(np.double, copy=False)
+        knots = self.knots.astype(np.double, copy=False)
+        u = np.atleast_1d(u).astype(np.double, copy=False)
         pts = lib.nurbs.curvePoints(ctrl, knots, u)
         if np.isnan(pts).any():
             print("We got a NaN")
@@ -914,9 +1083,9 @@ class NurbsCurve(Geometry4):
             u = at.checkArray(u, (-1,), 'f', 'i')
 
         # sanitize arguments for library call
-        ctrl = self.ctrl.astype(np.double)
-        knots = self.knots.astype(np.double)
-        u = np.atleast_1d(u).astype(np.double)
+        ctrl = self.ctrl.astype(np.double, copy=False)
+        knots = self.knots.astype(np.double, copy=False)
+        u = np.atleast_1d(u).astype(np.double, copy=False)
         d = int(d)
 
         try:
@@ -1171,6 +1340,19 @@ class NurbsCurve(Geometry4):
     blend = removeAllKnots
 
 
+    def bezierExtraction(self):
+        """Return the Bezier extraction operator of the curve.
+
+        Returns
+        -------
+        :class:`BezierExtraction`
+            The (cached) extraction operator for the knots and degree
+            of the curve. It can be reused for all curves with the same
+            knots and degree, whatever their control points.
+        """
+        return bezierExtraction(self.knots, self.degree)
+
+
     def decompose(self):
         """Decompose a curve in subsequent Bezier curves.
 
@@ -1182,15 +1364,13 @@ class NurbsCurve(Geometry4):
         See also
         --------
         toCurve: convert the NurbsCurve to a BezierSpline or PolyLine
+        bezierExtraction: the operator used for the decomposition
 
         Notes
         -----
         :meth:`decompose` and :meth:`unblend` are aliases.
         """
-        # sanitize arguments for library call
-        ctrl = self.ctrl
-        knots = self.knots.astype(np.double)
-        X = lib.nurbs.curveDecompose(ctrl, knots)
+        X = self.bezierExtraction().bezierPoints(self.ctrl)
         return NurbsCurve(X, degree=self.degree, blended=False)
 
     # For compatibility
@@ -1300,9 +1480,7 @@ class NurbsCurve(Geometry4):
         if self.isRational():
             raise ValueError("Can not convert a rational NURBS to BezierSpline")
 
-        ctrl = self.ctrl
-        knots = self.knots
-        X = lib.nurbs.curveDecompose(ctrl, knots)
+        X = self.bezierExtraction().bezierPoints(self.ctrl)
         X = Coords4(X).toCoords()
         if self.degree > 1 or force_Bezier:
             return curve.BezierSpline(control=X, degree=self.degree,
@@ -1679,10 +1857,10 @@ class NurbsSurface(Geometry4):
         parametric values.
 
         """
-        ctrl = self.ctrl.astype(np.double)
-        U = self.knotv.astype(np.double)
-        V = self.knotu.astype(np.double)
-        u = np.asarray(u).astype(np.double)
+        ctrl = self.ctrl.astype(np.double, copy=False)
+        U = self.knotv.astype(np.double, copy=False)
+        V = self.knotu.astype(np.double, copy=False)
+        u = np.asarray(u).astype(np.double, copy=False)
 
         try:
             pts = lib.nurbs.surfacePoints(ctrl, U, V, u)
@@ -1701,6 +1879,85 @@ class NurbsSurface(Geometry4):
         return pts
 
 
+    def gridPointsAt(self, u, v):
+        """Return the points on the Nurbs surface at a grid of parametric values.
+
+        Parameters:
+
+        - `u`: (nu,) shaped float array: parametric values in direction u.
+        - `v`: (nv,) shaped float array: parametric values in direction v.
+
+        Returns (nv,nu,3) shaped Coords where the item [j,i] is the point at
+        the parametric values (u[i],v[j]). This gives the same points as
+        :meth:`pointsAt` for all combinations of u and v, but is much faster,
+        because the basis functions are only computed once for each value.
+
+        Raises a ValueError if the evaluation produces NaN values.
+
+        Examples
+        --------
+        >>> X = np.indices((4, 3)).transpose(1, 2, 0)
+        >>> Z = 0.1 * X[..., :1] * X[..., 1:]
+        >>> S = NurbsSurface(np.concatenate([X, Z], axis=-1), degree=(2, 2))
+        >>> u, v = [0., 0.3, 0.5, 1.], [0.1, 0.75]
+        >>> P = S.gridPointsAt(u, v)
+        >>> P.shape
+        (2, 4, 3)
+        >>> uv = np.stack(np.meshgrid(u, v), axis=-1).reshape(-1, 2)
+        >>> np.allclose(P.reshape(-1, 3), S.pointsAt(uv))
+        True
+        """
+        ctrl = self.ctrl.astype(np.double, copy=False)
+        U = self.knotv.astype(np.double, copy=False)
+        V = self.knotu.astype(np.double, copy=False)
+        u = np.asarray(u).astype(np.double, copy=False).ravel()
+        v = np.asarray(v).astype(np.double, copy=False).ravel()
+
+        try:
+            pts = lib.nurbs.surfaceGridPoints(ctrl, U, V, u, v)
+        except Exception:
+            raise RuntimeError(
+                "Some error occurred during the evaluation of the Nurbs "
+                "surface.\nPerhaps you are not using the compiled library?")
+        if np.isnan(pts).any():
+            raise ValueError("The evaluation of the Nurbs surface produced "
+                             "NaN values: check the parametric values and "
+                             "the knot vectors")
+
+        pts = pts.swapaxes(0, 1)
+        if pts.shape[-1] == 4:
+            pts = Coords4(pts).toCoords()
+        else:
+            pts = Coords(pts)
+        return pts
+
+
+    def bezierExtraction(self):
+        """Return the Bezier extraction operators of the surface.
+
+        Returns
+        -------
+        tuple of :class:`BezierExtraction`
+            The (cached) extraction operators in the u and v directions.
+        """
+        return (bezierExtraction(self.knotu, self.degree[0]),
+                bezierExtraction(self.knotv, self.degree[1]))
+
+
+    def bezierPatches(self):
+        """Decompose the surface in Bezier patches.
+
+        Returns
+        -------
+        Coords4 (nsegv, nsegu, degreev+1, degreeu+1, 4)
+            The control points of the Bezier patches. The item [j,i] holds
+            the control points of the patch on the i-th Bezier segment in
+            direction u and the j-th in direction v.
+        """
+        Eu, Ev = self.bezierExtraction()
+        return Coords4(Eu.patches(Ev, self.ctrl))
+
+
     def derivs(self, u, m):
         """Return points and derivatives at given parametric values.
 
@@ -1719,10 +1976,10 @@ class NurbsSurface(Geometry4):
 
         """
         # sanitize arguments for library call
-        ctrl = self.ctrl.astype(np.double)
-        U = self.knotv.astype(np.double)
-        V = self.knotu.astype(np.double)
-        u = np.asarray(u).astype(np.double)
+        ctrl = self.ctrl.astype(np.double, copy=False)
+        U = self.knotv.astype(np.double, copy=False)
+        V = self.knotu.astype(np.double, copy=False)
+        u = np.asarray(u).astype(np.double, copy=False)
         mu, mv = m
         mu = int(mu)
         mv = int(mv)
@@ -1760,21 +2017,20 @@ class NurbsSurface(Geometry4):
         umin, umax = self.urange()
         vmin, vmax = self.vrange()
         u = at.uniformParamValues(udiv, umin, umax)
-        v = at.uniformParamValues(udiv, umin, umax)
-        uv = np.ones((udiv+1, vdiv+1, 2))
-        uv[:, :, 0] *= u
-        uv[:, :, 1] *= v.reshape(-1, 1)
-        coords = self.pointsAt(uv.reshape(-1, 2))
+        v = at.uniformParamValues(vdiv, vmin, vmax)
+        coords = self.gridPointsAt(u, v).reshape(-1, 3)
         elems = Quad4.els(udiv, vdiv)
         return Mesh(coords, elems, eltype='quad4')
 
 
     def actor(self, **kargs):
-        """Graphical representation"""
-        from pyformex.opengl.actors import Actor
-        G = self.approx(ndiv=100)
-        G.attrib(**self.attrib)
-        return Actor(G, **kargs)
+        """Graphical representation
+
+        The surface is rendered as Bezier patches tessellated on the GPU
+        if the OpenGL version supports it, and as a quad mesh otherwise.
+        """
+        from pyformex.opengl.actors import PatchActor
+        return PatchActor(self, **kargs)
 
 
     def pzf_dict(self):
@@ -2327,24 +2583,16 @@ def globalInterpolationCurve(Q, degree=3, *, D=None, D0=None, D1=None,
         from pyformex.lib import nurbs_e
         U, A, Q = nurbs_e.curveGlobalInterpolationMatrix2(Q, D, u, p)
         print(f"U {U.shape}, A {A.shape}, Q {Q.shape}")
+        P = np.linalg.solve(A, Q)
     else:
         print(f"Global, Q {Q.shape}, D0 {D0}, D1 {D1}")
         # set the end conditions
-        it0 = D0 is not None
-        it1 = D1 is not None
-        if it0:
-            D0 = at.checkArray(D0, (3,), 'f', 'i')
-        if it1:
-            D1 = at.checkArray(D1, (3,), 'f', 'i')
-        U, A = lib.nurbs.curveGlobalInterpolationMatrix(u, degree, it0, it1)
-        # set right hand side (TODO: move this inside ^^^)
-        if it0:
-            D0 = Coords(D0).reshape(-1,3) * U[p+1] / p * 4
-            Q = Coords.concatenate([Q[0:1], D0, Q[1:]])
-        if it1:
-            D1 = Coords(D1).reshape(-1,3) * (1-U[-(p+2)]) / p * 4
-            Q = Coords.concatenate([Q[:-1], D1, Q[-1:]])
-    P = np.linalg.solve(A, Q)
+        if D0 is not None:
+            D0 = at.checkArray(D0, (3,), 'f', 'i') * 4.
+        if D1 is not None:
+            D1 = at.checkArray(D1, (3,), 'f', 'i') * 4.
+        # solve the (banded) system directly
+        U, P = lib.nurbs.curveGlobalInterpolation(Q, u, degree, D0, D1)
     N = NurbsCurve(P, knots=U, degree=degree)
     if return_param:
         return N, u
@@ -2687,6 +2935,67 @@ def NurbsCircle(C=[0., 0., 0.], r=1.0, X=[1., 0., 0.], Y=[0., 1., 0.],
     return NurbsCurve(control=Pw, degree=2, knots=U)
 
 
+def curvesPointsAt(curves, u, d=0):
+    """Return points and derivatives on multiple Nurbs curves.
+
+    This evaluates a set of Nurbs curves sharing the same knot vector
+    (and thus degree and number of control points) at the same parametric
+    values in a single call. The basis functions are only computed once
+    for each parametric value, making this a lot faster than calling
+    :meth:`NurbsCurve.pointsAt` for each curve.
+
+    Parameters
+    ----------
+    curves: list of :class:`NurbsCurve`
+        The curves to evaluate. They should all have the same knots.
+    u: float :term:`array_like` (nu,)
+        The parametric values at which to compute the points. The
+        evaluation is fastest if the values are sorted.
+    d: int
+        The highest derivative to compute. The default only
+        computes the points.
+
+    Returns
+    -------
+    Coords (ncurves, nu, 3) or (d+1, ncurves, nu, 3)
+        The points on the curves. If d > 0, the points and all derivatives
+        up to d: the slice [0] contains the points.
+
+    Examples
+    --------
+    >>> N1 = NurbsCurve(control=Coords('0121'), degree=3)
+    >>> N2 = NurbsCurve(control=Coords('0121').scale(2.), degree=3)
+    >>> print(curvesPointsAt([N1, N2], [0.0, 0.5, 1.0]))
+    [[[0.  0.  0. ]
+      [1.  0.5 0. ]
+      [2.  1.  0. ]]
+    <BLANKLINE>
+     [[0.  0.  0. ]
+      [2.  1.  0. ]
+      [4.  2.  0. ]]]
+    """
+    knots = curves[0].knots
+    if any(not np.array_equal(C.knots, knots) for C in curves[1:]):
+        raise ValueError("All curves should have the same knots")
+    ctrl = np.stack([C.ctrl for C in curves]).astype(np.double, copy=False)
+    knots = knots.astype(np.double, copy=False)
+    u = np.atleast_1d(u).astype(np.double, copy=False)
+    d = int(d)
+    pts = lib.nurbs.curvesDerivs(ctrl, knots, u, d)
+    if np.isnan(pts).any():
+        raise RuntimeError("Some error occurred during the evaluation "
+                           "of the Nurbs curves")
+
+    if pts.shape[-1] == 4:
+        # see NurbsCurve.derivs for the meaning of the w=0 derivatives
+        pts = Coords4(pts)
+        pts[0].normalize()
+        pts = Coords(pts[..., :3])
+    else:
+        pts = Coords(pts)
+    return pts if d > 0 else pts[0]
+
+
 def toCoords4(x):
     """Convert cartesian coordinates to homogeneous
 
@@ -670,6 +670,29 @@ def importFlavia(fn=None):
         selectDB(db)
 
 
+def importPostabq(fn=None):
+    """Import the binary results of postabq and select them as the current.
+
+    The binary results are created with ``postabq -b BASE.fil`` and are
+    stored in a directory BASE.fepost. The results are memory mapped, so
+    that even huge result files can be loaded quickly.
+    """
+    from pyformex.plugins.fe_post import readPostabq
+    if fn is None:
+        fn = askDirname(pf.cfg['workdir'], change=False)
+    else:
+        fn = Path(fn)
+    if fn:
+        chdir(fn.parent)
+        db = readPostabq(fn)
+        name = fn.stem
+        db.name = name
+        export({name: db})
+        print("Read %d nodes, %d elements" % (db.nnodes, db.nelems))
+        db.printSteps()
+        selection.set([name])
+        selectDB(db)
+
 
 def importDB(fn=None):
     """Import a .post.py database and select it as the current."""
@@ -934,6 +957,7 @@ def create_menu(before='help'):
         ("&Read FeResult Database", importDB),
         ("&Read CalculiX results", importCalculix),
         ("&Read Flavia Database", importFlavia),
+        ("&Read Abaqus Binary Results", importPostabq),
         ("&Select FeResult Data", selectDB),
 #        ("&Forget FeResult Data",P.selection.forget),
         ("---", None),
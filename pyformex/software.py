@@ -591,6 +591,7 @@ Module('moderngl')
 Module('numpy')
 Module('pil', modname='PIL')
 Module('pydicom')
+Module('pyformex_gts')
 Module('pyopengl', modname='OpenGL')
 Module('pyqt5', modname='PyQt5.QtCore',
        attr='PYQT_VERSION_STR',
@@ -489,6 +489,44 @@ def test_nodalSum_Avg():
     avg = nodalAvg(val,elems)
     assert eq(avg,[[0,0],[1,10],[2,20],[3,30],[4,40],[5,50]])
 
+def test_NodalIndex():
+    val = np.array([
+        [[ 0.,  0.],
+         [ 2., 20.],
+         [ 3., 30.],
+         [ 1., 10.]],
+        [[ 2., 20.],
+         [ 4., 40.],
+         [ 5., 50.],
+         [ 3., 30.]]])
+    elems = np.array([
+        [0, 2, 3, 1],
+        [2, 4, 5, 3]])
+    ind = NodalIndex(elems, 7)
+    assert ind.nnod == 7
+    assert (ind.count() == [1, 1, 2, 2, 1, 1, 0]).all()
+    assert eq(ind.sum(val),[[0,0],[1,10],[4,40],[6,60],[4,40],[5,50],[0,0]])
+    assert eq(ind.avg(val)[:6],[[0,0],[1,10],[2,20],[3,30],[4,40],[5,50]])
+    assert np.isnan(ind.avg(val)[6]).all()
+    val[1] *= 2
+    assert eq(ind.max(val)[:6],[[0,0],[1,10],[4,40],[6,60],[8,80],[10,100]])
+    assert eq(ind.min(val)[:6],[[0,0],[1,10],[2,20],[3,30],[8,80],[10,100]])
+    sum,cnt = nodalSum(val,ind)
+    assert eq(sum[:6],[[0,0],[1,10],[6,60],[9,90],[8,80],[10,100]])
+    assert (cnt == ind.count()).all()
+    with pytest.raises(ValueError):
+        ind.reduce(val, 'mean')
+
+@pytest.mark.parametrize('offsets', [[0, 2, 1, 3], [0, 1, 2, 9], [-1, 1, 2, 3]])
+def test_nodalreduce_offsets(offsets):
+    from pyformex.lib import misc
+    val = np.ones((1, 3, 1))
+    index = np.arange(3, dtype=np.int32)
+    with pytest.raises(ValueError):
+        misc.nodalreduce(val, np.array(offsets, dtype=np.int32), index, 0)
+    with pytest.raises(ValueError):
+        misc.nodalreduce(val, np.array([0, 1, 2, 3], dtype=np.int32), index, 4)
+
 def test_pprint():
     pass
 
@@ -0,0 +1,72 @@
+#
+##
+##  SPDX-FileCopyrightText: © 2007-2023 Benedict Verhegghe <bverheg@gmail.com>
+##  SPDX-License-Identifier: GPL-3.0-or-later
+##
+##  This file is part of pyFormex 3.3  (Sun Mar 26 20:16:15 CEST 2023)
+##  pyFormex is a tool for generating, manipulating and transforming 3D
+##  geometrical models by sequences of mathematical operations.
+##  Home page: https://pyformex.org
+##  Project page: https://savannah.nongnu.org/projects/pyformex/
+##  Development: https://gitlab.com/bverheg/pyformex
+##  Distributed under the GNU General Public License version 3 or later.
+##
+##  This program is free software: you can redistribute it and/or modify
+##  it under the terms of the GNU General Public License as published by
+##  the Free Software Foundation, either version 3 of the License, or
+##  (at your option) any later version.
+##
+##  This program is distributed in the hope that it will be useful,
+##  but WITHOUT ANY WARRANTY; without even the implied warranty of
+##  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+##  GNU General Public License for more details.
+##
+##  You should have received a copy of the GNU General Public License
+##  along with this program.  If not, see http://www.gnu.org/licenses/.
+##
+
+
+
+"""Unit tests for the pyformex.lib.clust module
+
+These unit tests are based on the pytest framework. They check that
+the clustering starting from a previous clustering (a warm start)
+gives a valid clustering with the requested number of clusters.
+
+"""
+from . import *
+
+pytest.importorskip('scipy')
+pytest.importorskip('pyformex.lib.clust_c')
+from pyformex import simple
+from pyformex.lib.clust import Clustering
+
+
+def check_clusters(C, clusters, nclus):
+    """Check that every point is in one of nclus nonempty clusters"""
+    assert clusters.shape == (C.S.ncoords(),)
+    assert aeq(np.unique(clusters), np.arange(nclus))
+
+
+@pytest.mark.parametrize('nclus', [(200, 50), (200, 50, 12), (50, 200)])
+def test_warm_start(nclus):
+    S = simple.sphere(12)
+    C = Clustering(S)
+    levels = C.levels(nclus)
+    assert len(levels) == len(nclus)
+    for clusters, n in zip(levels, nclus):
+        check_clusters(C, clusters, n)
+    assert C.nclus == nclus[-1]
+    # the same number of clusters from scratch
+    clusters, ndisc = C.cluster(nclus[-1])
+    check_clusters(C, clusters, nclus[-1])
+
+
+def test_warm_start_current():
+    S = simple.sphere(12)
+    C = Clustering(S)
+    C.cluster(120)
+    clusters, ndisc = C.cluster(30, init=True)
+    check_clusters(C, clusters, 30)
+
+# End
@@ -0,0 +1,67 @@
+#
+##
+##  SPDX-FileCopyrightText: © 2007-2023 Benedict Verhegghe <bverheg@gmail.com>
+##  SPDX-License-Identifier: GPL-3.0-or-later
+##
+##  This file is part of pyFormex 3.3  (Sun Mar 26 20:16:15 CEST 2023)
+##  pyFormex is a tool for generating, manipulating and transforming 3D
+##  geometrical models by sequences of mathematical operations.
+##  Home page: https://pyformex.org
+##  Project page: https://savannah.nongnu.org/projects/pyformex/
+##  Development: https://gitlab.com/bverheg/pyformex
+##  Distributed under the GNU General Public License version 3 or later.
+##
+##  This program is free software: you can redistribute it and/or modify
+##  it under the terms of the GNU General Public License as published by
+##  the Free Software Foundation, either version 3 of the License, or
+##  (at your option) any later version.
+##
+##  This program is distributed in the hope that it will be useful,
+##  but WITHOUT ANY WARRANTY; without even the implied warranty of
+##  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+##  GNU General Public License for more details.
+##
+##  You should have received a copy of the GNU General Public License
+##  along with this program.  If not, see http://www.gnu.org/licenses/.
+##
+
+"""Unit tests for the pyformex.coords module
+
+These unit tests are based on the pytest framework.
+
+"""
+from . import *
+from pyformex.coords import *
+
+
+def fuse_points():
+    """Points with many (almost) coinciding ones, in random order"""
+    rng = np.random.default_rng(7)
+    X = rng.random((200, 3))
+    X = np.concatenate([X, X+1.e-7, X[:50]-1.e-7])
+    return Coords(X[rng.permutation(X.shape[0])])
+
+
+def test_fuse_methods():
+    """The 'box' and 'hash' fuse methods find the same points"""
+    X = fuse_points()
+    xb, eb = X.fuse(method='box')
+    xh, eh = X.fuse(method='hash')
+    assert xb.shape == xh.shape == (200, 3)
+    assert eq(xb[eb], X)
+    assert eq(xh[eh], X)
+    # the same partition of the points: a one to one renumbering
+    assert np.unique(np.stack([eb, eh], axis=-1), axis=0).shape[0] == 200
+    # the same unique points
+    assert eq(xb[eb[np.argsort(eh)]], xh[np.sort(eh)])
+    # hash numbers the points in order of first occurrence
+    first = np.unique(eh, return_index=True)[1]
+    assert aeq(np.argsort(first), np.arange(200))
+
+
+def test_fuse_empty():
+    for method in ('box', 'hash'):
+        x, e = Coords().fuse(method=method)
+        assert x.size == 0 and e.size == 0
+
+# End
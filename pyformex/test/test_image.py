@@ -0,0 +1,97 @@
+#
+##
+##  SPDX-FileCopyrightText: © 2007-2023 Benedict Verhegghe <bverheg@gmail.com>
+##  SPDX-License-Identifier: GPL-3.0-or-later
+##
+##  This file is part of pyFormex 3.3  (Sun Mar 26 20:16:15 CEST 2023)
+##  pyFormex is a tool for generating, manipulating and transforming 3D
+##  geometrical models by sequences of mathematical operations.
+##  Home page: https://pyformex.org
+##  Project page: https://savannah.nongnu.org/projects/pyformex/
+##  Development: https://gitlab.com/bverheg/pyformex
+##  Distributed under the GNU General Public License version 3 or later.
+##
+##  This program is free software: you can redistribute it and/or modify
+##  it under the terms of the GNU General Public License as published by
+##  the Free Software Foundation, either version 3 of the License, or
+##  (at your option) any later version.
+##
+##  This program is distributed in the hope that it will be useful,
+##  but WITHOUT ANY WARRANTY; without even the implied warranty of
+##  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+##  GNU General Public License for more details.
+##
+##  You should have received a copy of the GNU General Public License
+##  along with this program.  If not, see http://www.gnu.org/licenses/.
+##
+
+
+
+"""Unit tests for the pyformex.gui.image module
+
+These unit tests are based on the pytest framework. They check the
+culling of the primitives for the chunked gl2ps export on a fake
+camera, without an OpenGL context.
+
+"""
+from types import SimpleNamespace
+from . import *
+
+image = pytest.importorskip('pyformex.gui.image')
+if not hasattr(image, '_gl2ps_primitives'):
+    pytest.skip("gl2ps is not available", allow_module_level=True)
+from pyformex.opengl.gl import GL
+
+
+def canvas():
+    """A canvas with an identity camera and a 100x100 viewport"""
+    camera = SimpleNamespace(modelview=np.eye(4), projection=np.eye(4),
+                             viewport=[0, 0, 100, 100])
+    return SimpleNamespace(camera=camera)
+
+
+def drawable(x, cullface=None):
+    """A triangle drawable with the vertices x"""
+    x = np.asarray(x, dtype=np.float32).reshape(-1, 3)
+    return SimpleNamespace(glmode=GL.GL_TRIANGLES, vbo=SimpleNamespace(data=x),
+                           indices=None, cullface=cullface)
+
+
+# a front facing and a back facing triangle, at depth 0.5 and -0.5
+tri = [[-0.5, -0.5, 0.5], [0.5, -0.5, 0.5], [0., 0.5, 0.5]]
+tri_back = [[-0.5, -0.5, -0.5], [0., 0.5, -0.5], [0.5, -0.5, -0.5]]
+# a triangle beyond the right side of the view
+tri_off = [[1.5, 0., 0.], [2., 0., 0.], [2., 0.5, 0.]]
+
+
+def test_offscreen():
+    d = drawable(tri + tri_off)
+    prims, depth = image._gl2ps_primitives(canvas(), d, ('offscreen',), 1.)
+    assert aeq(prims, [[0, 1, 2]])
+    assert eq(depth, [0.5])
+    prims, depth = image._gl2ps_primitives(canvas(), d, (), 1.)
+    assert len(prims) == 2
+
+
+def test_back():
+    d = drawable(tri + tri_back)
+    prims, depth = image._gl2ps_primitives(canvas(), d, ('back',), 1.)
+    assert aeq(prims, [[0, 1, 2]])
+    prims, depth = image._gl2ps_primitives(canvas(), drawable(
+        tri + tri_back, cullface='front'), (), 1.)
+    assert aeq(prims, [[3, 4, 5]])
+    assert eq(depth, [-0.5])
+
+
+def test_subpixel():
+    # 10 triangles inside the same pixel (the one at the center), and
+    # a large one
+    small = np.array(tri) * 0.001
+    d = drawable(np.concatenate([small + 0.01 + 0.0001*i for i in range(10)]
+                                + [tri]))
+    prims, depth = image._gl2ps_primitives(canvas(), d, ('subpixel',), 1.)
+    assert aeq(prims, [[0, 1, 2], [30, 31, 32]])
+    prims, depth = image._gl2ps_primitives(canvas(), d, ('subpixel',), 0.0001)
+    assert len(prims) == 11
+
+# End
@@ -0,0 +1,450 @@
+#
+##
+##  SPDX-FileCopyrightText: © 2007-2023 Benedict Verhegghe <bverheg@gmail.com>
+##  SPDX-License-Identifier: GPL-3.0-or-later
+##
+##  This file is part of pyFormex 3.3  (Sun Mar 26 20:16:15 CEST 2023)
+##  pyFormex is a tool for generating, manipulating and transforming 3D
+##  geometrical models by sequences of mathematical operations.
+##  Home page: https://pyformex.org
+##  Project page: https://savannah.nongnu.org/projects/pyformex/
+##  Development: https://gitlab.com/bverheg/pyformex
+##  Distributed under the GNU General Public License version 3 or later.
+##
+##  This program is free software: you can redistribute it and/or modify
+##  it under the terms of the GNU General Public License as published by
+##  the Free Software Foundation, either version 3 of the License, or
+##  (at your option) any later version.
+##
+##  This program is distributed in the hope that it will be useful,
+##  but WITHOUT ANY WARRANTY; without even the implied warranty of
+##  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+##  GNU General Public License for more details.
+##
+##  You should have received a copy of the GNU General Public License
+##  along with this program.  If not, see http://www.gnu.org/licenses/.
+##
+
+
+
+"""Unit tests for the pyformex.lib.misc_c module
+
+These unit tests are based on the pytest framework. They compare
+the functions of the compiled library with those of the Python
+emulation in misc_e.
+
+"""
+from . import *
+from pyformex.lib import misc_e
+from pyformex import simple
+from pyformex.trisurface import TriSurface
+
+misc_c = pytest.importorskip('pyformex.lib.misc_c')
+
+
+def cube():
+    """A closed triangulated unit cube"""
+    return TriSurface(simple.Cube(2).convert('tri3'))
+
+
+def sphere():
+    """A closed triangulated sphere with radius 1"""
+    return simple.sphere(4)
+
+
+def surface_points(S):
+    """Points exactly on the vertices, edges and faces of a surface"""
+    x = S.coords
+    return np.concatenate([x, x[S.edges].mean(axis=1), S.centroids()])
+
+
+def volume(shape=(8, 9, 10)):
+    """The distance field of a point on an (nz,ny,nx) grid"""
+    z, y, x = np.indices(shape, dtype=np.float32)
+    return np.sqrt((x-4.2)**2 + (y-3.9)**2 + (z-3.6)**2).astype(np.float32)
+
+
+def area(shape=(9, 11)):
+    """The distance field of a point on an (ny,nx) grid"""
+    y, x = np.indices(shape, dtype=np.float32)
+    return np.sqrt((x-4.6)**2 + (y-3.7)**2).astype(np.float32)
+
+
+def active_blocks(data, level, bs):
+    """The blocks of data that contain the level"""
+    bmin, bmax = misc_c.minmaxblocks(data, bs)
+    return np.argwhere((bmin <= level) & (bmax >= level)).astype(np.int32)
+
+
+def directions(nvec, seed=7):
+    """Normalized vectors clustered around a few well separated axes"""
+    rng = np.random.default_rng(seed)
+    axes = np.eye(3)[rng.integers(0, 3, nvec)] * rng.choice([-1, 1], (nvec, 1))
+    vec = axes + rng.normal(scale=0.02, size=(nvec, 3))
+    vec /= np.linalg.norm(vec, axis=1, keepdims=True)
+    return vec.astype(np.float32)
+
+
+def element_values(vdtype, edtype, strided=False, nnod=8):
+    """Values on element nodes and the element connectivity
+
+    Some entries in elems are -1 and node nnod-1 is not used.
+    With strided=True, the arrays are noncontiguous views.
+    """
+    rng = np.random.default_rng(11)
+    n = 2*12 if strided else 12
+    val = rng.random((n, 3, 2)).astype(vdtype)
+    elems = rng.integers(0, nnod-1, (n, 3)).astype(edtype)
+    elems[::5, 1] = -1
+    if strided:
+        val, elems = val[::2], elems[::2]
+    return val, elems
+
+
+def sorted_rows(a, decimals=4):
+    """The items of a flattened to rows, in a unique order
+
+    The kernels may return the same items in a different order. The
+    values are rounded to make the order insensitive to rounding errors.
+    """
+    a = np.asarray(a, dtype=np.float64)
+    a = np.round(a.reshape(len(a), -1), decimals)
+    return a[np.lexsort(a.T[::-1])]
+
+
+@pytest.mark.parametrize('dir', [0, 1, 2])
+def test_insideSurface_grid(dir):
+    # a grid of points on the planes of the faces of the cube: most
+    # of the rays go exactly through its vertices and edges
+    S = cube()
+    t = np.array([-0.5, 0., 0.25, 0.5, 1., 1.5])
+    P = np.stack(np.meshgrid(t, t, t, indexing='ij'), -1).reshape(-1, 3)
+    ins = misc_c.insideSurface(S.coords, S.elems, P, dir)
+    assert aeq(ins, misc_e.insideSurface(S.coords, S.elems, P, dir))
+    # the points off the surface are classified exactly
+    inner = ((P > 0.) & (P < 1.)).all(axis=1)
+    outer = ((P < 0.) | (P > 1.)).any(axis=1)
+    assert ins[inner].all()
+    assert not ins[outer].any()
+
+
+@pytest.mark.parametrize('S', [cube(), sphere()])
+@pytest.mark.parametrize('dir', [0, 1, 2])
+def test_insideSurface_onsurface(S, dir):
+    # points on the surface are classified arbitrarily, but the same
+    # way as the emulation does
+    P = surface_points(S)
+    ins = misc_c.insideSurface(S.coords, S.elems, P, dir)
+    assert aeq(ins, misc_e.insideSurface(S.coords, S.elems, P, dir))
+    # shrinking or growing the points moves them in or out
+    for f, res in [(0.5, True), (1.5, False)]:
+        Q = (P - S.center()) * f + S.center()
+        ins = misc_c.insideSurface(S.coords, S.elems, Q, dir)
+        assert aeq(ins, misc_e.insideSurface(S.coords, S.elems, Q, dir))
+        assert (ins == res).all()
+
+
+@pytest.mark.parametrize('S', [cube(), sphere()])
+def test_inside_lib(S):
+    # the rays from these points go exactly through the vertices
+    x0 = [S.center()[0], 0., 0.]
+    P = np.concatenate([surface_points(S), S.coords - [2., 0., 0.],
+                        S.coords * [0., 1., 1.] + x0])
+    ins = misc_e.insideSurface(S.coords, S.elems, P, 0)
+    assert aeq(S.inside(P, method='lib'), np.where(ins)[0])
+    # an inside out surface is a hole
+    assert aeq(S.reverse().inside(P, method='lib'), np.where(~ins)[0])
+
+
+@pytest.mark.parametrize('nthreads', [1, 3, 0])
+def test_isosurface(nthreads):
+    data = volume()
+    tri = misc_c.isosurface(data, 3., 0, nthreads)
+    assert tri.shape[1:] == (3, 3) and len(tri) > 0
+    assert eq(sorted_rows(tri), sorted_rows(misc_e.isosurface(data, 3.)))
+
+
+@pytest.mark.parametrize('nthreads', [1, 3])
+def test_isosurface_indexed(nthreads):
+    data = volume()
+    x, e = misc_c.isosurface(data, 3., 0, nthreads, 1)
+    # the vertices are unique and all used
+    assert len(np.unique(x, axis=0)) == len(x)
+    assert aeq(np.unique(e), np.arange(len(x)))
+    assert eq(sorted_rows(x[e]),
+              sorted_rows(misc_c.isosurface(data, 3., 0, nthreads)))
+    xe, ee = misc_e.isosurface(data, 3., indexed=1)
+    assert eq(sorted_rows(x[e]), sorted_rows(xe[ee]))
+
+
+def test_isosurface_tet():
+    # no emulation: the slabs give the same triangles as a single thread
+    data = volume()
+    tri = misc_c.isosurface(data, 3., 1, 1)
+    assert tri.shape[1:] == (3, 3) and len(tri) > 0
+    assert eq(sorted_rows(misc_c.isosurface(data, 3., 1, 3)), sorted_rows(tri))
+
+
+@pytest.mark.parametrize('indexed', [0, 1])
+def test_isosurface_empty(indexed):
+    res = misc_c.isosurface(volume(), 100., 0, 3, indexed)
+    if indexed:
+        assert res[0].shape == (0, 3) and res[1].shape == (0, 3)
+    else:
+        assert res.shape == (0, 3, 3)
+
+
+def test_isosurface_slice():
+    # a contiguous slab of a larger volume is read in place
+    data = volume()
+    for block in data[2:6], data[:, 1:7]:
+        assert eq(sorted_rows(misc_c.isosurface(block, 3., 0, 1)),
+                  sorted_rows(misc_e.isosurface(block, 3.)))
+
+
+@pytest.mark.parametrize('nlayers,nproc', [(1, 1), (3, 1), (3, 3)])
+def test_isosurface_iter(tmp_path, nlayers, nproc):
+    from pyformex.plugins.isosurface import isosurfaceIter
+    data = volume()
+    fn = tmp_path / 'volume.raw'
+    data.tofile(fn)
+    data = np.memmap(fn, dtype=np.float32, mode='r', shape=data.shape)
+    batches = list(isosurfaceIter(data, 3., maxtri=40, nlayers=nlayers,
+                                  nproc=nproc))
+    assert max(len(b) for b in batches) <= 40
+    assert eq(sorted_rows(np.concatenate(batches)),
+              sorted_rows(misc_c.isosurface(volume(), 3., 0, 1)))
+
+
+@pytest.mark.parametrize('shape', [(9, 11), (2, 5), (8, 9, 10), (3, 2, 7)])
+@pytest.mark.parametrize('bs', [1, 3, 8])
+def test_minmaxblocks(shape, bs):
+    data = np.random.default_rng(5).random(shape, dtype=np.float32)
+    bmin, bmax = misc_c.minmaxblocks(data, bs)
+    emin, emax = misc_e.minmaxblocks(data, bs)
+    assert bmin.shape == tuple((n-2)//bs + 1 for n in shape)
+    assert aeq(bmin, emin) and aeq(bmax, emax)
+
+
+@pytest.mark.parametrize('data,bs', [
+    (np.zeros((4, 4), dtype=np.float32), 0),
+    (np.zeros(4, dtype=np.float32), 2),
+    (np.zeros((2, 2, 2, 2), dtype=np.float32), 2),
+    ])
+def test_minmaxblocks_invalid(data, bs):
+    for lib in misc_c, misc_e:
+        with pytest.raises(ValueError):
+            lib.minmaxblocks(data, bs)
+
+
+@pytest.mark.parametrize('bs', [1, 3, 8])
+def test_isosurface_blocks(bs):
+    data = volume()
+    blocks = active_blocks(data, 3., bs)
+    tri = misc_c.isosurface(data, 3., 0, 1, 0, blocks, bs)
+    assert eq(sorted_rows(tri),
+              sorted_rows(misc_c.isosurface(data, 3., 0, 1)))
+    assert eq(sorted_rows(tri), sorted_rows(
+        misc_e.isosurface(data, 3., blocks=blocks, bs=bs)))
+
+
+@pytest.mark.parametrize('bs', [1, 3, 8])
+def test_isoline_blocks(bs):
+    data = area()
+    blocks = active_blocks(data, 2.5, bs)
+    seg = misc_c.isoline(data, 2.5, blocks, bs)
+    assert eq(sorted_rows(seg), sorted_rows(misc_c.isoline(data, 2.5)))
+    assert eq(sorted_rows(seg),
+              sorted_rows(misc_e.isoline(data, 2.5, blocks, bs)))
+
+
+def test_isoline():
+    data = area()
+    seg = misc_c.isoline(data, 2.5)
+    assert seg.shape[1:] == (2, 2) and len(seg) > 0
+    assert eq(sorted_rows(seg), sorted_rows(misc_e.isoline(data, 2.5)))
+
+
+def test_isolines():
+    data = area()
+    levels = np.array([3.2, 1.5, 100., 2.5, 1.5], dtype=np.float32)
+    seg, lev = misc_c.isolines(data, levels)
+    eseg, elev = misc_e.isolines(data, levels)
+    # same ordering, by cell and by increasing level
+    assert seg.shape == eseg.shape and eq(seg, eseg)
+    assert lev.dtype == np.int32 and aeq(lev, elev)
+    assert not np.any(lev == 2)
+    for i, level in enumerate(levels):
+        assert eq(sorted_rows(seg[lev == i]),
+                  sorted_rows(misc_c.isoline(data, level)))
+
+
+@pytest.mark.parametrize('nvec', [10, 100])
+def test_average_direction(nvec):
+    vec = directions(nvec)
+    ref = vec.copy()
+    misc_c.averageDirection(vec, 0.99)
+    misc_e.averageDirection(ref, 0.99)
+    assert eq(vec, ref)
+    # the vectors of a cluster now coincide
+    assert len(np.unique(vec, axis=0)) <= 6
+
+
+@pytest.mark.parametrize('nvec', [10, 100])
+def test_average_direction_indexed(nvec):
+    vec = directions(nvec)
+    ref = vec.copy()
+    ind = np.arange(1, nvec, 2, dtype=np.int32)
+    misc_c.averageDirectionIndexed(vec, ind, 0.99)
+    misc_e.averageDirectionIndexed(ref, ind, 0.99)
+    assert eq(vec, ref)
+    assert aeq(vec[::2], directions(nvec)[::2])
+
+
+@pytest.mark.parametrize('nvec', [10, 100])
+def test_average_direction_groups(nvec):
+    vec = directions(nvec)
+    offsets = np.array([0, 3, 3, nvec//2, nvec], dtype=np.int32)
+    ref = vec.copy()
+    misc_c.averageDirectionGroups(vec, offsets, None, 0.99)
+    misc_e.averageDirectionGroups(ref, offsets, None, 0.99)
+    assert eq(vec, ref)
+    # groups from a nodal index, as used for the node normals
+    elems = np.random.default_rng(3).integers(0, 5, (nvec//2, 2))
+    offsets, index = misc_c.nodalindex(elems.astype(np.int32), 5)
+    vec = directions(nvec)
+    ref = vec.copy()
+    misc_c.averageDirectionGroups(vec, offsets, index, 0.99)
+    misc_e.averageDirectionGroups(ref, offsets, index, 0.99)
+    assert eq(vec, ref)
+
+
+nodal_types = [
+    (np.float32, np.int32, False),
+    (np.float64, np.int32, False),
+    (np.float32, np.int64, False),
+    (np.float64, np.int64, True),
+    ]
+
+
+@pytest.mark.parametrize('vdtype,edtype,strided', nodal_types)
+def test_nodalsum(vdtype, edtype, strided):
+    val, elems = element_values(vdtype, edtype, strided)
+    sum, cnt = misc_c.nodalsum(val, elems, 8)
+    esum, ecnt = misc_e.nodalsum(val, elems, 8)
+    assert sum.dtype == esum.dtype == vdtype
+    assert sum.shape == (8, 2) and eq(sum, esum)
+    assert aeq(cnt, ecnt) and cnt[7] == 0
+
+
+@pytest.mark.parametrize('vdtype,edtype,strided', nodal_types)
+def test_nodalreduce(vdtype, edtype, strided):
+    val, elems = element_values(vdtype, edtype, strided)
+    offsets, index = misc_c.nodalindex(elems, 8)
+    eoffsets, eindex = misc_e.nodalindex(elems, 8)
+    assert aeq(offsets, eoffsets) and aeq(index, eindex)
+    assert len(index) == (elems >= 0).sum()
+    for op in range(4):
+        res = misc_c.nodalreduce(val, offsets, index, op)
+        ref = misc_e.nodalreduce(val, offsets, index, op)
+        assert res.dtype == ref.dtype == vdtype
+        assert res.shape == (8, 2) and eq(res, ref)
+    # the empty node is nan, except in the sum
+    assert np.isnan(res[7]).all()
+    with pytest.raises(ValueError):
+        misc_c.nodalreduce(val, offsets, index, 4)
+
+
+@pytest.mark.parametrize('dtype', [np.float32, np.float64])
+def test_coordsfuse(dtype):
+    x = np.random.default_rng(2).random((20, 3)).astype(dtype)
+    val = np.round(x[:, 0]*4).astype(np.int64)
+    x = np.concatenate([x, x[::3] + 1.e-6, x[:4]])
+    val = np.concatenate([val, val[::3], val[:4]])
+    srt = np.argsort(val, kind='stable')
+    x, val = x[srt], val[srt]
+    res = []
+    for lib in misc_c, misc_e:
+        flag = np.ones((len(x),), dtype=np.int32)
+        sel = np.arange(len(x)).astype(np.int32)
+        lib.coordsfuse(x, val, flag, sel, 1.e-4)
+        res.append((flag, sel))
+    assert aeq(res[0][0], res[1][0]) and aeq(res[0][1], res[1][1])
+    assert res[0][0].sum() == 20
+
+
+def points(dtype, strided=False):
+    x = np.random.default_rng(4).normal(size=(40, 3)).astype(dtype)
+    return x[::2] if strided else x
+
+
+mat = np.array([[0., 1., 0.], [-2., 0., 0.], [0., 0.5, 1.]])
+trl = np.array([1., -3., 0.25])
+
+
+@pytest.mark.parametrize('dtype', [np.float32, np.float64])
+@pytest.mark.parametrize('strided', [False, True])
+def test_transform(dtype, strided):
+    x = points(dtype, strided)
+    y = misc_c.transform(x, mat, trl)
+    assert y.dtype == dtype and y.shape == x.shape
+    assert eq(y, misc_e.transform(x, mat, trl))
+    assert eq(y, np.dot(x, mat) + trl)
+
+
+@pytest.mark.parametrize('dtype', [np.float32, np.float64])
+def test_transform_inplace(dtype):
+    x = points(dtype)
+    ref = misc_e.transform(x, mat, trl)
+    y = misc_c.transform(x, mat, trl, x)
+    assert y is x and eq(x, ref)
+
+
+@pytest.mark.parametrize('dtype', [np.float32, np.float64])
+@pytest.mark.parametrize('strided', [False, True])
+def test_bbox_distance(dtype, strided):
+    x = points(dtype, strided)
+    bb = misc_c.bbox(x)
+    assert bb.dtype == dtype and aeq(bb, misc_e.bbox(x))
+    p, n = [0.5, 0., -1.], [1., 2., 2.]
+    for f in 'distanceFromPlane', 'distanceFromLine':
+        d = getattr(misc_c, f)(x, p, n)
+        assert d.shape == (len(x),)
+        assert eq(d, getattr(misc_e, f)(x, p, n))
+
+
+@pytest.mark.parametrize('func,args', [
+    ('transform', (mat, trl)),
+    ('bbox', ()),
+    ('distanceFromPlane', ([0., 0., 0.], [0., 0., 1.])),
+    ('distanceFromLine', ([0., 0., 0.], [0., 0., 1.])),
+    ])
+def test_points_shape(func, args):
+    x = np.zeros((5, 2), dtype=np.float32)
+    for lib in misc_c, misc_e:
+        with pytest.raises(ValueError, match='shape'):
+            getattr(lib, func)(x, *args)
+
+
+@pytest.mark.parametrize('dtype', [np.float32, np.float64])
+def test_hashfuse(dtype):
+    rng = np.random.default_rng(9)
+    x = rng.random((30, 3))
+    x = np.concatenate([x, x[::2] + 1.e-6, x[5:10]])
+    x = x[rng.permutation(len(x))].astype(dtype)
+    sel, flag, coords = misc_c.hashfuse(x, 1.e-4, 1)
+    esel, eflag, ecoords = misc_e.hashfuse(x, 1.e-4, 1)
+    assert aeq(sel, esel) and aeq(flag, eflag)
+    assert flag.sum() == 30 and coords.shape == (30, 3)
+    assert eq(coords, ecoords) and eq(coords[sel], x)
+    # numbered by first occurrence
+    assert aeq(sel[flag > 0], np.arange(30))
+
+
+def test_hashfuse_shape():
+    x = np.zeros((5, 2), dtype=np.float32)
+    for lib in misc_c, misc_e:
+        with pytest.raises(ValueError, match='shape'):
+            lib.hashfuse(x, 1.e-4)
+
+# End
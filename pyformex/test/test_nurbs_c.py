@@ -0,0 +1,168 @@
+#
+##
+##  SPDX-FileCopyrightText: © 2007-2023 Benedict Verhegghe <bverheg@gmail.com>
+##  SPDX-License-Identifier: GPL-3.0-or-later
+##
+##  This file is part of pyFormex 3.3  (Sun Mar 26 20:16:15 CEST 2023)
+##  pyFormex is a tool for generating, manipulating and transforming 3D
+##  geometrical models by sequences of mathematical operations.
+##  Home page: https://pyformex.org
+##  Project page: https://savannah.nongnu.org/projects/pyformex/
+##  Development: https://gitlab.com/bverheg/pyformex
+##  Distributed under the GNU General Public License version 3 or later.
+##
+##  This program is free software: you can redistribute it and/or modify
+##  it under the terms of the GNU General Public License as published by
+##  the Free Software Foundation, either version 3 of the License, or
+##  (at your option) any later version.
+##
+##  This program is distributed in the hope that it will be useful,
+##  but WITHOUT ANY WARRANTY; without even the implied warranty of
+##  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+##  GNU General Public License for more details.
+##
+##  You should have received a copy of the GNU General Public License
+##  along with this program.  If not, see http://www.gnu.org/licenses/.
+##
+
+
+"""Unit tests for the pyformex.lib.nurbs_c module
+
+These unit tests are based on the pytest framework. They compare
+the specialized kernels of the compiled library with the generic
+algorithms of the Python emulation in nurbs_e.
+
+"""
+from . import *
+from pyformex.lib import nurbs_e
+
+nurbs_c = pytest.importorskip('pyformex.lib.nurbs_c')
+
+# Degrees 1..5 use constant degree kernels, up to 15 (BASIS_MAXDEG)
+# the work arrays are on the stack, above that in the scratch arena.
+DEGREES = list(range(1, 18))
+
+# Numbers of parametric values: around the block size (64) of
+# curve_points, and above the parallel threshold (1024)
+LENGTHS = [1, 2, 63, 64, 65, 130, 1500]
+
+
+def knots(nc, p, rng):
+    """A clamped knot vector with random interior knots"""
+    inner = np.sort(rng.random(nc-p-1))
+    return np.concatenate([np.zeros(p+1), inner, np.ones(p+1)])
+
+
+def params(n, rng):
+    """n parametric values in random order, including both ends"""
+    u = rng.random(n)
+    u[:2] = [0., 1.][:n]
+    return rng.permutation(u)
+
+
+def curve_points_e(P, U, u):
+    """Points on a B-spline curve with the generic Python algorithms"""
+    nc = P.shape[0]
+    p = len(U) - nc - 1
+    pts = []
+    for ui in u:
+        s = nurbs_e.find_span(U, ui, p, nc-1)
+        N = nurbs_e.basis_funs(U, ui, p, s)
+        pts.append(N @ P[s-p:s+1])
+    return np.array(pts)
+
+
+@pytest.mark.parametrize('p', DEGREES)
+def test_allBernstein(p):
+    for u in (0., 0.3, 1.):
+        assert np.allclose(nurbs_c.allBernstein(p, u),
+                           nurbs_e.allBernstein(p, u))
+
+
+@pytest.mark.parametrize('p', DEGREES)
+def test_basisDerivs(p):
+    rng = np.random.default_rng(p)
+    nc = p + 4
+    U = knots(nc, p, rng)
+    for u in params(5, rng):
+        s = nurbs_e.find_span(U, u, p, nc-1)
+        n = min(p, 3)
+        assert np.allclose(nurbs_c.basisDerivs(U, u, p, s, n),
+                           nurbs_e.basis_derivs(U, u, p, s, n))
+
+
+@pytest.mark.parametrize('p', DEGREES)
+@pytest.mark.parametrize('n', LENGTHS)
+def test_curvePoints(p, n):
+    rng = np.random.default_rng(100*p+n)
+    nc = p + 4
+    P = rng.random((nc, 4))
+    U = knots(nc, p, rng)
+    u = params(n, rng)
+    ref = curve_points_e(P, U, u)
+    assert np.allclose(nurbs_c.curvePoints(P, U, u), ref)
+    # sorted values take the forward span search path
+    srt = np.argsort(u)
+    assert np.allclose(nurbs_c.curvePoints(P, U, u[srt]), ref[srt])
+
+
+@pytest.mark.parametrize('p,q', [(1, 2), (3, 5), (4, 7), (6, 16)])
+@pytest.mark.parametrize('n', [1, 65, 130])
+def test_surfaceGridPoints(p, q, n):
+    rng = np.random.default_rng(100*p+q+n)
+    ns, nt = p + 3, q + 2
+    P = rng.random((ns, nt, 4))
+    U = knots(ns, p, rng)
+    V = knots(nt, q, rng)
+    u, v = params(n, rng), params(7, rng)
+    grid = nurbs_c.surfaceGridPoints(P, U, V, u, v)
+    uv = np.stack(np.meshgrid(u, v, indexing='ij'), axis=-1).reshape(-1, 2)
+    pts = nurbs_c.surfacePoints(P, U, V, uv)
+    assert np.allclose(grid.reshape(-1, 4), pts)
+
+
+def interp_params(nc, rng):
+    """nc increasing parametric values from 0 to 1"""
+    return np.concatenate([[0.], np.sort(rng.random(nc-2)), [1.]])
+
+
+def dense_interpolation(U, A, Q, p, D0, D1):
+    """Solve the full interpolation system A * P = B"""
+    B = [Q[:1]]
+    if D0 is not None:
+        B.append(D0.reshape(1, -1) * U[p+1] / p)
+    B.append(Q[1:-1])
+    if D1 is not None:
+        B.append(D1.reshape(1, -1) * (1.0-U[-(p+2)]) / p)
+    B.append(Q[-1:])
+    return np.linalg.solve(A, np.concatenate(B))
+
+
+@pytest.mark.parametrize('p', [1, 2, 3, 4, 5])
+@pytest.mark.parametrize('nc', [8, 200])
+@pytest.mark.parametrize('ends', [(False, False), (True, False),
+                                  (False, True), (True, True)])
+def test_curveGlobalInterpolation(p, nc, ends):
+    """The banded solve gives the control points of the dense solve"""
+    rng = np.random.default_rng(1000*p+nc)
+    Q = rng.random((nc, 3))
+    u = interp_params(nc, rng)
+    D0, D1 = [rng.random(3) if e else None for e in ends]
+    U, P = nurbs_c.curveGlobalInterpolation(Q, u, p, D0, D1)
+    # dense system from the compiled library
+    Uc, A = nurbs_c.curveGlobalInterpolationMatrix(u, p, *map(int, ends))
+    assert np.allclose(U, Uc)
+    assert np.allclose(P, dense_interpolation(Uc, A, Q, p, D0, D1))
+    # dense system from the emulation
+    Ue, Pe = nurbs_e.curveGlobalInterpolation(Q, u, p, D0, D1)
+    assert np.allclose(U, Ue)
+    assert np.allclose(P, Pe)
+    # the curve passes through the points
+    assert np.allclose(nurbs_c.curvePoints(P, U, u), Q)
+
+
+def test_curveGlobalInterpolation_shape():
+    with pytest.raises(ValueError):
+        nurbs_c.curveGlobalInterpolation(np.zeros(10), np.linspace(0, 1, 10), 3)
+
+# End
@@ -2676,12 +2676,14 @@ Quality: {qual.min():.4f} .. {qual.max():.4f}
     def coarsen(self, min_edges=None, max_cost=None,
                 mid_vertex=False, length_cost=False, max_fold=1.0,
                 volume_weight=0.5, boundary_weight=0.5, shape_weight=0.0,
-                progressive=False, log=False, verbose=False):
-        """Coarsen a surface using gtscoarsen.
+                progressive=False, log=False, verbose=False,
+                angle_cost=False):
+        """Coarsen a surface using GTS.
 
         Construct a coarsened version of the surface.
-        This uses the external program `gtscoarsen`. The surface
-        should be a closed orientable non-intersecting manifold.
+        This uses the ``pyformex_gts`` extension module if it is installed
+        (see ``extra/pygts``), and else the external program `gtscoarsen`.
+        The surface should be a closed orientable non-intersecting manifold.
         Use the :meth:`check` method to find out.
 
         Parameters
@@ -2712,9 +2714,28 @@ Quality: {qual.min():.4f} .. {qual.max():.4f}
             If Trye, log the evolution of the cost.
         verbose: bool
             If True, print statistics about the surface.
+        angle_cost: bool
+            Use the angle between the two triangles at the edge as cost
+            function instead of the default optimized point cost.
+
+        Notes
+        -----
+        The options progressive, log and verbose are only available with
+        the external program. If any of them is set, `gtscoarsen` is used.
         """
         if min_edges is None and max_cost is None:
             min_edges = self.nedges() // 2
+        if not (progressive or log or verbose) and \
+           utils.Module.has('pyformex_gts', quiet=True):
+            import pyformex_gts
+            cost = ('angle' if angle_cost else
+                    'length' if length_cost else 'optimized')
+            x, elems = pyformex_gts.coarsen(
+                self.coords, self.elems, min_edges=min_edges or 0,
+                max_cost=max_cost, cost=cost, mid_vertex=mid_vertex,
+                max_fold=max_fold, volume_weight=volume_weight,
+                boundary_weight=boundary_weight, shape_weight=shape_weight)
+            return TriSurface(x, elems)
         cmd = 'gtscoarsen'
         if min_edges:
             cmd += f" -n {min_edges}"
@@ -2724,6 +2745,8 @@ Quality: {qual.min():.4f} .. {qual.max():.4f}
             cmd += " -m"
         if length_cost:
             cmd += " -l"
+        if angle_cost:
+            cmd += " -a"
         if max_fold:
             cmd += f" -f {max_fold}"
         cmd += f" -w {volume_weight}"
@@ -2755,8 +2778,9 @@ Quality: {qual.min():.4f} .. {qual.max():.4f}
         Refining a TriSurface means increasing the number of triangles and
         reducing their size, while keeping the changes to the modeled surface
         minimal.
-        This uses the external program `gtsrefine`. The surface
-        should be a closed orientable non-intersecting manifold.
+        This uses the ``pyformex_gts`` extension module if it is installed
+        (see ``extra/pygts``), and else the external program `gtsrefine`.
+        The surface should be a closed orientable non-intersecting manifold.
         Use the :meth:`check` method to find out.
 
         Parameters
@@ -2778,6 +2802,12 @@ Quality: {qual.min():.4f} .. {qual.max():.4f}
         """
         if max_edges is None and min_cost is None:
             max_edges = self.nedges() * 2
+        if not verbose and utils.Module.has('pyformex_gts', quiet=True):
+            import pyformex_gts
+            x, elems = pyformex_gts.refine(
+                self.coords, self.elems, max_edges=max_edges or 0,
+                min_cost=min_cost)
+            return TriSurface(x, elems)
         cmd = "gtsrefine"
         if max_edges:
             cmd += f" -n {max_edges}"
@@ -2806,8 +2836,9 @@ Quality: {qual.min():.4f} .. {qual.max():.4f}
         """Smooth the surface using gtssmooth.
 
         Smooth a surface by applying iterations of a Laplacian filter.
-        This uses the external program `gtssmooth`. The surface
-        should be a closed orientable non-intersecting manifold.
+        This uses the ``pyformex_gts`` extension module if it is installed
+        (see ``extra/pygts``), and else the external program `gtssmooth`.
+        The surface should be a closed orientable non-intersecting manifold.
         Use the :meth:`check` method to find out.
 
         Parameters
@@ -2820,6 +2851,11 @@ Quality: {qual.min():.4f} .. {qual.max():.4f}
             If True, print statistics about the surface.
 
         """
+        if not verbose and utils.Module.has('pyformex_gts', quiet=True):
+            import pyformex_gts
+            x, elems = pyformex_gts.smooth(
+                self.coords, self.elems, niter=niter, lamb=lamb)
+            return TriSurface(x, elems)
         cmd = "gtssmooth"
         # if fold_smoothing:
         #     cmd += f" -f {fold_smoothing}"
@@ -2901,8 +2937,9 @@ Quality: {qual.min():.4f} .. {qual.max():.4f}
 
         Note
         ----
-        This method uses the external command 'gtsset' and will not run if
-        it is not installed (available from pyformex/extras).
+        This method uses the ``pyformex_gts`` extension module if it is
+        installed, and else the external command 'gtsset'. It will not run
+        if neither is installed (available from pyformex/extras).
         """
         from pyformex.plugins.gts_itf import gtsset
         base = gtsset(self, surf, op='a', filt='', ext='.gts',
@@ -2979,8 +3016,9 @@ Quality: {qual.min():.4f} .. {qual.max():.4f}
 
         Note
         ----
-        This method uses the external command 'gtsset' and will not run if
-        it is not installed (available from pyformex/extras).
+        This method uses the ``pyformex_gts`` extension module if it is
+        installed, and else the external command 'gtsset'. It will not run
+        if neither is installed (available from pyformex/extras).
         """
         from pyformex.plugins.gts_itf import gtsset
         return gtsset(self, surf, op, filt='', ext='.gts',
@@ -3017,7 +3055,7 @@ Quality: {qual.min():.4f} .. {qual.max():.4f}
                       check=check, verbose=verbose)
 
 
-    def inside(self, pts, method='gts', tol='auto', multi=True, keep=False):
+    def inside(self, pts, method='auto', tol='auto', multi=True, keep=False):
         """Test which of the points pts are inside the surface.
 
         Parameters
@@ -3028,8 +3066,13 @@ Quality: {qual.min():.4f} .. {qual.max():.4f}
             Method to be used for the detection. Depending on
             the software you have installed the following are possible:
 
-            - 'gts': provided by pyformex-extra (default)
+            - 'lib': provided by the pyFormex compiled library. This
+              tests all points in memory, using multiple threads. The
+              tolerance is not used.
+            - 'gts': provided by pyformex-extra
             - 'vtk': provided by python-vtk (slower)
+            - 'auto': 'lib' if the compiled library is available,
+              else 'gts' (default)
 
         tol: float
             Tolerance on equality of floating point values.
@@ -3050,7 +3093,18 @@ Quality: {qual.min():.4f} .. {qual.max():.4f}
 
         """
         pts = Coords(pts).points()
-        if method == 'gts':
+        from pyformex.lib import misc
+        if method == 'auto':
+            method = 'lib' if misc._accelerated else 'gts'
+        if method == 'lib':
+            # rays through edges and vertices are handled exactly,
+            # so (unlike with gts) a single shooting direction suffices
+            ins = misc.insideSurface(self.coords, self.elems, pts, 0)
+            if self.volume() < 0.:
+                # like gts, consider an inside out surface as a hole
+                ins = ~ins
+            return np.where(ins)[0]
+        elif method == 'gts':
             from pyformex.plugins import gts_itf
             return gts_itf.inside(self, pts, tol, multi=multi, keep=keep)
         elif method == 'vtk':
@@ -70,6 +70,44 @@ class install_lib(_install_lib):
         print(f"INSTALL_DIR = {self.install_dir}")
 
 
+def openmp_flags(compiler):
+    """Return the compile and link flags to use OpenMP with compiler
+
+    Returns empty lists if the compiler can not build an OpenMP program:
+    the libraries are then built without threads.
+    """
+    import tempfile
+    if compiler.compiler_type == 'msvc':
+        return ['/openmp'], []
+    flags = ['-fopenmp']
+    with tempfile.TemporaryDirectory() as tmpdir:
+        src = os.path.join(tmpdir, 'test_openmp.c')
+        with open(src, 'w') as f:
+            f.write("#include <omp.h>\n"
+                    "int main(void) { return omp_get_max_threads() < 1; }\n")
+        try:
+            obj = compiler.compile([src], output_dir=tmpdir,
+                                   extra_postargs=flags)
+            compiler.link_executable(obj, os.path.join(tmpdir, 'test_openmp'),
+                                     extra_postargs=flags)
+        except Exception:
+            print("The compiler does not support OpenMP: "
+                  "building the libraries without threads")
+            return [], []
+    return flags, flags
+
+
+import setuptools.command.build_ext
+_build_ext = setuptools.command.build_ext.build_ext
+class build_ext(_build_ext):
+    def build_extensions(self):
+        cflags, lflags = openmp_flags(self.compiler)
+        for ext in self.extensions:
+            ext.extra_compile_args.extend(cflags)
+            ext.extra_link_args.extend(lflags)
+        _build_ext.build_extensions(self)
+
+
 # define the things to include
 import manifest
 
@@ -86,8 +124,11 @@ def run_setup(options):
     # The acceleration libraries
     LIB_MODULES = ['misc_c', 'nurbs_c', 'clust_c']
 
+    # The libraries use OpenMP to run some loops in parallel,
+    # if the compiler supports it (see build_ext)
     ext_modules = [Extension(f"pyformex.lib.{m}",
                              [f"pyformex/lib/{m}.c"],
+                             depends=["pyformex/lib/pflib.h"],
                              include_dirs=[np.get_include()],
                              )
                    for m in LIB_MODULES
@@ -123,7 +164,7 @@ def run_setup(options):
         ]
 
     setup(
-        cmdclass={'install_lib': install_lib},
+        cmdclass={'install_lib': install_lib, 'build_ext': build_ext},
         #use_scm_version=True,
         #setup_requires=['setuptools_scm'],
         name='pyformex',